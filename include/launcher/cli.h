@@ -54,6 +54,16 @@ public:
         return _curlConnectTimeout;
     }
 
+    /* 0 if the default of the GithubExecutor should be used. */
+    inline unsigned long CurlMaxTransfers() const {
+        return _curlMaxTransfers;
+    }
+
+    /* Empty if the default of curl::HttpCache should be used. */
+    inline std::optional<unsigned long> const& HttpCacheTTL() const {
+        return _httpCacheTTL;
+    }
+
     inline bool SteamLaunch() const {
         return _steamLaunch;
     }
@@ -159,6 +169,8 @@ private:
         static constexpr const char* curlLimit = "curl-limit";
         static constexpr const char* curlTimeout = "curl-timeout";
         static constexpr const char* curlConnectTimeout = "curl-connect-timeout";
+        static constexpr const char* curlMaxTransfers = "curl-max-transfers";
+        static constexpr const char* httpCacheTTL = "http-cache-ttl";
         static constexpr const char* configurationPath = "configuration-file";
         static constexpr const char* trapIsaacLaunch = "trap-isaac-launch";
         static constexpr const char* isaacWaitTime = "isaac-wait-time";
@@ -200,6 +212,8 @@ private:
     unsigned long _curlLimit = 0;
     unsigned long _curlTimeout = 0;
     unsigned long _curlConnectTimeout = 0;
+    unsigned long _curlMaxTransfers = 0;
+    std::optional<unsigned long> _httpCacheTTL;
     std::optional<std::string> _configurationPath;
 
     bool _steamLaunch = false;
@@ -1,6 +1,9 @@
 #pragma once
 
 #include <filesystem>
+#include <set>
+#include <string>
+#include <vector>
 
 namespace diff_patcher {
     enum PatchFolderResult {
@@ -16,15 +19,60 @@ namespace diff_patcher {
         OP_PATCH
     };
 
+    /* Values of PatchError::code for errors that do not come from the
+     * system.
+     */
+    enum PatchErrorCode {
+        /* bspatch failed. */
+        PATCH_ERROR_APPLY = -1,
+        /* The file to patch does not have the hash the patch expects. */
+        PATCH_ERROR_PRE_HASH = -2,
+        /* The output does not have the hash the manifest expects. */
+        PATCH_ERROR_POST_HASH = -3
+    };
+
     struct PatchError {
         std::string name;
         PatchOperation op;
         int code;
     };
 
+    /**
+     * Journal of the entries of the manifest that have been processed,
+     * stored in the folder being patched while PatchFolder runs. It is
+     * removed once the whole manifest has been applied successfully.
+     */
+    static constexpr const char* PATCH_JOURNAL = "patchme.journal";
+    static constexpr const char* PATCH_JOURNAL_HEADER = "REPENTOGON-PATCH-JOURNAL 1";
+
+    /**
+     * Apply the manifest.json found in rootPatchesFolder to rootFolderToPatch.
+     *
+     * Entries of the "patch" array are either a file name, or an object
+     * { "file": name, "pre": hash, "post": hash } giving the SHA-256 of the
+     * file before and after patching. Entries of the "create" object are
+     * either the path of the file to copy, or an object
+     * { "source": path, "post": hash }. Hashes are optional.
+     *
+     * Patches are applied by up to workers threads in parallel (one per core
+     * if 0), each writing into a .patched temporary. The blocks of RGPATCH1
+     * patches are decompressed in parallel within the same thread budget. The temporaries replace
+     * the original files only if every patch applied cleanly.
+     *
+     * If a previous run was interrupted, entries recorded in its journal are
+     * skipped, as are files that already have their expected post hash.
+     */
     PatchFolderResult PatchFolder(const std::filesystem::path& rootFolderToPatch,
         const std::filesystem::path& rootPatchesFolder,
-        std::vector<PatchError>* errors);
+        std::vector<PatchError>* errors, unsigned int workers = 0);
+
+    /**
+     * Files of rootFolderToPatch that an interrupted PatchFolder already
+     * created, patched or deleted, according to its journal. Empty if there
+     * is no interrupted patch. None of them must be copied again: PatchFolder
+     * skips journaled entries, so a deleted file put back would stay.
+     */
+    std::set<std::filesystem::path> GetFinishedEntries(const std::filesystem::path& rootFolderToPatch);
 
     /**
      * Poison the first byte of the main function of the given Isaac executable.
@@ -39,18 +87,18 @@ namespace diff_patcher {
     bool PatchIsaacMain(const char* filename);
 
     /**
-     * Signature of main() inside the Isaac executable.
+     * Signature of main() inside the Isaac executable, see Signature::Parse.
      *
-     * Unlike a ZHL signature, this one has no wildcards as the executable is
-     * completely static. The syntax used is the binary one as we do not
-     * use ZHL's packed representation of signatures.
+     * Like a ZHL signature, the absolute addresses pushed by the prologue
+     * (exception handler and scope table) are wildcards, so that the
+     * signature survives a rebuild of the executable.
      *
      * We use a signature instead of an offset as there is no guarantee that
      * steamless and other file modifying tools may not alter the offset when
      * they are used on the executable.
      */
-    static constexpr const char ISAAC_MAIN_SIGNATURE[] = "\x55\x8b\xec\x6a\xfe\x68\x18\xf5\xb5\x00\x68\xac"
-        "\x74\xa8\x00\x64\xa1\x00\x00\x00\x00\x50\x81\xec\x3c\x05\x00\x00";
+    static constexpr const char ISAAC_MAIN_SIGNATURE[] = "55 8B EC 6A FE 68 ?? ?? ?? ?? 68 ?? ?? ?? ?? "
+        "64 A1 00 00 00 00 50 81 EC 3C 05 00 00";
 
     static const char ISAAC_POISON_BYTE = '\xcc';
 }
\ No newline at end of file
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <string>
+
+#include "shared/filesystem.h"
+
+/* What is known about an Isaac executable, recorded across launches so that
+ * an unchanged executable is neither parsed nor hashed again.
+ */
+struct ExecutableFingerprint {
+	/* Identity of the executable when the fingerprint was computed. */
+	Filesystem::FileIdentity identity;
+	/* Version string found in the executable. */
+	std::string version;
+	/* SHA-256 of the executable, empty if it was never needed. */
+	std::string hash;
+};
+
+namespace FingerprintCache {
+	/* Location of the on-disk cache. */
+	static constexpr const char* CACHE_FILE = "launcher-data/fingerprints.txt";
+
+	/* Format of the cache. Increase it whenever the way the version or the
+	 * hash are computed changes, so that every entry is discarded.
+	 */
+	static constexpr unsigned int CACHE_FORMAT = 1;
+
+	/* Executables modified less than this many seconds ago are not
+	 * remembered. See Filesystem::IsOlderThan.
+	 */
+	static constexpr unsigned int CACHE_MIN_AGE = 2;
+
+	/* Read the identity of the executable at path into fingerprint, then
+	 * look it up in the cache.
+	 *
+	 * The entry is used only if the canonical path, volume, file index, size
+	 * and last write time of the executable all match. On a hit, the version
+	 * and hash of fingerprint are filled and true is returned. Hits and
+	 * misses are logged, along with the reason of the miss.
+	 */
+	bool Lookup(const char* path, ExecutableFingerprint& fingerprint);
+
+	/* Remember fingerprint, unless the executable at path no longer has the
+	 * identity stored in the fingerprint (i.e. it changed while the version
+	 * or the hash were computed) or is too recent.
+	 */
+	void Store(const char* path, ExecutableFingerprint const& fingerprint);
+}
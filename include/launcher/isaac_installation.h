@@ -4,6 +4,7 @@
 #include <string>
 #include <variant>
 
+#include "launcher/installation_fingerprint.h"
 #include "shared/loggable_gui.h"
 
 struct Version {
@@ -45,6 +46,8 @@ private:
     bool _isValid = false;
     bool _needsPatch = false;
 	IsaacPatchAvailability _patchAvailability = ISAAC_PATCH_NOT_CHECKED;
+	/* Cached identity, version and hash of the executable. */
+	ExecutableFingerprint _fingerprint;
 
     mutable ILoggableGUI* _gui = nullptr;
 
@@ -5,7 +5,7 @@
 #include <vector>
 
 #include "shared/loggable_gui.h"
-#include "shared/scoped_module.h"
+#include "shared/pe32.h"
 
 static constexpr const char* defaultRepentogonFolder = "repentogon";
 
@@ -141,20 +141,21 @@ public:
 private:
 	void Invalidate();
 
-	/* Load a library that has an entry in the _dllStates array.
-     *
-	 * Returns the result of loading the library. If the load is successful,
-	 * the entry in _dllStates is updated to true.
+	/* Open a library that has an entry in the _dllStates array, as a file.
+	 * The library is never loaded: the versions are read from the file.
+	 *
+	 * Returns NULL if the file is not a valid PE32 image. The entry in
+	 * _dllStates is updated with the result.
 	 */
-	HMODULE LoadLib(const char* name, LoadableDlls dll);
+	std::unique_ptr<PE32> OpenLibrary(const char* shortName, const char* path, LoadableDlls dll);
 
-	/* DLL management related function: loading core ZHL DLLs, retrieving
-	 * symbols and validating that symbols to string are well formed.
+	/* DLL management related function: finding the version symbols in the
+	 * export table of the core ZHL DLLs and validating that they point to
+	 * well formed strings.
 	 */
-	ScopedModule LoadModule(const char* shortName, const char* path, LoadableDlls dll);
-	FARPROC RetrieveSymbol(HMODULE module, const char* libname, const char* symbol);
-	bool ValidateVersionSymbol(HMODULE module, const char* libname, const char* symbolName,
-		FARPROC versionSymbol, std::string& target);
+	PE32Byte RetrieveSymbol(PE32 const& library, const char* libname, const char* symbol);
+	bool ValidateVersionSymbol(PE32 const& library, const char* libname, const char* symbolName,
+		PE32Byte versionSymbol, std::string& target);
 
 	void ClearInstallation();
 
@@ -178,8 +179,8 @@ private:
 	 * they were found or not.
 	 */
 	std::vector<FoundFile> _repentogonFiles;
-	/* For all DLLs that need to be loaded to retrieve data, indicate whether
-	 * the load was successful or not.
+	/* For all DLLs that need to be opened to retrieve data, indicate whether
+	 * they could be parsed or not.
 	 */
 	LoadDLLState _dllStates[LOADABLE_DLL_MAX] = { LOAD_DLL_STATE_NONE };
 
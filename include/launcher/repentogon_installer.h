@@ -1,7 +1,9 @@
 #pragma once
 
 #include <atomic>
+#include <filesystem>
 #include <future>
+#include <memory>
 #include <optional>
 #include <sstream>
 #include <string>
@@ -10,6 +12,7 @@
 #include <variant>
 
 #include "launcher/installation.h"
+#include "launcher/zip_stream.h"
 #include "shared/loggable_gui.h"
 #include "shared/monitor.h"
 #include "shared/scoped_file.h"
@@ -59,10 +62,24 @@ namespace Launcher {
 		REPENTOGON_INSTALLATION_RESULT_NO_ISAAC_PATCH,
 		/* Update failed: doesnt meet required launcher version. */
 		REPENTOGON_INSTALLATION_RESULT_LAUNCHER_UPDATE_REQUIRED,
+		/* Update failed: the installation does not validate once complete,
+		 * the previous Repentogon files were restored.
+		 */
+		REPENTOGON_INSTALLATION_RESULT_INVALID,
 		/* Empty state. */
 		REPENTOGON_INSTALLATION_RESULT_NONE
 	};
 
+	/* Outcome of the extraction of a file of the Repentogon archive. */
+	enum RepentogonExtractedFileState {
+		/* The file was written. */
+		REPENTOGON_EXTRACTED_FILE_CHANGED,
+		/* The file on disk already matched the archive and was kept. */
+		REPENTOGON_EXTRACTED_FILE_UNCHANGED,
+		/* The file could not be extracted. */
+		REPENTOGON_EXTRACTED_FILE_FAILED
+	};
+
 	/* Structure holding the state of the current Repentogon update.
 	 * This is used for logging and debugging purposes.
 	 */
@@ -83,8 +100,8 @@ namespace Launcher {
 		std::string hash; /* Expected hash of the zip file. */
 		std::string zipHash; /* Hash of the zip file. */
 		/* All files that have been found in the archive and whether they
-		 * were properly unpacked. */
-		std::vector<std::tuple<std::string, bool>> unzipedFiles;
+		 * were unpacked, left as is, or could not be unpacked. */
+		std::vector<std::tuple<std::string, RepentogonExtractedFileState>> unzipedFiles;
 
 		void Clear();
 	};
@@ -198,14 +215,21 @@ namespace Launcher {
 		bool CheckRepentogonAssets(rapidjson::Document const& release);
 
 		/* Download the latest release of Repentogon: hash and archive.
+		 *
+		 * While the archive is received, it is hashed and its content is
+		 * extracted into stagingDir. Nothing from stagingDir is used unless
+		 * the hash of the archive matches the release.
 		 *
 		 * Return true if the download completes without issue, false otherwise.
 		 */
-		bool DownloadRepentogon();
+		bool DownloadRepentogon(std::filesystem::path const& stagingDir);
 
 		/* Check that the hash of the downloaded archive matches the hash of
 		 * the release.
 		 *
+		 * The hash computed during the download is used if there is one,
+		 * otherwise the archive is read again from the disk.
+		 *
 		 * Return true if the hash matches, false otherwise.
 		 */
 		bool CheckRepentogonIntegrity();
@@ -215,12 +239,23 @@ namespace Launcher {
 
 		/* Extract the content of the Repentogon archive.
 		 *
-		 * The content of the archive are extracted in outputDir.
+		 * The content of the archive are extracted next to outputDir, then
+		 * swapped in all at once: if anything fails, outputDir is left as it
+		 * was. If the archive was extracted during the download, the files
+		 * already staged are used.
 		 *
 		 * Return true if the extraction is successful, false otherwise.
 		 */
 		bool ExtractRepentogon(const char* outputDir);
 
+		/* Swap the files extracted during the download into outputDir,
+		 * except those outputDir already holds. See Staging::Commit.
+		 */
+		bool CommitStreamedRepentogon(const char* outputDir);
+
+		/* Drop the files extracted during the download, if any. */
+		void DiscardStreamedRepentogon();
+
 		/* Update the installation of Repentogon.
 		 *
 		 * The update is performed by downloading the latest release from
@@ -290,6 +325,10 @@ namespace Launcher {
 						PushNotification(false, "[RepentogonUpdater] Successfully downloaded content from %s", std::get<std::string>(message->data).c_str());
 						break;
 
+					case curl::DOWNLOAD_RETRY:
+						PushNotification(false, "[RepentogonUpdater] Retrying cURL request to %s", std::get<std::string>(message->data).c_str());
+						break;
+
 					default:
 						PushNotification(true, "[RepentogonUpdater] Unexpected asynchronous notification (id = %d)", message->type);
 						break;
@@ -315,6 +354,13 @@ namespace Launcher {
 		Threading::Monitor<RepentogonInstallationNotification> _monitor;
 
 		RepentogonInstallationState _installationState;
+
+		/* Extraction of the archive performed during its download. Reset if
+		 * the archive could not be streamed.
+		 */
+		std::shared_ptr<ZipStreamExtractor> _streamExtractor;
+		/* Hash of the archive computed during its download, empty if none. */
+		std::string _streamedZipHash;
 	};
 
 }
\ No newline at end of file
@@ -1,12 +1,23 @@
 #include <iostream>
 #include <string>
 #include <filesystem>
+#include <set>
 #include <vector>
 #include "shared/logger.h"
 
 namespace standalone_rgon {
+    /* Copy the files of the Isaac installation in basePath that Repentogon
+     * needs into destination.
+     *
+     * When resuming an interrupted installation, keep lists the files of
+     * destination that the patch already created, patched or deleted, and
+     * that must not be copied again.
+     * In that case, files that are already identical (same size and write
+     * time) are not copied again either.
+     */
     bool CopyFiles(const std::string& basePath,
-        const std::string& destination);
+        const std::string& destination,
+        const std::set<std::filesystem::path>* keep = nullptr);
     bool Patch(const std::filesystem::path& repentogonFolder,
         const std::filesystem::path& patchPath);
     bool CreateSteamAppIDFile(const std::string& repentogonFolder);
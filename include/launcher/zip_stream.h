@@ -0,0 +1,160 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <filesystem>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <zlib.h>
+
+namespace Launcher {
+	/* Extract a zip archive while it is being received, without waiting for
+	 * its central directory.
+	 *
+	 * The archive is consumed sequentially, through its local file headers.
+	 * Stored and deflated entries are supported, with or without data
+	 * descriptors (except for stored entries with a data descriptor, whose
+	 * end cannot be found without the central directory). Each file is
+	 * written into the staging folder and checked against its CRC-32.
+	 *
+	 * Data is handed over by Feed, which only queues it: decompression runs
+	 * on a thread of its own so that the producer (typically a cURL write
+	 * callback) is never slowed down.
+	 *
+	 * If the archive uses a feature that cannot be streamed, or if anything
+	 * goes wrong, the extractor gives up and ignores the rest of the data.
+	 * This includes the decompression falling too far behind the producer,
+	 * and archives that expand to more than any release of REPENTOGON.
+	 * The archive then has to be extracted the usual way.
+	 */
+	class ZipStreamExtractor {
+	public:
+		struct Entry {
+			std::string name;
+			uint64_t size = 0;
+			uint32_t crc = 0;
+			bool directory = false;
+		};
+
+		/* Stage the content of the archive in folder. Anything already in
+		 * folder is removed.
+		 */
+		explicit ZipStreamExtractor(std::filesystem::path folder);
+		~ZipStreamExtractor();
+
+		ZipStreamExtractor(ZipStreamExtractor const&) = delete;
+		ZipStreamExtractor& operator=(ZipStreamExtractor const&) = delete;
+
+		/* Queue the next size bytes of the archive. Thread safe. Does nothing
+		 * once the extractor has given up or reached the central directory.
+		 */
+		void Feed(const void* data, size_t size);
+
+		/* Signal the end of the archive and wait until everything queued is
+		 * processed.
+		 *
+		 * Return true if the whole archive, up to its central directory, was
+		 * extracted and every file matched its CRC-32.
+		 */
+		bool Finish();
+
+		/* Remove from the staging folder the files that liveFolder already
+		 * holds with the same size and CRC-32, so that committing the
+		 * staging folder into liveFolder does not swap them. Only meaningful
+		 * once Finish has returned true.
+		 *
+		 * Return, for each entry of GetEntries, whether it was removed.
+		 */
+		std::vector<bool> RemoveUnchanged(std::filesystem::path const& liveFolder);
+
+		/* Remove the staging folder and everything in it. */
+		void Discard();
+
+		std::filesystem::path const& GetFolder() const {
+			return _folder;
+		}
+
+		/* Entries extracted so far, in archive order. Only stable once
+		 * Finish has returned.
+		 */
+		std::vector<Entry> const& GetEntries() const {
+			return _entries;
+		}
+
+	private:
+		enum State {
+			/* Waiting for a local file header, or the central directory. */
+			STATE_HEADER,
+			/* Copying or inflating the data of the current entry. */
+			STATE_DATA,
+			/* Waiting for the data descriptor of the current entry. */
+			STATE_DESCRIPTOR,
+			/* Central directory reached, the rest is ignored. */
+			STATE_DONE,
+			/* Gave up. */
+			STATE_ERROR
+		};
+
+		void Run();
+		void Process();
+
+		/* Each returns false if more data is needed. */
+		bool ParseHeader();
+		bool ParseData();
+		bool ParseDescriptor();
+		/* The data of the current entry has been consumed. */
+		bool EndData();
+
+		bool OpenEntry();
+		bool CloseEntry(uint32_t crc, uint64_t size);
+		bool Write(const unsigned char* data, size_t size);
+		void Fail(const char* reason);
+
+		std::filesystem::path _folder;
+
+		std::mutex _mutex;
+		std::condition_variable _cv;
+		std::deque<std::vector<unsigned char>> _queue;
+		/* Bytes in _queue. */
+		size_t _queued = 0;
+		/* Feed dropped the queue because it grew too large. */
+		bool _overflow = false;
+		bool _finished = false;
+		std::thread _thread;
+
+		/* Set once the rest of the archive is of no use, so that Feed can
+		 * drop it without taking the lock.
+		 */
+		std::atomic<bool> _ignoring = false;
+
+		/* Data received but not parsed yet. Only touched by _thread. */
+		std::vector<unsigned char> _pending;
+		size_t _offset = 0;
+
+		State _state = STATE_HEADER;
+		std::vector<Entry> _entries;
+
+		/* Current entry. */
+		std::ofstream _output;
+		uint16_t _flags = 0;
+		uint16_t _method = 0;
+		uint32_t _expectedCrc = 0;
+		uint64_t _compressedSize = 0;
+		uint64_t _expectedSize = 0;
+		bool _zip64 = false;
+		uint64_t _remaining = 0;
+		uint32_t _crc = 0;
+		uint64_t _written = 0;
+		/* Bytes written into the staging folder, across all entries. */
+		uint64_t _staged = 0;
+		z_stream _zstream;
+		bool _inflating = false;
+		std::vector<unsigned char> _inflateBuffer;
+	};
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace patchgen {
+	enum PatchFormat {
+		/* BSDIFF40, three bzip2 streams. Understood by every launcher. */
+		PATCH_FORMAT_BSDIFF,
+		/* RGPATCH1, zlib compressed blocks applied in parallel. See
+		 * src/diff_patcher.cpp for a description of the format.
+		 */
+		PATCH_FORMAT_RGPATCH
+	};
+
+	/* Maximum number of bytes of the new file covered by a block of an
+	 * RGPATCH1 patch.
+	 */
+	static constexpr size_t RGPATCH_BLOCK_SIZE = 1 << 20;
+
+	/* One bsdiff control entry: add diff bytes of the old file to the diff
+	 * block, copy extra bytes from the extra block, then move forward by seek
+	 * bytes in the old file.
+	 */
+	struct Control {
+		int64_t diff;
+		int64_t extra;
+		int64_t seek;
+	};
+
+	/* Uncompressed output of the bsdiff algorithm. */
+	struct Diff {
+		std::vector<Control> controls;
+		std::vector<unsigned char> diff;
+		std::vector<unsigned char> extra;
+	};
+
+	/* Run the bsdiff algorithm (Colin Percival, "Naive differences of
+	 * executable code") between oldData and newData, using a suffix array
+	 * of oldData built by SA-IS.
+	 */
+	Diff ComputeDiff(const unsigned char* oldData, size_t oldSize,
+		const unsigned char* newData, size_t newSize);
+
+	/* Serialize diff as a patch in the given format. newSize is the size of
+	 * the file the patch produces.
+	 */
+	std::vector<unsigned char> WritePatch(Diff const& diff, size_t newSize, PatchFormat format);
+}
@@ -0,0 +1,15 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace patchgen {
+	/* Build the suffix array of data using SA-IS (Nong, Zhang and Chan,
+	 * "Two Efficient Algorithms for Linear Time Suffix Array Construction").
+	 *
+	 * The result has size + 1 entries: the empty suffix comes first, as in
+	 * the suffix array bsdiff expects. size must be lower than INT32_MAX.
+	 */
+	std::vector<int32_t> BuildSuffixArray(const unsigned char* data, size_t size);
+}
@@ -0,0 +1,29 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace ByteSearch {
+	static constexpr size_t NOT_FOUND = SIZE_MAX;
+
+	/* Search for needle, of needleSize bytes, in the size bytes of haystack.
+	 * Both may contain any byte, including NUL.
+	 *
+	 * Candidates are found by comparing the first and last bytes of the
+	 * needle against 32 (AVX2) or 16 (SSE2) positions of the haystack at
+	 * once. Only the positions where both match are compared in full.
+	 *
+	 * Return the offset of the first occurrence, NOT_FOUND if there is none.
+	 * An empty needle is found at offset 0.
+	 */
+	size_t Find(const void* haystack, size_t size, const void* needle, size_t needleSize);
+
+	/* Same as Find, but return the offsets of every occurrence, overlapping
+	 * ones included, in increasing order.
+	 */
+	std::vector<size_t> FindAll(const void* haystack, size_t size, const void* needle, size_t needleSize);
+
+	/* Name of the implementation used, for logging purposes. */
+	const char* GetBackendName();
+}
@@ -0,0 +1,23 @@
+#pragma once
+
+namespace CPU {
+	/* Instruction set extensions the launcher knows how to take advantage of.
+	 *
+	 * Features that require support from the operating system (AVX2) are
+	 * only reported if the OS saves the corresponding registers.
+	 */
+	struct Features {
+		bool sse2 = false;
+		bool ssse3 = false;
+		bool sse41 = false;
+		bool sse42 = false;
+		bool pclmul = false;
+		bool avx2 = false;
+		bool sha = false;
+	};
+
+	/* Return the features of the CPU the launcher is running on. Detection
+	 * is performed once, the first time the function is called.
+	 */
+	Features const& GetFeatures();
+}
@@ -0,0 +1,19 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace Crc32 {
+	/* Update crc with size bytes of data, using the CRC-32 polynomial of
+	 * zip and zlib. Start from 0 for a new computation: the result can then
+	 * be compared with the CRC libzip reports for an entry.
+	 *
+	 * Uses carry-less multiplication (PCLMULQDQ) when the CPU has it. The
+	 * SSE4.2 crc32 instruction cannot be used here, as it implements the
+	 * Castagnoli polynomial.
+	 */
+	uint32_t Update(uint32_t crc, const void* data, size_t size);
+
+	/* Name of the implementation used by Update, for logging purposes. */
+	const char* GetBackendName();
+}
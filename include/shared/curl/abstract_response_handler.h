@@ -1,5 +1,6 @@
 #pragma once
 
+#include <cstdint>
 #include <functional>
 #include <vector>
 
@@ -15,9 +16,19 @@ public:
 
 	void RegisterHook(OnDataHandlerFn fn);
 
+	/* Accept at most limit bytes of data, neither the hooks nor the handler
+	 * see anything past it. curl then stops the transfer with
+	 * CURLE_WRITE_ERROR. 0 means no limit.
+	 */
+	void SetLimit(uint64_t limit);
+	inline uint64_t GetReceived() const { return _received; }
+	inline bool IsLimitReached() const { return _limit && _received >= _limit; }
+
 private:
 	size_t OnData(void* data, size_t size, size_t n);
 	bool _firstReceived = false;
+	uint64_t _received = 0;
+	uint64_t _limit = 0;
 
 	std::vector<OnDataHandlerFn> _hooks;
 };
\ No newline at end of file
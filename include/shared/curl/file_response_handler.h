@@ -1,5 +1,6 @@
 #pragma once
 
+#include <cstdint>
 #include <string>
 
 #include "shared/curl/abstract_response_handler.h"
@@ -7,14 +8,23 @@
 class CurlFileResponse : public AbstractCurlResponseHandler {
 public:
 	CurlFileResponse(std::string const& name);
+	/* If append is true, the current content of the file is kept and data
+	 * is written after it.
+	 */
+	CurlFileResponse(std::string const& name, bool append);
 	~CurlFileResponse();
 
 	size_t OnFirstData(void* data, size_t len, size_t n);
 	size_t OnNewData(void* data, size_t len, size_t n);
 	FILE* GetFile() const;
+	/* Discard everything in the file, including what was there before. */
+	bool Truncate();
+	/* Write the next data at offset, instead of after what was written. */
+	bool Seek(uint64_t offset);
 
 private:
 	size_t Append(void* data, size_t len, size_t n);
 
+	std::string _name;
 	FILE* _f = NULL;
 };
\ No newline at end of file
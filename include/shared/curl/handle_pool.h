@@ -0,0 +1,18 @@
+#pragma once
+
+#include <curl/curl.h>
+
+namespace curl {
+	/* Easy handles of the whole process come from a single pool. They all use
+	 * the same share object, so the DNS cache, the TLS sessions and the open
+	 * connections are reused from one request to the next, whichever handle
+	 * performs it.
+	 *
+	 * AcquireHandle returns a handle in its default state (apart from the
+	 * share), or NULL if curl cannot create one. ReleaseHandle gives it back
+	 * to the pool, which resets it. A handle must be removed from any multi
+	 * handle before it is released.
+	 */
+	CURL* AcquireHandle();
+	void ReleaseHandle(CURL* curl);
+}
\ No newline at end of file
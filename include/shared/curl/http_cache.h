@@ -0,0 +1,39 @@
+#pragma once
+
+#include <chrono>
+#include <string>
+
+namespace curl {
+	/* Body of a response kept on disk, along with what is needed to ask the
+	 * server whether it changed.
+	 */
+	struct CachedResponse {
+		std::string url;
+		std::string etag;
+		std::string lastModified;
+		std::string body;
+		/* Time since the server last sent or confirmed the body. */
+		std::chrono::seconds age;
+	};
+
+	/* Responses of the requests made with RequestParameters::cache, stored
+	 * in %APPDATA%/REPENTOGONLauncher_Cache/http, one file per URL.
+	 */
+	namespace HttpCache {
+		/* Age below which a cached body can be used when the server
+		 * cannot be reached, by default.
+		 */
+		static constexpr long DEFAULT_MAX_STALE = 24 * 60 * 60;
+
+		/* Seconds. 0 never uses a cached body without the server confirming
+		 * it first.
+		 */
+		void SetMaxStale(long seconds);
+		long GetMaxStale();
+
+		bool Load(std::string const& url, CachedResponse& response);
+		void Store(CachedResponse const& response);
+		/* Record that the server confirmed the cached body of url. */
+		void Touch(std::string const& url);
+	}
+}
\ No newline at end of file
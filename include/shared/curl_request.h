@@ -1,10 +1,12 @@
 #pragma once
 
 #include <atomic>
+#include <chrono>
 #include <memory>
 #include <string>
 #include <utility>
 #include <variant>
+#include <vector>
 
 #include <curl/curl.h>
 
@@ -42,7 +44,11 @@ namespace curl {
 		DOWNLOAD_INIT_CURL_DONE,
 		DOWNLOAD_CURL_PERFORM,
 		DOWNLOAD_CURL_PERFORM_DONE,
-		DOWNLOAD_DATA_RECEIVED
+		DOWNLOAD_DATA_RECEIVED,
+		/* An attempt failed and the request is tried again, data tells why
+		 * and when (see RequestParameters::retry).
+		 */
+		DOWNLOAD_RETRY
 	};
 
 	struct DownloadNotification {
@@ -64,6 +70,10 @@ namespace curl {
 		DownloadFileResult	result;
 		CURLcode			code;
 		std::string			filename;
+		/* Size of the partial file the download continued from, 0 if the
+		 * whole file was downloaded. See RequestParameters::resume.
+		 */
+		curl_off_t			resumedFrom;
 	};
 
 	struct AsynchronousDownloadDescriptor {
@@ -83,12 +93,90 @@ namespace curl {
 		std::future<DownloadFileDescriptor>		result;
 	};
 
+	/* Order in which the GithubExecutor starts pending requests. Requests
+	 * of the same priority start in the order they were added.
+	 */
+	enum RequestPriority {
+		/* Large downloads (e.g. archives). They never take the last transfer
+		 * slot, so that other requests are not stuck behind them.
+		 */
+		REQUEST_PRIORITY_LOW,
+		REQUEST_PRIORITY_NORMAL,
+		REQUEST_PRIORITY_HIGH
+	};
+
+	/* How a request that failed because of a transient error is tried
+	 * again. The delay before each retry is doubled from baseDelay up to
+	 * maxDelay, then shortened by a random fraction of up to jitter of
+	 * itself, so that clients do not retry all at once. A delay asked by
+	 * the server through Retry-After or X-RateLimit-Reset is waited in full.
+	 */
+	struct RetryPolicy {
+		/* Number of attempts, including the first one. 1 never retries. */
+		unsigned int				attempts = 1;
+		std::chrono::milliseconds	baseDelay{ 500 };
+		std::chrono::milliseconds	maxDelay{ 8000 };
+		/* Between 0 and 1. */
+		double						jitter = 0.5;
+		/* If the server asks to wait longer than this, the request fails
+		 * right away.
+		 */
+		std::chrono::milliseconds	maxServerDelay{ 60000 };
+		/* HTTP statuses worth a retry. A 403 asking to wait (Retry-After) or
+		 * telling that no request is left (X-RateLimit-Remaining: 0), as
+		 * GitHub sends when it rate limits, counts as a 429.
+		 */
+		std::vector<long>			statuses = { 408, 429, 500, 502, 503, 504 };
+		/* cURL errors worth a retry, if the server did not answer with an
+		 * HTTP error.
+		 */
+		std::vector<CURLcode>		codes = {
+			CURLE_COULDNT_RESOLVE_PROXY, CURLE_COULDNT_RESOLVE_HOST, CURLE_COULDNT_CONNECT,
+			CURLE_HTTP2, CURLE_PARTIAL_FILE, CURLE_OPERATION_TIMEDOUT, CURLE_SSL_CONNECT_ERROR,
+			CURLE_GOT_NOTHING, CURLE_SEND_ERROR, CURLE_RECV_ERROR, CURLE_HTTP2_STREAM
+		};
+	};
+
 	struct RequestParameters {
 		std::string					url;
 		long						timeout = 0;
 		long						serverTimeout = 0;
 		curl_off_t					maxSpeed = 0;
 		std::vector<std::string>	headers;
+		/* If set, called from the transfer thread with every chunk of the
+		 * body before it is stored. Returning false aborts the transfer.
+		 */
+		AbstractCurlResponseHandler::OnDataHandlerFn	onData;
+		/* Only used by the asynchronous functions. */
+		RequestPriority				priority = REQUEST_PRIORITY_NORMAL;
+		/* File downloads only. If the download fails, keep what was received
+		 * and remember it next to the file, so that the next download of the
+		 * same URL to the same file only fetches the rest, provided the
+		 * server still has the same version of the file.
+		 */
+		bool						resume = false;
+		/* Asynchronous file downloads only. If greater than 1, and the
+		 * server accepts byte ranges, the file is split in up to this many
+		 * ranges downloaded at the same time. A resumed download splits what
+		 * remains. Ignored if maxSpeed is set, and if onData is set, since
+		 * segments arrive out of order and onData must see the body in
+		 * order: a download that is processed while it is received is never
+		 * split.
+		 */
+		unsigned int				segments = 1;
+		/* String downloads only. Keep the body of the response on disk (see
+		 * curl::HttpCache) and ask the server whether it changed on the
+		 * next request; if it did not, the body is read from the disk.
+		 * If the server cannot be reached, or refuses the request, a body
+		 * younger than HttpCache::GetMaxStale() is used instead: the result
+		 * is then DOWNLOAD_STRING_OK, code still telling what went wrong.
+		 */
+		bool						cache = false;
+		/* A download that is retried starts over, unless resume is set:
+		 * it then continues from what the failed attempt received. Requests
+		 * with onData are not retried once it was given data.
+		 */
+		RetryPolicy					retry;
 	};
 
 	/* Returns a human readable description of a DownloadAsStringResult for use in logging. */
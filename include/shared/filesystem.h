@@ -3,6 +3,7 @@
 #include <WinSock2.h>
 #include <Windows.h>
 
+#include <cstdint>
 #include <filesystem>
 #include <string>
 #include <vector>
@@ -55,9 +56,45 @@ namespace Filesystem {
 	 */
 	bool DeleteFolder(const char* path, HANDLE transaction = NULL);
 
+	/* Replace the content of filename with size bytes from data, in such a
+	 * way that a crash at any point leaves either the previous content or
+	 * the new one, never a mix of both.
+	 *
+	 * The data is written to filename.tmp, flushed to the disk, then moved
+	 * over filename.
+	 *
+	 * Return true on success, false on failure.
+	 */
+	bool AtomicWriteFile(const char* filename, const void* data, size_t size);
+
 	bool SplitIntoComponents(const char* path, std::string* drive,
 		std::string* filename, std::string* extension,
 		std::vector<std::string>* folders);
 
 	void TokenizePath(const char* path, std::vector<std::string>& tokens);
+
+	/* Identity of a file, read through an open handle. Two identities are
+	 * equal if they designate the same file (volume and index) at the same
+	 * location, with the same size and last write time.
+	 */
+	struct FileIdentity {
+		/* Final path of the file, normalized and in lower case. */
+		std::string path;
+		uint64_t size = 0;
+		/* FILETIME of the last write. */
+		uint64_t lastWrite = 0;
+		uint32_t volume = 0;
+		uint64_t fileIndex = 0;
+
+		bool operator==(FileIdentity const& other) const = default;
+	};
+
+	/* Fill identity with the identity of file. Return false on failure. */
+	bool GetFileIdentity(HANDLE file, FileIdentity& identity);
+
+	/* Check that the file was last written at least seconds ago. Caches
+	 * keyed on the identity of a file should not remember younger files: a
+	 * write landing in the same timestamp tick would go unnoticed.
+	 */
+	bool IsOlderThan(FileIdentity const& identity, unsigned int seconds);
 }
\ No newline at end of file
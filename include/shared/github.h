@@ -28,6 +28,12 @@ namespace Github {
 		RELEASE_INFO_NO_NAME
 	};
 
+	/* Number of attempts of the requests to GitHub, so that its transient
+	 * errors and rate limits do not send us to the slower fallbacks. See
+	 * curl::RetryPolicy.
+	 */
+	static constexpr unsigned int REQUEST_ATTEMPTS = 3;
+
 	void GenerateGithubHeaders(curl::RequestParameters& parameters);
 
 	/* Check if the latest release data is newer than the installed version.
@@ -1,13 +1,43 @@
 #pragma once
 
 #include <atomic>
+#include <chrono>
+#include <cstdint>
 #include <future>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <utility>
+#include <variant>
+#include <vector>
 
 #include "shared/curl_request.h"
-#include "shared/monitor.h"
 
+namespace curl::detail {
+    class Transfer;
+    class StringTransfer;
+    class FileTransfer;
+}
+
+/* Performs the asynchronous requests of curl::AsyncDownloadString and
+ * curl::AsyncDownloadFile on a single thread, driving up to GetMaxTransfers()
+ * transfers at once through a curl multi handle. A transfer may use more than
+ * one of these slots (see RequestParameters::segments).
+ *
+ * Pending requests start by decreasing priority, then in the order they were
+ * added. Low priority requests never take the last transfer slot, so small
+ * requests are not stuck behind large downloads.
+ *
+ * A request that fails is tried again according to its RetryPolicy. It
+ * holds no transfer slot while it waits.
+ */
 class GithubExecutor {
 public:
+    static constexpr size_t DEFAULT_MAX_TRANSFERS = 4;
+
     static GithubExecutor& Instance();
 
     ~GithubExecutor();
@@ -15,6 +45,12 @@ public:
     void Start();
     void Stop();
 
+    /* Requests that are already running are not interrupted if max is
+     * lower than their number. 0 is treated as 1.
+     */
+    void SetMaxTransfers(size_t max);
+    size_t GetMaxTransfers() const;
+
     std::future<curl::DownloadStringDescriptor> AddDownloadStringRequest(std::string&& name,
         curl::RequestParameters const& request,
         std::shared_ptr<curl::AsynchronousDownloadStringDescriptor> const& desc);
@@ -24,31 +60,77 @@ public:
         std::shared_ptr<curl::AsynchronousDownloadFileDescriptor> const& desc);
 
 private:
-    friend class GithubRequestVisitor;
-
     struct DownloadStringRequest {
-        curl::RequestParameters                                     request;
-        std::string                                                 name;
-        std::shared_ptr<curl::AsynchronousDownloadStringDescriptor> descriptor;
+        std::unique_ptr<curl::detail::StringTransfer>               transfer;
         std::promise<curl::DownloadStringDescriptor>                result;
     };
 
     struct DownloadFileRequest {
-        curl::RequestParameters                                     request;
-        std::string                                                 filename;
-        std::shared_ptr<curl::AsynchronousDownloadFileDescriptor>   descriptor;
+        std::unique_ptr<curl::detail::FileTransfer>                 transfer;
         std::promise<curl::DownloadFileDescriptor>                  result;
     };
 
     typedef std::variant<DownloadStringRequest, DownloadFileRequest> GithubRequest;
-    Threading::Monitor<GithubRequest> _requests;
+    /* (-priority, sequence), so that iterating goes by decreasing priority,
+     * then by insertion order.
+     */
+    typedef std::pair<int, uint64_t> RequestKey;
+
+    struct RunningRequest {
+        GithubRequest                                               request;
+        /* Handles of the transfer currently in the multi handle. */
+        std::vector<CURL*>                                          handles;
+        /* Set while the transfer waits to be tried again. */
+        std::optional<std::chrono::steady_clock::time_point>        retryAt;
+    };
+
+    typedef std::list<RunningRequest>::iterator RunningIterator;
 
     GithubExecutor();
 
     void Run();
+    /* Queue request, or fail it right away if the executor is not
+     * running.
+     */
+    void Push(curl::RequestPriority priority, GithubRequest&& request);
+    /* Start the additional handles of running requests and the new attempts
+     * of the requests that are due, then begin pending requests, while there
+     * are free transfer slots.
+     */
+    void StartPendingRequests(CURLM* multi);
+    /* How long to wait for activity, in milliseconds, so that retries are
+     * not late.
+     */
+    int GetPollTimeout() const;
+    /* Whether a request of the given priority can take a transfer slot. */
+    bool HasFreeSlot(curl::RequestPriority priority) const;
+    bool AddHandle(CURLM* multi, RunningIterator request, CURL* handle);
+    void RemoveHandle(CURLM* multi, CURL* handle);
+    void RemoveHandles(CURLM* multi, RunningIterator request);
+    /* Abort running and pending requests whose descriptor was cancelled, or
+     * all of them if all is true.
+     */
+    void AbortRequests(CURLM* multi, bool all);
+    void WakeUp();
+
+    static curl::detail::Transfer* GetTransfer(GithubRequest& request);
+    static void Complete(GithubRequest& request);
+
+    /* Protects _pending, _sequence and _multi. */
+    std::mutex _mutex;
+    std::map<RequestKey, GithubRequest> _pending;
+    uint64_t _sequence = 0;
+    CURLM* _multi = nullptr;
+
+    /* Only accessed by the executor thread. Each handle in the multi handle
+     * is a transfer slot, and maps to the request it belongs to.
+     */
+    std::list<RunningRequest> _running;
+    std::map<CURL*, RunningIterator> _handles;
 
     std::thread _thread;
     std::atomic<bool> _stop;
+    std::atomic<size_t> _maxTransfers;
 };
 
 #define sGithubExecutor (&GithubExecutor::Instance())
\ No newline at end of file
@@ -14,12 +14,7 @@
 #include <chrono>
 #include <ctime>
 
-inline size_t versionwriteresponse(void* contents, size_t size, size_t nmemb, void* userp) {
-    size_t total = size * nmemb;
-    std::string* s = (std::string*)userp;
-    s->append((char*)contents, total);
-    return total;
-}
+#include "shared/curl_request.h"
 
 inline bool ShouldDoTimeBasedGitLabSkip() { //only used for the launcher update routine, since ideally we shouldnt really skip this process unless theres a problem....and if theres a problem we would fix it in a launcher update so thats why it skips it once a day just in case, lol
     char* appdataPath = nullptr;
@@ -61,42 +56,24 @@ inline bool ShouldDoTimeBasedGitLabSkip() { //only used for the launcher update
     return ret;
 }
 
-inline bool RemoteGitLabVersionMatches(std::string versionfilename, std::string currversion) {
-    const std::string url =
-        "https://gitlab.com/repentogon/versiontracker/-/raw/main/" + versionfilename + ".txt";
-
-    CURL* curl = curl_easy_init();
-    if (!curl)
-        return false; //dont care, we have github as backup, let it error there, lol
-
-    std::string response;
-    struct curl_slist* headers = nullptr;
-    headers = curl_slist_append(headers, "User-Agent: rgon-version-getter/6.9");
-    curl_easy_setopt(curl, CURLOPT_HTTPHEADER, headers);
-    curl_easy_setopt(curl, CURLOPT_URL, url.c_str());
-    curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, 1L);
-    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, versionwriteresponse);
-    curl_easy_setopt(curl, CURLOPT_WRITEDATA, &response);
-    curl_easy_setopt(curl, CURLOPT_TIMEOUT, 10L);
-
-    CURLcode res = curl_easy_perform(curl);
-    long http_code = 0;
-    curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &http_code);
-
-    curl_slist_free_all(headers);
-    curl_easy_cleanup(curl);
-
-    if (res != CURLE_OK)
-    {        
-        return false; //dont care, we have github as backup, let it error there, lol
-    }
+inline curl::RequestParameters GitLabVersionRequest(std::string const& versionfilename) {
+    curl::RequestParameters request;
+    request.url = "https://gitlab.com/repentogon/versiontracker/-/raw/main/" + versionfilename + ".txt";
+    request.headers.push_back("User-Agent: rgon-version-getter/6.9");
+    request.timeout = 10000;
+    /* Usually answered with an empty 304. */
+    request.cache = true;
+    return request;
+}
 
-    if (http_code < 200 || http_code >= 300)
+inline bool RemoteGitLabVersionMatches(std::string versionfilename, std::string currversion) {
+    curl::DownloadStringDescriptor result = curl::DownloadString(GitLabVersionRequest(versionfilename), versionfilename);
+    if (result.result != curl::DOWNLOAD_STRING_OK)
     {
         return false; //dont care, we have github as backup, let it error there, lol
     }
 
-    return response == currversion;
+    return result.string == currversion;
 }
 
 #endif 
\ No newline at end of file
@@ -2,6 +2,7 @@
 
 #include <cstdint>
 
+#include <chrono>
 #include <optional>
 #include <string>
 #include <variant>
@@ -40,6 +41,11 @@ namespace Shared {
 
 	class LauncherUpdateChecker {
 	public:
+		/* Time given to the GitLab version file, which is small and usually
+		 * unchanged, before the GitHub releases are requested as well.
+		 */
+		static constexpr std::chrono::milliseconds GITHUB_STAGGER{ 250 };
+
 		/* Check if an update of the launcher is available.
 		 *
 		 *   allowPreRelease indicates if a prerelease is considered a valid update.
@@ -49,6 +55,9 @@ namespace Shared {
 		 *   version receives the name of new available version, if any.
 		 *   url receives the url to download the newest available version, if any.
 		 *
+		 * GitLab and GitHub are asked at the same time (see SourceResolver),
+		 * and Steam if neither answered.
+		 *
 		 * Return true if an update is available, false otherwise. false is
 		 * also returned on error.
 		 */
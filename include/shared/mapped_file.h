@@ -0,0 +1,63 @@
+#pragma once
+
+#include <WinSock2.h>
+#include <Windows.h>
+
+#include <cstdint>
+
+/* RAII-style class that maps a whole file in memory and unmaps it upon
+ * destruction.
+ *
+ * Empty files are valid: they map to a NULL pointer with a size of 0.
+ */
+class MappedFile {
+public:
+	enum Mode {
+		/* Read-only view of an existing file. */
+		MAP_READ,
+		/* Read-write view of an existing file. */
+		MAP_WRITE,
+		/* Copy-on-write view of an existing file: writes are visible
+		 * through the view but never reach the file.
+		 */
+		MAP_COPY
+	};
+
+	MappedFile();
+	MappedFile(MappedFile&& other);
+	MappedFile(MappedFile const& other) = delete;
+
+	MappedFile& operator=(MappedFile&& other);
+	MappedFile& operator=(MappedFile const&) = delete;
+
+	~MappedFile();
+
+	/* Map an existing file. Return false on failure, including when the
+	 * file is too large for the address space of the process.
+	 */
+	bool Open(const char* filename, Mode mode = MAP_READ);
+
+	/* Create (or truncate) filename with a size of size bytes and map it
+	 * for writing. Return false on failure.
+	 */
+	bool Create(const char* filename, uint64_t size);
+
+	/* Write the modified pages of [offset, offset + size) back to the disk. */
+	bool Flush(size_t offset, size_t size);
+	bool Flush();
+
+	void Close();
+
+	unsigned char* Data() const;
+	size_t Size() const;
+	operator bool() const;
+
+private:
+	bool Map(DWORD protection, DWORD access, uint64_t size);
+
+	HANDLE _file = INVALID_HANDLE_VALUE;
+	HANDLE _mapping = NULL;
+	unsigned char* _data = nullptr;
+	size_t _size = 0;
+	bool _open = false;
+};
@@ -4,7 +4,11 @@
 #include <map>
 #include <string>
 #include <tuple>
+#include <utility>
+#include <vector>
 
+#include "shared/mapped_file.h"
+#include "shared/signature_scanner.h"
 #include "shared/unique_free_ptr.h"
 
 #pragma pack(push, 1)
@@ -140,35 +144,93 @@ private:
 	char* _bytes;
 };
 
+/* Parser for PE32 executables.
+ *
+ * The file is mapped in memory instead of being read. In READ_ONLY mode, the
+ * mapping is shared with the page cache and Patch() always fails. In
+ * READ_WRITE mode, the mapping is copy-on-write: only the pages touched by
+ * Patch() are copied, and Write() only writes the patched ranges back.
+ * Write() maps the file again: pointers obtained before are invalidated.
+ */
 class PE32 {
 public:
 	static constexpr size_t PE_SIGNATURE_OFFSET = 0x3c;
 
-    PE32(const char* filename);
+	enum Mode {
+		READ_ONLY,
+		READ_WRITE
+	};
+
+    PE32(const char* filename, Mode mode = READ_ONLY);
     ~PE32();
 
 	bool IsSectionSizeValid(SectionHeader const* header) const;
 	std::tuple<const SectionHeader*, PE32Byte> GetSection(const char* section);
+	/* Search for the size bytes of pattern, which may contain NUL bytes, in
+	 * the given section, or in the whole file if header is NULL. See
+	 * ByteSearch::Find.
+	 */
+	PE32Byte Lookup(const void* pattern, size_t size, const SectionHeader* header = nullptr) const;
 	PE32Byte Lookup(const char* str, const SectionHeader* header = nullptr) const;
+	/* Same as Lookup, but return every occurrence of pattern. */
+	std::vector<PE32Byte> LookupAll(const void* pattern, size_t size, const SectionHeader* header = nullptr) const;
+	/* Search for all the signatures of a compiled scanner in a single pass
+	 * over the given section. See SignatureScanner::Scan.
+	 */
+	std::vector<std::vector<PE32Byte>> Scan(SignatureScanner const& scanner, const SectionHeader* header = nullptr) const;
+	bool Patch(PE32Byte where, const void* with, size_t size);
 	bool Patch(PE32Byte where, const char* with);
 	bool Write();
 	inline OptionalHeader const* GetOptionalHeader() const { return _optionalHeader;  }
+	/* The image of the file as loaded in memory is built on the first call. */
 	const char* RVA(uint32_t, const char* base = nullptr);
 
+	/* Convert an RVA to an offset in the file, using the section table
+	 * instead of the image built by RVA(). Return false if the RVA is not
+	 * backed by the content of a section (e.g. uninitialized data).
+	 */
+	bool RVAToOffset(uint32_t rva, uint32_t* offset) const;
+	/* Find the data exported under name in the export directory. Forwarded
+	 * exports and exports with no content in the file are not found.
+	 */
+	PE32Byte GetExport(const char* name) const;
+	/* Read the string pointed to by the 32-bit pointer at where, as written
+	 * in the file (i.e. relative to the preferred image base). Return false
+	 * if the pointer or the string are outside of the file, or if the string
+	 * does not end before its section.
+	 */
+	bool ReadStringPointer(PE32Byte where, std::string& value) const;
+
 private:
     void Validate(const char* filename);
 	void Map();
 
+	inline char* Content() const { return (char*)_file.Data(); }
+	/* Range of the file covered by header, or the whole file. */
+	std::tuple<char*, size_t> GetRange(const SectionHeader* header) const;
+	/* Section in the file that contains rva, NULL if there is none. */
+	const SectionHeader* GetSectionOfRVA(uint32_t rva) const;
+	/* Pointer to the size bytes at rva, NULL if they are not all in the
+	 * content of the same section.
+	 */
+	const char* GetRVARange(uint32_t rva, uint64_t size) const;
+	/* Read the NUL terminated string at rva, which must end in its section. */
+	bool ReadString(uint32_t rva, std::string& value) const;
+
 	std::map<std::string, std::tuple<SectionHeader*, PE32Byte>> _sectionsMap;
 
 	std::string _filename;
+	Mode _mode;
 	size_t _size;
 	COFFHeader* _coffHeader = nullptr;
 	SectionHeader* _sections = nullptr;
 	OptionalHeader* _optionalHeader = nullptr;
-	unique_free_ptr<char> _content;
+	MappedFile _file;
+	/* Ranges of the file modified by Patch(), as (offset, size). */
+	std::vector<std::pair<size_t, size_t>> _patches;
 	/* Content of the file as it it was loaded in memory. This includes padding
 	 * at the end of sections, and can be used to compute RVAs.
 	 */
 	unique_free_ptr<char> _memoryContent;
+	bool _mapped = false;
 };
\ No newline at end of file
@@ -1,8 +1,256 @@
 #pragma once
 
+#include <chrono>
+#include <memory>
+#include <optional>
+#include <string>
+#include <vector>
+
 #include "shared/curl_request.h"
+#include "shared/curl/file_response_handler.h"
+#include "shared/curl/http_cache.h"
+#include "shared/curl/string_response_handler.h"
 
 namespace curl::detail {
+    /* A single transfer, from the creation of its easy handle to its result.
+     * The blocking functions drive the handle with curl_easy_perform, the
+     * GithubExecutor with its multi handle.
+     *
+     * If Begin returns false, the transfer cannot start. Otherwise, End must
+     * be called with the result of curl once the handle is done. Either way,
+     * the result is then available through GetResult. End may also be called
+     * without Begin, to abort a transfer that never started.
+     *
+     * A transfer may use more than one easy handle (see NextHandle), in which
+     * case End is called once HandleDone reports that all of them are done.
+     *
+     * Before calling End, ask ShouldRetry whether another attempt should be
+     * made, as a failed request may still end with CURLE_OK. If so, wait for
+     * the delay, then call Restart, which works as Begin.
+     */
+    class Transfer {
+    public:
+        Transfer(RequestParameters const& parameters, AsynchronousDownloadDescriptor* descriptor);
+        Transfer(Transfer const&) = delete;
+        Transfer& operator=(Transfer const&) = delete;
+        virtual ~Transfer();
+
+        virtual bool Begin() = 0;
+        virtual void End(CURLcode code) = 0;
+
+        /* End a transfer cancelled through its descriptor, notifying its
+         * monitor.
+         */
+        void Abort();
+
+        inline CURL* GetHandle() const {
+            return _curl;
+        }
+
+        /* Additional handle of the transfer that can be started, nullptr if
+         * there is none (yet). Only asked by the GithubExecutor, whenever it
+         * has a free transfer slot.
+         */
+        virtual CURL* NextHandle();
+
+        /* Called once handle, one of the handles of the transfer, is done
+         * with code. Return true if the transfer is over, code then being
+         * the result to give to End; the other handles are stopped.
+         */
+        virtual bool HandleDone(CURL* handle, CURLcode& code);
+
+        /* Whether the transfer should be tried again after handle, one of
+         * its handles, ended it with code (see RequestParameters::retry).
+         * If so, delay is set to how long to wait before Restart, and the
+         * monitor of the descriptor is notified.
+         */
+        bool ShouldRetry(CURL* handle, CURLcode code, std::chrono::milliseconds& delay);
+        /* Wrap up the failed attempt as End would, then start a new one. */
+        virtual bool Restart() = 0;
+
+        inline RequestParameters const& GetParameters() const {
+            return _parameters;
+        }
+
+        /* NULL for blocking transfers. */
+        inline AsynchronousDownloadDescriptor* GetDescriptor() const {
+            return _descriptor;
+        }
+
+    protected:
+        /* Create and configure the easy handle, with the body of the
+         * response going to handler. Return false on failure.
+         */
+        bool Init(AbstractCurlResponseHandler* handler, const char* name);
+        /* Register the onData hook of the parameters and the hook notifying
+         * the monitor of the descriptor on handler. Done by Init.
+         */
+        void RegisterHooks(AbstractCurlResponseHandler* handler, const char* name);
+        void NotifyPerform();
+        void NotifyDone();
+        /* Release the easy handle and go back to the parameters given to
+         * the constructor, before a new attempt.
+         */
+        void Reset();
+
+        /* Parameters of the current attempt. */
+        RequestParameters _parameters;
+        AsynchronousDownloadDescriptor* _descriptor;
+        uint32_t _id;
+
+    private:
+        /* Delay asked by the server in the response handle received,
+         * through Retry-After, or through X-RateLimit-Reset once no request
+         * is left. rateLimited is set if the server asked to wait or has no
+         * request left.
+         */
+        static std::optional<std::chrono::milliseconds> GetServerDelay(CURL* handle,
+            bool& rateLimited);
+
+        RequestParameters _request;
+        unsigned int _attempt = 1;
+        CURL* _curl = nullptr;
+        struct curl_slist* _headers = nullptr;
+    };
+
+    class StringTransfer : public Transfer {
+    public:
+        StringTransfer(RequestParameters const& parameters, std::string const& name,
+            std::shared_ptr<AsynchronousDownloadStringDescriptor> const& desc);
+
+        bool Begin() override;
+        void End(CURLcode code) override;
+        bool Restart() override;
+
+        inline DownloadStringDescriptor& GetResult() {
+            return _result;
+        }
+
+    private:
+        static size_t OnHeader(char* data, size_t size, size_t n, void* userp);
+        /* Use the cached body in place of a response that could not be
+         * obtained, if it is recent enough. Return false if there is none.
+         */
+        bool UseStaleResponse(const char* reason);
+
+        std::string _name;
+        std::shared_ptr<AsynchronousDownloadStringDescriptor> _desc;
+        CurlStringResponse _response;
+        DownloadStringDescriptor _result;
+
+        /* Cached response of the URL, if any. */
+        std::optional<CachedResponse> _cached;
+        /* Headers of the response being received. */
+        long _status = 0;
+        std::string _etag;
+        std::string _lastModified;
+    };
+
+    /* What was received of a file download that did not complete, saved
+     * next to the file (see PathOf). The download can continue only if the
+     * URL is the same and the file still has exactly size bytes.
+     */
+    struct ResumeState {
+        static constexpr const char* HEADER = "REPENTOGON-RESUME 1";
+
+        std::string url;
+        /* ETag of the file, or its Last-Modified date if it has no ETag.
+         * Sent as If-Range, so that the server sends the whole file again
+         * if it changed.
+         */
+        std::string validator;
+        /* Number of bytes received. */
+        curl_off_t size = 0;
+        /* Size of the whole file, -1 if unknown. */
+        curl_off_t total = -1;
+
+        static std::string PathOf(std::string const& filename);
+        bool Load(std::string const& filename);
+        bool Save(std::string const& filename) const;
+        static void Discard(std::string const& filename);
+    };
+
+    /* One of the byte ranges of a segmented file download, written at its
+     * place in the file through its own handle.
+     */
+    struct FileSegment {
+        FileSegment(std::string const& filename, curl_off_t first, curl_off_t last);
+        FileSegment(FileSegment const&) = delete;
+        FileSegment& operator=(FileSegment const&) = delete;
+        ~FileSegment();
+
+        /* Inclusive bounds of the range. */
+        curl_off_t first;
+        curl_off_t last;
+        CurlFileResponse response;
+        CURL* curl = nullptr;
+        struct curl_slist* headers = nullptr;
+        bool done = false;
+    };
+
+    class FileTransfer : public Transfer {
+    public:
+        /* Files smaller than this are never split, nor split in ranges
+         * smaller than this.
+         */
+        static constexpr curl_off_t MIN_SEGMENT_SIZE = 1 << 20;
+
+        FileTransfer(RequestParameters const& parameters, std::string const& filename,
+            std::shared_ptr<AsynchronousDownloadFileDescriptor> const& desc);
+
+        bool Begin() override;
+        void End(CURLcode code) override;
+        CURL* NextHandle() override;
+        bool HandleDone(CURL* handle, CURLcode& code) override;
+        bool Restart() override;
+
+        inline DownloadFileDescriptor& GetResult() {
+            return _result;
+        }
+
+    private:
+        static size_t OnHeader(char* data, size_t size, size_t n, void* userp);
+        /* Called once the headers of the final response are received.
+         * Return false if the body cannot be written to the file.
+         */
+        bool OnHeadersDone();
+        /* Close the file and the segments. If the download failed, keep
+         * what was received to resume it later, if resume is set.
+         */
+        void Close(bool failed);
+        void SaveResumeState();
+        /* Split the file, of _total bytes, from start once the server
+         * answered the first range request. The first handle keeps the
+         * first segment.
+         */
+        bool PlanSegments(curl_off_t start);
+
+        std::string _filename;
+        std::shared_ptr<AsynchronousDownloadFileDescriptor> _desc;
+        /* Only opened once the transfer starts. */
+        std::optional<CurlFileResponse> _response;
+        DownloadFileDescriptor _result;
+
+        /* Resume state the transfer continues from, if any. */
+        std::optional<ResumeState> _resume;
+        /* Headers of the response being received. */
+        long _status = 0;
+        std::string _etag;
+        std::string _lastModified;
+        curl_off_t _rangeStart = -1;
+        curl_off_t _total = -1;
+
+        /* Whether the first request asks for the file as a range even if
+         * nothing is resumed, to find out if the server can send it in
+         * segments.
+         */
+        bool _probe = false;
+        /* Segments after the first one. */
+        std::vector<std::unique_ptr<FileSegment>> _segments;
+        size_t _startedSegments = 0;
+        bool _firstSegmentDone = false;
+    };
+
     DownloadStringDescriptor DownloadString(RequestParameters const& parameters,
         std::string const& name,
         std::shared_ptr<AsynchronousDownloadStringDescriptor> const& desc);
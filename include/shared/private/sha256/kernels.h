@@ -0,0 +1,52 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+/* Compression functions behind Sha256::Context. Not meant to be used
+ * outside of shared/sha256.cpp.
+ */
+namespace Sha256::detail {
+	static constexpr size_t BLOCK_SIZE = 64;
+	static constexpr size_t LANES = 8;
+
+	enum Backend {
+		/* Portable C++ implementation. This is also the value of the backend
+		 * before static initialization has run, so hashing from another
+		 * static initializer is safe.
+		 */
+		BACKEND_SCALAR,
+		/* Intel SHA extensions. */
+		BACKEND_SHANI
+	};
+
+	/* Process blocks consecutive 64 bytes blocks of data into state. */
+	typedef void (*CompressFn)(uint32_t state[8], const unsigned char* data, size_t blocks);
+
+	/* Process blocks consecutive 64 bytes blocks of each of the LANES
+	 * independent messages in data into the matching entry of states.
+	 */
+	typedef void (*Compress8xFn)(uint32_t states[LANES][8], const unsigned char* const data[LANES], size_t blocks);
+
+	void CompressScalar(uint32_t state[8], const unsigned char* data, size_t blocks);
+	void CompressSHANI(uint32_t state[8], const unsigned char* data, size_t blocks);
+
+	/* The scalar version exists so that callers do not have to special case
+	 * CPUs without AVX2.
+	 */
+	void Compress8xScalar(uint32_t states[LANES][8], const unsigned char* const data[LANES], size_t blocks);
+	void Compress8xAVX2(uint32_t states[LANES][8], const unsigned char* const data[LANES], size_t blocks);
+
+	/* Kernels selected at startup, according to the features of the CPU
+	 * and the result of the known-answer tests.
+	 */
+	Backend GetBackend();
+	CompressFn GetCompress();
+	bool HasMultiBuffer();
+	Compress8xFn GetCompress8x();
+
+	/* Check compress against the FIPS 180-2 test vectors. */
+	bool SelfTest(CompressFn compress);
+	/* Check compress against the scalar kernel on pseudo-random input. */
+	bool SelfTest8x(Compress8xFn compress);
+}
@@ -2,6 +2,9 @@
 
 #include <curl/curl.h>
 
+/* RAII-style class that gives a handle obtained from curl::AcquireHandle
+ * back to the pool upon destruction.
+ */
 class ScopedCURL {
 public:
 	ScopedCURL(CURL* curl);
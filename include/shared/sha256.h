@@ -1,19 +1,155 @@
 #pragma once
 
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <span>
+#include <string>
+#include <vector>
+
+#include "shared/monitor.h"
+
 enum HashResult {
 	HASH_OK,
 	HASH_INVALID_FILE,
 	HASH_NO_MEMORY,
-	HASH_BCRYPT
+	HASH_BCRYPT,
+	HASH_IO,
+	HASH_CANCELLED
 };
 
 const char* HashResultToString(HashResult result);
 
 namespace Sha256 {
+	/* Size of the blocks read from the disk when hashing a file. The memory
+	 * used by HashFile in HASH_FILE_READ mode never exceeds this value,
+	 * regardless of the size of the file.
+	 */
+	static constexpr size_t FILE_BLOCK_SIZE = 1 << 20;
+
+	/* Size of the views mapped in memory when hashing a file in
+	 * HASH_FILE_MAPPED mode. Must be a multiple of the allocation
+	 * granularity of the system (64 KB).
+	 */
+	static constexpr size_t FILE_VIEW_SIZE = 64 << 20;
+
+	/* Files up to this size are read whole by HashFiles and hashed eight at
+	 * a time by HashBuffers. A thread of HashFiles holds at most eight of
+	 * them in memory.
+	 */
+	static constexpr size_t BATCH_FILE_SIZE = 256 << 10;
+
+	enum HashFileMode {
+		/* Read the file through a fixed-size buffer. */
+		HASH_FILE_READ,
+		/* Map successive views of the file in memory, avoiding the copy
+		 * into an intermediate buffer.
+		 */
+		HASH_FILE_MAPPED
+	};
+
+	/* Incremental SHA-256 computation.
+	 *
+	 * Call Init() once, Update() as many times as needed, then Final() to
+	 * retrieve the hexadecimal digest. A context can be reused by calling
+	 * Init() again after Final().
+	 *
+	 * The computation is done natively, using the SHA extensions of the CPU
+	 * when they are available. See GetBackendName().
+	 */
+	class Context {
+	public:
+		Context();
+
+		HashResult Init();
+		HashResult Update(const void* data, size_t size);
+		HashResult Final(std::string& result);
+
+	private:
+		friend HashResult HashBuffers(const void* const* buffers, const size_t* sizes,
+			size_t count, std::string* results);
+
+		uint32_t _state[8];
+		unsigned char _buffer[64];
+		size_t _buffered = 0;
+		uint64_t _length = 0;
+	};
+
+	/* Name of the kernel used to hash single buffers ("scalar" or "SHA-NI"),
+	 * selected at startup depending on the CPU.
+	 */
+	const char* GetBackendName();
+
+	/* Hash count independent buffers, storing the hexadecimal digest of
+	 * buffers[i] (of sizes[i] bytes) in results[i].
+	 *
+	 * On CPUs with AVX2, up to eight buffers are processed simultaneously.
+	 */
+	HashResult HashBuffers(const void* const* buffers, const size_t* sizes,
+		size_t count, std::string* results);
+
+	/* Return the SHA-256 hash of the buffer, computed by the Windows CNG
+	 * provider. Kept as a reference to compare the native implementation
+	 * against.
+	 */
+	HashResult Sha256BCrypt(const void* data, size_t size, std::string& result);
+
+	/* Return the SHA-256 hash of the content of filename.
+	 *
+	 * The file is processed by blocks, peak memory usage does not depend on
+	 * the size of the file. If cancel is not NULL, it is checked between
+	 * blocks and the function returns HASH_CANCELLED once it is set.
+	 */
+	HashResult HashFile(const char* filename, std::string& result,
+		HashFileMode mode = HASH_FILE_READ, std::atomic<bool> const* cancel = nullptr);
+
+	enum HashFilesNotificationType {
+		/* A file has been processed, successfully or not. */
+		HASH_FILES_FILE_DONE,
+		/* Every file has been processed. End of message stream. */
+		HASH_FILES_DONE
+	};
+
+	struct HashFilesNotification {
+		HashFilesNotificationType	type;
+		/* Index of the file in the list given to HashFiles. Unused for
+		 * HASH_FILES_DONE.
+		 */
+		size_t						index;
+		HashResult					result;
+		size_t						filesDone;
+		size_t						filesTotal;
+		uint64_t					bytesDone;
+		uint64_t					bytesTotal;
+	};
+
+	typedef Threading::Monitor<HashFilesNotification> HashFilesMonitor;
+
+	struct FileHash {
+		HashResult	result = HASH_CANCELLED;
+		std::string	hash;
+	};
+
+	/* Hash every file in files, returning the results in the same order.
+	 *
+	 * Files are distributed, smallest first, over a pool of threads workers
+	 * (the number of cores if 0), each reading and hashing its own files so
+	 * that the I/O of a file overlaps with the hashing of the others. Files
+	 * of at most BATCH_FILE_SIZE bytes go through HashBuffers in groups of
+	 * eight, larger ones through HashFile.
+	 *
+	 * If monitor is not NULL, a notification is pushed after each file and
+	 * once all files are done. If cancel is set while the function runs,
+	 * files that were not finished report HASH_CANCELLED.
+	 */
+	std::vector<FileHash> HashFiles(std::span<const std::filesystem::path> files,
+		HashFilesMonitor* monitor = nullptr, std::atomic<bool> const* cancel = nullptr,
+		unsigned int threads = 0);
+
 	/* Return the SHA-256 hash of the content of filename.
 	 *
-	 * If the function cannot load the content of the file in memory, or if
-	 * the file does not exist, the function throws.
+	 * Equivalent to HashFile(filename, result, HASH_FILE_READ).
 	 */
 	HashResult Sha256F(const char* filename, std::string& result);
 
@@ -36,4 +172,4 @@ namespace Sha256 {
 	 */
 	char* Trim(char* hash);
 	void Trim(std::string& hash);
-}
\ No newline at end of file
+}
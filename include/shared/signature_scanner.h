@@ -0,0 +1,79 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/* Byte signature in which some bytes may be wildcards. */
+struct Signature {
+	std::vector<uint8_t> bytes;
+	/* true for the bytes that must match, false for wildcards. */
+	std::vector<bool> fixed;
+
+	/* Parse a signature written as hexadecimal bytes, with ?? for wildcards,
+	 * such as "55 8B EC ?? ?? 68". Whitespace is ignored, so the packed form
+	 * of ZHL ("558BEC????68") is accepted as well.
+	 *
+	 * Return false if text is malformed or only made of wildcards.
+	 */
+	static bool Parse(const char* text, Signature& result);
+
+	/* Check the signature against the size() bytes at data. */
+	bool Matches(const unsigned char* data) const;
+
+	size_t size() const { return bytes.size(); }
+};
+
+/* Search for several signatures in a single pass over a buffer.
+ *
+ * The longest run of fixed bytes of each signature is used as its anchor.
+ * A single anchor is searched with ByteSearch::FindAll. Several anchors are
+ * compiled into an Aho-Corasick automaton, which reports every position at
+ * which an anchor ends after a single read of the buffer. The signature
+ * owning the anchor is then checked in full around that position.
+ */
+class SignatureScanner {
+public:
+	/* Add a signature to the scanner. Return its index in the results of
+	 * Scan, or -1 if the signature is invalid.
+	 */
+	int Add(Signature const& signature);
+	int Add(const char* text);
+
+	/* Build the automaton. Must be called after the last call to Add and
+	 * before Scan.
+	 */
+	void Compile();
+
+	/* Return the offsets of the matches of every signature, indexed as
+	 * returned by Add. Offsets are in increasing order.
+	 */
+	std::vector<std::vector<size_t>> Scan(const void* data, size_t size) const;
+
+	size_t Count() const { return _signatures.size(); }
+
+private:
+	struct Anchor {
+		size_t signature;
+		/* Offset of the anchor in the signature. */
+		size_t offset;
+		size_t length;
+	};
+
+	bool Check(Anchor const& anchor, const unsigned char* bytes, size_t size, size_t last,
+		size_t& start) const;
+
+	std::vector<Signature> _signatures;
+	std::vector<Anchor> _anchors;
+
+	bool _compiled = false;
+	/* Transitions of the automaton, 256 per state. State 0 is the root. */
+	std::vector<int32_t> _transitions;
+	/* Anchors ending in each state, including through suffix links. */
+	std::vector<std::vector<size_t>> _outputs;
+	/* Whether _outputs of each state is not empty. */
+	std::vector<uint8_t> _accepting;
+	/* Whether each byte leads out of the root state. */
+	std::vector<uint8_t> _leavesRoot;
+};
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "shared/curl_request.h"
+
+namespace Shared {
+	/* Asks several sources for the same information and keeps the first
+	 * answer accepted, instead of trying them one after the other.
+	 *
+	 * Sources start in the order they were added: each one after its
+	 * stagger has elapsed since the previous one started, or right away if
+	 * every source started so far already failed. As soon as a source is
+	 * accepted, the other ones are cancelled. How long each source took is
+	 * logged, to tune the staggers.
+	 */
+	class SourceResolver {
+	public:
+		/* Called on the thread running Resolve with the answer of a source.
+		 * Return true to accept it.
+		 */
+		typedef std::function<bool(curl::DownloadStringDescriptor const&)> AcceptFn;
+
+		/* Interval between two checks of the sources. */
+		static constexpr std::chrono::milliseconds POLL_INTERVAL{ 10 };
+
+		SourceResolver(std::string name);
+		SourceResolver(SourceResolver const&) = delete;
+		SourceResolver& operator=(SourceResolver const&) = delete;
+		~SourceResolver();
+
+		void AddSource(std::string name, curl::RequestParameters const& request,
+			std::chrono::milliseconds stagger, AcceptFn accept);
+
+		/* Return the index of the accepted source, -1 if none was. */
+		int Resolve();
+
+	private:
+		struct Source {
+			std::string name;
+			curl::RequestParameters request;
+			std::chrono::milliseconds stagger;
+			AcceptFn accept;
+			std::shared_ptr<curl::AsynchronousDownloadStringDescriptor> descriptor;
+			std::chrono::steady_clock::time_point start;
+			bool done = false;
+		};
+
+		void Start(Source& source);
+		void CancelAll();
+		long long ElapsedMs(Source const& source) const;
+
+		std::string _name;
+		std::vector<Source> _sources;
+	};
+}
\ No newline at end of file
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <filesystem>
+
+/* Crash-safe update of the content of a folder.
+ *
+ * The new content is prepared in GetStagingFolder(folder). Commit() then
+ * flushes it to the disk and swaps it into folder: every item of the staging
+ * folder replaces the item of the same name in folder. Folders are swapped as
+ * a whole, unless the folder in place holds files the staged one does not
+ * have, in which case their items are swapped one by one so that nothing
+ * foreign to the update is lost.
+ *
+ * The items replaced are kept in GetBackupFolder(folder) until the next
+ * commit, so that Rollback() can instantly restore them.
+ *
+ * The list of items swapped is written to a journal before anything is moved.
+ * If the process dies in the middle of a commit (or of a rollback), Recover()
+ * puts the previous content back in place on the next start.
+ */
+namespace Staging {
+	/* Folder in which the new content of folder is prepared. */
+	std::filesystem::path GetStagingFolder(std::filesystem::path const& folder);
+
+	/* Folder holding the content replaced by the last commit. */
+	std::filesystem::path GetBackupFolder(std::filesystem::path const& folder);
+
+	/* Swap the content of the staging folder into folder, then remove the
+	 * staging folder.
+	 *
+	 * Return true on success. On failure, folder is left as it was before
+	 * the call.
+	 */
+	bool Commit(std::filesystem::path const& folder);
+
+	/* Undo the last successful commit into folder.
+	 *
+	 * Return true on success, false if there is nothing to roll back or if
+	 * the rollback failed. A failed rollback is resumed by Recover().
+	 */
+	bool Rollback(std::filesystem::path const& folder);
+
+	/* Restore the previous content of folder if a commit or rollback was
+	 * interrupted, and remove the staging folder of an update that was
+	 * abandoned. Meant to be called on startup, before folder is used.
+	 */
+	void Recover(std::filesystem::path const& folder);
+}
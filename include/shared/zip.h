@@ -1,11 +1,15 @@
 #pragma once
 
+#include <cstdint>
 #include <cstdio>
+#include <filesystem>
 #include <zip.h>
 #include <string>
 #include <vector>
 #include <tuple>
 
+#include "shared/monitor.h"
+
 namespace Zip {
 	class ScopedZip {
 	  public:
@@ -34,6 +38,10 @@ namespace Zip {
 		EXTRACT_FILE_ERR_FOPEN,
 		EXTRACT_FILE_ERR_ZIP_FREAD,
 		EXTRACT_FILE_ERR_FWRITE,
+		/* libzip could not describe or open the entry. */
+		EXTRACT_FILE_ERR_ZIP_OPEN,
+		/* The folders leading to the entry could not be created. */
+		EXTRACT_FILE_ERR_MKDIR,
 	};
 
 	ExtractFileResult ExtractFile(zip_t* zip, int index, zip_file_t* file, 
@@ -41,5 +49,81 @@ namespace Zip {
 	ExtractFileResult ExtractFile(zip_t* zip, int index, zip_file_t* file,
 		FILE* output);
 
-	bool ExtractAllToFolder(const char* filename, const char* outputDir);
+	enum ExtractMode {
+		/* Write every file of the archive. */
+		EXTRACT_ALL,
+		/* Only write the files whose size or CRC-32 on disk differ from the
+		 * ones recorded in the archive.
+		 */
+		EXTRACT_CHANGED,
+		/* Write the files that EXTRACT_CHANGED would write into the staging
+		 * folder of the output folder, then swap them in with
+		 * Staging::Commit. Unchanged files stay where they are. If anything
+		 * fails, the output folder is left untouched.
+		 */
+		EXTRACT_STAGED
+	};
+
+	/* Outcome of the extraction of one entry of an archive. */
+	struct ExtractedEntry {
+		/* Name of the entry in the archive, empty if libzip cannot give it. */
+		std::string name;
+		ExtractFileResult result = EXTRACT_FILE_OK;
+		/* Folder entries only create a folder. */
+		bool directory = false;
+		/* In EXTRACT_CHANGED and EXTRACT_STAGED modes, the file in the
+		 * output folder already matched the entry and was left untouched.
+		 */
+		bool unchanged = false;
+		uint64_t size = 0;
+	};
+
+	enum ExtractNotificationType {
+		/* An entry has been processed, successfully or not. */
+		EXTRACT_ENTRY_DONE,
+		/* Every entry has been processed. End of message stream. */
+		EXTRACT_DONE
+	};
+
+	struct ExtractNotification {
+		ExtractNotificationType	type;
+		/* Index of the entry in the archive. Unused for EXTRACT_DONE. */
+		size_t					index;
+		ExtractFileResult		result;
+		size_t					entriesDone;
+		size_t					entriesTotal;
+		uint64_t				bytesDone;
+		uint64_t				bytesTotal;
+	};
+
+	typedef Threading::Monitor<ExtractNotification> ExtractMonitor;
+
+	/* Size of the buffer each extraction thread decompresses into. */
+	static constexpr size_t EXTRACT_BUFFER_SIZE = 1 << 20;
+
+	/* Extract every entry of the archive filename into outputDir.
+	 *
+	 * The folders needed by the archive are created first, in a single pass
+	 * over the central directory. Files are then decompressed by up to
+	 * threads workers (the number of cores if 0), largest first, each with
+	 * its own handle on the archive. Output files are preallocated to their
+	 * final size.
+	 *
+	 * In EXTRACT_CHANGED and EXTRACT_STAGED modes, a file that already exists
+	 * in outputDir with the size and CRC-32 of its entry is only read, not
+	 * rewritten. In EXTRACT_STAGED mode, the EXTRACT_DONE notification is
+	 * pushed before the staged files are swapped in.
+	 *
+	 * If entries is not NULL, it receives one element per entry of the
+	 * archive, in archive order. If monitor is not NULL, a notification is
+	 * pushed after each entry and once all entries are done.
+	 *
+	 * Return true if the archive was opened and every entry was extracted.
+	 */
+	bool ExtractAllToFolder(const char* filename, const char* outputDir,
+		std::vector<ExtractedEntry>* entries = nullptr, ExtractMonitor* monitor = nullptr,
+		unsigned int threads = 0, ExtractMode mode = EXTRACT_ALL);
+
+	/* Return true if path is a file of size bytes whose CRC-32 is crc. */
+	bool FileMatches(std::filesystem::path const& path, uint64_t size, uint32_t crc);
 }
@@ -0,0 +1,355 @@
+#include <cstring>
+
+#include <algorithm>
+#include <stdexcept>
+
+#include <bzlib.h>
+#include <zlib.h>
+
+#include "patchgen/bsdiff.h"
+#include "patchgen/sais.h"
+
+namespace patchgen {
+	static size_t MatchLength(const unsigned char* a, size_t aSize, const unsigned char* b, size_t bSize) {
+		size_t i = 0;
+		size_t limit = std::min(aSize, bSize);
+		while (i < limit && a[i] == b[i]) {
+			++i;
+		}
+
+		return i;
+	}
+
+	/* Binary search the suffix array for the longest match of newData in
+	 * oldData. Same logic as search() in bsdiff.c, without the recursion.
+	 */
+	static size_t Search(std::vector<int32_t> const& sa, const unsigned char* oldData, size_t oldSize,
+		const unsigned char* newData, size_t newSize, int64_t* position) {
+		size_t start = 0, end = oldSize;
+		while (end - start >= 2) {
+			size_t middle = start + (end - start) / 2;
+			size_t offset = (size_t)sa[middle];
+			if (memcmp(oldData + offset, newData, std::min(oldSize - offset, newSize)) < 0) {
+				start = middle;
+			} else {
+				end = middle;
+			}
+		}
+
+		size_t x = MatchLength(oldData + sa[start], oldSize - sa[start], newData, newSize);
+		size_t y = MatchLength(oldData + sa[end], oldSize - sa[end], newData, newSize);
+		if (x > y) {
+			*position = sa[start];
+			return x;
+		} else {
+			*position = sa[end];
+			return y;
+		}
+	}
+
+	Diff ComputeDiff(const unsigned char* oldData, size_t oldSize,
+		const unsigned char* newData, size_t newSize) {
+		std::vector<int32_t> sa = BuildSuffixArray(oldData, oldSize);
+
+		Diff result;
+		result.diff.reserve(newSize);
+
+		/* Variables named as in bsdiff.c to ease comparison. */
+		int64_t oldsize = (int64_t)oldSize, newsize = (int64_t)newSize;
+		int64_t scan = 0, len = 0, pos = 0;
+		int64_t lastscan = 0, lastpos = 0, lastoffset = 0;
+
+		while (scan < newsize) {
+			int64_t oldscore = 0;
+			int64_t scsc = scan += len;
+			for (; scan < newsize; ++scan) {
+				len = (int64_t)Search(sa, oldData, oldSize, newData + scan, (size_t)(newsize - scan), &pos);
+
+				for (; scsc < scan + len; ++scsc) {
+					if (scsc + lastoffset < oldsize && oldData[scsc + lastoffset] == newData[scsc]) {
+						++oldscore;
+					}
+				}
+
+				if ((len == oldscore && len != 0) || len > oldscore + 8) {
+					break;
+				}
+
+				if (scan + lastoffset < oldsize && oldData[scan + lastoffset] == newData[scan]) {
+					--oldscore;
+				}
+			}
+
+			if (len == oldscore && scan != newsize) {
+				continue;
+			}
+
+			int64_t s = 0, Sf = 0, lenf = 0;
+			for (int64_t i = 0; lastscan + i < scan && lastpos + i < oldsize;) {
+				if (oldData[lastpos + i] == newData[lastscan + i]) {
+					++s;
+				}
+
+				++i;
+				if (s * 2 - i > Sf * 2 - lenf) {
+					Sf = s;
+					lenf = i;
+				}
+			}
+
+			int64_t lenb = 0;
+			if (scan < newsize) {
+				int64_t Sb = 0;
+				s = 0;
+				for (int64_t i = 1; scan >= lastscan + i && pos >= i; ++i) {
+					if (oldData[pos - i] == newData[scan - i]) {
+						++s;
+					}
+
+					if (s * 2 - i > Sb * 2 - lenb) {
+						Sb = s;
+						lenb = i;
+					}
+				}
+			}
+
+			if (lastscan + lenf > scan - lenb) {
+				int64_t overlap = (lastscan + lenf) - (scan - lenb);
+				int64_t Ss = 0, lens = 0;
+				s = 0;
+				for (int64_t i = 0; i < overlap; ++i) {
+					if (newData[lastscan + lenf - overlap + i] == oldData[lastpos + lenf - overlap + i]) {
+						++s;
+					}
+
+					if (newData[scan - lenb + i] == oldData[pos - lenb + i]) {
+						--s;
+					}
+
+					if (s > Ss) {
+						Ss = s;
+						lens = i + 1;
+					}
+				}
+
+				lenf += lens - overlap;
+				lenb -= lens;
+			}
+
+			for (int64_t i = 0; i < lenf; ++i) {
+				result.diff.push_back((unsigned char)(newData[lastscan + i] - oldData[lastpos + i]));
+			}
+
+			int64_t extra = (scan - lenb) - (lastscan + lenf);
+			result.extra.insert(result.extra.end(), newData + lastscan + lenf, newData + lastscan + lenf + extra);
+			result.controls.push_back({ lenf, extra, (pos - lenb) - (lastpos + lenf) });
+
+			lastscan = scan - lenb;
+			lastpos = pos - lenb;
+			lastoffset = pos - scan;
+		}
+
+		return result;
+	}
+
+	/* Encode x the way BSDIFF40 encodes its control values. */
+	static void offtout(int64_t x, unsigned char* buf) {
+		uint64_t y = x < 0 ? (uint64_t)-x : (uint64_t)x;
+		for (int i = 0; i < 8; ++i) {
+			buf[i] = (unsigned char)(y >> (8 * i));
+		}
+
+		if (x < 0) {
+			buf[7] |= 0x80;
+		}
+	}
+
+	static void AppendOfft(std::vector<unsigned char>& out, int64_t x) {
+		unsigned char buf[8];
+		offtout(x, buf);
+		out.insert(out.end(), buf, buf + 8);
+	}
+
+	static void AppendU32(std::vector<unsigned char>& out, uint32_t x) {
+		for (int i = 0; i < 4; ++i) {
+			out.push_back((unsigned char)(x >> (8 * i)));
+		}
+	}
+
+	static void AppendU64(std::vector<unsigned char>& out, uint64_t x) {
+		for (int i = 0; i < 8; ++i) {
+			out.push_back((unsigned char)(x >> (8 * i)));
+		}
+	}
+
+	static void AppendBZ2(std::vector<unsigned char>& out, const unsigned char* data, size_t size) {
+		bz_stream stream;
+		memset(&stream, 0, sizeof(stream));
+		if (BZ2_bzCompressInit(&stream, 9, 0, 0) != BZ_OK) {
+			throw std::runtime_error("BZ2_bzCompressInit failed");
+		}
+
+		size_t start = out.size();
+		size_t written = 0;
+		int ret = BZ_RUN_OK;
+		do {
+			/* avail_in is 32 bits, feed the input in chunks. */
+			unsigned int chunk = (unsigned int)std::min(size, (size_t)1 << 30);
+			if (stream.avail_in == 0 && chunk) {
+				stream.next_in = (char*)data;
+				stream.avail_in = chunk;
+				data += chunk;
+				size -= chunk;
+			}
+
+			out.resize(start + written + (1 << 20));
+			stream.next_out = (char*)out.data() + start + written;
+			stream.avail_out = 1 << 20;
+			ret = BZ2_bzCompress(&stream, size || stream.avail_in ? BZ_RUN : BZ_FINISH);
+			written += (1 << 20) - stream.avail_out;
+			if (ret != BZ_RUN_OK && ret != BZ_FINISH_OK && ret != BZ_STREAM_END) {
+				BZ2_bzCompressEnd(&stream);
+				throw std::runtime_error("BZ2_bzCompress failed");
+			}
+		} while (ret != BZ_STREAM_END);
+
+		out.resize(start + written);
+		BZ2_bzCompressEnd(&stream);
+	}
+
+	static std::vector<unsigned char> WriteBSDiff(Diff const& diff, size_t newSize) {
+		std::vector<unsigned char> ctrl;
+		ctrl.reserve(diff.controls.size() * 24);
+		for (Control const& control : diff.controls) {
+			AppendOfft(ctrl, control.diff);
+			AppendOfft(ctrl, control.extra);
+			AppendOfft(ctrl, control.seek);
+		}
+
+		std::vector<unsigned char> patch(32);
+		memcpy(patch.data(), "BSDIFF40", 8);
+		AppendBZ2(patch, ctrl.data(), ctrl.size());
+		size_t ctrlSize = patch.size() - 32;
+		AppendBZ2(patch, diff.diff.data(), diff.diff.size());
+		size_t diffSize = patch.size() - 32 - ctrlSize;
+		AppendBZ2(patch, diff.extra.data(), diff.extra.size());
+
+		offtout((int64_t)ctrlSize, patch.data() + 8);
+		offtout((int64_t)diffSize, patch.data() + 16);
+		offtout((int64_t)newSize, patch.data() + 24);
+		return patch;
+	}
+
+	struct RGPatchBlock {
+		std::vector<unsigned char> ctrl;
+		std::vector<unsigned char> data;
+		uint32_t count = 0;
+		uint64_t newOffset = 0;
+		int64_t oldOffset = 0;
+		uint64_t size = 0;
+	};
+
+	/* Same layout as rgpatch() in patchgenerator/creatediff.py. */
+	static std::vector<unsigned char> WriteRGPatch(Diff const& diff, size_t newSize) {
+		std::vector<RGPatchBlock> blocks;
+		const int64_t blockSize = (int64_t)RGPATCH_BLOCK_SIZE;
+		int64_t newPos = 0, oldPos = 0, diffPos = 0, extraPos = 0;
+
+		auto push = [&](int64_t x, int64_t y, int64_t z) {
+			if (blocks.empty() || blocks.back().size + x + y > (uint64_t)blockSize) {
+				RGPatchBlock& block = blocks.emplace_back();
+				block.newOffset = newPos;
+				block.oldOffset = oldPos;
+			}
+
+			RGPatchBlock& block = blocks.back();
+			AppendOfft(block.ctrl, x);
+			AppendOfft(block.ctrl, y);
+			AppendOfft(block.ctrl, z);
+			block.data.insert(block.data.end(), diff.diff.begin() + diffPos, diff.diff.begin() + diffPos + x);
+			block.data.insert(block.data.end(), diff.extra.begin() + extraPos, diff.extra.begin() + extraPos + y);
+			++block.count;
+			block.size += x + y;
+			diffPos += x;
+			extraPos += y;
+			newPos += x + y;
+			oldPos += x + z;
+		};
+
+		/* Split the control entries so that none produces more than a block
+		 * of the new file.
+		 */
+		for (Control const& control : diff.controls) {
+			int64_t x = control.diff, y = control.extra, z = control.seek;
+			while (x > blockSize) {
+				push(blockSize, 0, 0);
+				x -= blockSize;
+			}
+
+			if (x + y <= blockSize) {
+				push(x, y, z);
+				continue;
+			}
+
+			if (x) {
+				push(x, 0, 0);
+			}
+
+			while (y > blockSize) {
+				push(0, blockSize, 0);
+				y -= blockSize;
+			}
+
+			push(0, y, z);
+		}
+
+		std::vector<std::vector<unsigned char>> compressed(blocks.size());
+		for (size_t i = 0; i < blocks.size(); ++i) {
+			std::vector<unsigned char> raw = std::move(blocks[i].ctrl);
+			raw.insert(raw.end(), blocks[i].data.begin(), blocks[i].data.end());
+
+			uLongf size = compressBound((uLong)raw.size());
+			compressed[i].resize(size);
+			if (compress2(compressed[i].data(), &size, raw.data(), (uLong)raw.size(), 9) != Z_OK) {
+				throw std::runtime_error("compress2 failed");
+			}
+
+			compressed[i].resize(size);
+		}
+
+		std::vector<unsigned char> patch(8);
+		memcpy(patch.data(), "RGPATCH1", 8);
+		AppendU64(patch, newSize);
+		AppendU32(patch, (uint32_t)blocks.size());
+		AppendU32(patch, 0);
+
+		uint64_t offset = patch.size() + 48 * blocks.size();
+		for (size_t i = 0; i < blocks.size(); ++i) {
+			AppendU64(patch, offset);
+			AppendU64(patch, compressed[i].size());
+			AppendU64(patch, blocks[i].newOffset);
+			AppendU64(patch, (uint64_t)blocks[i].oldOffset);
+			AppendU64(patch, blocks[i].size);
+			AppendU32(patch, blocks[i].count);
+			AppendU32(patch, 0);
+			offset += compressed[i].size();
+		}
+
+		for (std::vector<unsigned char> const& data : compressed) {
+			patch.insert(patch.end(), data.begin(), data.end());
+		}
+
+		return patch;
+	}
+
+	std::vector<unsigned char> WritePatch(Diff const& diff, size_t newSize, PatchFormat format) {
+		switch (format) {
+		case PATCH_FORMAT_RGPATCH:
+			return WriteRGPatch(diff, newSize);
+
+		case PATCH_FORMAT_BSDIFF:
+		default:
+			return WriteBSDiff(diff, newSize);
+		}
+	}
+}
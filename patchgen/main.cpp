@@ -0,0 +1,524 @@
+#include <cstdio>
+#include <cstring>
+
+#include <algorithm>
+#include <atomic>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <map>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "rapidjson/prettywriter.h"
+#include "rapidjson/stringbuffer.h"
+
+#include "launcher/diff_patcher.h"
+#include "patchgen/bsdiff.h"
+#include "shared/logger.h"
+#include "shared/sha256.h"
+
+namespace fs = std::filesystem;
+
+/* Native counterpart of patchgenerator/creatediff.py: same options, same
+ * output layout, same manifest. Patches are generated by several threads,
+ * one file per thread.
+ */
+struct Options {
+	fs::path source = "source";
+	fs::path target = "target";
+	fs::path output = "output";
+	patchgen::PatchFormat format = patchgen::PATCH_FORMAT_BSDIFF;
+	unsigned int jobs = 0;
+	bool dry = false;
+	bool force = false;
+	bool verify = false;
+};
+
+struct PatchEntry {
+	fs::path name;
+	std::string pre;
+	std::string post;
+	uintmax_t cost = 0;
+	bool ok = false;
+};
+
+static void Usage(const char* program) {
+	fprintf(stderr, "Usage: %s [-n] [-y] [--verify] [-j JOBS] [-f bsdiff|rgpatch] "
+		"[-s SOURCE] [-t TARGET] [-o OUTPUT]\n\n"
+		"  -n, --dry-run   Perform a dry run: only simulate execution\n"
+		"  -y, --yes       Do not prompt before removing an existing output folder\n"
+		"  -j, --jobs      Number of files diffed in parallel (default: one per core)\n"
+		"  -f, --format    Format of the generated patches (default: bsdiff)\n"
+		"  -s, --source    Folder in which to find the files to downgrade (default: source)\n"
+		"  -t, --target    Folder in which to find the downgraded files (default: target)\n"
+		"  -o, --output    Folder in which to output the patches (default: output)\n"
+		"  --verify        Apply the generated patch to a copy of the source folder\n"
+		"                  and check that the result matches the target folder\n",
+		program);
+}
+
+static bool ParseArgs(int argc, char** argv, Options& options) {
+	for (int i = 1; i < argc; ++i) {
+		const char* arg = argv[i];
+		auto value = [&]() -> const char* {
+			if (i + 1 >= argc) {
+				fprintf(stderr, "Missing value for %s\n", arg);
+				return nullptr;
+			}
+
+			return argv[++i];
+		};
+
+		if (!strcmp(arg, "-n") || !strcmp(arg, "--dry-run")) {
+			options.dry = true;
+		} else if (!strcmp(arg, "-y") || !strcmp(arg, "--yes")) {
+			options.force = true;
+		} else if (!strcmp(arg, "--verify")) {
+			options.verify = true;
+		} else if (!strcmp(arg, "-s") || !strcmp(arg, "--source")) {
+			const char* v = value();
+			if (!v)
+				return false;
+			options.source = v;
+		} else if (!strcmp(arg, "-t") || !strcmp(arg, "--target")) {
+			const char* v = value();
+			if (!v)
+				return false;
+			options.target = v;
+		} else if (!strcmp(arg, "-o") || !strcmp(arg, "--output")) {
+			const char* v = value();
+			if (!v)
+				return false;
+			options.output = v;
+		} else if (!strcmp(arg, "-j") || !strcmp(arg, "--jobs")) {
+			const char* v = value();
+			if (!v)
+				return false;
+			options.jobs = (unsigned int)strtoul(v, nullptr, 10);
+		} else if (!strcmp(arg, "-f") || !strcmp(arg, "--format")) {
+			const char* v = value();
+			if (!v)
+				return false;
+
+			if (!strcmp(v, "bsdiff")) {
+				options.format = patchgen::PATCH_FORMAT_BSDIFF;
+			} else if (!strcmp(v, "rgpatch")) {
+				options.format = patchgen::PATCH_FORMAT_RGPATCH;
+			} else {
+				fprintf(stderr, "Unknown patch format %s\n", v);
+				return false;
+			}
+		} else {
+			fprintf(stderr, "Unknown option %s\n", arg);
+			return false;
+		}
+	}
+
+	if (options.dry && options.verify) {
+		fprintf(stderr, "--verify cannot be used with --dry-run\n");
+		return false;
+	}
+
+	return true;
+}
+
+static bool ReadFile(fs::path const& path, std::vector<unsigned char>& content) {
+	std::ifstream stream(path, std::ios::binary);
+	if (!stream) {
+		return false;
+	}
+
+	content.assign(std::istreambuf_iterator<char>(stream), std::istreambuf_iterator<char>());
+	return !stream.bad();
+}
+
+static bool WriteFile(fs::path const& path, std::vector<unsigned char> const& content) {
+	std::ofstream stream(path, std::ios::binary | std::ios::trunc);
+	if (!stream) {
+		return false;
+	}
+
+	stream.write((const char*)content.data(), content.size());
+	return stream.good();
+}
+
+/* Paths of all the files in folder, relative to folder. */
+static std::set<fs::path> RelativeFiles(fs::path const& folder) {
+	std::set<fs::path> files;
+	for (fs::directory_entry const& entry : fs::recursive_directory_iterator(folder)) {
+		if (entry.is_regular_file()) {
+			files.insert(fs::relative(entry.path(), folder));
+		}
+	}
+
+	return files;
+}
+
+/* Hash the files of folder listed in names, in parallel. Return false if a
+ * file cannot be hashed.
+ */
+static bool HashAll(fs::path const& folder, std::vector<fs::path> const& names,
+	std::vector<std::string>& hashes, unsigned int jobs) {
+	std::vector<fs::path> paths;
+	paths.reserve(names.size());
+	for (fs::path const& name : names) {
+		paths.push_back(folder / name);
+	}
+
+	std::vector<Sha256::FileHash> results = Sha256::HashFiles(paths, nullptr, nullptr, jobs);
+	hashes.clear();
+	for (size_t i = 0; i < results.size(); ++i) {
+		if (results[i].result != HASH_OK) {
+			fprintf(stderr, "Unable to hash %s (%d)\n", paths[i].string().c_str(), results[i].result);
+			return false;
+		}
+
+		hashes.push_back(std::move(results[i].hash));
+	}
+
+	return true;
+}
+
+static bool HandleOutputFolder(Options const& options) {
+	std::error_code ec;
+	if (fs::exists(options.output, ec)) {
+		if (!options.force) {
+			std::string answer;
+			do {
+				printf("Output folder %s already exists, do you want to remove it (Y/n) ? "
+					"(Answering no will abort) ", options.output.string().c_str());
+				if (!std::getline(std::cin, answer)) {
+					return false;
+				}
+			} while (answer != "" && answer != "y" && answer != "Y" && answer != "n" && answer != "N");
+
+			if (answer == "n" || answer == "N") {
+				return false;
+			}
+		}
+
+		printf("Removing output folder %s\n", options.output.string().c_str());
+		if (!options.dry) {
+			fs::remove_all(options.output, ec);
+			if (ec) {
+				fprintf(stderr, "Unable to remove %s: %s\n", options.output.string().c_str(), ec.message().c_str());
+				return false;
+			}
+		}
+	}
+
+	printf("Creating output folder %s\n", options.output.string().c_str());
+	if (!options.dry) {
+		fs::create_directories(options.output / "patches", ec);
+		if (ec) {
+			fprintf(stderr, "Unable to create %s: %s\n", options.output.string().c_str(), ec.message().c_str());
+			return false;
+		}
+	}
+
+	return true;
+}
+
+static bool GeneratePatch(Options const& options, PatchEntry const& entry) {
+	std::vector<unsigned char> oldData, newData;
+	if (!ReadFile(options.source / entry.name, oldData) || !ReadFile(options.target / entry.name, newData)) {
+		fprintf(stderr, "Unable to read %s\n", entry.name.string().c_str());
+		return false;
+	}
+
+	std::vector<unsigned char> patch;
+	try {
+		patchgen::Diff diff = patchgen::ComputeDiff(oldData.data(), oldData.size(), newData.data(), newData.size());
+		patch = patchgen::WritePatch(diff, newData.size(), options.format);
+	} catch (std::exception& e) {
+		fprintf(stderr, "Unable to diff %s: %s\n", entry.name.string().c_str(), e.what());
+		return false;
+	}
+
+	if (options.dry) {
+		return true;
+	}
+
+	fs::path path = options.output / "patches" / (entry.name.string() + ".patch");
+	std::error_code ec;
+	fs::create_directories(path.parent_path(), ec);
+	if (ec || !WriteFile(path, patch)) {
+		fprintf(stderr, "Unable to write %s\n", path.string().c_str());
+		return false;
+	}
+
+	return true;
+}
+
+/* Diff the files on up to options.jobs threads. Largest files start first
+ * so that they do not end up alone at the end of the run.
+ */
+static bool GeneratePatches(Options const& options, std::vector<PatchEntry>& entries) {
+	std::vector<PatchEntry*> order;
+	for (PatchEntry& entry : entries) {
+		order.push_back(&entry);
+	}
+
+	std::stable_sort(order.begin(), order.end(), [](PatchEntry const* lhs, PatchEntry const* rhs) {
+		return lhs->cost > rhs->cost;
+	});
+
+	unsigned int threads = options.jobs;
+	if (threads == 0) {
+		threads = std::max(1u, std::thread::hardware_concurrency());
+	}
+
+	threads = (unsigned int)std::min<size_t>(threads, order.size());
+
+	std::atomic<size_t> next = 0;
+	std::mutex outputMutex;
+	auto worker = [&]() {
+		for (;;) {
+			size_t position = next.fetch_add(1, std::memory_order_relaxed);
+			if (position >= order.size()) {
+				return;
+			}
+
+			PatchEntry& entry = *order[position];
+			{
+				std::unique_lock<std::mutex> lck(outputMutex);
+				printf("Generating patch for %s\n", entry.name.string().c_str());
+			}
+
+			entry.ok = GeneratePatch(options, entry);
+		}
+	};
+
+	std::vector<std::thread> pool;
+	for (unsigned int i = 1; i < threads; ++i) {
+		pool.emplace_back(worker);
+	}
+
+	worker();
+	for (std::thread& thread : pool) {
+		thread.join();
+	}
+
+	return std::all_of(entries.begin(), entries.end(), [](PatchEntry const& entry) { return entry.ok; });
+}
+
+static bool WriteManifest(Options const& options, std::vector<fs::path> const& deleted,
+	std::vector<fs::path> const& created, std::vector<std::string> const& createdHashes,
+	std::vector<PatchEntry> const& patched) {
+	rapidjson::StringBuffer buffer;
+	rapidjson::PrettyWriter<rapidjson::StringBuffer> writer(buffer);
+	writer.SetIndent(' ', 2);
+
+	writer.StartObject();
+	writer.Key("delete");
+	writer.StartArray();
+	for (fs::path const& name : deleted) {
+		writer.String(name.string().c_str());
+	}
+	writer.EndArray();
+
+	writer.Key("create");
+	writer.StartObject();
+	for (size_t i = 0; i < created.size(); ++i) {
+		writer.Key(created[i].string().c_str());
+		writer.StartObject();
+		writer.Key("source");
+		writer.String((fs::path("create") / created[i]).generic_string().c_str());
+		writer.Key("post");
+		writer.String(createdHashes[i].c_str());
+		writer.EndObject();
+	}
+	writer.EndObject();
+
+	writer.Key("patch");
+	writer.StartArray();
+	for (PatchEntry const& entry : patched) {
+		writer.StartObject();
+		writer.Key("file");
+		writer.String(entry.name.string().c_str());
+		writer.Key("pre");
+		writer.String(entry.pre.c_str());
+		writer.Key("post");
+		writer.String(entry.post.c_str());
+		writer.EndObject();
+	}
+	writer.EndArray();
+	writer.EndObject();
+
+	printf("Generating manifest file\n");
+	if (options.dry) {
+		return true;
+	}
+
+	std::ofstream manifest(options.output / "manifest.json", std::ios::binary | std::ios::trunc);
+	manifest << buffer.GetString();
+	return manifest.good();
+}
+
+/* Apply the generated patch to a copy of the source folder with the
+ * launcher's own PatchFolder, and check that the result has exactly the
+ * files of the target folder, with the same content.
+ */
+static bool Verify(Options const& options) {
+	fs::path copy = options.output;
+	copy += ".verify";
+
+	printf("Verifying patch in %s\n", copy.string().c_str());
+	std::error_code ec;
+	fs::remove_all(copy, ec);
+	fs::copy(options.source, copy, fs::copy_options::recursive, ec);
+	if (ec) {
+		fprintf(stderr, "Unable to copy %s: %s\n", options.source.string().c_str(), ec.message().c_str());
+		return false;
+	}
+
+	std::vector<diff_patcher::PatchError> errors;
+	diff_patcher::PatchFolderResult result = diff_patcher::PatchFolder(copy, options.output, &errors, options.jobs);
+	if (result != diff_patcher::PATCH_OK) {
+		fprintf(stderr, "PatchFolder failed (%d)\n", result);
+		for (diff_patcher::PatchError const& error : errors) {
+			fprintf(stderr, "  %s: operation %d, error %d\n", error.name.c_str(), error.op, error.code);
+		}
+
+		return false;
+	}
+
+	std::set<fs::path> patched = RelativeFiles(copy);
+	std::set<fs::path> expected = RelativeFiles(options.target);
+	bool ok = true;
+	for (fs::path const& name : patched) {
+		if (!expected.count(name)) {
+			fprintf(stderr, "Extraneous file %s\n", name.string().c_str());
+			ok = false;
+		}
+	}
+
+	std::vector<fs::path> common;
+	for (fs::path const& name : expected) {
+		if (!patched.count(name)) {
+			fprintf(stderr, "Missing file %s\n", name.string().c_str());
+			ok = false;
+		} else {
+			common.push_back(name);
+		}
+	}
+
+	std::vector<std::string> patchedHashes, expectedHashes;
+	if (!HashAll(copy, common, patchedHashes, options.jobs) ||
+		!HashAll(options.target, common, expectedHashes, options.jobs)) {
+		return false;
+	}
+
+	for (size_t i = 0; i < common.size(); ++i) {
+		if (patchedHashes[i] != expectedHashes[i]) {
+			fprintf(stderr, "Content mismatch on %s\n", common[i].string().c_str());
+			ok = false;
+		}
+	}
+
+	if (ok) {
+		printf("Patch verified: %zu files match the target\n", expected.size());
+		fs::remove_all(copy, ec);
+	} else {
+		fprintf(stderr, "Verification failed, patched copy left in %s\n", copy.string().c_str());
+	}
+
+	return ok;
+}
+
+int main(int argc, char** argv) {
+	Options options;
+	if (!ParseArgs(argc, argv, options)) {
+		Usage(argv[0]);
+		return 1;
+	}
+
+	Logger::Init("patchgen.log", false);
+	if (options.dry) {
+		printf("Performing a dry run\n");
+	}
+
+	if (!HandleOutputFolder(options)) {
+		return 1;
+	}
+
+	std::set<fs::path> sourceFiles, targetFiles;
+	try {
+		sourceFiles = RelativeFiles(options.source);
+		targetFiles = RelativeFiles(options.target);
+	} catch (fs::filesystem_error& e) {
+		fprintf(stderr, "%s\n", e.what());
+		return 1;
+	}
+
+	std::vector<fs::path> deleted, created, common;
+	std::set_difference(sourceFiles.begin(), sourceFiles.end(), targetFiles.begin(), targetFiles.end(),
+		std::back_inserter(deleted));
+	std::set_difference(targetFiles.begin(), targetFiles.end(), sourceFiles.begin(), sourceFiles.end(),
+		std::back_inserter(created));
+	std::set_intersection(sourceFiles.begin(), sourceFiles.end(), targetFiles.begin(), targetFiles.end(),
+		std::back_inserter(common));
+
+	std::vector<std::string> preHashes, postHashes, createdHashes;
+	if (!HashAll(options.source, common, preHashes, options.jobs) ||
+		!HashAll(options.target, common, postHashes, options.jobs) ||
+		!HashAll(options.target, created, createdHashes, options.jobs)) {
+		return 1;
+	}
+
+	std::vector<PatchEntry> patched;
+	for (size_t i = 0; i < common.size(); ++i) {
+		if (preHashes[i] == postHashes[i]) {
+			continue;
+		}
+
+		PatchEntry entry;
+		entry.name = common[i];
+		entry.pre = preHashes[i];
+		entry.post = postHashes[i];
+
+		/* Building the suffix array of the old file dominates. */
+		std::error_code ec;
+		uintmax_t size = fs::file_size(options.source / entry.name, ec);
+		entry.cost = ec ? 0 : size;
+		patched.push_back(std::move(entry));
+	}
+
+	if (!GeneratePatches(options, patched)) {
+		fprintf(stderr, "Some patches could not be generated\n");
+		return 1;
+	}
+
+	for (fs::path const& name : created) {
+		printf("Generating creation patch for %s\n", name.string().c_str());
+		if (options.dry) {
+			continue;
+		}
+
+		fs::path destination = options.output / "create" / name;
+		std::error_code ec;
+		fs::create_directories(destination.parent_path(), ec);
+		fs::copy_file(options.target / name, destination, fs::copy_options::overwrite_existing, ec);
+		if (ec) {
+			fprintf(stderr, "Unable to copy %s: %s\n", name.string().c_str(), ec.message().c_str());
+			return 1;
+		}
+	}
+
+	if (!WriteManifest(options, deleted, created, createdHashes, patched)) {
+		fprintf(stderr, "Unable to write the manifest\n");
+		return 1;
+	}
+
+	printf("Patch created at %s\n", options.output.string().c_str());
+	if (options.verify && !Verify(options)) {
+		return 1;
+	}
+
+	return 0;
+}
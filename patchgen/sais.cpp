@@ -0,0 +1,172 @@
+#include <algorithm>
+#include <stdexcept>
+
+#include "patchgen/sais.h"
+
+namespace patchgen {
+	/* Bit vector of suffix types: true for S-type, false for L-type. */
+	typedef std::vector<uint8_t> Types;
+
+	static inline bool IsLMS(Types const& t, int32_t i) {
+		return i > 0 && t[i] && !t[i - 1];
+	}
+
+	/* Compute the start (end = false) or end (end = true) of each bucket. */
+	static void GetBuckets(const int32_t* s, int32_t n, int32_t k, std::vector<int32_t>& buckets, bool end) {
+		std::fill(buckets.begin(), buckets.end(), 0);
+		for (int32_t i = 0; i < n; ++i) {
+			++buckets[s[i]];
+		}
+
+		int32_t sum = 0;
+		for (int32_t i = 0; i < k; ++i) {
+			sum += buckets[i];
+			buckets[i] = end ? sum : sum - buckets[i];
+		}
+	}
+
+	static void InduceL(Types const& t, int32_t* sa, const int32_t* s, int32_t n, int32_t k,
+		std::vector<int32_t>& buckets) {
+		GetBuckets(s, n, k, buckets, false);
+		for (int32_t i = 0; i < n; ++i) {
+			int32_t j = sa[i] - 1;
+			if (j >= 0 && !t[j]) {
+				sa[buckets[s[j]]++] = j;
+			}
+		}
+	}
+
+	static void InduceS(Types const& t, int32_t* sa, const int32_t* s, int32_t n, int32_t k,
+		std::vector<int32_t>& buckets) {
+		GetBuckets(s, n, k, buckets, true);
+		for (int32_t i = n - 1; i >= 0; --i) {
+			int32_t j = sa[i] - 1;
+			if (j >= 0 && t[j]) {
+				sa[--buckets[s[j]]] = j;
+			}
+		}
+	}
+
+	/* s holds n symbols in [0, k), the last one being a unique 0 sentinel. */
+	static void SAIS(const int32_t* s, int32_t* sa, int32_t n, int32_t k) {
+		Types t(n);
+		t[n - 1] = true;
+		if (n > 1) {
+			t[n - 2] = false;
+		}
+
+		for (int32_t i = n - 3; i >= 0; --i) {
+			t[i] = s[i] < s[i + 1] || (s[i] == s[i + 1] && t[i + 1]);
+		}
+
+		/* Stage 1: sort the LMS substrings. */
+		std::vector<int32_t> buckets(k);
+		GetBuckets(s, n, k, buckets, true);
+		std::fill(sa, sa + n, -1);
+		for (int32_t i = 1; i < n; ++i) {
+			if (IsLMS(t, i)) {
+				sa[--buckets[s[i]]] = i;
+			}
+		}
+
+		InduceL(t, sa, s, n, k, buckets);
+		InduceS(t, sa, s, n, k, buckets);
+
+		int32_t n1 = 0;
+		for (int32_t i = 0; i < n; ++i) {
+			if (IsLMS(t, sa[i])) {
+				sa[n1++] = sa[i];
+			}
+		}
+
+		/* Name the LMS substrings, storing the names in the second half. */
+		std::fill(sa + n1, sa + n, -1);
+		int32_t name = 0, previous = -1;
+		for (int32_t i = 0; i < n1; ++i) {
+			int32_t position = sa[i];
+			bool different = false;
+			for (int32_t d = 0; d < n; ++d) {
+				if (previous == -1 || s[position + d] != s[previous + d] || t[position + d] != t[previous + d]) {
+					different = true;
+					break;
+				} else if (d > 0 && (IsLMS(t, position + d) || IsLMS(t, previous + d))) {
+					break;
+				}
+			}
+
+			if (different) {
+				++name;
+				previous = position;
+			}
+
+			sa[n1 + position / 2] = name - 1;
+		}
+
+		for (int32_t i = n - 1, j = n - 1; i >= n1; --i) {
+			if (sa[i] >= 0) {
+				sa[j--] = sa[i];
+			}
+		}
+
+		/* Stage 2: sort the reduced problem, recursing if names are not
+		 * unique yet.
+		 */
+		int32_t* sa1 = sa;
+		int32_t* s1 = sa + n - n1;
+		if (name < n1) {
+			SAIS(s1, sa1, n1, name);
+		} else {
+			for (int32_t i = 0; i < n1; ++i) {
+				sa1[s1[i]] = i;
+			}
+		}
+
+		/* Stage 3: induce the full suffix array from the sorted LMS
+		 * suffixes.
+		 */
+		GetBuckets(s, n, k, buckets, true);
+		for (int32_t i = 1, j = 0; i < n; ++i) {
+			if (IsLMS(t, i)) {
+				s1[j++] = i;
+			}
+		}
+
+		for (int32_t i = 0; i < n1; ++i) {
+			sa1[i] = s1[sa1[i]];
+		}
+
+		std::fill(sa + n1, sa + n, -1);
+		for (int32_t i = n1 - 1; i >= 0; --i) {
+			int32_t j = sa[i];
+			sa[i] = -1;
+			sa[--buckets[s[j]]] = j;
+		}
+
+		InduceL(t, sa, s, n, k, buckets);
+		InduceS(t, sa, s, n, k, buckets);
+	}
+
+	std::vector<int32_t> BuildSuffixArray(const unsigned char* data, size_t size) {
+		if (size >= (size_t)INT32_MAX) {
+			throw std::length_error("file too large for a 32 bits suffix array");
+		}
+
+		/* Shift the bytes by one to make room for the sentinel. */
+		int32_t n = (int32_t)size + 1;
+		std::vector<int32_t> s(n);
+		for (size_t i = 0; i < size; ++i) {
+			s[i] = (int32_t)data[i] + 1;
+		}
+
+		s[size] = 0;
+
+		std::vector<int32_t> sa(n);
+		if (size == 0) {
+			sa[0] = 0;
+			return sa;
+		}
+
+		SAIS(s.data(), sa.data(), n, 257);
+		return sa;
+	}
+}
@@ -5,6 +5,9 @@ import os
 import hashlib
 import json
 import bsdiff4
+import bsdiff4.core
+import struct
+import zlib
 from pathlib import Path
 import shutil
 import sys
@@ -40,10 +43,119 @@ The processing of manifest.json is to be done through a different process.
     parser.add_argument("-o", "--output", metavar="DIR",
                         help="Folder in which to output the resulting patches",
                         default="output", type=Path)
+    parser.add_argument("-f", "--format", choices=["bsdiff", "rgpatch"],
+                        help="Format of the generated patches: BSDIFF40 with "
+                             "bzip2 streams, or RGPATCH1 with zlib "
+                             "compressed blocks that the launcher can "
+                             "decompress in parallel",
+                        default="bsdiff")
+    parser.add_argument("-a", "--annotate", action="store_true",
+                        help="Do not generate patches: add the pre and post "
+                             "hashes to the manifest.json of the existing "
+                             "patchset in the output folder, by applying its "
+                             "patches to the files of the source folder")
 
     return parser.parse_args()
 
 
+# Maximum number of bytes of the new file covered by a block of an RGPATCH1
+# patch.
+RGPATCH_BLOCK_SIZE = 1 << 20
+
+def offtout(x):
+    """Encode x the way BSDIFF40 encodes its control values."""
+    data = bytearray(struct.pack("<Q", abs(x)))
+    if x < 0:
+        data[7] |= 0x80
+    return bytes(data)
+
+def split_control(tcontrol, block_size):
+    """Split control entries so that none produces more than block_size bytes
+    of the new file. The result describes the same transformation."""
+    for x, y, z in tcontrol:
+        while x > block_size:
+            yield (block_size, 0, 0)
+            x -= block_size
+
+        if x + y <= block_size:
+            yield (x, y, z)
+            continue
+
+        if x:
+            yield (x, 0, 0)
+
+        while y > block_size:
+            yield (0, block_size, 0)
+            y -= block_size
+
+        yield (0, y, z)
+
+def rgpatch(tcontrol, bdiff, bextra, block_size=RGPATCH_BLOCK_SIZE):
+    """Build an RGPATCH1 patch from the output of bsdiff4.core.diff. See
+    src/diff_patcher.cpp in the launcher for a description of the format."""
+    blocks = []
+    current = None
+    new_pos = old_pos = diff_pos = extra_pos = 0
+
+    for x, y, z in split_control(tcontrol, block_size):
+        if current is None or current["size"] + x + y > block_size:
+            current = {"ctrl": bytearray(), "data": bytearray(), "count": 0,
+                       "new": new_pos, "old": old_pos, "size": 0}
+            blocks.append(current)
+
+        current["ctrl"] += offtout(x) + offtout(y) + offtout(z)
+        current["data"] += bdiff[diff_pos:diff_pos + x]
+        current["data"] += bextra[extra_pos:extra_pos + y]
+        current["count"] += 1
+        current["size"] += x + y
+        diff_pos += x
+        extra_pos += y
+        new_pos += x + y
+        old_pos += x + z
+
+    compressed = [zlib.compress(bytes(b["ctrl"] + b["data"]), 9) for b in blocks]
+    header = b"RGPATCH1" + struct.pack("<QII", new_pos, len(blocks), 0)
+    index = bytearray()
+    offset = len(header) + 48 * len(blocks)
+    for block, data in zip(blocks, compressed):
+        index += struct.pack("<QQQqQII", offset, len(data), block["new"],
+                             block["old"], block["size"], block["count"], 0)
+        offset += len(data)
+
+    return header + bytes(index) + b"".join(compressed)
+
+def offtin(data):
+    """Decode a control value encoded by offtout."""
+    x = struct.unpack("<Q", data[:7] + bytes([data[7] & 0x7F]))[0]
+    return -x if data[7] & 0x80 else x
+
+def read_rgpatch(patch):
+    """Turn an RGPATCH1 patch back into the arguments of bsdiff4.core.patch."""
+    new_size, count, _ = struct.unpack_from("<QII", patch, 8)
+    tcontrol = []
+    bdiff = bytearray()
+    bextra = bytearray()
+
+    for i in range(count):
+        offset, size, _, _, _, entries, _ = struct.unpack_from("<QQQqQII", patch, 24 + 48 * i)
+        block = zlib.decompress(patch[offset:offset + size])
+        data_pos = 24 * entries
+        for j in range(entries):
+            x, y, z = (offtin(block[24 * j + 8 * k:24 * j + 8 * k + 8]) for k in range(3))
+            tcontrol.append((x, y, z))
+            bdiff += block[data_pos:data_pos + x]
+            bextra += block[data_pos + x:data_pos + x + y]
+            data_pos += x + y
+
+    return new_size, tcontrol, bytes(bdiff), bytes(bextra)
+
+def apply_patch(data, patch):
+    if patch.startswith(b"RGPATCH1"):
+        new_size, tcontrol, bdiff, bextra = read_rgpatch(patch)
+        return bsdiff4.core.patch(data, new_size, tcontrol, bdiff, bextra)
+
+    return bsdiff4.patch(data, patch)
+
 def file_hash(path):
     with open(path, 'rb') as f:
         return hashlib.sha256(f.read()).hexdigest()
@@ -76,14 +188,14 @@ def handle_output_folder(output, force, dry):
     if not dry:
         output.mkdir(parents=True)
 
-def generate_common_files_patches(files, source, target, patch_dir, dry):
+def generate_common_files_patches(files, source, target, patch_dir, dry, fmt):
     to_patch = []
 
     for file in files:
         file_a = source / file
         file_b = target / file
         if file_hash(file_a) != file_hash(file_b):
-            print (f"Generating bsdiff patch for {file}")
+            print (f"Generating {fmt} patch for {file}")
             patch_path = patch_dir / (file.replace("/", "__") + ".patch")
 
             if not dry:
@@ -92,12 +204,19 @@ def generate_common_files_patches(files, source, target, patch_dir, dry):
             with open(file_a, 'rb') as fa, open(file_b, 'rb') as fb:
                 a_data = fa.read()
                 b_data = fb.read()
-                patch = bsdiff4.diff(a_data, b_data)
+                if fmt == "rgpatch":
+                    patch = rgpatch(*bsdiff4.core.diff(a_data, b_data))
+                else:
+                    patch = bsdiff4.diff(a_data, b_data)
 
                 if not dry:
                     patch_path.write_bytes(patch)
 
-            to_patch.append(file)
+            to_patch.append({
+                "file": file,
+                "pre": file_hash(file_a),
+                "post": file_hash(file_b)
+            })
 
     return to_patch
 
@@ -113,11 +232,14 @@ def generate_created_files_patches(files, target, output, dry):
             dst.parent.mkdir(parents=True, exist_ok=True)
             shutil.copy2(src, dst)
 
-        result[file] = str((Path("create") / file).as_posix())
+        result[file] = {
+            "source": str((Path("create") / file).as_posix()),
+            "post": file_hash(src)
+        }
 
     return result
 
-def main(source, target, output, dry, force):
+def main(source, target, output, dry, force, fmt):
     if dry:
         print ("Performing a dry run")
 
@@ -139,7 +261,7 @@ def main(source, target, output, dry, force):
     if not dry:
         patch_dir.mkdir()
 
-    to_patch = generate_common_files_patches(common, source, target, patch_dir, dry)
+    to_patch = generate_common_files_patches(common, source, target, patch_dir, dry, fmt)
     created_patch = generate_created_files_patches(created, target, output, dry)
 
     patch_manifest = {
@@ -155,6 +277,53 @@ def main(source, target, output, dry, force):
 
     print(f"Patch created at {output}")
 
+def annotate(source, output, dry):
+    """Add the hashes the launcher verifies to the manifest of a patchset that
+    was generated without them, leaving the patches themselves untouched."""
+    source = Path(source)
+    output = Path(output)
+
+    with open(output / "manifest.json") as f:
+        manifest = json.load(f)
+
+    patched = []
+    for entry in manifest.get("patch", []):
+        file = entry if isinstance(entry, str) else entry["file"]
+        local = Path(file.replace("\\", "/"))
+        print (f"Hashing {file}")
+
+        data = (source / local).read_bytes()
+        # The shipped patches mirror the hierarchy of the game folder, the ones
+        # generated by main flatten it.
+        patch_path = output / "patches" / local.with_name(local.name + ".patch")
+        if not patch_path.exists():
+            patch_path = output / "patches" / (local.as_posix().replace("/", "__") + ".patch")
+        patch = patch_path.read_bytes()
+        patched.append({
+            "file": file,
+            "pre": hashlib.sha256(data).hexdigest(),
+            "post": hashlib.sha256(apply_patch(data, patch)).hexdigest()
+        })
+
+    created = {}
+    for file, entry in manifest.get("create", {}).items():
+        name = entry if isinstance(entry, str) else entry["source"]
+        created[file] = {
+            "source": name,
+            "post": file_hash(output / name.replace("\\", "/"))
+        }
+
+    manifest["patch"] = patched
+    manifest["create"] = created
+
+    print ("Updating manifest file")
+    if not dry:
+        with open(output / "manifest.json", "w") as f:
+            json.dump(manifest, f, indent=2)
+
 if __name__ == "__main__":
     args = parse_args()
-    main(args.source, args.target, args.output, args.dry_run, args.yes)
+    if args.annotate:
+        annotate(args.source, args.output, args.dry_run)
+    else:
+        main(args.source, args.target, args.output, args.dry_run, args.yes, args.format)
@@ -101,6 +101,10 @@ namespace Updater {
 						Logger::Info("[%s] Successfully downloaded content from %s\n", s->name.c_str(), std::get<std::string>(message->data).c_str());
 						break;
 
+					case curl::DOWNLOAD_RETRY:
+						Logger::Warn("[%s] Retrying cURL request to %s\n", s->name.c_str(), std::get<std::string>(message->data).c_str());
+						break;
+
 					default:
 						Logger::Error("[%s] Unexpected asynchronous notification (id = %d)\n", s->name.c_str(), message->type);
 						break;
@@ -1,6 +1,7 @@
 #include <iostream>
 #include <sstream>
 
+#include "shared/github_executor.h"
 #include "shared/logger.h"
 #include "shared/scoped_file.h"
 #include "shared/sha256.h"
@@ -22,6 +23,8 @@ namespace Updater {
 		Github::GenerateGithubHeaders(request);
 		request.maxSpeed = request.timeout = request.serverTimeout = 0;
 		request.url = _url;
+		request.cache = true;
+		request.retry.attempts = Github::REQUEST_ATTEMPTS;
 
 		Github::FetchReleaseInfo(request, _releaseInfo, &_releaseDownloadResult, "launcher releases info");
 		if (_releaseDownloadResult != curl::DOWNLOAD_STRING_OK) {
@@ -55,10 +58,15 @@ namespace Updater {
 		curl::RequestParameters request;
 		request.maxSpeed = request.serverTimeout = request.timeout = 0;
 		request.url = data->_hashUrl;
+		request.retry.attempts = Github::REQUEST_ATTEMPTS;
 		Github::GenerateGithubHeaders(request);
 
 		data->_hashDownloadDesc = curl::AsyncDownloadString(request, "update hash");
 		request.url = data->_zipUrl;
+		request.priority = curl::REQUEST_PRIORITY_LOW;
+		request.resume = true;
+		/* As many segments as a low priority request can run at once. */
+		request.segments = GithubExecutor::DEFAULT_MAX_TRANSFERS - 1;
 		data->_zipDownloadDesc = curl::AsyncDownloadFile(request, data->_zipFilename);
 	}
 
@@ -0,0 +1,217 @@
+#include <cstdint>
+#include <cstring>
+
+#if defined(_M_IX86) || defined(_M_X64) || defined(__i386__) || defined(__x86_64__)
+#define BYTE_SEARCH_X86 1
+#if defined(_MSC_VER)
+#include <intrin.h>
+#else
+#include <immintrin.h>
+#endif
+#endif
+
+#if defined(BYTE_SEARCH_X86) && !defined(_MSC_VER)
+#define BYTE_SEARCH_TARGET(x) __attribute__((target(x)))
+#else
+#define BYTE_SEARCH_TARGET(x)
+#endif
+
+#include "shared/byte_search.h"
+#include "shared/cpu_features.h"
+
+namespace ByteSearch {
+	enum Backend {
+		BACKEND_SCALAR,
+		BACKEND_SSE2,
+		BACKEND_AVX2
+	};
+
+	static Backend DetectBackend() {
+#ifdef BYTE_SEARCH_X86
+		CPU::Features const& features = CPU::GetFeatures();
+		if (features.avx2) {
+			return BACKEND_AVX2;
+		}
+
+		if (features.sse2) {
+			return BACKEND_SSE2;
+		}
+#endif
+		return BACKEND_SCALAR;
+	}
+
+	static Backend GetBackend() {
+		static Backend backend = DetectBackend();
+		return backend;
+	}
+
+	/* Each scanner reports the offsets at which needle occurs, starting from
+	 * offset, to onMatch until it returns false. They return false if they
+	 * were stopped, true otherwise, and leave offset on the first position
+	 * they did not check.
+	 */
+	template<typename F>
+	static bool ScanScalar(const unsigned char* haystack, size_t size, const unsigned char* needle,
+		size_t needleSize, size_t& offset, F& onMatch) {
+		size_t lastOffset = size - needleSize;
+		while (offset <= lastOffset) {
+			const unsigned char* candidate = (const unsigned char*)memchr(haystack + offset, needle[0],
+				lastOffset - offset + 1);
+			if (!candidate) {
+				offset = lastOffset + 1;
+				break;
+			}
+
+			offset = candidate - haystack;
+			if (!memcmp(candidate, needle, needleSize) && !onMatch(offset)) {
+				++offset;
+				return false;
+			}
+
+			++offset;
+		}
+
+		return true;
+	}
+
+#ifdef BYTE_SEARCH_X86
+	static inline unsigned int CountTrailingZeros(uint32_t value) {
+#if defined(_MSC_VER)
+		unsigned long index;
+		_BitScanForward(&index, value);
+		return index;
+#else
+		return __builtin_ctz(value);
+#endif
+	}
+
+	/* Check the candidates of mask, relative to base, in increasing order. */
+	template<typename F>
+	static inline bool CheckCandidates(const unsigned char* haystack, size_t base, uint32_t mask,
+		const unsigned char* needle, size_t needleSize, F& onMatch) {
+		while (mask) {
+			size_t candidate = base + CountTrailingZeros(mask);
+			/* The first and last bytes are already known to match. */
+			if ((needleSize <= 2 || !memcmp(haystack + candidate + 1, needle + 1, needleSize - 2)) &&
+				!onMatch(candidate)) {
+				return false;
+			}
+
+			mask &= mask - 1;
+		}
+
+		return true;
+	}
+
+	template<typename F>
+	BYTE_SEARCH_TARGET("sse2")
+	static bool ScanSSE2(const unsigned char* haystack, size_t size, const unsigned char* needle,
+		size_t needleSize, size_t& offset, F& onMatch) {
+		const __m128i first = _mm_set1_epi8((char)needle[0]);
+		const __m128i last = _mm_set1_epi8((char)needle[needleSize - 1]);
+
+		for (; size - offset >= 16 + needleSize - 1; offset += 16) {
+			__m128i blockFirst = _mm_loadu_si128((const __m128i*)(haystack + offset));
+			__m128i blockLast = _mm_loadu_si128((const __m128i*)(haystack + offset + needleSize - 1));
+			__m128i eq = _mm_and_si128(_mm_cmpeq_epi8(blockFirst, first), _mm_cmpeq_epi8(blockLast, last));
+			uint32_t mask = (uint32_t)_mm_movemask_epi8(eq);
+			if (mask && !CheckCandidates(haystack, offset, mask, needle, needleSize, onMatch)) {
+				return false;
+			}
+		}
+
+		return true;
+	}
+
+	template<typename F>
+	BYTE_SEARCH_TARGET("avx2")
+	static bool ScanAVX2(const unsigned char* haystack, size_t size, const unsigned char* needle,
+		size_t needleSize, size_t& offset, F& onMatch) {
+		const __m256i first = _mm256_set1_epi8((char)needle[0]);
+		const __m256i last = _mm256_set1_epi8((char)needle[needleSize - 1]);
+
+		for (; size - offset >= 32 + needleSize - 1; offset += 32) {
+			__m256i blockFirst = _mm256_loadu_si256((const __m256i*)(haystack + offset));
+			__m256i blockLast = _mm256_loadu_si256((const __m256i*)(haystack + offset + needleSize - 1));
+			__m256i eq = _mm256_and_si256(_mm256_cmpeq_epi8(blockFirst, first), _mm256_cmpeq_epi8(blockLast, last));
+			uint32_t mask = (uint32_t)_mm256_movemask_epi8(eq);
+			if (mask && !CheckCandidates(haystack, offset, mask, needle, needleSize, onMatch)) {
+				return false;
+			}
+		}
+
+		return true;
+	}
+#endif
+
+	template<typename F>
+	static void Scan(const void* haystack, size_t size, const void* needle, size_t needleSize, F onMatch) {
+		if (needleSize == 0) {
+			onMatch(0);
+			return;
+		}
+
+		if (needleSize > size) {
+			return;
+		}
+
+		const unsigned char* h = (const unsigned char*)haystack;
+		const unsigned char* n = (const unsigned char*)needle;
+		size_t offset = 0;
+
+#ifdef BYTE_SEARCH_X86
+		switch (GetBackend()) {
+		case BACKEND_AVX2:
+			if (!ScanAVX2(h, size, n, needleSize, offset, onMatch)) {
+				return;
+			}
+			break;
+
+		case BACKEND_SSE2:
+			if (!ScanSSE2(h, size, n, needleSize, offset, onMatch)) {
+				return;
+			}
+			break;
+
+		default:
+			break;
+		}
+#endif
+
+		/* Whatever is too short for a full vector. */
+		ScanScalar(h, size, n, needleSize, offset, onMatch);
+	}
+
+	size_t Find(const void* haystack, size_t size, const void* needle, size_t needleSize) {
+		size_t result = NOT_FOUND;
+		Scan(haystack, size, needle, needleSize, [&](size_t offset) {
+			result = offset;
+			return false;
+		});
+
+		return result;
+	}
+
+	std::vector<size_t> FindAll(const void* haystack, size_t size, const void* needle, size_t needleSize) {
+		std::vector<size_t> result;
+		Scan(haystack, size, needle, needleSize, [&](size_t offset) {
+			result.push_back(offset);
+			return true;
+		});
+
+		return result;
+	}
+
+	const char* GetBackendName() {
+		switch (GetBackend()) {
+		case BACKEND_AVX2:
+			return "avx2";
+
+		case BACKEND_SSE2:
+			return "sse2";
+
+		default:
+			return "scalar";
+		}
+	}
+}
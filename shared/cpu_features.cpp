@@ -0,0 +1,76 @@
+#if defined(_MSC_VER)
+#include <intrin.h>
+#elif defined(__i386__) || defined(__x86_64__)
+#include <cpuid.h>
+#endif
+
+#include <cstdint>
+
+#include "shared/cpu_features.h"
+
+namespace CPU {
+#if defined(_M_IX86) || defined(_M_X64) || defined(__i386__) || defined(__x86_64__)
+	static void CpuId(uint32_t leaf, uint32_t subleaf, uint32_t regs[4]) {
+#if defined(_MSC_VER)
+		int out[4];
+		__cpuidex(out, (int)leaf, (int)subleaf);
+		for (int i = 0; i < 4; ++i) {
+			regs[i] = (uint32_t)out[i];
+		}
+#else
+		__cpuid_count(leaf, subleaf, regs[0], regs[1], regs[2], regs[3]);
+#endif
+	}
+
+	static uint64_t XGetBV() {
+#if defined(_MSC_VER)
+		return _xgetbv(0);
+#else
+		uint32_t eax, edx;
+		__asm__ volatile ("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+		return ((uint64_t)edx << 32) | eax;
+#endif
+	}
+
+	static Features Detect() {
+		Features features;
+		uint32_t regs[4] = { 0 };
+
+		CpuId(0, 0, regs);
+		uint32_t maxLeaf = regs[0];
+		if (maxLeaf < 1) {
+			return features;
+		}
+
+		CpuId(1, 0, regs);
+		features.sse2 = (regs[3] >> 26) & 1;
+		features.ssse3 = (regs[2] >> 9) & 1;
+		features.sse41 = (regs[2] >> 19) & 1;
+		features.sse42 = (regs[2] >> 20) & 1;
+		features.pclmul = (regs[2] >> 1) & 1;
+
+		/* AVX registers are only usable if the OS saves them on context
+		 * switches: check OSXSAVE, then check XCR0 for XMM and YMM state.
+		 */
+		bool osxsave = (regs[2] >> 27) & 1;
+		bool avxState = osxsave && (XGetBV() & 0x6) == 0x6;
+
+		if (maxLeaf >= 7) {
+			CpuId(7, 0, regs);
+			features.avx2 = avxState && ((regs[1] >> 5) & 1);
+			features.sha = (regs[1] >> 29) & 1;
+		}
+
+		return features;
+	}
+#else
+	static Features Detect() {
+		return Features();
+	}
+#endif
+
+	Features const& GetFeatures() {
+		static Features features = Detect();
+		return features;
+	}
+}
@@ -0,0 +1,200 @@
+#include <cstdint>
+#include <cstring>
+
+#if defined(_M_IX86) || defined(_M_X64) || defined(__i386__) || defined(__x86_64__)
+#define CRC32_X86 1
+#if defined(_MSC_VER)
+#include <intrin.h>
+#else
+#include <immintrin.h>
+#endif
+#endif
+
+#if defined(CRC32_X86) && !defined(_MSC_VER)
+#define CRC32_TARGET(x) __attribute__((target(x)))
+#else
+#define CRC32_TARGET(x)
+#endif
+
+#include "shared/cpu_features.h"
+#include "shared/crc32.h"
+
+namespace Crc32 {
+	/* Reflected CRC-32 polynomial. */
+	static constexpr uint32_t POLYNOMIAL = 0xEDB88320;
+
+	/* Slicing-by-8 tables: _table[k][b] is the CRC of byte b followed by k
+	 * zero bytes.
+	 */
+	struct Tables {
+		uint32_t table[8][256];
+
+		constexpr Tables() : table() {
+			for (uint32_t i = 0; i < 256; ++i) {
+				uint32_t crc = i;
+				for (int j = 0; j < 8; ++j) {
+					crc = crc & 1 ? (crc >> 1) ^ POLYNOMIAL : crc >> 1;
+				}
+
+				table[0][i] = crc;
+			}
+
+			for (uint32_t i = 0; i < 256; ++i) {
+				for (int k = 1; k < 8; ++k) {
+					table[k][i] = (table[k - 1][i] >> 8) ^ table[0][table[k - 1][i] & 0xFF];
+				}
+			}
+		}
+	};
+
+	static constexpr Tables _tables;
+
+	/* Works on the inverted CRC, as the kernels below. */
+	static uint32_t UpdateTable(uint32_t crc, const unsigned char* data, size_t size) {
+		auto const& t = _tables.table;
+		while (size >= 8) {
+			uint32_t low, high;
+			memcpy(&low, data, 4);
+			memcpy(&high, data + 4, 4);
+			low ^= crc;
+			crc = t[7][low & 0xFF] ^ t[6][(low >> 8) & 0xFF] ^ t[5][(low >> 16) & 0xFF] ^ t[4][low >> 24] ^
+				t[3][high & 0xFF] ^ t[2][(high >> 8) & 0xFF] ^ t[1][(high >> 16) & 0xFF] ^ t[0][high >> 24];
+			data += 8;
+			size -= 8;
+		}
+
+		while (size--) {
+			crc = (crc >> 8) ^ t[0][(crc ^ *data++) & 0xFF];
+		}
+
+		return crc;
+	}
+
+#ifdef CRC32_X86
+	/* Fold 64 bytes at a time with carry-less multiplications, then reduce
+	 * with Barrett's method. See Intel's "Fast CRC Computation for Generic
+	 * Polynomials Using PCLMULQDQ Instruction". The constants are those of
+	 * the paper for the reflected CRC-32 polynomial.
+	 *
+	 * size must be a multiple of 16, and at least 64.
+	 */
+	CRC32_TARGET("pclmul,sse4.1")
+	static uint32_t UpdatePCLMUL(uint32_t crc, const unsigned char* data, size_t size) {
+		alignas(16) static const uint64_t k1k2[] = { 0x0154442bd4, 0x01c6e41596 };
+		alignas(16) static const uint64_t k3k4[] = { 0x01751997d0, 0x00ccaa009e };
+		alignas(16) static const uint64_t k5k0[] = { 0x0163cd6124, 0x0000000000 };
+		alignas(16) static const uint64_t poly[] = { 0x01db710641, 0x01f7011641 };
+
+		__m128i x0, x1, x2, x3, x4, x5, x6, x7, x8;
+
+		x1 = _mm_loadu_si128((const __m128i*)(data + 0x00));
+		x2 = _mm_loadu_si128((const __m128i*)(data + 0x10));
+		x3 = _mm_loadu_si128((const __m128i*)(data + 0x20));
+		x4 = _mm_loadu_si128((const __m128i*)(data + 0x30));
+		x1 = _mm_xor_si128(x1, _mm_cvtsi32_si128((int)crc));
+		x0 = _mm_load_si128((const __m128i*)k1k2);
+		data += 64;
+		size -= 64;
+
+		while (size >= 64) {
+			x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+			x6 = _mm_clmulepi64_si128(x2, x0, 0x00);
+			x7 = _mm_clmulepi64_si128(x3, x0, 0x00);
+			x8 = _mm_clmulepi64_si128(x4, x0, 0x00);
+
+			x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+			x2 = _mm_clmulepi64_si128(x2, x0, 0x11);
+			x3 = _mm_clmulepi64_si128(x3, x0, 0x11);
+			x4 = _mm_clmulepi64_si128(x4, x0, 0x11);
+
+			x1 = _mm_xor_si128(_mm_xor_si128(x1, x5), _mm_loadu_si128((const __m128i*)(data + 0x00)));
+			x2 = _mm_xor_si128(_mm_xor_si128(x2, x6), _mm_loadu_si128((const __m128i*)(data + 0x10)));
+			x3 = _mm_xor_si128(_mm_xor_si128(x3, x7), _mm_loadu_si128((const __m128i*)(data + 0x20)));
+			x4 = _mm_xor_si128(_mm_xor_si128(x4, x8), _mm_loadu_si128((const __m128i*)(data + 0x30)));
+
+			data += 64;
+			size -= 64;
+		}
+
+		/* Fold the four lanes into one. */
+		x0 = _mm_load_si128((const __m128i*)k3k4);
+
+		x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+		x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+		x1 = _mm_xor_si128(_mm_xor_si128(x1, x2), x5);
+
+		x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+		x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+		x1 = _mm_xor_si128(_mm_xor_si128(x1, x3), x5);
+
+		x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+		x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+		x1 = _mm_xor_si128(_mm_xor_si128(x1, x4), x5);
+
+		while (size >= 16) {
+			x2 = _mm_loadu_si128((const __m128i*)data);
+			x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+			x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+			x1 = _mm_xor_si128(_mm_xor_si128(x1, x2), x5);
+			data += 16;
+			size -= 16;
+		}
+
+		/* Fold 128 bits to 64. */
+		x2 = _mm_clmulepi64_si128(x1, x0, 0x10);
+		x3 = _mm_setr_epi32(~0, 0, ~0, 0);
+		x1 = _mm_srli_si128(x1, 8);
+		x1 = _mm_xor_si128(x1, x2);
+
+		x0 = _mm_loadl_epi64((const __m128i*)k5k0);
+		x2 = _mm_srli_si128(x1, 4);
+		x1 = _mm_and_si128(x1, x3);
+		x1 = _mm_clmulepi64_si128(x1, x0, 0x00);
+		x1 = _mm_xor_si128(x1, x2);
+
+		/* Barrett reduction to 32 bits. */
+		x0 = _mm_load_si128((const __m128i*)poly);
+		x2 = _mm_and_si128(x1, x3);
+		x2 = _mm_clmulepi64_si128(x2, x0, 0x10);
+		x2 = _mm_and_si128(x2, x3);
+		x2 = _mm_clmulepi64_si128(x2, x0, 0x00);
+		x1 = _mm_xor_si128(x1, x2);
+
+		return (uint32_t)_mm_extract_epi32(x1, 1);
+	}
+#endif
+
+	static bool UsePCLMUL() {
+#ifdef CRC32_X86
+		CPU::Features const& features = CPU::GetFeatures();
+		return features.pclmul && features.sse41;
+#else
+		return false;
+#endif
+	}
+
+	/* false until static initialization has run, Update is correct either
+	 * way.
+	 */
+	static const bool _pclmul = UsePCLMUL();
+
+	uint32_t Update(uint32_t crc, const void* data, size_t size) {
+		const unsigned char* bytes = (const unsigned char*)data;
+		crc = ~crc;
+
+#ifdef CRC32_X86
+		if (_pclmul && size >= 64) {
+			size_t chunk = size & ~(size_t)15;
+			crc = UpdatePCLMUL(crc, bytes, chunk);
+			bytes += chunk;
+			size -= chunk;
+		}
+#endif
+
+		return ~UpdateTable(crc, bytes, size);
+	}
+
+	const char* GetBackendName() {
+		return _pclmul ? "pclmul" : "table";
+	}
+}
@@ -3,18 +3,31 @@
 #include "shared/curl/abstract_response_handler.h"
 
 size_t AbstractCurlResponseHandler::OnData(void* data, size_t size, size_t n) {
+	if (_limit && size * n > _limit - _received) {
+		size = 1;
+		n = (size_t)(_limit - _received);
+		if (!n) {
+			return CURL_WRITEFUNC_ERROR;
+		}
+	}
+
 	for (OnDataHandlerFn const& fn : _hooks) {
 		if (!fn(!_firstReceived, data, size, n)) {
 			return CURL_WRITEFUNC_ERROR;
 		}
 	}
 
+	size_t consumed;
 	if (!_firstReceived) {
 		_firstReceived = true;
-		return OnFirstData(data, size, n);
+		consumed = OnFirstData(data, size, n);
 	} else {
-		return OnNewData(data, size, n);
+		consumed = OnNewData(data, size, n);
 	}
+
+	/* curl always gives data as bytes (size is 1). */
+	_received += consumed;
+	return consumed;
 }
 
 size_t AbstractCurlResponseHandler::ResponseSkeleton(void* data, size_t size, size_t n,
@@ -25,4 +38,8 @@ size_t AbstractCurlResponseHandler::ResponseSkeleton(void* data, size_t size, si
 
 void AbstractCurlResponseHandler::RegisterHook(OnDataHandlerFn fn) {
 	_hooks.push_back(fn);
+}
+
+void AbstractCurlResponseHandler::SetLimit(uint64_t limit) {
+	_limit = limit;
 }
\ No newline at end of file
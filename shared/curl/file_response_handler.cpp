@@ -1,7 +1,20 @@
 #include "shared/curl/file_response_handler.h"
 
-CurlFileResponse::CurlFileResponse(std::string const& name) {
-	_f = fopen(name.c_str(), "wb");
+CurlFileResponse::CurlFileResponse(std::string const& name) : CurlFileResponse(name, false) {
+
+}
+
+CurlFileResponse::CurlFileResponse(std::string const& name, bool append) : _name(name) {
+	if (!append) {
+		_f = fopen(name.c_str(), "wb");
+		return;
+	}
+
+	_f = fopen(name.c_str(), "r+b");
+	if (_f && fseek(_f, 0, SEEK_END)) {
+		fclose(_f);
+		_f = NULL;
+	}
 }
 
 CurlFileResponse::~CurlFileResponse() {
@@ -21,6 +34,18 @@ FILE* CurlFileResponse::GetFile() const {
 	return _f;
 }
 
+bool CurlFileResponse::Truncate() {
+	if (!_f)
+		return false;
+
+	_f = freopen(_name.c_str(), "wb", _f);
+	return _f != NULL;
+}
+
+bool CurlFileResponse::Seek(uint64_t offset) {
+	return _f && !_fseeki64(_f, (long long)offset, SEEK_SET);
+}
+
 size_t CurlFileResponse::Append(void* data, size_t len, size_t n) {
 	return fwrite(data, len, n, _f);
 }
\ No newline at end of file
@@ -0,0 +1,104 @@
+#include <mutex>
+#include <vector>
+
+#include "shared/curl/handle_pool.h"
+#include "shared/logger.h"
+
+namespace curl {
+	class HandlePool {
+	public:
+		/* Handles kept beyond this are freed when released. */
+		static constexpr size_t MAX_IDLE_HANDLES = 8;
+
+		/* Never destroyed, as handles may still be released by other
+		 * threads while the process exits.
+		 */
+		static HandlePool& Instance() {
+			static HandlePool* pool = new HandlePool();
+			return *pool;
+		}
+
+		HandlePool() {
+			curl_global_init(CURL_GLOBAL_DEFAULT);
+
+			_share = curl_share_init();
+			if (!_share) {
+				Logger::Error("curl::HandlePool: unable to create share object, connections will not be reused\n");
+				return;
+			}
+
+			curl_share_setopt(_share, CURLSHOPT_LOCKFUNC, Lock);
+			curl_share_setopt(_share, CURLSHOPT_UNLOCKFUNC, Unlock);
+			curl_share_setopt(_share, CURLSHOPT_USERDATA, this);
+			curl_share_setopt(_share, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+			curl_share_setopt(_share, CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION);
+			curl_share_setopt(_share, CURLSHOPT_SHARE, CURL_LOCK_DATA_CONNECT);
+		}
+
+		CURL* Acquire() {
+			CURL* curl = nullptr;
+			{
+				std::unique_lock<std::mutex> lck(_mutex);
+				if (!_idle.empty()) {
+					curl = _idle.back();
+					_idle.pop_back();
+				}
+			}
+
+			if (!curl) {
+				curl = curl_easy_init();
+				if (!curl) {
+					return nullptr;
+				}
+			}
+
+			if (_share) {
+				curl_easy_setopt(curl, CURLOPT_SHARE, _share);
+			}
+
+			return curl;
+		}
+
+		void Release(CURL* curl) {
+			/* Keeps the connections, the caches and the share. */
+			curl_easy_reset(curl);
+
+			{
+				std::unique_lock<std::mutex> lck(_mutex);
+				if (_idle.size() < MAX_IDLE_HANDLES) {
+					_idle.push_back(curl);
+					return;
+				}
+			}
+
+			curl_easy_cleanup(curl);
+		}
+
+	private:
+		static void Lock(CURL*, curl_lock_data data, curl_lock_access, void* userp) {
+			HandlePool* pool = (HandlePool*)userp;
+			pool->_locks[data < CURL_LOCK_DATA_LAST ? data : CURL_LOCK_DATA_NONE].lock();
+		}
+
+		static void Unlock(CURL*, curl_lock_data data, void* userp) {
+			HandlePool* pool = (HandlePool*)userp;
+			pool->_locks[data < CURL_LOCK_DATA_LAST ? data : CURL_LOCK_DATA_NONE].unlock();
+		}
+
+		CURLSH* _share = nullptr;
+		/* One lock per kind of shared data, as curl only locks one at a time. */
+		std::mutex _locks[CURL_LOCK_DATA_LAST];
+		std::mutex _mutex;
+		std::vector<CURL*> _idle;
+	};
+
+	CURL* AcquireHandle() {
+		return HandlePool::Instance().Acquire();
+	}
+
+	void ReleaseHandle(CURL* curl) {
+		if (curl) {
+			HandlePool::Instance().Release(curl);
+		}
+	}
+}
\ No newline at end of file
@@ -0,0 +1,99 @@
+#include <atomic>
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+
+#include "shared/curl/http_cache.h"
+#include "shared/filesystem.h"
+#include "shared/logger.h"
+
+namespace curl::HttpCache {
+	static constexpr const char* HEADER = "REPENTOGON-HTTP-CACHE 1";
+
+	static std::atomic<long> __maxStale = DEFAULT_MAX_STALE;
+
+	void SetMaxStale(long seconds) {
+		__maxStale.store(seconds > 0 ? seconds : 0, std::memory_order_release);
+	}
+
+	long GetMaxStale() {
+		return __maxStale.load(std::memory_order_acquire);
+	}
+
+	static std::filesystem::path GetDirectory() {
+		char* appdataPath = nullptr;
+		size_t len = 0;
+		_dupenv_s(&appdataPath, &len, "APPDATA");
+
+		std::filesystem::path path;
+		if (appdataPath && *appdataPath) {
+			path = appdataPath;
+		}
+
+		free(appdataPath);
+		return path / "REPENTOGONLauncher_Cache" / "http";
+	}
+
+	/* FNV-1a, only to get a file name out of the URL. The URL itself is
+	 * stored in the file and checked on load.
+	 */
+	static std::filesystem::path PathOf(std::string const& url) {
+		uint64_t hash = 0xcbf29ce484222325ULL;
+		for (unsigned char c : url) {
+			hash = (hash ^ c) * 0x100000001b3ULL;
+		}
+
+		char name[32];
+		snprintf(name, sizeof(name), "%016" PRIx64 ".cache", hash);
+		return GetDirectory() / name;
+	}
+
+	bool Load(std::string const& url, CachedResponse& response) {
+		std::filesystem::path path = PathOf(url);
+		std::ifstream in(path, std::ios::binary);
+		std::string header;
+		if (!std::getline(in, header) || header != HEADER || !std::getline(in, response.url) ||
+			response.url != url || !std::getline(in, response.etag) || !std::getline(in, response.lastModified)) {
+			return false;
+		}
+
+		std::ostringstream body;
+		body << in.rdbuf();
+		response.body = body.str();
+
+		std::error_code ec;
+		std::filesystem::file_time_type validated = std::filesystem::last_write_time(path, ec);
+		if (ec) {
+			return false;
+		}
+
+		response.age = std::chrono::duration_cast<std::chrono::seconds>(
+			std::filesystem::file_time_type::clock::now() - validated);
+		return true;
+	}
+
+	void Store(CachedResponse const& response) {
+		if (response.url.find('\n') != std::string::npos || response.etag.find('\n') != std::string::npos ||
+			response.lastModified.find('\n') != std::string::npos) {
+			return;
+		}
+
+		std::filesystem::path path = PathOf(response.url);
+		std::error_code ec;
+		std::filesystem::create_directories(path.parent_path(), ec);
+
+		std::string content = std::string(HEADER) + "\n" + response.url + "\n" + response.etag + "\n" +
+			response.lastModified + "\n" + response.body;
+		if (!Filesystem::AtomicWriteFile(path.string().c_str(), content.data(), content.size())) {
+			Logger::Warn("HttpCache::Store: unable to cache the response of %s\n", response.url.c_str());
+		}
+	}
+
+	void Touch(std::string const& url) {
+		std::error_code ec;
+		std::filesystem::last_write_time(PathOf(url), std::filesystem::file_time_type::clock::now(), ec);
+	}
+}
\ No newline at end of file
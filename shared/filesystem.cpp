@@ -1,6 +1,8 @@
 #include <WinSock2.h>
 #include <Windows.h>
 
+#include <algorithm>
+#include <cctype>
 #include <cstdlib>
 #include <cstring>
 
@@ -158,6 +160,48 @@ namespace Filesystem {
 		}
 	}
 
+	bool AtomicWriteFile(const char* filename, const void* data, size_t size) {
+		std::string tmp = std::string(filename) + ".tmp";
+		HANDLE file = CreateFileA(tmp.c_str(), GENERIC_WRITE, 0, NULL, CREATE_ALWAYS,
+			FILE_ATTRIBUTE_NORMAL, NULL);
+		if (file == INVALID_HANDLE_VALUE) {
+			Logger::Error("AtomicWriteFile: unable to create %s: %d\n", tmp.c_str(), GetLastError());
+			return false;
+		}
+
+		const char* bytes = (const char*)data;
+		while (size) {
+			DWORD chunk = size > (1 << 30) ? (1 << 30) : (DWORD)size;
+			DWORD written = 0;
+			if (!WriteFile(file, bytes, chunk, &written, NULL) || written != chunk) {
+				Logger::Error("AtomicWriteFile: unable to write %s: %d\n", tmp.c_str(), GetLastError());
+				CloseHandle(file);
+				DeleteFileA(tmp.c_str());
+				return false;
+			}
+
+			bytes += chunk;
+			size -= chunk;
+		}
+
+		if (!FlushFileBuffers(file)) {
+			Logger::Error("AtomicWriteFile: unable to flush %s: %d\n", tmp.c_str(), GetLastError());
+			CloseHandle(file);
+			DeleteFileA(tmp.c_str());
+			return false;
+		}
+
+		CloseHandle(file);
+
+		if (!MoveFileExA(tmp.c_str(), filename, MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH)) {
+			Logger::Error("AtomicWriteFile: unable to move %s to %s: %d\n", tmp.c_str(), filename, GetLastError());
+			DeleteFileA(tmp.c_str());
+			return false;
+		}
+
+		return true;
+	}
+
 	bool SplitIntoComponents(const char* path, std::string* drive,
 		std::string* filename, std::string* extension,
 		std::vector<std::string>* folders) {
@@ -198,4 +242,38 @@ namespace Filesystem {
 	void TokenizePath(const char* path, std::vector<std::string>& tokens) {
 		utils::Tokenize(path, "/\\", tokens);
 	}
+
+	bool GetFileIdentity(HANDLE file, FileIdentity& identity) {
+		BY_HANDLE_FILE_INFORMATION information;
+		if (!GetFileInformationByHandle(file, &information)) {
+			return false;
+		}
+
+		char buffer[MAX_PATH * 4];
+		DWORD length = GetFinalPathNameByHandleA(file, buffer, sizeof(buffer), FILE_NAME_NORMALIZED);
+		if (length == 0 || length >= sizeof(buffer)) {
+			return false;
+		}
+
+		identity.path.assign(buffer, length);
+		std::transform(identity.path.begin(), identity.path.end(), identity.path.begin(), [](char c) -> char {
+			return (char)std::tolower((unsigned char)c);
+		});
+
+		identity.size = ((uint64_t)information.nFileSizeHigh << 32) | information.nFileSizeLow;
+		identity.lastWrite = ((uint64_t)information.ftLastWriteTime.dwHighDateTime << 32) |
+			information.ftLastWriteTime.dwLowDateTime;
+		identity.volume = information.dwVolumeSerialNumber;
+		identity.fileIndex = ((uint64_t)information.nFileIndexHigh << 32) | information.nFileIndexLow;
+		return true;
+	}
+
+	bool IsOlderThan(FileIdentity const& identity, unsigned int seconds) {
+		FILETIME now;
+		GetSystemTimeAsFileTime(&now);
+		uint64_t current = ((uint64_t)now.dwHighDateTime << 32) | now.dwLowDateTime;
+
+		/* FILETIME counts 100 ns intervals. */
+		return current > identity.lastWrite && current - identity.lastWrite >= (uint64_t)seconds * 10000000;
+	}
 }
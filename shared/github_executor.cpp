@@ -1,17 +1,9 @@
+#include <algorithm>
+
 #include "shared/github_executor.h"
+#include "shared/logger.h"
 #include "shared/private/curl/curl_request.h"
 
-class GithubRequestVisitor {
-public:
-    void operator()(GithubExecutor::DownloadStringRequest& r) {
-        r.result.set_value(curl::detail::DownloadString(r.request, r.name, r.descriptor));
-    }
-
-    void operator()(GithubExecutor::DownloadFileRequest& r) {
-        r.result.set_value(curl::detail::DownloadFile(r.request, r.filename, r.descriptor));
-    }
-};
-
 GithubExecutor& GithubExecutor::Instance() {
     static GithubExecutor executor;
     return executor;
@@ -19,46 +11,330 @@ GithubExecutor& GithubExecutor::Instance() {
 
 GithubExecutor::~GithubExecutor() {
     Stop();
-    _thread.join();
+    if (_thread.joinable()) {
+        _thread.join();
+    }
 }
 
 GithubExecutor::GithubExecutor() {
     _stop.store(false, std::memory_order_release);
+    _maxTransfers.store(DEFAULT_MAX_TRANSFERS, std::memory_order_release);
 }
 
 void GithubExecutor::Start() {
+    curl_global_init(CURL_GLOBAL_DEFAULT);
+
+    CURLM* multi = curl_multi_init();
+    if (!multi) {
+        Logger::Error("GithubExecutor::Start: unable to create cURL multi handle\n");
+        return;
+    }
+
+    {
+        std::unique_lock<std::mutex> lck(_mutex);
+        _multi = multi;
+    }
+
     _thread = std::thread(&GithubExecutor::Run, this);
 }
 
+void GithubExecutor::Stop() {
+    _stop.store(true, std::memory_order_release);
+    WakeUp();
+}
+
+void GithubExecutor::SetMaxTransfers(size_t max) {
+    _maxTransfers.store(max ? max : 1, std::memory_order_release);
+    WakeUp();
+}
+
+size_t GithubExecutor::GetMaxTransfers() const {
+    return _maxTransfers.load(std::memory_order_acquire);
+}
+
+void GithubExecutor::WakeUp() {
+    std::unique_lock<std::mutex> lck(_mutex);
+    if (_multi) {
+        curl_multi_wakeup(_multi);
+    }
+}
+
+curl::detail::Transfer* GithubExecutor::GetTransfer(GithubRequest& request) {
+    return std::visit([](auto& r) -> curl::detail::Transfer* {
+        return r.transfer.get();
+    }, request);
+}
+
+void GithubExecutor::Complete(GithubRequest& request) {
+    std::visit([](auto& r) {
+        r.result.set_value(std::move(r.transfer->GetResult()));
+    }, request);
+}
+
 void GithubExecutor::Run() {
-    bool timedout = false;
+    CURLM* multi = nullptr;
+    {
+        std::unique_lock<std::mutex> lck(_mutex);
+        multi = _multi;
+    }
+
     while (!_stop.load(std::memory_order_acquire)) {
-        std::optional<GithubRequest> request = _requests.Get(&timedout);
-        if (!request) {
-            if (!timedout) {
-                std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        /* Before starting anything, so that a request cancelled while it
+         * waits to be tried again is not started once more.
+         */
+        AbortRequests(multi, false);
+        StartPendingRequests(multi);
+
+        int running = 0;
+        CURLMcode code = curl_multi_perform(multi, &running);
+        if (code != CURLM_OK) {
+            Logger::Error("GithubExecutor::Run: curl_multi_perform failed: %s\n", curl_multi_strerror(code));
+        }
+
+        int left = 0;
+        while (CURLMsg* message = curl_multi_info_read(multi, &left)) {
+            if (message->msg != CURLMSG_DONE) {
+                continue;
+            }
+
+            CURL* handle = message->easy_handle;
+            CURLcode result = message->data.result;
+            auto it = _handles.find(handle);
+            if (it == _handles.end()) {
+                curl_multi_remove_handle(multi, handle);
+                continue;
+            }
+
+            RunningIterator request = it->second;
+            RemoveHandle(multi, handle);
+
+            curl::detail::Transfer* transfer = GetTransfer(request->request);
+            if (!transfer->HandleDone(handle, result)) {
+                continue;
+            }
+
+            RemoveHandles(multi, request);
+            std::chrono::milliseconds delay;
+            if (transfer->ShouldRetry(handle, result, delay)) {
+                request->retryAt = std::chrono::steady_clock::now() + delay;
+                continue;
+            }
+
+            transfer->End(result);
+            Complete(request->request);
+            _running.erase(request);
+        }
+
+        code = curl_multi_poll(multi, NULL, 0, GetPollTimeout(), NULL);
+        if (code != CURLM_OK) {
+            Logger::Error("GithubExecutor::Run: curl_multi_poll failed: %s\n", curl_multi_strerror(code));
+        }
+    }
+
+    /* From now on Push fails requests itself. */
+    {
+        std::unique_lock<std::mutex> lck(_mutex);
+        _multi = nullptr;
+    }
+
+    /* Nobody would ever get the results otherwise. */
+    AbortRequests(multi, true);
+
+    curl_multi_cleanup(multi);
+    curl_global_cleanup();
+}
+
+void GithubExecutor::StartPendingRequests(CURLM* multi) {
+    for (RunningIterator it = _running.begin(); it != _running.end(); ) {
+        curl::detail::Transfer* transfer = GetTransfer(it->request);
+        if (!HasFreeSlot(transfer->GetParameters().priority)) {
+            ++it;
+            continue;
+        }
+
+        CURL* handle = nullptr;
+        if (!it->retryAt) {
+            handle = transfer->NextHandle();
+        } else if (std::chrono::steady_clock::now() >= *it->retryAt) {
+            it->retryAt.reset();
+            if (!transfer->Restart()) {
+                RunningIterator request = it++;
+                Complete(request->request);
+                _running.erase(request);
+                continue;
+            }
+
+            handle = transfer->GetHandle();
+        }
+
+        if (!handle) {
+            ++it;
+            continue;
+        }
+
+        if (!AddHandle(multi, it, handle)) {
+            RunningIterator request = it++;
+            RemoveHandles(multi, request);
+            transfer->End(CURLE_FAILED_INIT);
+            Complete(request->request);
+            _running.erase(request);
+        }
+    }
+
+    while (true) {
+        GithubRequest request;
+        {
+            std::unique_lock<std::mutex> lck(_mutex);
+            auto it = _pending.begin();
+            if (it == _pending.end() || !HasFreeSlot((curl::RequestPriority)-it->first.first)) {
+                return;
             }
+
+            request = std::move(it->second);
+            _pending.erase(it);
+        }
+
+        curl::detail::Transfer* transfer = GetTransfer(request);
+        if (!transfer->Begin()) {
+            Complete(request);
             continue;
         }
 
-        std::visit(GithubRequestVisitor(), *request);
+        RunningIterator it = _running.emplace(_running.end());
+        it->request = std::move(request);
+        if (!AddHandle(multi, it, transfer->GetHandle())) {
+            transfer->End(CURLE_FAILED_INIT);
+            Complete(it->request);
+            _running.erase(it);
+        }
     }
 }
 
-void GithubExecutor::Stop() {
-    _stop.store(true, std::memory_order_release);
+int GithubExecutor::GetPollTimeout() const {
+    std::chrono::milliseconds timeout(100);
+    std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+    for (RunningRequest const& request : _running) {
+        /* Requests that are due only wait for a free slot, and a slot is
+         * freed when a transfer is done, which ends the poll.
+         */
+        if (request.retryAt && *request.retryAt > now) {
+            timeout = std::min(timeout, std::chrono::ceil<std::chrono::milliseconds>(*request.retryAt - now));
+        }
+    }
+
+    return (int)timeout.count();
+}
+
+bool GithubExecutor::HasFreeSlot(curl::RequestPriority priority) const {
+    size_t max = _maxTransfers.load(std::memory_order_acquire);
+    if (priority == curl::REQUEST_PRIORITY_LOW && max > 1) {
+        return _handles.size() < max - 1;
+    }
+
+    return _handles.size() < max;
+}
+
+bool GithubExecutor::AddHandle(CURLM* multi, RunningIterator request, CURL* handle) {
+    CURLMcode code = curl_multi_add_handle(multi, handle);
+    if (code != CURLM_OK) {
+        Logger::Error("GithubExecutor::AddHandle: unable to start request to %s: %s\n",
+            GetTransfer(request->request)->GetParameters().url.c_str(), curl_multi_strerror(code));
+        return false;
+    }
+
+    request->handles.push_back(handle);
+    _handles.emplace(handle, request);
+    return true;
+}
+
+void GithubExecutor::RemoveHandle(CURLM* multi, CURL* handle) {
+    auto it = _handles.find(handle);
+    if (it == _handles.end()) {
+        return;
+    }
+
+    std::vector<CURL*>& handles = it->second->handles;
+    handles.erase(std::find(handles.begin(), handles.end(), handle));
+    _handles.erase(it);
+    curl_multi_remove_handle(multi, handle);
+}
+
+void GithubExecutor::RemoveHandles(CURLM* multi, RunningIterator request) {
+    for (CURL* handle : request->handles) {
+        curl_multi_remove_handle(multi, handle);
+        _handles.erase(handle);
+    }
+
+    request->handles.clear();
+}
+
+void GithubExecutor::AbortRequests(CURLM* multi, bool all) {
+    auto shouldAbort = [all](GithubRequest& request) -> bool {
+        if (all) {
+            return true;
+        }
+
+        curl::AsynchronousDownloadDescriptor* descriptor = GetTransfer(request)->GetDescriptor();
+        return descriptor && descriptor->cancel.load(std::memory_order_acquire);
+    };
+
+    for (RunningIterator it = _running.begin(); it != _running.end(); ) {
+        if (!shouldAbort(it->request)) {
+            ++it;
+            continue;
+        }
+
+        RemoveHandles(multi, it);
+        GetTransfer(it->request)->Abort();
+        Complete(it->request);
+        it = _running.erase(it);
+    }
+
+    std::map<RequestKey, GithubRequest> aborted;
+    {
+        std::unique_lock<std::mutex> lck(_mutex);
+        for (auto it = _pending.begin(); it != _pending.end(); ) {
+            if (shouldAbort(it->second)) {
+                aborted.insert(_pending.extract(it++));
+            } else {
+                ++it;
+            }
+        }
+    }
+
+    for (auto& [_, request] : aborted) {
+        GetTransfer(request)->Abort();
+        Complete(request);
+    }
+}
+
+void GithubExecutor::Push(curl::RequestPriority priority, GithubRequest&& request) {
+    {
+        std::unique_lock<std::mutex> lck(_mutex);
+        if (_multi) {
+            _pending.emplace(RequestKey(-(int)priority, _sequence++), std::move(request));
+            curl_multi_wakeup(_multi);
+            return;
+        }
+    }
+
+    /* Never started, failed to start or stopped: nothing would ever run
+     * the request, and its future would never be ready.
+     */
+    Logger::Error("GithubExecutor::Push: executor is not running, failing %s\n",
+        GetTransfer(request)->GetParameters().url.c_str());
+    GetTransfer(request)->Abort();
+    Complete(request);
 }
 
 std::future<curl::DownloadStringDescriptor> GithubExecutor::AddDownloadStringRequest(
     std::string&& name, curl::RequestParameters const& request,
     std::shared_ptr<curl::AsynchronousDownloadStringDescriptor> const& desc) {
     DownloadStringRequest r;
-    r.descriptor = desc;
-    r.name = std::move(name);
-    r.request = request;
+    r.transfer = std::make_unique<curl::detail::StringTransfer>(request, name, desc);
 
     std::future<curl::DownloadStringDescriptor> result = r.result.get_future();
-    _requests.Push(std::move(r));
+    Push(request.priority, std::move(r));
     return result;
 }
 
@@ -66,12 +342,10 @@ std::future<curl::DownloadFileDescriptor> GithubExecutor::AddDownloadFileRequest
     std::string&& filename, curl::RequestParameters const& request,
     std::shared_ptr<curl::AsynchronousDownloadFileDescriptor> const& desc) {
     DownloadFileRequest r;
-    r.descriptor = desc;
-    r.filename = std::move(filename);
-    r.request = request;
+    r.transfer = std::make_unique<curl::detail::FileTransfer>(request, filename, desc);
 
     std::future<curl::DownloadFileDescriptor> result = r.result.get_future();
-    _requests.Push(std::move(r));
+    Push(request.priority, std::move(r));
     return result;
 }
 
@@ -8,27 +8,31 @@
 #include "shared/launcher_update_checker.h"
 #include "shared/logger.h"
 #include "shared/gitlab_versionchecker.h"
+#include "shared/source_resolver.h"
 #include "shared/version_utils.h"
 
 namespace Shared {
+	static curl::RequestParameters ReleasesRequest();
+	static bool ParseReleases(curl::DownloadStringDescriptor const& result,
+		rapidjson::Document& answer);
 	static bool FetchReleases(curl::DownloadStringResult* curlResult,
 		rapidjson::Document& answer);
 
 	static const char* ReleasesURL = "https://api.github.com/repos/TeamREPENTOGON/Launcher/releases";
 
-	bool FetchReleases(curl::DownloadStringResult* curlResult,
-		rapidjson::Document& answer) {
+	curl::RequestParameters ReleasesRequest() {
 		curl::RequestParameters request;
 
 		request.maxSpeed = request.serverTimeout = request.timeout = 0;
 		request.url = ReleasesURL;
+		request.cache = true;
+		request.retry.attempts = Github::REQUEST_ATTEMPTS;
 		Github::GenerateGithubHeaders(request);
+		return request;
+	}
 
-		curl::DownloadStringDescriptor result = curl::DownloadString(request, "launcher releases info");
-		if (curlResult) {
-			*curlResult = result.result;
-		}
-
+	bool ParseReleases(curl::DownloadStringDescriptor const& result,
+		rapidjson::Document& answer) {
 		if (result.result != curl::DOWNLOAD_STRING_OK) {
 			return false;
 		}
@@ -44,6 +48,16 @@ namespace Shared {
 		return true;
 	}
 
+	bool FetchReleases(curl::DownloadStringResult* curlResult,
+		rapidjson::Document& answer) {
+		curl::DownloadStringDescriptor result = curl::DownloadString(ReleasesRequest(), "launcher releases info");
+		if (curlResult) {
+			*curlResult = result.result;
+		}
+
+		return ParseReleases(result, answer);
+	}
+
 	bool SelectTargetRelease(rapidjson::Document const& releases, bool allowPreRelease,
 		bool force, std::string& version, std::string& url);
 
@@ -85,20 +99,38 @@ namespace Shared {
 
 		steamUpdateStatus = STEAM_LAUNCHER_UPDATE_NOT_USED;
 
-		//GitLab Barrier
-		if (!force && !allowPreRelease && !ShouldDoTimeBasedGitLabSkip()) {
-			if (RemoteGitLabVersionMatches("versionlauncher", Launcher::LAUNCHER_VERSION)) {
-				fetchReleasesResult = curl::DownloadStringResult::DOWNLOAD_STRING_OK; //I would call this up a level so I dont have to do this hacky, but here is more convenient because I have some things already pre-chewed
-				return false;
-			}
+		/* GitLab only tells whether the current version is the latest stable
+		 * one. Its answer ends the check unless it is the daily check against
+		 * GitHub; otherwise it is only used if GitHub cannot be reached.
+		 */
+		bool useGitLab = !allowPreRelease;
+		bool trustGitLab = useGitLab && !force && !ShouldDoTimeBasedGitLabSkip();
+		bool gitLabMatches = false;
+		fetchReleasesResult = curl::DOWNLOAD_STRING_BAD_CURL;
+
+		SourceResolver resolver("launcher update");
+		if (useGitLab) {
+			resolver.AddSource("GitLab", GitLabVersionRequest("versionlauncher"), std::chrono::milliseconds(0),
+				[&](curl::DownloadStringDescriptor const& answer) {
+					gitLabMatches = answer.result == curl::DOWNLOAD_STRING_OK && answer.string == Launcher::LAUNCHER_VERSION;
+					return gitLabMatches && trustGitLab;
+				});
 		}
-		//GitLab Barrier END
 
-		bool downloadResult = FetchReleases(&fetchReleasesResult, _releasesInfo);
+		resolver.AddSource("GitHub", ReleasesRequest(), GITHUB_STAGGER,
+			[&](curl::DownloadStringDescriptor const& answer) {
+				fetchReleasesResult = answer.result;
+				return ParseReleases(answer, _releasesInfo) && _releasesInfo.IsArray();
+			});
+
+		int source = resolver.Resolve();
+		if (source >= 0 && gitLabMatches && trustGitLab) {
+			fetchReleasesResult = curl::DownloadStringResult::DOWNLOAD_STRING_OK; //I would call this up a level so I dont have to do this hacky, but here is more convenient because I have some things already pre-chewed
+			return false;
+		}
 
-		if (!downloadResult) {
-			// Double check with gitlab before resorting to steam (we may not have checked gitlab earlier).
-			if (!allowPreRelease && RemoteGitLabVersionMatches("versionlauncher", Launcher::LAUNCHER_VERSION)) {
+		if (source < 0) {
+			if (gitLabMatches) {
 				fetchReleasesResult = curl::DownloadStringResult::DOWNLOAD_STRING_OK;
 				return false;
 			}
@@ -0,0 +1,151 @@
+#include <cstdint>
+#include <utility>
+
+#include "shared/logger.h"
+#include "shared/mapped_file.h"
+
+MappedFile::MappedFile() {
+
+}
+
+MappedFile::MappedFile(MappedFile&& other) {
+	*this = std::move(other);
+}
+
+MappedFile& MappedFile::operator=(MappedFile&& other) {
+	if (this != &other) {
+		Close();
+		std::swap(_file, other._file);
+		std::swap(_mapping, other._mapping);
+		std::swap(_data, other._data);
+		std::swap(_size, other._size);
+		std::swap(_open, other._open);
+	}
+
+	return *this;
+}
+
+MappedFile::~MappedFile() {
+	Close();
+}
+
+bool MappedFile::Open(const char* filename, Mode mode) {
+	Close();
+
+	DWORD access = mode == MAP_WRITE ? GENERIC_READ | GENERIC_WRITE : GENERIC_READ;
+	_file = CreateFileA(filename, access, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+		FILE_ATTRIBUTE_NORMAL, NULL);
+	if (_file == INVALID_HANDLE_VALUE) {
+		Logger::Error("MappedFile::Open: unable to open %s (%d)\n", filename, GetLastError());
+		return false;
+	}
+
+	LARGE_INTEGER size;
+	if (!GetFileSizeEx(_file, &size)) {
+		Logger::Error("MappedFile::Open: unable to get size of %s (%d)\n", filename, GetLastError());
+		Close();
+		return false;
+	}
+
+	switch (mode) {
+	case MAP_WRITE:
+		return Map(PAGE_READWRITE, FILE_MAP_WRITE, size.QuadPart);
+
+	case MAP_COPY:
+		return Map(PAGE_WRITECOPY, FILE_MAP_COPY, size.QuadPart);
+
+	default:
+		return Map(PAGE_READONLY, FILE_MAP_READ, size.QuadPart);
+	}
+}
+
+bool MappedFile::Create(const char* filename, uint64_t size) {
+	Close();
+
+	_file = CreateFileA(filename, GENERIC_READ | GENERIC_WRITE, 0, NULL, CREATE_ALWAYS,
+		FILE_ATTRIBUTE_NORMAL, NULL);
+	if (_file == INVALID_HANDLE_VALUE) {
+		Logger::Error("MappedFile::Create: unable to create %s (%d)\n", filename, GetLastError());
+		return false;
+	}
+
+	/* The mapping extends the file to its maximum size. */
+	return Map(PAGE_READWRITE, FILE_MAP_WRITE, size);
+}
+
+bool MappedFile::Map(DWORD protection, DWORD access, uint64_t size) {
+	if (size > SIZE_MAX) {
+		Logger::Error("MappedFile::Map: file too large to be mapped (%llu bytes)\n", size);
+		Close();
+		return false;
+	}
+
+	_size = (size_t)size;
+	_open = true;
+
+	/* CreateFileMapping refuses empty mappings. */
+	if (size == 0) {
+		return true;
+	}
+
+	_mapping = CreateFileMappingA(_file, NULL, protection, (DWORD)(size >> 32),
+		(DWORD)(size & 0xFFFFFFFF), NULL);
+	if (!_mapping) {
+		Logger::Error("MappedFile::Map: unable to create mapping (%d)\n", GetLastError());
+		Close();
+		return false;
+	}
+
+	_data = (unsigned char*)MapViewOfFile(_mapping, access, 0, 0, _size);
+	if (!_data) {
+		Logger::Error("MappedFile::Map: unable to map view of %llu bytes (%d)\n", size, GetLastError());
+		Close();
+		return false;
+	}
+
+	return true;
+}
+
+bool MappedFile::Flush(size_t offset, size_t size) {
+	if (!_data || size == 0) {
+		return true;
+	}
+
+	return FlushViewOfFile(_data + offset, size) && FlushFileBuffers(_file);
+}
+
+bool MappedFile::Flush() {
+	return Flush(0, _size);
+}
+
+void MappedFile::Close() {
+	if (_data) {
+		UnmapViewOfFile(_data);
+		_data = nullptr;
+	}
+
+	if (_mapping) {
+		CloseHandle(_mapping);
+		_mapping = NULL;
+	}
+
+	if (_file != INVALID_HANDLE_VALUE) {
+		CloseHandle(_file);
+		_file = INVALID_HANDLE_VALUE;
+	}
+
+	_size = 0;
+	_open = false;
+}
+
+unsigned char* MappedFile::Data() const {
+	return _data;
+}
+
+size_t MappedFile::Size() const {
+	return _size;
+}
+
+MappedFile::operator bool() const {
+	return _open;
+}
@@ -1,19 +1,18 @@
 #include <WinSock2.h>
 #include <Windows.h>
-#include <io.h>
 
 #include <cassert>
+#include <cstddef>
 
 #include <map>
 #include <set>
 #include <stdexcept>
 
+#include "shared/byte_search.h"
 #include "shared/pe32.h"
-#include "shared/scoped_file.h"
 
-PE32::PE32(const char* filename) : _filename(filename) {
+PE32::PE32(const char* filename, Mode mode) : _filename(filename), _mode(mode) {
     Validate(filename);
-	Map();
 }
 
 PE32::~PE32() {
@@ -25,66 +24,131 @@ bool PE32::IsSectionSizeValid(const SectionHeader* header) const {
 }
 
 bool PE32::Patch(PE32Byte where, const char* with) {
-	if (*where < _content.get() || *where > (_content.get() + _size))
+	return Patch(where, with, strlen(with));
+}
+
+bool PE32::Patch(PE32Byte where, const void* with, size_t size) {
+	if (_mode != READ_WRITE)
+		return false;
+
+	if (*where < Content() || *where > (Content() + _size))
 		return false;
 
-	size_t size = strlen(with);
-	if (*where + size > (_content.get() + _size))
+	if (*where + size > (Content() + _size))
 		return false;
 
+	/* Only the pages written to stop being shared with the file. */
 	memcpy(*where, with, size);
+	_patches.push_back(std::make_pair((size_t)(*where - Content()), size));
 	return true;
 }
 
+std::tuple<char*, size_t> PE32::GetRange(const SectionHeader* header) const {
+	if (!header)
+		return std::make_tuple(Content(), _size);
+
+	if (!IsSectionSizeValid(header))
+		return std::make_tuple(nullptr, 0);
+
+	return std::make_tuple(Content() + header->PointerToRawData, (size_t)header->SizeOfRawData);
+}
+
 PE32Byte PE32::Lookup(const char* str, const SectionHeader* header) const {
-	size_t size = strlen(str);
+	return Lookup(str, strlen(str), header);
+}
 
-	char* start = _content.get();
-	char* end = start + _size;
-	if (header) {
-		start = _content.get() + header->PointerToRawData;
-		end = start + header->SizeOfRawData;
-	}
+PE32Byte PE32::Lookup(const void* pattern, size_t size, const SectionHeader* header) const {
+	auto [start, length] = GetRange(header);
+	if (!start)
+		return PE32Byte(nullptr);
 
-	ptrdiff_t dist = end - start;
-	// If the string is longer than the available space, save some time
-	if (dist < size)
+	size_t offset = ByteSearch::Find(start, length, pattern, size);
+	if (offset == ByteSearch::NOT_FOUND)
 		return PE32Byte(nullptr);
 
-	char* substring = nullptr;
-	while (start != (end - size + 1)) {
-		if (!memcmp(start, str, size)) {
-			substring = start;
-			break;
-		}
+	return PE32Byte(start + offset);
+}
+
+std::vector<PE32Byte> PE32::LookupAll(const void* pattern, size_t size, const SectionHeader* header) const {
+	std::vector<PE32Byte> result;
+	auto [start, length] = GetRange(header);
+	if (!start)
+		return result;
+
+	for (size_t offset : ByteSearch::FindAll(start, length, pattern, size)) {
+		result.push_back(PE32Byte(start + offset));
+	}
+
+	return result;
+}
 
-		++start;
+std::vector<std::vector<PE32Byte>> PE32::Scan(SignatureScanner const& scanner, const SectionHeader* header) const {
+	std::vector<std::vector<PE32Byte>> result(scanner.Count());
+	auto [start, length] = GetRange(header);
+	if (!start)
+		return result;
+
+	std::vector<std::vector<size_t>> offsets = scanner.Scan(start, length);
+	for (size_t i = 0; i < offsets.size(); ++i) {
+		for (size_t offset : offsets[i]) {
+			result[i].push_back(PE32Byte(start + offset));
+		}
 	}
 
-	return PE32Byte(substring);
+	return result;
 }
 
 bool PE32::Write() {
-	std::string filename = _filename + ".tmp";
-	FILE* file = fopen(filename.c_str(), "wb");
-	if (!file) {
+	if (_mode != READ_WRITE)
 		return false;
+
+	if (_patches.empty())
+		return true;
+
+	/* The mapping does not allow other handles to write to the file: save
+	 * the patched ranges, release it, write them in place, then map the
+	 * file again.
+	 */
+	std::vector<std::pair<size_t, std::string>> patches;
+	for (auto const& [offset, size] : _patches) {
+		patches.push_back(std::make_pair(offset, std::string(Content() + offset, size)));
 	}
 
-	ScopedFile f(file);
-	if (fwrite(_content.get(), _size, 1, file) != 1) {
+	_sectionsMap.clear();
+	_memoryContent.reset();
+	_mapped = false;
+	_file.Close();
+
+	HANDLE file = CreateFileA(_filename.c_str(), GENERIC_WRITE, 0, NULL, OPEN_EXISTING,
+		FILE_ATTRIBUTE_NORMAL, NULL);
+	if (file == INVALID_HANDLE_VALUE) {
 		return false;
 	}
 
-	fclose(file);
-	f.Release();
+	bool ok = true;
+	for (auto const& [offset, bytes] : patches) {
+		LARGE_INTEGER position;
+		position.QuadPart = offset;
+		DWORD written = 0;
+		if (!SetFilePointerEx(file, position, NULL, FILE_BEGIN) ||
+			!WriteFile(file, bytes.data(), (DWORD)bytes.size(), &written, NULL) ||
+			written != bytes.size()) {
+			ok = false;
+			break;
+		}
+	}
+
+	ok = ok && FlushFileBuffers(file);
+	CloseHandle(file);
 
-	if (!CopyFileA(filename.c_str(), _filename.c_str(), FALSE)) {
+	try {
+		Validate(_filename.c_str());
+	} catch (std::runtime_error const&) {
 		return false;
 	}
 
-	DeleteFileA(filename.c_str());
-	return true;
+	_patches.clear();
+	return ok;
 }
 
 std::tuple<const SectionHeader*, PE32Byte> PE32::GetSection(const char* section) {
@@ -95,7 +159,7 @@ std::tuple<const SectionHeader*, PE32Byte> PE32::GetSection(const char* section)
 	for (int i = 0; i < _coffHeader->NumberOfSections; ++i) {
 		SectionHeader* header = _sections + i;
 		if (!strncmp(header->Name, section, sizeof(header->Name))) {
-			std::tuple<SectionHeader*, PE32Byte> res = std::make_tuple(header, PE32Byte(_content.get() + header->PointerToRawData));
+			std::tuple<SectionHeader*, PE32Byte> res = std::make_tuple(header, PE32Byte(Content() + header->PointerToRawData));
 			_sectionsMap[section] = res;
 			return res;
 		}
@@ -105,33 +169,20 @@ std::tuple<const SectionHeader*, PE32Byte> PE32::GetSection(const char* section)
 }
 
 void PE32::Validate(const char* filename) {
-	FILE* file = fopen(filename, "rb");
-
-	if (!file)
+	if (!_file.Open(filename, _mode == READ_WRITE ? MappedFile::MAP_COPY : MappedFile::MAP_READ))
 		throw std::runtime_error("PE32: unable to open provided file");
 
-	ScopedFile f(file);
-
-	DWORD highOrder = 0;
-	HANDLE exeHandle = (HANDLE)_get_osfhandle(_fileno(file));
-	DWORD size = GetFileSize(exeHandle, &highOrder);
+	size_t size = _file.Size();
 	_size = size;
-	DWORD minSize = 0x40; // DOS header
+	size_t minSize = 0x40; // DOS header
 
-	if (highOrder != 0)
+	if ((uint64_t)size > 0xFFFFFFFF)
 		throw std::runtime_error("PE32: provided executable size > 4GB");
 
 	if (size < minSize)
 		throw std::runtime_error("PE32: provided executable too short (< 0x40 bytes)");
 
-	char* content = (char*)malloc(size);
-	if (!content)
-		throw std::runtime_error("PE32: unable to allocate memory to read provided file");
-
-	_content.reset(content);
-
-	if (fread(content, size, 1, file) != 1)
-		throw std::runtime_error("PE32: error while reading file in memory");
+	char* content = Content();
 
 	uint32_t* peOffsetAddr = (uint32_t*)(content + PE_SIGNATURE_OFFSET);
 	minSize = *peOffsetAddr + sizeof(uint32_t);
@@ -192,7 +243,7 @@ void PE32::Map() {
 		size += sectionSize;
 	}
 
-	char* raw = _content.get();
+	char* raw = Content();
 	char* data = (char*)calloc(1, size);
 	if (!data) {
 		return;
@@ -229,6 +280,11 @@ void PE32::Map() {
 }
 
 const char* PE32::RVA(uint32_t rva, const char* base) {
+	if (!_mapped) {
+		_mapped = true;
+		Map();
+	}
+
 	if (!_memoryContent) {
 		return base;
 	}
@@ -238,4 +294,142 @@ const char* PE32::RVA(uint32_t rva, const char* base) {
 	}
 
 	return base + rva;
+}
+
+const SectionHeader* PE32::GetSectionOfRVA(uint32_t rva) const {
+	for (int i = 0; i < _coffHeader->NumberOfSections; ++i) {
+		const SectionHeader* header = _sections + i;
+		/* Past the raw data, the section is zero filled by the loader and has
+		 * no content in the file.
+		 */
+		uint32_t length = header->SizeOfRawData;
+		if (header->VirtualSize && header->VirtualSize < length)
+			length = header->VirtualSize;
+
+		if (rva < header->VirtualAddress || (uint64_t)rva >= (uint64_t)header->VirtualAddress + length)
+			continue;
+
+		if ((uint64_t)header->PointerToRawData + header->SizeOfRawData > _size)
+			return nullptr;
+
+		return header;
+	}
+
+	return nullptr;
+}
+
+bool PE32::RVAToOffset(uint32_t rva, uint32_t* offset) const {
+	const SectionHeader* header = GetSectionOfRVA(rva);
+	if (!header)
+		return false;
+
+	*offset = header->PointerToRawData + (rva - header->VirtualAddress);
+	return true;
+}
+
+const char* PE32::GetRVARange(uint32_t rva, uint64_t size) const {
+	const SectionHeader* header = GetSectionOfRVA(rva);
+	if (!header)
+		return nullptr;
+
+	uint32_t length = header->SizeOfRawData;
+	if (header->VirtualSize && header->VirtualSize < length)
+		length = header->VirtualSize;
+
+	if ((uint64_t)(rva - header->VirtualAddress) + size > length)
+		return nullptr;
+
+	return Content() + header->PointerToRawData + (rva - header->VirtualAddress);
+}
+
+bool PE32::ReadString(uint32_t rva, std::string& value) const {
+	const SectionHeader* header = GetSectionOfRVA(rva);
+	if (!header)
+		return false;
+
+	uint32_t length = header->SizeOfRawData;
+	if (header->VirtualSize && header->VirtualSize < length)
+		length = header->VirtualSize;
+
+	const char* start = Content() + header->PointerToRawData + (rva - header->VirtualAddress);
+	const char* end = Content() + header->PointerToRawData + length;
+	const char* nul = (const char*)memchr(start, 0, end - start);
+	if (!nul)
+		return false;
+
+	value.assign(start, nul);
+	return true;
+}
+
+PE32Byte PE32::GetExport(const char* name) const {
+	if (_optionalHeader->Magic != 0x10b || _optionalHeader->NumberOfRvasAndSizes < 1 ||
+		_coffHeader->SizeOfOptionalHeader < offsetof(OptionalHeader, ExportTable) + sizeof(DataDirectory))
+		return PE32Byte(nullptr);
+
+	DataDirectory const& directory = _optionalHeader->ExportTable;
+	if (!directory.VirtualAddress)
+		return PE32Byte(nullptr);
+
+	const ExportDirectoryTable* table = (const ExportDirectoryTable*)GetRVARange(directory.VirtualAddress,
+		sizeof(ExportDirectoryTable));
+	if (!table)
+		return PE32Byte(nullptr);
+
+	const char* names = GetRVARange(table->NamePointerRVA, (uint64_t)table->NumberOfNamePointers * sizeof(uint32_t));
+	const char* ordinals = GetRVARange(table->OrdinalTableRVA, (uint64_t)table->NumberOfNamePointers * sizeof(uint16_t));
+	const char* addresses = GetRVARange(table->ExportAddressTableRVA, (uint64_t)table->AddressTableEntries * sizeof(uint32_t));
+	if (!names || !ordinals || !addresses)
+		return PE32Byte(nullptr);
+
+	/* The name pointer table is sorted, so that the loader can binary search
+	 * it as well. The tables are not necessarily aligned in the file.
+	 */
+	uint32_t low = 0, high = table->NumberOfNamePointers;
+	while (low < high) {
+		uint32_t middle = low + (high - low) / 2;
+		uint32_t nameRVA;
+		memcpy(&nameRVA, names + middle * sizeof(uint32_t), sizeof(nameRVA));
+
+		std::string exportName;
+		if (!ReadString(nameRVA, exportName))
+			return PE32Byte(nullptr);
+
+		int comparison = strcmp(name, exportName.c_str());
+		if (comparison < 0) {
+			high = middle;
+		} else if (comparison > 0) {
+			low = middle + 1;
+		} else {
+			uint16_t ordinal;
+			memcpy(&ordinal, ordinals + middle * sizeof(uint16_t), sizeof(ordinal));
+			if (ordinal >= table->AddressTableEntries)
+				return PE32Byte(nullptr);
+
+			uint32_t rva;
+			memcpy(&rva, addresses + ordinal * sizeof(uint32_t), sizeof(rva));
+			/* Forwarders point to a string inside the export directory. */
+			if (rva >= directory.VirtualAddress && (uint64_t)rva < (uint64_t)directory.VirtualAddress + directory.Size)
+				return PE32Byte(nullptr);
+
+			uint32_t offset;
+			if (!RVAToOffset(rva, &offset))
+				return PE32Byte(nullptr);
+
+			return PE32Byte(Content() + offset);
+		}
+	}
+
+	return PE32Byte(nullptr);
+}
+
+bool PE32::ReadStringPointer(PE32Byte where, std::string& value) const {
+	if (!where || *where < Content() || *where + sizeof(uint32_t) > Content() + _size)
+		return false;
+
+	uint32_t address;
+	memcpy(&address, *where, sizeof(address));
+	if (address < _optionalHeader->ImageBase)
+		return false;
+
+	return ReadString(address - _optionalHeader->ImageBase, value);
 }
\ No newline at end of file
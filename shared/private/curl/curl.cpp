@@ -1,8 +1,18 @@
 #pragma once
 
+#include <algorithm>
+#include <cinttypes>
+#include <ctime>
+#include <filesystem>
+#include <fstream>
+#include <random>
+#include <thread>
+
 #include "shared/curl_request.h"
+#include "shared/filesystem.h"
 #include "shared/logger.h"
 #include "shared/scoped_curl.h"
+#include "shared/curl/handle_pool.h"
 #include "shared/curl/string_response_handler.h"
 #include "shared/private/curl/curl_request.h"
 
@@ -20,111 +30,782 @@ namespace curl::detail {
 
 	static std::atomic<uint32_t> __downloadCounter = 0;
 
-	void InitCurlSession(CURL* curl, RequestParameters const& request,
+	/* Drive a blocking transfer to its end, retrying it as long as
+	 * ShouldRetry allows.
+	 */
+	static void Perform(Transfer& transfer);
+
+	enum HeaderLineType {
+		/* First line of a response, status is set. */
+		HEADER_LINE_STATUS,
+		/* name (in lowercase) and value are set, name is empty if the line
+		 * is malformed.
+		 */
+		HEADER_LINE_FIELD,
+		/* Blank line after the headers of a response. */
+		HEADER_LINE_END
+	};
+
+	/* Parse a line given to a CURLOPT_HEADERFUNCTION. Each redirection
+	 * starts a new response, with a new status line.
+	 */
+	static HeaderLineType ParseHeaderLine(const char* data, size_t len, long& status,
+		std::string& name, std::string& value);
+
+	struct curl_slist* InitCurlSession(CURL* curl, RequestParameters const& request,
 		AbstractCurlResponseHandler* handler);
 
-	DownloadStringDescriptor DownloadString(RequestParameters const& parameters,
-		std::string const& name,
-		std::shared_ptr<AsynchronousDownloadStringDescriptor> const& desc) {
-		const char* url = parameters.url.c_str();
+	Transfer::Transfer(RequestParameters const& parameters, AsynchronousDownloadDescriptor* descriptor) :
+		_parameters(parameters), _descriptor(descriptor), _request(parameters) {
+		_id = __downloadCounter.fetch_add(1, std::memory_order_acq_rel) + 1;
+	}
+
+	Transfer::~Transfer() {
+		curl::ReleaseHandle(_curl);
+
+		if (_headers) {
+			curl_slist_free_all(_headers);
+		}
+	}
+
+	void Transfer::RegisterHooks(AbstractCurlResponseHandler* handler, const char* name) {
+		if (_parameters.onData) {
+			handler->RegisterHook(_parameters.onData);
+		}
+
+		if (_descriptor) {
+			handler->RegisterHook(std::bind_front(MonitorNotifyOnDataReceived, &_descriptor->monitor, name,
+				&_descriptor->cancel, _id));
+		}
+	}
 
-		CurlStringResponse data;
-		uint32_t id = __downloadCounter.fetch_add(1, std::memory_order_acq_rel) + 1;
+	bool Transfer::Init(AbstractCurlResponseHandler* handler, const char* name) {
+		const char* url = _parameters.url.c_str();
+		RegisterHooks(handler, name);
 
-		Threading::Monitor<DownloadNotification>* monitor = desc ? &desc->base.monitor : nullptr;
-		std::atomic<bool>* cancelFlag = desc ? &desc->base.cancel : nullptr;
+		Threading::Monitor<DownloadNotification>* monitor = _descriptor ? &_descriptor->monitor : nullptr;
 		if (monitor) {
-			data.RegisterHook(std::bind_front(MonitorNotifyOnDataReceived, monitor, name.c_str(), cancelFlag, id));
 			monitor->Push(CreateInitCurlNotification(url, false));
 		}
 
-		CURL* curl = curl_easy_init();
-		DownloadStringDescriptor result;
-		if (!curl) {
-			Logger::Error("DownloadAsString: error while initializing cURL session for %s\n", url);
-			result.result = DOWNLOAD_STRING_BAD_CURL;
-			return result;
+		_curl = curl::AcquireHandle();
+		if (!_curl) {
+			return false;
 		}
 
-		ScopedCURL session(curl);
-		InitCurlSession(curl, parameters, &data);
+		_headers = InitCurlSession(_curl, _parameters, handler);
 
 		if (monitor) {
 			monitor->Push(CreateInitCurlNotification(url, true));
 			monitor->Push(CreatePerformCurlNotification(url, false));
 		}
 
-		result.code = curl_easy_perform(curl);
-		if (result.code != CURLE_OK) {
+		return true;
+	}
+
+	void Transfer::NotifyPerform() {
+		if (_descriptor) {
+			_descriptor->monitor.Push(CreatePerformCurlNotification(_parameters.url.c_str(), true));
+		}
+	}
+
+	void Transfer::NotifyDone() {
+		if (_descriptor) {
+			_descriptor->monitor.Push(CreateDoneNotification(_parameters.url.c_str()));
+		}
+	}
+
+	void Transfer::Reset() {
+		curl::ReleaseHandle(_curl);
+		_curl = nullptr;
+
+		if (_headers) {
+			curl_slist_free_all(_headers);
+			_headers = nullptr;
+		}
+
+		_parameters = _request;
+	}
+
+	CURL* Transfer::NextHandle() {
+		return nullptr;
+	}
+
+	bool Transfer::HandleDone(CURL*, CURLcode&) {
+		return true;
+	}
+
+	bool Transfer::ShouldRetry(CURL* handle, CURLcode code, std::chrono::milliseconds& delay) {
+		RetryPolicy const& policy = _parameters.retry;
+		if (_attempt >= policy.attempts || code == CURLE_ABORTED_BY_CALLBACK ||
+			(_descriptor && _descriptor->cancel.load(std::memory_order_acquire))) {
+			return false;
+		}
+
+		long status = 0;
+		curl_easy_getinfo(handle, CURLINFO_RESPONSE_CODE, &status);
+		std::optional<std::chrono::milliseconds> serverDelay;
+
+		char reason[128];
+		if (status >= 400) {
+			bool rateLimited = false;
+			serverDelay = GetServerDelay(handle, rateLimited);
+			long retryable = status == 403 && rateLimited ? 429 : status;
+			if (std::find(policy.statuses.begin(), policy.statuses.end(), retryable) == policy.statuses.end()) {
+				return false;
+			}
+
+			snprintf(reason, sizeof(reason), "HTTP status %ld", status);
+		} else if (std::find(policy.codes.begin(), policy.codes.end(), code) != policy.codes.end()) {
+			snprintf(reason, sizeof(reason), "%s", curl_easy_strerror(code));
+		} else {
+			return false;
+		}
+
+		/* The hook cannot take the same data twice. */
+		curl_off_t received = 0;
+		if (_parameters.onData && curl_easy_getinfo(handle, CURLINFO_SIZE_DOWNLOAD_T, &received) == CURLE_OK &&
+			received > 0) {
+			Logger::Error("Transfer::ShouldRetry: %s: %s after %" PRId64 " bytes were processed, not trying again\n",
+				_parameters.url.c_str(), reason, (int64_t)received);
+			return false;
+		}
+
+		std::chrono::milliseconds backoff = policy.baseDelay;
+		for (unsigned int i = 1; i < _attempt && backoff < policy.maxDelay; ++i) {
+			backoff *= 2;
+		}
+
+		static thread_local std::mt19937 random(std::random_device{}());
+		double jitter = std::clamp(policy.jitter, 0.0, 1.0) *
+			std::uniform_real_distribution<double>(0.0, 1.0)(random);
+		backoff = std::min(backoff, policy.maxDelay);
+		backoff -= std::chrono::duration_cast<std::chrono::milliseconds>(backoff * jitter);
+
+		if (serverDelay && *serverDelay > policy.maxServerDelay) {
+			Logger::Error("Transfer::ShouldRetry: %s: %s, the server asks to wait %lld ms, not trying again\n",
+				_parameters.url.c_str(), reason, (long long)serverDelay->count());
+			return false;
+		}
+
+		delay = serverDelay ? std::max(*serverDelay, backoff) : backoff;
+		++_attempt;
+
+		char message[256];
+		snprintf(message, sizeof(message), "%s, attempt %u of %u in %lld ms", reason, _attempt,
+			policy.attempts, (long long)delay.count());
+		Logger::Warn("Transfer::ShouldRetry: %s: %s\n", _parameters.url.c_str(), message);
+		if (_descriptor) {
+			DownloadNotification notification = CreateNotification(DOWNLOAD_RETRY);
+			notification.data = _parameters.url + ": " + message;
+			notification.id = _id;
+			_descriptor->monitor.Push(notification);
+		}
+
+		return true;
+	}
+
+	std::optional<std::chrono::milliseconds> Transfer::GetServerDelay(CURL* handle, bool& rateLimited) {
+		rateLimited = false;
+		curl_off_t retryAfter = 0;
+		if (curl_easy_getinfo(handle, CURLINFO_RETRY_AFTER, &retryAfter) == CURLE_OK && retryAfter > 0) {
+			rateLimited = true;
+			return std::chrono::seconds(retryAfter);
+		}
+
+		struct curl_header* header = nullptr;
+		if (curl_easy_header(handle, "X-RateLimit-Remaining", 0, CURLH_HEADER, -1, &header) != CURLHE_OK ||
+			strtoll(header->value, NULL, 10) != 0) {
+			return std::nullopt;
+		}
+
+		rateLimited = true;
+		if (curl_easy_header(handle, "X-RateLimit-Reset", 0, CURLH_HEADER, -1, &header) != CURLHE_OK) {
+			return std::nullopt;
+		}
+
+		/* Seconds since the epoch. The clocks may differ by a little. */
+		long long reset = strtoll(header->value, NULL, 10) - (long long)time(NULL);
+		return std::chrono::seconds(std::max(reset, 0LL) + 1);
+	}
+
+	void Transfer::Abort() {
+		if (_descriptor) {
+			DownloadNotification notification = CreateNotification(DOWNLOAD_ABORTED);
+			notification.id = _id;
+			_descriptor->monitor.Push(notification);
+		}
+
+		End(CURLE_ABORTED_BY_CALLBACK);
+	}
+
+	StringTransfer::StringTransfer(RequestParameters const& parameters, std::string const& name,
+		std::shared_ptr<AsynchronousDownloadStringDescriptor> const& desc) :
+		Transfer(parameters, desc ? &desc->base : nullptr), _name(name), _desc(desc) {
+		_result.result = DOWNLOAD_STRING_BAD_CURL;
+		_result.code = CURLE_OK;
+	}
+
+	bool StringTransfer::Begin() {
+		if (_parameters.cache) {
+			CachedResponse cached;
+			if (HttpCache::Load(_parameters.url, cached)) {
+				if (!cached.etag.empty()) {
+					_parameters.headers.push_back("If-None-Match: " + cached.etag);
+				} else if (!cached.lastModified.empty()) {
+					_parameters.headers.push_back("If-Modified-Since: " + cached.lastModified);
+				}
+
+				_cached = std::move(cached);
+			}
+		}
+
+		if (!Init(&_response, _name.c_str())) {
+			Logger::Error("DownloadAsString: error while initializing cURL session for %s\n", _parameters.url.c_str());
+			_result.result = DOWNLOAD_STRING_BAD_CURL;
+			return false;
+		}
+
+		if (_parameters.cache) {
+			curl_easy_setopt(GetHandle(), CURLOPT_HEADERFUNCTION, OnHeader);
+			curl_easy_setopt(GetHandle(), CURLOPT_HEADERDATA, this);
+		}
+
+		return true;
+	}
+
+	bool StringTransfer::Restart() {
+		_response = CurlStringResponse();
+		_cached.reset();
+		_status = 0;
+		_etag.clear();
+		_lastModified.clear();
+		Reset();
+		return Begin();
+	}
+
+	void StringTransfer::End(CURLcode code) {
+		_result.code = code;
+		if (code != CURLE_OK) {
 			Logger::Error("DownloadAsString: %s: error while performing HTTP request: "
-				"cURL error: %s\n", url, curl_easy_strerror(result.code));
-			result.result = DOWNLOAD_STRING_BAD_REQUEST;
-			return result;
+				"cURL error: %s\n", _parameters.url.c_str(), curl_easy_strerror(code));
+			if (code != CURLE_ABORTED_BY_CALLBACK && UseStaleResponse(curl_easy_strerror(code))) {
+				return;
+			}
+
+			_result.result = DOWNLOAD_STRING_BAD_REQUEST;
+			return;
 		}
 
-		if (monitor) {
-			monitor->Push(CreatePerformCurlNotification(url, true));
-			monitor->Push(CreateDoneNotification(url));
+		NotifyPerform();
+		NotifyDone();
+
+		_result.result = DOWNLOAD_STRING_OK;
+		if (!_parameters.cache) {
+			_result.string = _response.GetData();
+			return;
+		}
+
+		if (_status == 304 && _cached) {
+			Logger::Info("DownloadAsString: %s: not modified, using the cached response\n", _parameters.url.c_str());
+			HttpCache::Touch(_parameters.url);
+			_result.string = std::move(_cached->body);
+			return;
+		}
+
+		/* Rate limits and server errors. */
+		if ((_status == 403 || _status == 429 || _status >= 500) && UseStaleResponse("HTTP error")) {
+			return;
 		}
 
-		result.string = data.GetData();
-		result.result = DOWNLOAD_STRING_OK;
-		return result;
+		_result.string = _response.GetData();
+		if (_status == 200) {
+			CachedResponse response;
+			response.url = _parameters.url;
+			response.etag = _etag;
+			response.lastModified = _lastModified;
+			response.body = _result.string;
+			HttpCache::Store(response);
+		}
 	}
 
-	DownloadFileDescriptor DownloadFile(RequestParameters const& parameters,
-		std::string const& filename,
-		std::shared_ptr<AsynchronousDownloadFileDescriptor> const& desc) {
-		const char* url = parameters.url.c_str();
-		CurlFileResponse response(filename);
+	size_t StringTransfer::OnHeader(char* data, size_t size, size_t n, void* userp) {
+		StringTransfer* transfer = (StringTransfer*)userp;
+		std::string name, value;
+		if (ParseHeaderLine(data, size * n, transfer->_status, name, value) == HEADER_LINE_STATUS) {
+			transfer->_etag.clear();
+			transfer->_lastModified.clear();
+		} else if (name == "etag") {
+			transfer->_etag = value;
+		} else if (name == "last-modified") {
+			transfer->_lastModified = value;
+		}
 
-		DownloadFileDescriptor result;
-		result.filename = filename;
+		return size * n;
+	}
 
-		if (!response.GetFile()) {
-			Logger::Error("DownloadFile: unable to open %s for writing\n", filename.c_str());
-			result.result = DOWNLOAD_FILE_BAD_FS;
-			return result;
+	bool StringTransfer::UseStaleResponse(const char* reason) {
+		if (!_cached || _cached->age.count() >= HttpCache::GetMaxStale()) {
+			return false;
 		}
 
-		uint32_t id = ++__downloadCounter;
-		Threading::Monitor<DownloadNotification>* monitor = desc ? &desc->base.monitor : nullptr;
-		std::atomic<bool>* cancelFlag = desc ? &desc->base.cancel : nullptr;
-		if (monitor) {
-			response.RegisterHook(std::bind_front(MonitorNotifyOnDataReceived, monitor, filename.c_str(), cancelFlag, id));
-			monitor->Push(CreateInitCurlNotification(url, false));
+		Logger::Warn("DownloadAsString: %s: %s, using the cached response from %lld seconds ago\n",
+			_parameters.url.c_str(), reason, (long long)_cached->age.count());
+		_result.result = DOWNLOAD_STRING_OK;
+		_result.string = std::move(_cached->body);
+		return true;
+	}
+
+	FileTransfer::FileTransfer(RequestParameters const& parameters, std::string const& filename,
+		std::shared_ptr<AsynchronousDownloadFileDescriptor> const& desc) :
+		Transfer(parameters, desc ? &desc->base : nullptr), _filename(filename), _desc(desc) {
+		_result.filename = filename;
+		_result.result = DOWNLOAD_FILE_BAD_CURL;
+		_result.code = CURLE_OK;
+		_result.resumedFrom = 0;
+	}
+
+	bool FileTransfer::Begin() {
+		if (_parameters.resume) {
+			ResumeState state;
+			if (state.Load(_filename) && state.url == _parameters.url) {
+				std::error_code ec;
+				uintmax_t size = std::filesystem::file_size(_filename, ec);
+				if (!ec && size == (uintmax_t)state.size) {
+					_resume = state;
+				} else {
+					Logger::Info("DownloadFile: %s changed since its download stopped, downloading it again\n",
+						_filename.c_str());
+				}
+			}
+
+			if (_resume) {
+				_parameters.headers.push_back("If-Range: " + _resume->validator);
+			} else {
+				ResumeState::Discard(_filename);
+			}
 		}
 
-		CURL* curl = curl_easy_init();
+		/* Segments are written out of order, onData would not see the body
+		 * in order.
+		 */
+		_probe = _parameters.segments > 1 && !_parameters.onData && !_parameters.maxSpeed;
 
-		if (!curl) {
-			Logger::Error("DownloadFile: error while initializing curl session to download hash\n");
-			result.result = DOWNLOAD_FILE_BAD_CURL;
-			return result;
+		_response.emplace(_filename, _resume.has_value());
+		if (!_response->GetFile()) {
+			Logger::Error("DownloadFile: unable to open %s for writing\n", _filename.c_str());
+			_result.result = DOWNLOAD_FILE_BAD_FS;
+			return false;
 		}
 
-		ScopedCURL scoppedCurl(curl);
-		InitCurlSession(curl, parameters, &response);
+		if (!Init(&*_response, _filename.c_str())) {
+			Logger::Error("DownloadFile: error while initializing curl session to download %s\n", _filename.c_str());
+			_result.result = DOWNLOAD_FILE_BAD_CURL;
+			return false;
+		}
 
-		if (monitor) {
-			monitor->Push(CreateInitCurlNotification(url, true));
-			monitor->Push(CreatePerformCurlNotification(url, false));
+		if (_parameters.resume || _probe) {
+			curl_easy_setopt(GetHandle(), CURLOPT_HEADERFUNCTION, OnHeader);
+			curl_easy_setopt(GetHandle(), CURLOPT_HEADERDATA, this);
 		}
 
-		result.code = curl_easy_perform(curl);
-		if (result.code != CURLE_OK) {
-			Logger::Error("DownloadFile: error while downloading file: %s\n", curl_easy_strerror(result.code));
-			result.result = DOWNLOAD_FILE_DOWNLOAD_ERROR;
-			return result;
+		if (_resume) {
+			Logger::Info("DownloadFile: resuming download of %s after %" PRId64 " bytes\n",
+				_filename.c_str(), (int64_t)_resume->size);
+			/* Not CURLOPT_RESUME_FROM_LARGE, which fails if the server sends
+			 * the whole file again.
+			 */
+			std::string range = std::to_string(_resume->size) + "-";
+			curl_easy_setopt(GetHandle(), CURLOPT_RANGE, range.c_str());
+		} else if (_probe) {
+			/* A server that accepts ranges answers with the size of the
+			 * file, one that does not sends the file as usual.
+			 */
+			curl_easy_setopt(GetHandle(), CURLOPT_RANGE, "0-");
 		}
 
-		if (monitor) {
-			monitor->Push(CreatePerformCurlNotification(url, true));
-			monitor->Push(CreateDoneNotification(url));
+		return true;
+	}
+
+	void FileTransfer::End(CURLcode code) {
+		_result.code = code;
+		if (code != CURLE_OK) {
+			Logger::Error("DownloadFile: error while downloading file: %s\n", curl_easy_strerror(code));
+			_result.result = DOWNLOAD_FILE_DOWNLOAD_ERROR;
+			Close(true);
+			return;
+		}
+
+		/* Close the files before the result is handed over. */
+		Close(false);
+		if (_parameters.resume) {
+			ResumeState::Discard(_filename);
+		}
+
+		NotifyPerform();
+		NotifyDone();
+
+		_result.result = DOWNLOAD_FILE_OK;
+	}
+
+	bool FileTransfer::Restart() {
+		Close(true);
+		_resume.reset();
+		_status = 0;
+		_etag.clear();
+		_lastModified.clear();
+		_rangeStart = _total = -1;
+		_probe = false;
+		_startedSegments = 0;
+		_firstSegmentDone = false;
+		_result.resumedFrom = 0;
+		Reset();
+		return Begin();
+	}
+
+	void FileTransfer::Close(bool failed) {
+		bool segmented = !_segments.empty();
+		curl_off_t contiguous = _result.resumedFrom + (_response ? (curl_off_t)_response->GetReceived() : 0);
+		_response.reset();
+		_segments.clear();
+		if (!failed || !_parameters.resume) {
+			return;
+		}
+
+		/* Only the first segment is known to be contiguous. */
+		std::error_code ec;
+		if (segmented) {
+			std::filesystem::resize_file(_filename, (uintmax_t)contiguous, ec);
+		}
+
+		if (!ec) {
+			SaveResumeState();
+		} else {
+			ResumeState::Discard(_filename);
+		}
+	}
+
+	CURL* FileTransfer::NextHandle() {
+		if (_startedSegments == _segments.size()) {
+			return nullptr;
+		}
+
+		return _segments[_startedSegments++]->curl;
+	}
+
+	bool FileTransfer::HandleDone(CURL* handle, CURLcode& code) {
+		if (_segments.empty()) {
+			return true;
+		}
+
+		if (handle == GetHandle()) {
+			/* The first handle asked for the whole file and is stopped by
+			 * the limit at the end of the first segment.
+			 */
+			if (code == CURLE_WRITE_ERROR && _response->IsLimitReached()) {
+				code = CURLE_OK;
+			} else if (code == CURLE_OK && !_response->IsLimitReached()) {
+				code = CURLE_PARTIAL_FILE;
+			}
+
+			_firstSegmentDone = true;
+		} else {
+			auto it = std::find_if(_segments.begin(), _segments.end(),
+				[handle](std::unique_ptr<FileSegment> const& segment) { return segment->curl == handle; });
+			if (it == _segments.end()) {
+				return false;
+			}
+
+			FileSegment& segment = **it;
+			long status = 0;
+			curl_easy_getinfo(handle, CURLINFO_RESPONSE_CODE, &status);
+			if (code == CURLE_WRITE_ERROR && segment.response.IsLimitReached()) {
+				code = CURLE_OK;
+			}
+
+			if (code == CURLE_OK && status != 206) {
+				Logger::Error("DownloadFile: %s: server answered the request for bytes %" PRId64 "-%" PRId64
+					" with HTTP status %ld\n", _filename.c_str(), (int64_t)segment.first, (int64_t)segment.last, status);
+				code = CURLE_RANGE_ERROR;
+			} else if (code == CURLE_OK && !segment.response.IsLimitReached()) {
+				code = CURLE_PARTIAL_FILE;
+			}
+
+			segment.done = true;
+		}
+
+		if (code != CURLE_OK) {
+			return true;
+		}
+
+		return _firstSegmentDone && std::all_of(_segments.begin(), _segments.end(),
+			[](std::unique_ptr<FileSegment> const& segment) { return segment->done; });
+	}
+
+	bool FileTransfer::PlanSegments(curl_off_t start) {
+		curl_off_t count = std::min<curl_off_t>(_parameters.segments, (_total - start) / MIN_SEGMENT_SIZE);
+		if (count < 2) {
+			return true;
+		}
+
+		/* Reserve the whole file, so that every segment can be written
+		 * at its place right away.
+		 */
+		std::error_code ec;
+		std::filesystem::resize_file(_filename, (uintmax_t)_total, ec);
+		if (ec) {
+			Logger::Warn("DownloadFile: unable to allocate %" PRId64 " bytes for %s, downloading it as a single stream\n",
+				(int64_t)_total, _filename.c_str());
+			return true;
+		}
+
+		/* Redirections were already followed, and the other segments must
+		 * come from the same version of the file.
+		 */
+		RequestParameters parameters = _parameters;
+		char* url = nullptr;
+		if (curl_easy_getinfo(GetHandle(), CURLINFO_EFFECTIVE_URL, &url) == CURLE_OK && url) {
+			parameters.url = url;
+		}
+
+		std::string validator = !_etag.empty() ? _etag : _lastModified;
+		if (!validator.empty()) {
+			parameters.headers.push_back("If-Range: " + validator);
+		}
+
+		curl_off_t size = (_total - start + count - 1) / count;
+		for (curl_off_t first = start + size; first < _total; first += size) {
+			std::unique_ptr<FileSegment> segment = std::make_unique<FileSegment>(_filename, first,
+				std::min(first + size, _total) - 1);
+			if (!segment->response.GetFile() || !segment->response.Seek(first) ||
+				!(segment->curl = curl::AcquireHandle())) {
+				Logger::Warn("DownloadFile: unable to prepare the segments of %s, downloading it as a single stream\n",
+					_filename.c_str());
+				_segments.clear();
+				return true;
+			}
+
+			segment->headers = InitCurlSession(segment->curl, parameters, &segment->response);
+			std::string range = std::to_string(segment->first) + "-" + std::to_string(segment->last);
+			curl_easy_setopt(segment->curl, CURLOPT_RANGE, range.c_str());
+			segment->response.SetLimit(segment->last - segment->first + 1);
+			RegisterHooks(&segment->response, _filename.c_str());
+			_segments.push_back(std::move(segment));
+		}
+
+		_response->SetLimit(size);
+		Logger::Info("DownloadFile: downloading %s (%" PRId64 " bytes from %" PRId64 ") in %zu segments\n",
+			_filename.c_str(), (int64_t)(_total - start), (int64_t)start, _segments.size() + 1);
+		return true;
+	}
+
+	FileSegment::FileSegment(std::string const& filename, curl_off_t first, curl_off_t last) :
+		first(first), last(last), response(filename, true) {
+
+	}
+
+	FileSegment::~FileSegment() {
+		curl::ReleaseHandle(curl);
+
+		if (headers) {
+			curl_slist_free_all(headers);
+		}
+	}
+
+	size_t FileTransfer::OnHeader(char* data, size_t size, size_t n, void* userp) {
+		FileTransfer* transfer = (FileTransfer*)userp;
+		std::string name, value;
+		switch (ParseHeaderLine(data, size * n, transfer->_status, name, value)) {
+		case HEADER_LINE_STATUS:
+			transfer->_etag.clear();
+			transfer->_lastModified.clear();
+			transfer->_rangeStart = transfer->_total = -1;
+			return size * n;
+
+		case HEADER_LINE_END: {
+			bool final = transfer->_status >= 200 && (transfer->_status < 300 || transfer->_status >= 400);
+			if (final && !transfer->OnHeadersDone()) {
+				return 0;
+			}
+
+			return size * n;
+		}
+
+		default:
+			break;
+		}
+
+		if (name == "etag") {
+			/* Weak validators cannot be used in If-Range. */
+			if (!value.starts_with("W/")) {
+				transfer->_etag = value;
+			}
+		} else if (name == "last-modified") {
+			transfer->_lastModified = value;
+		} else if (name == "content-length" && transfer->_status == 200) {
+			transfer->_total = strtoll(value.c_str(), NULL, 10);
+		} else if (name == "content-range") {
+			long long first = 0, last = 0, total = 0;
+			int count = sscanf(value.c_str(), "bytes %lld-%lld/%lld", &first, &last, &total);
+			if (count >= 2) {
+				transfer->_rangeStart = first;
+				transfer->_total = count == 3 ? total : -1;
+			}
+		}
+
+		return size * n;
+	}
+
+	bool FileTransfer::OnHeadersDone() {
+		if (_status == 206) {
+			if (_resume) {
+				if (_rangeStart != _resume->size ||
+					(_resume->total >= 0 && _total >= 0 && _total != _resume->total)) {
+					Logger::Error("DownloadFile: %s: the server did not send the rest of the file, "
+						"discarding what was downloaded\n", _filename.c_str());
+					_resume.reset();
+					ResumeState::Discard(_filename);
+					return false;
+				}
+
+				_result.resumedFrom = _resume->size;
+			} else if (!_probe || _rangeStart != 0) {
+				Logger::Error("DownloadFile: %s: the server did not send the start of the file\n", _filename.c_str());
+				return false;
+			}
+
+			return !_probe || PlanSegments(_rangeStart);
+		}
+
+		if (_status == 200) {
+			if (_probe) {
+				Logger::Info("DownloadFile: %s: the server does not accept ranges, downloading it as a single stream\n",
+					_filename.c_str());
+			}
+
+			if (_resume) {
+				Logger::Info("DownloadFile: %s changed on the server, downloading it again\n", _filename.c_str());
+				_resume.reset();
+				return _response->Truncate();
+			}
+
+			return true;
+		}
+
+		/* Do not overwrite what was received so far with an error page. */
+		Logger::Error("DownloadFile: %s: server answered with HTTP status %ld\n", _filename.c_str(), _status);
+		if (_status == 416) {
+			_resume.reset();
+			ResumeState::Discard(_filename);
+		}
+
+		_status = 0;
+		return false;
+	}
+
+	void FileTransfer::SaveResumeState() {
+		/* Only the body of a successful response can be continued. */
+		if (_status != 200 && _status != 206) {
+			return;
+		}
+
+		ResumeState state;
+		state.url = _parameters.url;
+		state.validator = !_etag.empty() ? _etag : _lastModified;
+		if (state.validator.empty() && _resume) {
+			state.validator = _resume->validator;
+		}
+
+		std::error_code ec;
+		uintmax_t size = std::filesystem::file_size(_filename, ec);
+		if (state.validator.empty() || ec || !size) {
+			ResumeState::Discard(_filename);
+			return;
 		}
 
-		result.result = DOWNLOAD_FILE_OK;
-		return result;
+		state.size = (curl_off_t)size;
+		state.total = _total;
+		if (state.Save(_filename)) {
+			Logger::Info("DownloadFile: %" PRId64 " bytes of %s kept to resume the download later\n",
+				(int64_t)state.size, _filename.c_str());
+		}
+	}
+
+	std::string ResumeState::PathOf(std::string const& filename) {
+		return filename + ".resume";
+	}
+
+	bool ResumeState::Load(std::string const& filename) {
+		std::ifstream in(PathOf(filename));
+		std::string header, sizeLine, totalLine;
+		if (!std::getline(in, header) || header != HEADER || !std::getline(in, url) ||
+			!std::getline(in, validator) || !std::getline(in, sizeLine) || !std::getline(in, totalLine)) {
+			return false;
+		}
+
+		char* end = nullptr;
+		size = strtoll(sizeLine.c_str(), &end, 10);
+		if (*end || size <= 0 || validator.empty()) {
+			return false;
+		}
+
+		total = strtoll(totalLine.c_str(), &end, 10);
+		return !*end;
+	}
+
+	bool ResumeState::Save(std::string const& filename) const {
+		std::string content = std::string(HEADER) + "\n" + url + "\n" + validator + "\n" +
+			std::to_string(size) + "\n" + std::to_string(total) + "\n";
+		if (!Filesystem::AtomicWriteFile(PathOf(filename).c_str(), content.data(), content.size())) {
+			Logger::Warn("DownloadFile: unable to save the state of the download of %s\n", filename.c_str());
+			return false;
+		}
+
+		return true;
+	}
+
+	void ResumeState::Discard(std::string const& filename) {
+		std::error_code ec;
+		std::filesystem::remove(PathOf(filename), ec);
+	}
+
+	DownloadStringDescriptor DownloadString(RequestParameters const& parameters,
+		std::string const& name,
+		std::shared_ptr<AsynchronousDownloadStringDescriptor> const& desc) {
+		StringTransfer transfer(parameters, name, desc);
+		Perform(transfer);
+		return transfer.GetResult();
+	}
+
+	DownloadFileDescriptor DownloadFile(RequestParameters const& parameters,
+		std::string const& filename,
+		std::shared_ptr<AsynchronousDownloadFileDescriptor> const& desc) {
+		/* Segments need the multi handle of the GithubExecutor. */
+		RequestParameters single = parameters;
+		single.segments = 1;
+		FileTransfer transfer(single, filename, desc);
+		Perform(transfer);
+		return transfer.GetResult();
+	}
+
+	void Perform(Transfer& transfer) {
+		if (!transfer.Begin()) {
+			return;
+		}
+
+		while (true) {
+			CURLcode code = curl_easy_perform(transfer.GetHandle());
+			std::chrono::milliseconds delay;
+			if (!transfer.ShouldRetry(transfer.GetHandle(), code, delay)) {
+				transfer.End(code);
+				return;
+			}
+
+			std::this_thread::sleep_for(delay);
+			if (!transfer.Restart()) {
+				return;
+			}
+		}
 	}
 
 	std::optional<std::string> GetCurlProxyString() {
@@ -171,7 +852,7 @@ namespace curl::detail {
 		return proxyString;
 	}
 
-	void InitCurlSession(CURL* curl, RequestParameters const& request,
+	struct curl_slist* InitCurlSession(CURL* curl, RequestParameters const& request,
 		AbstractCurlResponseHandler* handler) {
 		struct curl_slist* headers = NULL;
 
@@ -201,6 +882,43 @@ namespace curl::detail {
 		if (request.serverTimeout) {
 			curl_easy_setopt(curl, CURLOPT_CONNECTTIMEOUT_MS, request.serverTimeout);
 		}
+
+		return headers;
+	}
+
+	HeaderLineType ParseHeaderLine(const char* data, size_t len, long& status,
+		std::string& name, std::string& value) {
+		std::string line(data, len);
+		while (!line.empty() && (line.back() == '\r' || line.back() == '\n')) {
+			line.pop_back();
+		}
+
+		if (line.starts_with("HTTP/")) {
+			status = 0;
+			size_t space = line.find(' ');
+			if (space != std::string::npos) {
+				status = strtol(line.c_str() + space + 1, NULL, 10);
+			}
+
+			return HEADER_LINE_STATUS;
+		}
+
+		if (line.empty()) {
+			return HEADER_LINE_END;
+		}
+
+		size_t colon = line.find(':');
+		if (colon == std::string::npos) {
+			name.clear();
+			value.clear();
+			return HEADER_LINE_FIELD;
+		}
+
+		name = line.substr(0, colon);
+		std::transform(name.begin(), name.end(), name.begin(), [](unsigned char c) { return (char)tolower(c); });
+		size_t start = line.find_first_not_of(" \t", colon + 1);
+		value = start == std::string::npos ? std::string() : line.substr(start);
+		return HEADER_LINE_FIELD;
 	}
 
 	bool MonitorNotifyOnDataReceived(Threading::Monitor<DownloadNotification>* monitor,
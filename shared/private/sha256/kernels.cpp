@@ -0,0 +1,357 @@
+#include <cstdint>
+#include <cstring>
+
+#if defined(_M_IX86) || defined(_M_X64) || defined(__i386__) || defined(__x86_64__)
+#define SHA256_X86 1
+#if defined(_MSC_VER)
+#include <intrin.h>
+#else
+#include <immintrin.h>
+#endif
+#endif
+
+/* MSVC lets any function use any intrinsic, GCC and Clang need to be told
+ * which instructions a function may contain.
+ */
+#if defined(SHA256_X86) && !defined(_MSC_VER)
+#define SHA256_TARGET(x) __attribute__((target(x)))
+#else
+#define SHA256_TARGET(x)
+#endif
+
+#include "shared/cpu_features.h"
+#include "shared/private/sha256/kernels.h"
+
+namespace Sha256::detail {
+	alignas(64) static const uint32_t K[64] = {
+		0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+		0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+		0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+		0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+		0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+		0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+		0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+		0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+	};
+
+	static const uint32_t H0[8] = {
+		0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+	};
+
+	static inline uint32_t Rotr(uint32_t x, int n) {
+		return (x >> n) | (x << (32 - n));
+	}
+
+	static inline uint32_t LoadBE32(const unsigned char* p) {
+		return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | (uint32_t)p[3];
+	}
+
+	void CompressScalar(uint32_t state[8], const unsigned char* data, size_t blocks) {
+		uint32_t w[64];
+
+		while (blocks--) {
+			for (int t = 0; t < 16; ++t) {
+				w[t] = LoadBE32(data + 4 * t);
+			}
+
+			for (int t = 16; t < 64; ++t) {
+				uint32_t s0 = Rotr(w[t - 15], 7) ^ Rotr(w[t - 15], 18) ^ (w[t - 15] >> 3);
+				uint32_t s1 = Rotr(w[t - 2], 17) ^ Rotr(w[t - 2], 19) ^ (w[t - 2] >> 10);
+				w[t] = w[t - 16] + s0 + w[t - 7] + s1;
+			}
+
+			uint32_t a = state[0], b = state[1], c = state[2], d = state[3];
+			uint32_t e = state[4], f = state[5], g = state[6], h = state[7];
+
+			for (int t = 0; t < 64; ++t) {
+				uint32_t S1 = Rotr(e, 6) ^ Rotr(e, 11) ^ Rotr(e, 25);
+				uint32_t ch = (e & f) ^ (~e & g);
+				uint32_t t1 = h + S1 + ch + K[t] + w[t];
+				uint32_t S0 = Rotr(a, 2) ^ Rotr(a, 13) ^ Rotr(a, 22);
+				uint32_t maj = (a & b) ^ (a & c) ^ (b & c);
+				uint32_t t2 = S0 + maj;
+
+				h = g;
+				g = f;
+				f = e;
+				e = d + t1;
+				d = c;
+				c = b;
+				b = a;
+				a = t1 + t2;
+			}
+
+			state[0] += a; state[1] += b; state[2] += c; state[3] += d;
+			state[4] += e; state[5] += f; state[6] += g; state[7] += h;
+
+			data += BLOCK_SIZE;
+		}
+	}
+
+	void Compress8xScalar(uint32_t states[LANES][8], const unsigned char* const data[LANES], size_t blocks) {
+		for (size_t lane = 0; lane < LANES; ++lane) {
+			CompressScalar(states[lane], data[lane], blocks);
+		}
+	}
+
+#ifdef SHA256_X86
+	/* Adapted from the reference code published by Intel alongside the SHA
+	 * extensions. The state is kept as ABEF / CDGH pairs, the layout
+	 * expected by sha256rnds2. Each iteration of the inner loop performs four
+	 * rounds and, while they run, computes the next four words of the message
+	 * schedule.
+	 */
+	SHA256_TARGET("sha,sse4.1")
+	void CompressSHANI(uint32_t state[8], const unsigned char* data, size_t blocks) {
+		const __m128i MASK = _mm_set_epi64x(0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL);
+
+		__m128i tmp = _mm_loadu_si128((const __m128i*)&state[0]);
+		__m128i state1 = _mm_loadu_si128((const __m128i*)&state[4]);
+		tmp = _mm_shuffle_epi32(tmp, 0xB1);             /* CDAB */
+		state1 = _mm_shuffle_epi32(state1, 0x1B);       /* EFGH */
+		__m128i state0 = _mm_alignr_epi8(tmp, state1, 8);    /* ABEF */
+		state1 = _mm_blend_epi16(state1, tmp, 0xF0);    /* CDGH */
+
+		while (blocks--) {
+			__m128i abefSave = state0;
+			__m128i cdghSave = state1;
+			__m128i msgs[4];
+
+			for (int i = 0; i < 4; ++i) {
+				msgs[i] = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(data + 16 * i)), MASK);
+			}
+
+			for (int i = 0; i < 16; ++i) {
+				__m128i& current = msgs[i & 3];
+				__m128i& next = msgs[(i + 1) & 3];
+				__m128i& previous = msgs[(i + 3) & 3];
+
+				__m128i msg = _mm_add_epi32(current, _mm_load_si128((const __m128i*)&K[4 * i]));
+				state1 = _mm_sha256rnds2_epu32(state1, state0, msg);
+
+				if (i >= 3 && i < 15) {
+					next = _mm_add_epi32(next, _mm_alignr_epi8(current, previous, 4));
+					next = _mm_sha256msg2_epu32(next, current);
+				}
+
+				msg = _mm_shuffle_epi32(msg, 0x0E);
+				state0 = _mm_sha256rnds2_epu32(state0, state1, msg);
+
+				if (i >= 1 && i < 13) {
+					previous = _mm_sha256msg1_epu32(previous, current);
+				}
+			}
+
+			state0 = _mm_add_epi32(state0, abefSave);
+			state1 = _mm_add_epi32(state1, cdghSave);
+			data += BLOCK_SIZE;
+		}
+
+		tmp = _mm_shuffle_epi32(state0, 0x1B);          /* FEBA */
+		state1 = _mm_shuffle_epi32(state1, 0xB1);       /* DCHG */
+		state0 = _mm_blend_epi16(tmp, state1, 0xF0);    /* DCBA */
+		state1 = _mm_alignr_epi8(state1, tmp, 8);       /* HGFE */
+
+		_mm_storeu_si128((__m128i*)&state[0], state0);
+		_mm_storeu_si128((__m128i*)&state[4], state1);
+	}
+
+	/* Eight messages at once, one per 32 bits lane of the AVX2 registers.
+	 * Same algorithm as CompressScalar, with every variable widened to a
+	 * vector.
+	 */
+	SHA256_TARGET("avx2")
+	static inline __m256i Rotr8x(__m256i x, int n) {
+		return _mm256_or_si256(_mm256_srli_epi32(x, n), _mm256_slli_epi32(x, 32 - n));
+	}
+
+	SHA256_TARGET("avx2")
+	void Compress8xAVX2(uint32_t states[LANES][8], const unsigned char* const data[LANES], size_t blocks) {
+		const __m256i BSWAP = _mm256_set_epi8(
+			12, 13, 14, 15, 8, 9, 10, 11, 4, 5, 6, 7, 0, 1, 2, 3,
+			12, 13, 14, 15, 8, 9, 10, 11, 4, 5, 6, 7, 0, 1, 2, 3);
+
+		alignas(32) uint32_t transposed[8][LANES];
+		for (int i = 0; i < 8; ++i) {
+			for (size_t lane = 0; lane < LANES; ++lane) {
+				transposed[i][lane] = states[lane][i];
+			}
+		}
+
+		__m256i v[8];
+		for (int i = 0; i < 8; ++i) {
+			v[i] = _mm256_load_si256((const __m256i*)transposed[i]);
+		}
+
+		for (size_t block = 0; block < blocks; ++block) {
+			__m256i w[64];
+			size_t offset = block * BLOCK_SIZE;
+
+			/* Transpose the 16 words of each lane into 16 vectors. */
+			alignas(32) uint32_t words[16][LANES];
+			for (size_t lane = 0; lane < LANES; ++lane) {
+				const unsigned char* p = data[lane] + offset;
+				for (int t = 0; t < 16; ++t) {
+					memcpy(&words[t][lane], p + 4 * t, 4);
+				}
+			}
+
+			for (int t = 0; t < 16; ++t) {
+				w[t] = _mm256_shuffle_epi8(_mm256_load_si256((const __m256i*)words[t]), BSWAP);
+			}
+
+			for (int t = 16; t < 64; ++t) {
+				__m256i w15 = w[t - 15], w2 = w[t - 2];
+				__m256i s0 = _mm256_xor_si256(_mm256_xor_si256(Rotr8x(w15, 7), Rotr8x(w15, 18)),
+					_mm256_srli_epi32(w15, 3));
+				__m256i s1 = _mm256_xor_si256(_mm256_xor_si256(Rotr8x(w2, 17), Rotr8x(w2, 19)),
+					_mm256_srli_epi32(w2, 10));
+				w[t] = _mm256_add_epi32(_mm256_add_epi32(w[t - 16], s0), _mm256_add_epi32(w[t - 7], s1));
+			}
+
+			__m256i a = v[0], b = v[1], c = v[2], d = v[3];
+			__m256i e = v[4], f = v[5], g = v[6], h = v[7];
+
+			for (int t = 0; t < 64; ++t) {
+				__m256i S1 = _mm256_xor_si256(_mm256_xor_si256(Rotr8x(e, 6), Rotr8x(e, 11)), Rotr8x(e, 25));
+				__m256i ch = _mm256_xor_si256(_mm256_and_si256(e, f), _mm256_andnot_si256(e, g));
+				__m256i t1 = _mm256_add_epi32(_mm256_add_epi32(h, S1),
+					_mm256_add_epi32(_mm256_add_epi32(ch, _mm256_set1_epi32((int)K[t])), w[t]));
+				__m256i S0 = _mm256_xor_si256(_mm256_xor_si256(Rotr8x(a, 2), Rotr8x(a, 13)), Rotr8x(a, 22));
+				__m256i maj = _mm256_xor_si256(_mm256_xor_si256(_mm256_and_si256(a, b), _mm256_and_si256(a, c)),
+					_mm256_and_si256(b, c));
+				__m256i t2 = _mm256_add_epi32(S0, maj);
+
+				h = g;
+				g = f;
+				f = e;
+				e = _mm256_add_epi32(d, t1);
+				d = c;
+				c = b;
+				b = a;
+				a = _mm256_add_epi32(t1, t2);
+			}
+
+			v[0] = _mm256_add_epi32(v[0], a); v[1] = _mm256_add_epi32(v[1], b);
+			v[2] = _mm256_add_epi32(v[2], c); v[3] = _mm256_add_epi32(v[3], d);
+			v[4] = _mm256_add_epi32(v[4], e); v[5] = _mm256_add_epi32(v[5], f);
+			v[6] = _mm256_add_epi32(v[6], g); v[7] = _mm256_add_epi32(v[7], h);
+		}
+
+		for (int i = 0; i < 8; ++i) {
+			_mm256_store_si256((__m256i*)transposed[i], v[i]);
+			for (size_t lane = 0; lane < LANES; ++lane) {
+				states[lane][i] = transposed[i][lane];
+			}
+		}
+	}
+#else
+	void CompressSHANI(uint32_t state[8], const unsigned char* data, size_t blocks) {
+		CompressScalar(state, data, blocks);
+	}
+
+	void Compress8xAVX2(uint32_t states[LANES][8], const unsigned char* const data[LANES], size_t blocks) {
+		Compress8xScalar(states, data, blocks);
+	}
+#endif
+
+	/* Hash a message that fits in two blocks, with the padding done by hand
+	 * so that the test does not depend on Context.
+	 */
+	static void HashShort(CompressFn compress, const char* message, uint32_t state[8]) {
+		unsigned char blocks[2 * BLOCK_SIZE] = { 0 };
+		size_t length = strlen(message);
+		memcpy(blocks, message, length);
+		blocks[length] = 0x80;
+
+		size_t count = length + 9 > BLOCK_SIZE ? 2 : 1;
+		uint64_t bits = (uint64_t)length * 8;
+		for (int i = 0; i < 8; ++i) {
+			blocks[count * BLOCK_SIZE - 1 - i] = (unsigned char)(bits >> (8 * i));
+		}
+
+		memcpy(state, H0, sizeof(H0));
+		compress(state, blocks, count);
+	}
+
+	bool SelfTest(CompressFn compress) {
+		static const struct {
+			const char* message;
+			uint32_t digest[8];
+		} vectors[] = {
+			{ "", { 0xe3b0c442, 0x98fc1c14, 0x9afbf4c8, 0x996fb924, 0x27ae41e4, 0x649b934c, 0xa495991b, 0x7852b855 } },
+			{ "abc", { 0xba7816bf, 0x8f01cfea, 0x414140de, 0x5dae2223, 0xb00361a3, 0x96177a9c, 0xb410ff61, 0xf20015ad } },
+			{ "abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq",
+				{ 0x248d6a61, 0xd20638b8, 0xe5c02693, 0x0c3e6039, 0xa33ce459, 0x64ff2167, 0xf6ecedd4, 0x19db06c1 } }
+		};
+
+		for (auto const& vector : vectors) {
+			uint32_t state[8];
+			HashShort(compress, vector.message, state);
+			if (memcmp(state, vector.digest, sizeof(state))) {
+				return false;
+			}
+		}
+
+		return true;
+	}
+
+	bool SelfTest8x(Compress8xFn compress) {
+		static constexpr size_t BLOCKS = 3;
+		unsigned char buffers[LANES][BLOCKS * BLOCK_SIZE];
+		const unsigned char* data[LANES];
+		uint32_t expected[LANES][8], states[LANES][8];
+
+		uint32_t seed = 0x9e3779b9;
+		for (size_t lane = 0; lane < LANES; ++lane) {
+			for (unsigned char& byte : buffers[lane]) {
+				seed = seed * 1664525 + 1013904223;
+				byte = (unsigned char)(seed >> 24);
+			}
+
+			data[lane] = buffers[lane];
+			memcpy(expected[lane], H0, sizeof(H0));
+			memcpy(states[lane], H0, sizeof(H0));
+			CompressScalar(expected[lane], data[lane], BLOCKS);
+		}
+
+		compress(states, data, BLOCKS);
+		return memcmp(states, expected, sizeof(states)) == 0;
+	}
+
+	static Backend SelectBackend() {
+		CPU::Features const& features = CPU::GetFeatures();
+		if (features.sha && features.ssse3 && features.sse41 && SelfTest(CompressSHANI)) {
+			return BACKEND_SHANI;
+		}
+
+		return BACKEND_SCALAR;
+	}
+
+	static bool SelectMultiBuffer() {
+		CPU::Features const& features = CPU::GetFeatures();
+		return features.avx2 && SelfTest8x(Compress8xAVX2);
+	}
+
+	/* Selected once during static initialization. Both default to the
+	 * scalar kernels if something hashes before this runs.
+	 */
+	static Backend _backend = SelectBackend();
+	static bool _multiBuffer = SelectMultiBuffer();
+
+	Backend GetBackend() {
+		return _backend;
+	}
+
+	CompressFn GetCompress() {
+		return _backend == BACKEND_SHANI ? CompressSHANI : CompressScalar;
+	}
+
+	bool HasMultiBuffer() {
+		return _multiBuffer;
+	}
+
+	Compress8xFn GetCompress8x() {
+		return _multiBuffer ? Compress8xAVX2 : Compress8xScalar;
+	}
+}
@@ -1,11 +1,10 @@
 #include "shared/scoped_curl.h"
+#include "shared/curl/handle_pool.h"
 
 ScopedCURL::ScopedCURL(CURL* curl) : _curl(curl) {
 
 }
 
 ScopedCURL::~ScopedCURL() {
-	if (_curl) {
-		curl_easy_cleanup(_curl);
-	}
+	curl::ReleaseHandle(_curl);
 }
\ No newline at end of file
@@ -1,14 +1,18 @@
 #include <WinSock2.h>
 #include <Windows.h>
+#include <bcrypt.h>
 
 #include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
 #include <memory>
 #include <sstream>
 #include <stdexcept>
 #include <string>
 
-#include "shared/filesystem.h"
 #include "shared/sha256.h"
+#include "shared/private/sha256/kernels.h"
 
 const char* HashResultToString(HashResult result) {
 	switch (result) {
@@ -24,98 +28,316 @@ const char* HashResultToString(HashResult result) {
 	case HASH_BCRYPT:
 		return "bcrypt";
 
+	case HASH_IO:
+		return "I/O error";
+
+	case HASH_CANCELLED:
+		return "cancelled";
+
 	default:
 		std::terminate();
 	}
 }
 
 namespace Sha256 {
-	HashResult Sha256F(const char* filename, std::string& result) {
-		WIN32_FIND_DATAA data;
-		if (!Filesystem::FindFile(filename, &data)) {
-			return HASH_INVALID_FILE;
+	static const uint32_t INITIAL_STATE[8] = {
+		0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+	};
+
+	static void ToHex(const unsigned char* digest, size_t size, std::string& result) {
+		static const char digits[] = "0123456789abcdef";
+		result.resize(size * 2);
+		for (size_t i = 0; i < size; ++i) {
+			result[2 * i] = digits[digest[i] >> 4];
+			result[2 * i + 1] = digits[digest[i] & 0xF];
 		}
+	}
 
-		std::unique_ptr<char[]> content(new char[data.nFileSizeLow]);
-		if (!content) {
-			return HASH_NO_MEMORY;
+	Context::Context() {
+		Init();
+	}
+
+	HashResult Context::Init() {
+		memcpy(_state, INITIAL_STATE, sizeof(_state));
+		_buffered = 0;
+		_length = 0;
+		return HASH_OK;
+	}
+
+	HashResult Context::Update(const void* data, size_t size) {
+		const unsigned char* bytes = (const unsigned char*)data;
+		detail::CompressFn compress = detail::GetCompress();
+		_length += size;
+
+		if (_buffered) {
+			size_t missing = detail::BLOCK_SIZE - _buffered;
+			if (size < missing) {
+				memcpy(_buffer + _buffered, bytes, size);
+				_buffered += size;
+				return HASH_OK;
+			}
+
+			memcpy(_buffer + _buffered, bytes, missing);
+			compress(_state, _buffer, 1);
+			bytes += missing;
+			size -= missing;
+			_buffered = 0;
 		}
 
-		FILE* f = fopen(filename, "rb");
-		fread(content.get(), data.nFileSizeLow, 1, f);
-		fclose(f);
+		size_t blocks = size / detail::BLOCK_SIZE;
+		if (blocks) {
+			compress(_state, bytes, blocks);
+			bytes += blocks * detail::BLOCK_SIZE;
+			size -= blocks * detail::BLOCK_SIZE;
+		}
 
-		return Sha256(content.get(), data.nFileSizeLow, result);
+		memcpy(_buffer, bytes, size);
+		_buffered = size;
+		return HASH_OK;
 	}
 
-	HashResult Sha256(const char* str, size_t size, std::string& result) {
+	HashResult Context::Final(std::string& result) {
+		detail::CompressFn compress = detail::GetCompress();
+		uint64_t bits = _length * 8;
+
+		_buffer[_buffered++] = 0x80;
+		if (_buffered > detail::BLOCK_SIZE - 8) {
+			memset(_buffer + _buffered, 0, detail::BLOCK_SIZE - _buffered);
+			compress(_state, _buffer, 1);
+			_buffered = 0;
+		}
+
+		memset(_buffer + _buffered, 0, detail::BLOCK_SIZE - 8 - _buffered);
+		for (int i = 0; i < 8; ++i) {
+			_buffer[detail::BLOCK_SIZE - 1 - i] = (unsigned char)(bits >> (8 * i));
+		}
+
+		compress(_state, _buffer, 1);
+
+		unsigned char digest[32];
+		for (int i = 0; i < 8; ++i) {
+			digest[4 * i] = (unsigned char)(_state[i] >> 24);
+			digest[4 * i + 1] = (unsigned char)(_state[i] >> 16);
+			digest[4 * i + 2] = (unsigned char)(_state[i] >> 8);
+			digest[4 * i + 3] = (unsigned char)_state[i];
+		}
+
+		ToHex(digest, sizeof(digest), result);
+		return Init();
+	}
+
+	const char* GetBackendName() {
+		switch (detail::GetBackend()) {
+		case detail::BACKEND_SHANI:
+			return detail::HasMultiBuffer() ? "SHA-NI (AVX2 multi-buffer)" : "SHA-NI";
+
+		default:
+			return detail::HasMultiBuffer() ? "scalar (AVX2 multi-buffer)" : "scalar";
+		}
+	}
+
+	HashResult HashBuffers(const void* const* buffers, const size_t* sizes,
+		size_t count, std::string* results) {
+		for (size_t first = 0; first < count; first += detail::LANES) {
+			size_t lanes = std::min(detail::LANES, count - first);
+
+			/* Run the blocks shared by every buffer of the group through the
+			 * multi-buffer kernel, then finish each buffer on its own.
+			 */
+			size_t common = 0;
+			uint32_t states[detail::LANES][8];
+			if (lanes > 1 && detail::HasMultiBuffer()) {
+				common = SIZE_MAX;
+				const unsigned char* data[detail::LANES];
+				for (size_t lane = 0; lane < detail::LANES; ++lane) {
+					size_t index = first + (lane < lanes ? lane : 0);
+					data[lane] = (const unsigned char*)buffers[index];
+					common = std::min(common, sizes[index] / detail::BLOCK_SIZE);
+					memcpy(states[lane], INITIAL_STATE, sizeof(INITIAL_STATE));
+				}
+
+				if (common) {
+					detail::GetCompress8x()(states, data, common);
+				}
+			}
+
+			for (size_t lane = 0; lane < lanes; ++lane) {
+				size_t index = first + lane;
+				size_t done = common * detail::BLOCK_SIZE;
+
+				Context context;
+				if (common) {
+					memcpy(context._state, states[lane], sizeof(context._state));
+					context._length = done;
+				}
+
+				context.Update((const unsigned char*)buffers[index] + done, sizes[index] - done);
+				context.Final(results[index]);
+			}
+		}
+
+		return HASH_OK;
+	}
+
+	HashResult Sha256BCrypt(const void* data, size_t size, std::string& result) {
 		BCRYPT_ALG_HANDLE alg;
 		NTSTATUS err = BCryptOpenAlgorithmProvider(&alg, BCRYPT_SHA256_ALGORITHM, NULL, 0);
 		if (!BCRYPT_SUCCESS(err)) {
 			return HASH_BCRYPT;
 		}
 
-		DWORD buffSize;
-		DWORD dummy;
-		err = BCryptGetProperty(alg, BCRYPT_OBJECT_LENGTH, (unsigned char*)&buffSize, sizeof(buffSize), &dummy, 0);
-		if (!BCRYPT_SUCCESS(err)) {
-			return HASH_BCRYPT;
+		HashResult hashResult = HASH_BCRYPT;
+		BCRYPT_HASH_HANDLE hash = NULL;
+		unsigned char digest[32];
+		err = BCryptCreateHash(alg, &hash, NULL, 0, NULL, 0, 0);
+		if (BCRYPT_SUCCESS(err)) {
+			/* BCryptHashData takes a ULONG, feed it in slices so that buffers
+			 * larger than 4 GB are hashed entirely.
+			 */
+			const unsigned char* bytes = (const unsigned char*)data;
+			while (size && BCRYPT_SUCCESS(err)) {
+				ULONG slice = size > MAXULONG ? MAXULONG : (ULONG)size;
+				err = BCryptHashData(hash, (PUCHAR)bytes, slice, 0);
+				bytes += slice;
+				size -= slice;
+			}
+
+			if (BCRYPT_SUCCESS(err)) {
+				err = BCryptFinishHash(hash, digest, sizeof(digest), 0);
+			}
+
+			if (BCRYPT_SUCCESS(err)) {
+				ToHex(digest, sizeof(digest), result);
+				hashResult = HASH_OK;
+			}
+
+			BCryptDestroyHash(hash);
 		}
 
-		BCRYPT_HASH_HANDLE hashHandle;
-		std::unique_ptr<unsigned char[]> hashBuffer(new unsigned char[buffSize]);
-		if (!hashBuffer) {
+		BCryptCloseAlgorithmProvider(alg, 0);
+		return hashResult;
+	}
+
+	static HashResult HashFileRead(HANDLE file, Context& context, std::atomic<bool> const* cancel) {
+		std::unique_ptr<unsigned char[]> buffer(new (std::nothrow) unsigned char[FILE_BLOCK_SIZE]);
+		if (!buffer) {
 			return HASH_NO_MEMORY;
 		}
 
-		err = BCryptCreateHash(alg, &hashHandle, hashBuffer.get(), buffSize, NULL, 0, 0);
-		if (!BCRYPT_SUCCESS(err)) {
-			return HASH_BCRYPT;
+		for (;;) {
+			if (cancel && cancel->load(std::memory_order_relaxed)) {
+				return HASH_CANCELLED;
+			}
+
+			DWORD read = 0;
+			if (!ReadFile(file, buffer.get(), (DWORD)FILE_BLOCK_SIZE, &read, NULL)) {
+				return HASH_IO;
+			}
+
+			if (read == 0) {
+				return HASH_OK;
+			}
+
+			HashResult result = context.Update(buffer.get(), read);
+			if (result != HASH_OK) {
+				return result;
+			}
 		}
+	}
 
-		err = BCryptHashData(hashHandle, (unsigned char*)str, size, 0);
-		if (!BCRYPT_SUCCESS(err)) {
-			return HASH_BCRYPT;
+	static HashResult HashFileMapped(HANDLE file, Context& context, std::atomic<bool> const* cancel) {
+		LARGE_INTEGER size;
+		if (!GetFileSizeEx(file, &size)) {
+			return HASH_IO;
 		}
 
-		DWORD hashSize;
-		err = BCryptGetProperty(alg, BCRYPT_HASH_LENGTH, (unsigned char*)&hashSize, sizeof(hashSize), &dummy, 0);
-		if (!BCRYPT_SUCCESS(err)) {
-			return HASH_BCRYPT;
+		/* CreateFileMapping refuses to map empty files. */
+		if (size.QuadPart == 0) {
+			return HASH_OK;
 		}
 
-		std::unique_ptr<unsigned char[]> hash(new unsigned char[hashSize]);
-		if (!hash) {
-			return HASH_NO_MEMORY;
+		HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+		if (!mapping) {
+			return HASH_IO;
 		}
 
-		err = BCryptFinishHash(hashHandle, hash.get(), hashSize, 0);
-		if (!BCRYPT_SUCCESS(err)) {
-			return HASH_BCRYPT;
+		HashResult result = HASH_OK;
+		uint64_t offset = 0;
+		uint64_t total = (uint64_t)size.QuadPart;
+		while (offset < total && result == HASH_OK) {
+			if (cancel && cancel->load(std::memory_order_relaxed)) {
+				result = HASH_CANCELLED;
+				break;
+			}
+
+			size_t length = (size_t)std::min<uint64_t>(FILE_VIEW_SIZE, total - offset);
+			void* view = MapViewOfFile(mapping, FILE_MAP_READ, (DWORD)(offset >> 32),
+				(DWORD)(offset & 0xFFFFFFFF), length);
+			if (!view) {
+				result = HASH_IO;
+				break;
+			}
+
+			result = context.Update(view, length);
+			UnmapViewOfFile(view);
+			offset += length;
 		}
 
-		hashBuffer.reset();
-		std::unique_ptr<char[]> hashHex(new char[hashSize * 2 + 1]);
-		if (!hashHex) {
-			return HASH_NO_MEMORY;
+		CloseHandle(mapping);
+		return result;
+	}
+
+	HashResult HashFile(const char* filename, std::string& result, HashFileMode mode,
+		std::atomic<bool> const* cancel) {
+		/* Let others write to the file, as fopen does, so that hashing does
+		 * not make Steam or the game fail to open it. Callers that remember
+		 * the hash check the identity of the file again afterwards (see
+		 * FingerprintCache::Store).
+		 */
+		HANDLE file = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL,
+			OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+		if (file == INVALID_HANDLE_VALUE) {
+			return HASH_INVALID_FILE;
 		}
 
-		err = BCryptCloseAlgorithmProvider(alg, 0);
-		if (!BCRYPT_SUCCESS(err)) {
-			return HASH_BCRYPT;
+		Context context;
+		HashResult hashResult = context.Init();
+		if (hashResult == HASH_OK) {
+			if (mode == HASH_FILE_MAPPED) {
+				hashResult = HashFileMapped(file, context, cancel);
+			} else {
+				hashResult = HashFileRead(file, context, cancel);
+			}
 		}
 
-		for (DWORD i = 0; i < hashSize; ++i) {
-			sprintf(hashHex.get() + 2 * i, "%02hhx", hash[i]);
+		CloseHandle(file);
+
+		if (hashResult != HASH_OK) {
+			return hashResult;
 		}
 
-		hashHex[hashSize * 2] = '\0';
-		/* std::string will perform a copy of the content of the string,
-		 * the unique_ptr can safely release it afterwards.
-		 */
+		return context.Final(result);
+	}
 
-		result = hashHex.get();
-		return HASH_OK;
+	HashResult Sha256F(const char* filename, std::string& result) {
+		return HashFile(filename, result, HASH_FILE_READ);
+	}
+
+	HashResult Sha256(const char* str, size_t size, std::string& result) {
+		Context context;
+		HashResult hashResult = context.Init();
+		if (hashResult != HASH_OK) {
+			return hashResult;
+		}
+
+		if (str) {
+			hashResult = context.Update(str, size);
+			if (hashResult != HASH_OK) {
+				return hashResult;
+			}
+		}
+
+		return context.Final(result);
 	}
 
 	bool Equals(const char* lhs, const char* rhs) {
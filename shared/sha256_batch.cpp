@@ -0,0 +1,201 @@
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <mutex>
+#include <numeric>
+#include <thread>
+#include <vector>
+
+#include "shared/sha256.h"
+
+namespace Sha256 {
+	/* Files given to HashBuffers together. */
+	static constexpr size_t BATCH_FILES = 8;
+
+	/* Read the whole content of filename, which was size bytes long when
+	 * HashFiles listed it, into content. complete is false if the file grew
+	 * in the meantime, in which case the caller hashes it by blocks instead.
+	 */
+	static HashResult ReadSmallFile(std::filesystem::path const& filename, uint64_t size,
+		std::vector<unsigned char>& content, bool& complete) {
+		/* fopen lets others write to the file as well, see HashFile. */
+		FILE* file = fopen(filename.string().c_str(), "rb");
+		if (!file) {
+			return HASH_INVALID_FILE;
+		}
+
+		/* One more byte than expected, to notice files that grew. */
+		content.resize((size_t)size + 1);
+		size_t read = fread(content.data(), 1, content.size(), file);
+		bool error = ferror(file) != 0;
+		fclose(file);
+
+		if (error) {
+			return HASH_IO;
+		}
+
+		complete = read <= size;
+		content.resize(read);
+		return HASH_OK;
+	}
+
+	std::vector<FileHash> HashFiles(std::span<const std::filesystem::path> files,
+		HashFilesMonitor* monitor, std::atomic<bool> const* cancel, unsigned int threads) {
+		std::vector<FileHash> results(files.size());
+		std::vector<uint64_t> sizes(files.size(), 0);
+		uint64_t bytesTotal = 0;
+
+		for (size_t i = 0; i < files.size(); ++i) {
+			std::error_code ec;
+			uintmax_t size = std::filesystem::file_size(files[i], ec);
+			if (!ec) {
+				sizes[i] = size;
+				bytesTotal += size;
+			}
+		}
+
+		/* Small files first: a batch of many small files and a few large
+		 * ones gets most of its results early, and the large files do not
+		 * end up serialized behind each other at the end.
+		 */
+		std::vector<size_t> order(files.size());
+		std::iota(order.begin(), order.end(), 0);
+		std::stable_sort(order.begin(), order.end(), [&sizes](size_t lhs, size_t rhs) {
+			return sizes[lhs] < sizes[rhs];
+		});
+
+		/* The small files, at the front of order, are hashed BATCH_FILES at
+		 * a time. The others are hashed one at a time, by blocks.
+		 */
+		size_t small = 0;
+		while (small < order.size() && sizes[order[small]] <= BATCH_FILE_SIZE) {
+			++small;
+		}
+
+		if (threads == 0) {
+			threads = std::max(1u, std::thread::hardware_concurrency());
+		}
+
+		threads = (unsigned int)std::min<size_t>(threads, files.size());
+
+		std::atomic<size_t> nextBatch = 0;
+		std::atomic<size_t> next = small;
+		std::mutex progressMutex;
+		size_t filesDone = 0;
+		uint64_t bytesDone = 0;
+
+		auto notify = [&](size_t index) {
+			if (!monitor) {
+				return;
+			}
+
+			std::unique_lock<std::mutex> lck(progressMutex);
+			++filesDone;
+			bytesDone += sizes[index];
+
+			HashFilesNotification notification;
+			notification.type = HASH_FILES_FILE_DONE;
+			notification.index = index;
+			notification.result = results[index].result;
+			notification.filesDone = filesDone;
+			notification.filesTotal = files.size();
+			notification.bytesDone = bytesDone;
+			notification.bytesTotal = bytesTotal;
+			monitor->Push(notification);
+		};
+
+		auto hashOne = [&](size_t index) {
+			FileHash& result = results[index];
+			if (cancel && cancel->load(std::memory_order_relaxed)) {
+				result.result = HASH_CANCELLED;
+			} else {
+				result.result = HashFile(files[index].string().c_str(), result.hash,
+					HASH_FILE_READ, cancel);
+			}
+		};
+
+		auto worker = [&]() {
+			std::vector<unsigned char> contents[BATCH_FILES];
+			for (;;) {
+				size_t first = nextBatch.fetch_add(BATCH_FILES, std::memory_order_relaxed);
+				if (first >= small) {
+					break;
+				}
+
+				size_t last = std::min(first + BATCH_FILES, small);
+				const void* buffers[BATCH_FILES];
+				size_t lengths[BATCH_FILES];
+				size_t indices[BATCH_FILES];
+				std::string hashes[BATCH_FILES];
+				size_t count = 0;
+
+				for (size_t position = first; position < last; ++position) {
+					size_t index = order[position];
+					FileHash& result = results[index];
+					if (cancel && cancel->load(std::memory_order_relaxed)) {
+						result.result = HASH_CANCELLED;
+						continue;
+					}
+
+					std::vector<unsigned char>& content = contents[count];
+					bool complete = true;
+					result.result = ReadSmallFile(files[index], sizes[index], content, complete);
+					if (result.result == HASH_OK && !complete) {
+						hashOne(index);
+					} else if (result.result == HASH_OK) {
+						buffers[count] = content.data();
+						lengths[count] = content.size();
+						indices[count] = index;
+						++count;
+					}
+				}
+
+				HashBuffers(buffers, lengths, count, hashes);
+				for (size_t i = 0; i < count; ++i) {
+					results[indices[i]].hash = std::move(hashes[i]);
+				}
+
+				for (size_t position = first; position < last; ++position) {
+					notify(order[position]);
+				}
+			}
+
+			for (;;) {
+				size_t position = next.fetch_add(1, std::memory_order_relaxed);
+				if (position >= order.size()) {
+					return;
+				}
+
+				size_t index = order[position];
+				hashOne(index);
+				notify(index);
+			}
+		};
+
+		std::vector<std::thread> pool;
+		for (unsigned int i = 1; i < threads; ++i) {
+			pool.emplace_back(worker);
+		}
+
+		/* The calling thread takes part in the work as well. */
+		worker();
+
+		for (std::thread& thread : pool) {
+			thread.join();
+		}
+
+		if (monitor) {
+			HashFilesNotification notification;
+			notification.type = HASH_FILES_DONE;
+			notification.index = 0;
+			notification.result = cancel && cancel->load(std::memory_order_relaxed) ? HASH_CANCELLED : HASH_OK;
+			notification.filesDone = files.size();
+			notification.filesTotal = files.size();
+			notification.bytesDone = bytesTotal;
+			notification.bytesTotal = bytesTotal;
+			monitor->Push(notification);
+		}
+
+		return results;
+	}
+}
@@ -0,0 +1,251 @@
+#include <cctype>
+#include <deque>
+
+#include "shared/byte_search.h"
+#include "shared/logger.h"
+#include "shared/signature_scanner.h"
+
+static int HexValue(char c) {
+	if (c >= '0' && c <= '9') {
+		return c - '0';
+	}
+
+	c = (char)tolower((unsigned char)c);
+	if (c >= 'a' && c <= 'f') {
+		return c - 'a' + 10;
+	}
+
+	return -1;
+}
+
+bool Signature::Parse(const char* text, Signature& result) {
+	result.bytes.clear();
+	result.fixed.clear();
+
+	bool anyFixed = false;
+	const char* cur = text;
+	while (*cur) {
+		if (isspace((unsigned char)*cur)) {
+			++cur;
+			continue;
+		}
+
+		if (!cur[1]) {
+			Logger::Error("Signature::Parse: %s: incomplete byte at offset %zu\n", text, cur - text);
+			return false;
+		}
+
+		if (cur[0] == '?' && cur[1] == '?') {
+			result.bytes.push_back(0);
+			result.fixed.push_back(false);
+		} else {
+			int high = HexValue(cur[0]), low = HexValue(cur[1]);
+			if (high < 0 || low < 0) {
+				Logger::Error("Signature::Parse: %s: invalid byte at offset %zu\n", text, cur - text);
+				return false;
+			}
+
+			result.bytes.push_back((uint8_t)(high << 4 | low));
+			result.fixed.push_back(true);
+			anyFixed = true;
+		}
+
+		cur += 2;
+	}
+
+	if (!anyFixed) {
+		Logger::Error("Signature::Parse: %s: no fixed byte in signature\n", text);
+		return false;
+	}
+
+	return true;
+}
+
+bool Signature::Matches(const unsigned char* data) const {
+	for (size_t i = 0; i < bytes.size(); ++i) {
+		if (fixed[i] && data[i] != bytes[i]) {
+			return false;
+		}
+	}
+
+	return true;
+}
+
+int SignatureScanner::Add(Signature const& signature) {
+	/* Longest run of fixed bytes. */
+	Anchor anchor = { _signatures.size(), 0, 0 };
+	size_t runStart = 0;
+	for (size_t i = 0; i <= signature.size(); ++i) {
+		if (i < signature.size() && signature.fixed[i]) {
+			continue;
+		}
+
+		if (i - runStart > anchor.length) {
+			anchor.offset = runStart;
+			anchor.length = i - runStart;
+		}
+
+		runStart = i + 1;
+	}
+
+	if (!anchor.length) {
+		return -1;
+	}
+
+	_signatures.push_back(signature);
+	_anchors.push_back(anchor);
+	_compiled = false;
+	return (int)anchor.signature;
+}
+
+int SignatureScanner::Add(const char* text) {
+	Signature signature;
+	if (!Signature::Parse(text, signature)) {
+		return -1;
+	}
+
+	return Add(signature);
+}
+
+void SignatureScanner::Compile() {
+	_transitions.assign(256, -1);
+	_outputs.assign(1, std::vector<size_t>());
+
+	/* Trie of the anchors. */
+	for (size_t i = 0; i < _anchors.size(); ++i) {
+		Anchor const& anchor = _anchors[i];
+		const uint8_t* bytes = _signatures[anchor.signature].bytes.data() + anchor.offset;
+		int32_t state = 0;
+		for (size_t j = 0; j < anchor.length; ++j) {
+			int32_t& next = _transitions[state * 256 + bytes[j]];
+			if (next < 0) {
+				next = (int32_t)_outputs.size();
+				_outputs.emplace_back();
+				_transitions.resize(_transitions.size() + 256, -1);
+			}
+
+			/* _transitions may have moved. */
+			state = _transitions[state * 256 + bytes[j]];
+		}
+
+		_outputs[state].push_back(i);
+	}
+
+	_leavesRoot.assign(256, 0);
+	for (int c = 0; c < 256; ++c) {
+		_leavesRoot[c] = _transitions[c] >= 0;
+	}
+
+	/* Turn the trie into an automaton, breadth first: missing transitions
+	 * follow the suffix link, and each state reports the anchors of its
+	 * suffix link as well.
+	 */
+	std::vector<int32_t> suffix(_outputs.size(), 0);
+	std::deque<int32_t> queue;
+	for (int c = 0; c < 256; ++c) {
+		int32_t& next = _transitions[c];
+		if (next < 0) {
+			next = 0;
+		} else {
+			queue.push_back(next);
+		}
+	}
+
+	while (!queue.empty()) {
+		int32_t state = queue.front();
+		queue.pop_front();
+
+		std::vector<size_t> const& inherited = _outputs[suffix[state]];
+		_outputs[state].insert(_outputs[state].end(), inherited.begin(), inherited.end());
+
+		for (int c = 0; c < 256; ++c) {
+			int32_t next = _transitions[state * 256 + c];
+			int32_t fallback = _transitions[suffix[state] * 256 + c];
+			if (next < 0) {
+				_transitions[state * 256 + c] = fallback;
+			} else {
+				suffix[next] = fallback;
+				queue.push_back(next);
+			}
+		}
+	}
+
+	_accepting.assign(_outputs.size(), 0);
+	for (size_t state = 0; state < _outputs.size(); ++state) {
+		_accepting[state] = !_outputs[state].empty();
+	}
+
+	_compiled = true;
+}
+
+/* Check the signature of anchor around an occurrence of the anchor ending
+ * at the byte at offset last.
+ */
+bool SignatureScanner::Check(Anchor const& anchor, const unsigned char* bytes, size_t size,
+	size_t last, size_t& start) const {
+	Signature const& signature = _signatures[anchor.signature];
+	size_t anchorStart = last + 1 - anchor.length;
+	if (anchorStart < anchor.offset) {
+		return false;
+	}
+
+	start = anchorStart - anchor.offset;
+	return size - start >= signature.size() && signature.Matches(bytes + start);
+}
+
+std::vector<std::vector<size_t>> SignatureScanner::Scan(const void* data, size_t size) const {
+	std::vector<std::vector<size_t>> results(_signatures.size());
+	if (!_compiled) {
+		Logger::Error("SignatureScanner::Scan: scanner not compiled\n");
+		return results;
+	}
+
+	const unsigned char* bytes = (const unsigned char*)data;
+	size_t start;
+
+	/* A single anchor is found faster by ByteSearch than by walking the
+	 * automaton one byte at a time.
+	 */
+	if (_anchors.size() == 1) {
+		Anchor const& anchor = _anchors[0];
+		const uint8_t* needle = _signatures[anchor.signature].bytes.data() + anchor.offset;
+		for (size_t offset : ByteSearch::FindAll(bytes, size, needle, anchor.length)) {
+			if (Check(anchor, bytes, size, offset + anchor.length - 1, start)) {
+				results[anchor.signature].push_back(start);
+			}
+		}
+
+		return results;
+	}
+
+	const int32_t* transitions = _transitions.data();
+	const uint8_t* accepting = _accepting.data();
+	const uint8_t* leavesRoot = _leavesRoot.data();
+	int32_t state = 0;
+	for (size_t i = 0; i < size; ++i) {
+		/* Most bytes do not start any anchor. */
+		if (state == 0) {
+			while (i < size && !leavesRoot[bytes[i]]) {
+				++i;
+			}
+
+			if (i == size) {
+				break;
+			}
+		}
+
+		state = transitions[state * 256 + bytes[i]];
+		if (!accepting[state]) {
+			continue;
+		}
+
+		for (size_t index : _outputs[state]) {
+			Anchor const& anchor = _anchors[index];
+			if (Check(anchor, bytes, size, i, start)) {
+				results[anchor.signature].push_back(start);
+			}
+		}
+	}
+
+	return results;
+}
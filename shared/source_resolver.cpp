@@ -0,0 +1,88 @@
+#include <thread>
+
+#include "shared/logger.h"
+#include "shared/source_resolver.h"
+
+namespace Shared {
+	SourceResolver::SourceResolver(std::string name) : _name(std::move(name)) {
+
+	}
+
+	SourceResolver::~SourceResolver() {
+		CancelAll();
+	}
+
+	void SourceResolver::AddSource(std::string name, curl::RequestParameters const& request,
+		std::chrono::milliseconds stagger, AcceptFn accept) {
+		Source source;
+		source.name = std::move(name);
+		source.request = request;
+		source.stagger = stagger;
+		source.accept = std::move(accept);
+		_sources.push_back(std::move(source));
+	}
+
+	int SourceResolver::Resolve() {
+		size_t next = 0;
+		size_t running = 0;
+		std::chrono::steady_clock::time_point lastStart = std::chrono::steady_clock::now();
+
+		while (next < _sources.size() || running) {
+			std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+			if (next < _sources.size() && (!running || now - lastStart >= _sources[next].stagger)) {
+				Start(_sources[next++]);
+				lastStart = now;
+				++running;
+			}
+
+			for (size_t i = 0; i < next; ++i) {
+				Source& source = _sources[i];
+				if (source.done || source.descriptor->result.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+					continue;
+				}
+
+				source.done = true;
+				--running;
+
+				curl::DownloadStringDescriptor answer = source.descriptor->result.get();
+				bool accepted = source.accept(answer);
+				Logger::Info("SourceResolver: %s: %s answered in %lld ms (%s, %s)\n", _name.c_str(),
+					source.name.c_str(), ElapsedMs(source), curl::DownloadAsStringResultToLogString(answer.result),
+					accepted ? "accepted" : "not accepted");
+
+				if (accepted) {
+					CancelAll();
+					return (int)i;
+				}
+			}
+
+			std::this_thread::sleep_for(POLL_INTERVAL);
+		}
+
+		Logger::Warn("SourceResolver: %s: no source was accepted\n", _name.c_str());
+		return -1;
+	}
+
+	void SourceResolver::Start(Source& source) {
+		source.start = std::chrono::steady_clock::now();
+		source.descriptor = curl::AsyncDownloadString(source.request, source.name);
+	}
+
+	void SourceResolver::CancelAll() {
+		for (Source& source : _sources) {
+			if (!source.descriptor || source.done) {
+				continue;
+			}
+
+			source.done = true;
+			source.descriptor->base.cancel.store(true, std::memory_order_release);
+			Logger::Info("SourceResolver: %s: %s cancelled after %lld ms\n", _name.c_str(),
+				source.name.c_str(), ElapsedMs(source));
+		}
+	}
+
+	long long SourceResolver::ElapsedMs(Source const& source) const {
+		return (long long)std::chrono::duration_cast<std::chrono::milliseconds>(
+			std::chrono::steady_clock::now() - source.start).count();
+	}
+}
\ No newline at end of file
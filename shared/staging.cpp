@@ -0,0 +1,340 @@
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include <WinSock2.h>
+#include <Windows.h>
+
+#include "shared/filesystem.h"
+#include "shared/logger.h"
+#include "shared/staging.h"
+
+namespace fs = std::filesystem;
+
+namespace Staging {
+	/* An item swapped by a commit, relative to the folder. */
+	struct Item {
+		fs::path path;
+		/* The item existed in the folder and was moved to the backup. */
+		bool replaced = false;
+	};
+
+	static fs::path Sibling(fs::path const& folder, const char* suffix) {
+		fs::path result = folder;
+		if (!result.has_filename()) {
+			result = result.parent_path();
+		}
+
+		result += suffix;
+		return result;
+	}
+
+	fs::path GetStagingFolder(fs::path const& folder) {
+		return Sibling(folder, ".staging");
+	}
+
+	fs::path GetBackupFolder(fs::path const& folder) {
+		return Sibling(folder, ".previous");
+	}
+
+	/* Journal of the commit or rollback in progress. */
+	static fs::path GetJournal(fs::path const& folder) {
+		return Sibling(folder, ".journal");
+	}
+
+	/* Journal of the last successful commit, used to roll it back. */
+	static fs::path GetBackupJournal(fs::path const& folder) {
+		return Sibling(folder, ".previous.journal");
+	}
+
+	static bool Move(fs::path const& from, fs::path const& to) {
+		if (!MoveFileExW(from.c_str(), to.c_str(), MOVEFILE_WRITE_THROUGH)) {
+			Logger::Error("Staging: unable to move %s to %s (%d)\n", from.string().c_str(),
+				to.string().c_str(), GetLastError());
+			return false;
+		}
+
+		return true;
+	}
+
+	/* Flush every file below root to the disk. */
+	static bool FlushFiles(fs::path const& root) {
+		std::error_code ec;
+		for (fs::recursive_directory_iterator it(root, ec), end; !ec && it != end; it.increment(ec)) {
+			if (!it->is_regular_file()) {
+				continue;
+			}
+
+			HANDLE file = CreateFileW(it->path().c_str(), GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE,
+				NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+			if (file == INVALID_HANDLE_VALUE) {
+				Logger::Error("Staging: unable to open %s (%d)\n", it->path().string().c_str(), GetLastError());
+				return false;
+			}
+
+			BOOL flushed = FlushFileBuffers(file);
+			CloseHandle(file);
+			if (!flushed) {
+				Logger::Error("Staging: unable to flush %s (%d)\n", it->path().string().c_str(), GetLastError());
+				return false;
+			}
+		}
+
+		if (ec) {
+			Logger::Error("Staging: unable to list %s: %s\n", root.string().c_str(), ec.message().c_str());
+			return false;
+		}
+
+		return true;
+	}
+
+	/* Return true if everything below live also exists below staged, i.e.
+	 * if swapping staged for live drops nothing that is not being updated.
+	 */
+	static bool Covers(fs::path const& staged, fs::path const& live) {
+		std::error_code ec;
+		for (fs::recursive_directory_iterator it(live, ec), end; !ec && it != end; it.increment(ec)) {
+			std::error_code existsEc;
+			if (!fs::exists(staged / it->path().lexically_relative(live), existsEc)) {
+				return false;
+			}
+		}
+
+		return !ec;
+	}
+
+	/* Decide which items of staging / rel replace their counterpart in
+	 * folder / rel.
+	 */
+	static bool Plan(fs::path const& staging, fs::path const& folder, fs::path const& rel,
+		std::vector<Item>& items) {
+		std::error_code ec;
+		for (fs::directory_iterator it(staging / rel, ec), end; !ec && it != end; it.increment(ec)) {
+			fs::path itemPath = rel / it->path().filename();
+			std::error_code statusEc;
+			fs::file_status live = fs::symlink_status(folder / itemPath, statusEc);
+
+			Item item;
+			item.path = itemPath;
+			item.replaced = fs::exists(live);
+
+			if (item.replaced && it->is_directory() && fs::is_directory(live) &&
+				!Covers(it->path(), folder / itemPath)) {
+				if (!Plan(staging, folder, itemPath, items)) {
+					return false;
+				}
+
+				continue;
+			}
+
+			items.push_back(std::move(item));
+		}
+
+		if (ec) {
+			Logger::Error("Staging: unable to list %s: %s\n", (staging / rel).string().c_str(),
+				ec.message().c_str());
+			return false;
+		}
+
+		return true;
+	}
+
+	static bool WriteJournal(fs::path const& path, std::vector<Item> const& items) {
+		std::string content;
+		for (Item const& item : items) {
+			std::u8string name = item.path.generic_u8string();
+			content += item.replaced ? "= " : "+ ";
+			content.append(name.begin(), name.end());
+			content += '\n';
+		}
+
+		return Filesystem::AtomicWriteFile(path.string().c_str(), content.data(), content.size());
+	}
+
+	static bool ReadJournal(fs::path const& path, std::vector<Item>& items) {
+		std::ifstream journal(path, std::ios::binary);
+		if (!journal) {
+			return false;
+		}
+
+		std::string line;
+		while (std::getline(journal, line)) {
+			if (!line.empty() && line.back() == '\r') {
+				line.pop_back();
+			}
+
+			if (line.size() < 3 || (line[0] != '=' && line[0] != '+') || line[1] != ' ') {
+				Logger::Error("Staging: malformed line in journal %s: %s\n", path.string().c_str(), line.c_str());
+				return false;
+			}
+
+			Item item;
+			item.path = fs::path(std::u8string(line.begin() + 2, line.end()));
+			item.replaced = line[0] == '=';
+			items.push_back(std::move(item));
+		}
+
+		return true;
+	}
+
+	/* Put back the content of folder as it was before items were swapped.
+	 *
+	 * Every step checks the state it leaves behind, so that restoring an
+	 * interrupted commit, or an interrupted restoration, works the same.
+	 */
+	static bool Restore(fs::path const& folder, std::vector<Item> const& items) {
+		fs::path backup = GetBackupFolder(folder);
+		bool ok = true;
+		for (auto it = items.rbegin(); it != items.rend(); ++it) {
+			fs::path live = folder / it->path;
+			fs::path saved = backup / it->path;
+			std::error_code ec;
+
+			if (it->replaced && !fs::exists(saved, ec)) {
+				/* Never moved out, or already restored. */
+				continue;
+			}
+
+			fs::remove_all(live, ec);
+			if (ec) {
+				Logger::Error("Staging: unable to remove %s: %s\n", live.string().c_str(), ec.message().c_str());
+				ok = false;
+				continue;
+			}
+
+			if (it->replaced && !Move(saved, live)) {
+				ok = false;
+			}
+		}
+
+		return ok;
+	}
+
+	bool Commit(fs::path const& folder) {
+		fs::path staging = GetStagingFolder(folder);
+		fs::path backup = GetBackupFolder(folder);
+		fs::path journal = GetJournal(folder);
+
+		if (!FlushFiles(staging)) {
+			Logger::Error("Staging::Commit: unable to flush the content of %s\n", staging.string().c_str());
+			return false;
+		}
+
+		std::error_code ec;
+		fs::remove(GetBackupJournal(folder), ec);
+		fs::remove_all(backup, ec);
+		fs::create_directories(backup, ec);
+		if (!ec) {
+			fs::create_directories(folder, ec);
+		}
+
+		if (ec) {
+			Logger::Error("Staging::Commit: unable to prepare %s: %s\n", folder.string().c_str(),
+				ec.message().c_str());
+			return false;
+		}
+
+		std::vector<Item> items;
+		if (!Plan(staging, folder, fs::path(), items)) {
+			return false;
+		}
+
+		if (!WriteJournal(journal, items)) {
+			Logger::Error("Staging::Commit: unable to write journal %s\n", journal.string().c_str());
+			return false;
+		}
+
+		bool ok = true;
+		for (Item const& item : items) {
+			fs::path live = folder / item.path;
+			if (item.replaced) {
+				fs::path saved = backup / item.path;
+				fs::create_directories(saved.parent_path(), ec);
+				ok = Move(live, saved);
+			}
+
+			if (!ok || !Move(staging / item.path, live)) {
+				ok = false;
+				break;
+			}
+		}
+
+		/* Once the journal is moved, the commit is done: Recover() no longer
+		 * undoes it.
+		 */
+		if (ok && !MoveFileExW(journal.c_str(), GetBackupJournal(folder).c_str(),
+			MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH)) {
+			Logger::Error("Staging::Commit: unable to complete journal %s (%d)\n",
+				journal.string().c_str(), GetLastError());
+			ok = false;
+		}
+
+		if (!ok) {
+			Logger::Error("Staging::Commit: unable to update %s, restoring its previous content\n",
+				folder.string().c_str());
+			if (Restore(folder, items)) {
+				fs::remove(journal, ec);
+			}
+
+			return false;
+		}
+
+		fs::remove_all(staging, ec);
+		Logger::Info("Staging::Commit: updated %s (%zu items swapped)\n", folder.string().c_str(), items.size());
+		return true;
+	}
+
+	bool Rollback(fs::path const& folder) {
+		fs::path journal = GetJournal(folder);
+		fs::path backupJournal = GetBackupJournal(folder);
+
+		std::vector<Item> items;
+		if (!ReadJournal(backupJournal, items)) {
+			Logger::Error("Staging::Rollback: no previous content to restore in %s\n", folder.string().c_str());
+			return false;
+		}
+
+		/* From now on, an interruption is resumed by Recover(). */
+		if (!MoveFileExW(backupJournal.c_str(), journal.c_str(), MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH)) {
+			Logger::Error("Staging::Rollback: unable to move journal %s (%d)\n",
+				backupJournal.string().c_str(), GetLastError());
+			return false;
+		}
+
+		if (!Restore(folder, items)) {
+			Logger::Error("Staging::Rollback: unable to restore the previous content of %s\n",
+				folder.string().c_str());
+			return false;
+		}
+
+		std::error_code ec;
+		fs::remove(journal, ec);
+		fs::remove_all(GetBackupFolder(folder), ec);
+		Logger::Info("Staging::Rollback: restored the previous content of %s\n", folder.string().c_str());
+		return true;
+	}
+
+	void Recover(fs::path const& folder) {
+		fs::path journal = GetJournal(folder);
+		fs::path staging = GetStagingFolder(folder);
+		std::error_code ec;
+
+		if (fs::exists(journal, ec)) {
+			Logger::Warn("Staging::Recover: update of %s was interrupted, restoring its previous content\n",
+				folder.string().c_str());
+
+			std::vector<Item> items;
+			if (ReadJournal(journal, items) && Restore(folder, items)) {
+				fs::remove(journal, ec);
+			} else {
+				Logger::Error("Staging::Recover: unable to restore the previous content of %s\n",
+					folder.string().c_str());
+			}
+		}
+
+		if (fs::exists(staging, ec)) {
+			Logger::Info("Staging::Recover: removing abandoned staging folder %s\n", staging.string().c_str());
+			fs::remove_all(staging, ec);
+		}
+	}
+}
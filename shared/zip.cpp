@@ -1,9 +1,20 @@
+#include <algorithm>
+#include <atomic>
 #include <filesystem>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <thread>
+
+#include <WinSock2.h>
+#include <Windows.h>
 
 #include "shared/zip.h"
 #include "zip.h"
+#include "shared/crc32.h"
 #include "shared/filesystem.h"
 #include "shared/scoped_file.h"
+#include "shared/staging.h"
 #include "shared/logger.h"
 
 namespace Zip {
@@ -34,7 +45,145 @@ namespace Zip {
 		return EXTRACT_FILE_OK;
 	}
 
-	bool ExtractAllToFolder(const char* filename, const char* outputDir) {
+	static bool IsDirectoryEntry(const char* name, zip_uint64_t size) {
+		const size_t nameLength = strlen(name);
+		return size == 0 && nameLength && (name[nameLength - 1] == '/' || name[nameLength - 1] == '\\');
+	}
+
+	/* Decompress entry index of zip into path, reserving size bytes on disk
+	 * beforehand.
+	 */
+	static ExtractFileResult ExtractEntry(zip_t* zip, zip_uint64_t index, std::filesystem::path const& path,
+		uint64_t size, char* buffer) {
+		ScopedZipFile file(zip_fopen_index(zip, index, 0));
+		if (!file) {
+			return EXTRACT_FILE_ERR_ZIP_OPEN;
+		}
+
+		HANDLE output = CreateFileW(path.c_str(), GENERIC_WRITE, 0, NULL, CREATE_ALWAYS,
+			FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+		if (output == INVALID_HANDLE_VALUE) {
+			return EXTRACT_FILE_ERR_FOPEN;
+		}
+
+		/* Only a hint to the file system, failing is harmless. */
+		FILE_ALLOCATION_INFO allocation;
+		allocation.AllocationSize.QuadPart = (LONGLONG)size;
+		SetFileInformationByHandle(output, FileAllocationInfo, &allocation, sizeof(allocation));
+
+		ExtractFileResult result = EXTRACT_FILE_OK;
+		zip_int64_t read = 0;
+		while ((read = zip_fread(file, buffer, EXTRACT_BUFFER_SIZE)) > 0) {
+			DWORD written = 0;
+			if (!WriteFile(output, buffer, (DWORD)read, &written, NULL) || written != (DWORD)read) {
+				result = EXTRACT_FILE_ERR_FWRITE;
+				break;
+			}
+		}
+
+		if (result == EXTRACT_FILE_OK && read == -1) {
+			result = EXTRACT_FILE_ERR_ZIP_FREAD;
+		}
+
+		CloseHandle(output);
+		return result;
+	}
+
+	/* Check whether path already holds size bytes with the given CRC-32.
+	 * buffer must hold EXTRACT_BUFFER_SIZE bytes.
+	 */
+	static bool IsUnchanged(std::filesystem::path const& path, uint64_t size, uint32_t crc, char* buffer) {
+		WIN32_FILE_ATTRIBUTE_DATA attributes;
+		if (!GetFileAttributesExW(path.c_str(), GetFileExInfoStandard, &attributes) ||
+			(attributes.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)) {
+			return false;
+		}
+
+		uint64_t diskSize = ((uint64_t)attributes.nFileSizeHigh << 32) | attributes.nFileSizeLow;
+		if (diskSize != size) {
+			return false;
+		}
+
+		HANDLE input = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+			FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+		if (input == INVALID_HANDLE_VALUE) {
+			return false;
+		}
+
+		uint32_t diskCrc = 0;
+		uint64_t total = 0;
+		DWORD read = 0;
+		while (ReadFile(input, buffer, (DWORD)EXTRACT_BUFFER_SIZE, &read, NULL) && read) {
+			diskCrc = Crc32::Update(diskCrc, buffer, read);
+			total += read;
+		}
+
+		CloseHandle(input);
+		return total == size && diskCrc == crc;
+	}
+
+	static const char* DescribeResult(ExtractFileResult result) {
+		switch (result) {
+		case EXTRACT_FILE_OK:
+			return "ok";
+
+		case EXTRACT_FILE_ERR_FOPEN:
+			return "unable to open file on disk to write content";
+
+		case EXTRACT_FILE_ERR_ZIP_FREAD:
+			return "error while reading file content";
+
+		case EXTRACT_FILE_ERR_FWRITE:
+			return "unable to write extracted file";
+
+		case EXTRACT_FILE_ERR_ZIP_OPEN:
+			return "unable to open file in archive";
+
+		case EXTRACT_FILE_ERR_MKDIR:
+			return "unable to create parent directory";
+
+		default:
+			return "unexpected error";
+		}
+	}
+
+	bool FileMatches(std::filesystem::path const& path, uint64_t size, uint32_t crc) {
+		std::unique_ptr<char[]> buffer(new char[EXTRACT_BUFFER_SIZE]);
+		return IsUnchanged(path, size, crc, buffer.get());
+	}
+
+	/* Extract the archive into outputDir. If liveDir is not NULL, the files
+	 * that liveDir already holds with the right size and CRC-32 are skipped.
+	 */
+	static bool Extract(const char* filename, const char* outputDir, const char* liveDir,
+		std::vector<ExtractedEntry>* entries, ExtractMonitor* monitor, unsigned int threads);
+
+	bool ExtractAllToFolder(const char* filename, const char* outputDir,
+		std::vector<ExtractedEntry>* entries, ExtractMonitor* monitor, unsigned int threads,
+		ExtractMode mode) {
+		if (mode == EXTRACT_STAGED) {
+			std::filesystem::path staging = Staging::GetStagingFolder(outputDir);
+			std::error_code ec;
+			std::filesystem::remove_all(staging, ec);
+
+			/* Files left out of the staging folder are not swapped, so the
+			 * unchanged ones keep their place in outputDir.
+			 */
+			bool ok = Extract(filename, staging.string().c_str(), outputDir, entries, monitor, threads) &&
+				Staging::Commit(outputDir);
+			if (!ok) {
+				std::filesystem::remove_all(staging, ec);
+			}
+
+			return ok;
+		}
+
+		return Extract(filename, outputDir, mode == EXTRACT_CHANGED ? outputDir : nullptr, entries,
+			monitor, threads);
+	}
+
+	static bool Extract(const char* filename, const char* outputDir, const char* liveDir,
+		std::vector<ExtractedEntry>* entries, ExtractMonitor* monitor, unsigned int threads) {
 		Logger::Info("[Zip::ExtractAllToFolder] Extracting contents of `%s` to `%s`...\n", filename, outputDir);
 
 		int error = 0;
@@ -46,6 +195,7 @@ namespace Zip {
 		}
 
 		const std::filesystem::path outputPath(outputDir);
+		const std::filesystem::path livePath(liveDir ? liveDir : outputDir);
 
 		if (Filesystem::SafeExists(outputPath)) {
 			if (!std::filesystem::is_directory(outputPath)) {
@@ -65,83 +215,181 @@ namespace Zip {
 			}
 		}
 
-		bool extractError = false;
-
 		const zip_int64_t nFiles = zip_get_num_entries(zip, 0);
+		std::vector<ExtractedEntry> results(nFiles > 0 ? (size_t)nFiles : 0);
+		std::vector<std::filesystem::path> paths(results.size());
+		/* CRC-32 of each entry, -1 if the archive does not give it. */
+		std::vector<int64_t> crcs(results.size(), -1);
+		uint64_t bytesTotal = 0;
 
-		for (int i = 0; i < nFiles; ++i) {
-			ScopedZipFile file(zip_fopen_index(zip, i, 0));
-			if (!file) {
-				Logger::Error("[Zip::ExtractAllToFolder] zip_fopen_index failed (%s)\n", zip_error_strerror(zip_get_error(zip)));
-				return false;
+		/* First pass over the central directory: describe every entry and
+		 * gather the folders it needs.
+		 */
+		std::set<std::filesystem::path> folders;
+		for (size_t i = 0; i < results.size(); ++i) {
+			ExtractedEntry& entry = results[i];
+			zip_stat_t fileStat;
+			zip_stat_init(&fileStat);
+			if (zip_stat_index(zip, i, 0, &fileStat) || !(fileStat.valid & ZIP_STAT_NAME)) {
+				Logger::Error("[Zip::ExtractAllToFolder] Failed to stat file %zu (%s)\n", i, zip_error_strerror(zip_get_error(zip)));
+				entry.result = EXTRACT_FILE_ERR_ZIP_OPEN;
+				continue;
 			}
 
-			const char* name = zip_get_name(zip, i, 0);
-			if (!name) {
-				Logger::Error("[Zip::ExtractAllToFolder] zip_get_name failed (%s)\n", zip_error_strerror(zip_get_error(zip)));
-				return false;
+			entry.name = fileStat.name;
+			entry.size = fileStat.valid & ZIP_STAT_SIZE ? fileStat.size : 0;
+			if (fileStat.valid & ZIP_STAT_CRC) {
+				crcs[i] = fileStat.crc;
 			}
-			const size_t nameLength = strlen(name);
+			paths[i] = outputPath / entry.name;
 
-			zip_stat_t fileStat;
-			const int statResult = zip_stat_index(zip, i, 0, &fileStat);
-			if (statResult) {
-				Logger::Error("[Zip::ExtractAllToFolder] Failed to stat file %s (%d)\n", name, statResult);
-				extractError = true;
+			// Directories are not guarunteed to be detected separately within the zip, depending on how the zip was created.
+			// Therefore we must create parent directories as needed for files.
+			if (IsDirectoryEntry(fileStat.name, entry.size) || !paths[i].has_filename()) {
+				entry.directory = true;
+				folders.insert(paths[i].parent_path());
 			} else {
-				const std::filesystem::path filePath = outputPath / name;
-				const bool isDirectory = fileStat.size == 0 && (name[nameLength - 1] == '/' || name[nameLength - 1] == '\\');
-				if (isDirectory || !filePath.has_filename()) {
-					// Directories are not guarunteed to be detected separately within the zip, depending on how the zip was created.
-					// Therefore we must create parent directories as needed for files.
-					Logger::Info("[Zip::ExtractAllToFolder] Skipping directory %s\n", name);
-					continue;
+				folders.insert(paths[i].parent_path());
+				bytesTotal += entry.size;
+			}
+		}
+
+		/* Parents sort before their children, so a folder that cannot be
+		 * created is detected before any of its content.
+		 */
+		std::set<std::filesystem::path> failedFolders;
+		for (std::filesystem::path const& folder : folders) {
+			std::error_code ec;
+			std::filesystem::create_directories(folder, ec);
+			if (ec) {
+				Logger::Error("[Zip::ExtractAllToFolder] Unable to create directory %s: %s\n",
+					folder.string().c_str(), ec.message().c_str());
+				failedFolders.insert(folder);
+			}
+		}
+
+		std::vector<size_t> order;
+		for (size_t i = 0; i < results.size(); ++i) {
+			ExtractedEntry& entry = results[i];
+			if (entry.result != EXTRACT_FILE_OK) {
+				continue;
+			}
+
+			if (failedFolders.find(paths[i].parent_path()) != failedFolders.end()) {
+				entry.result = EXTRACT_FILE_ERR_MKDIR;
+			} else if (!entry.directory) {
+				order.push_back(i);
+			}
+		}
+
+		std::stable_sort(order.begin(), order.end(), [&results](size_t lhs, size_t rhs) {
+			return results[lhs].size > results[rhs].size;
+		});
+
+		if (threads == 0) {
+			threads = std::max(1u, std::thread::hardware_concurrency());
+		}
+
+		threads = (unsigned int)std::max<size_t>(1, std::min<size_t>(threads, order.size()));
+
+		std::atomic<size_t> next = 0;
+		std::mutex progressMutex;
+		size_t entriesDone = results.size() - order.size();
+		uint64_t bytesDone = 0;
+
+		/* libzip handles are not thread safe: each worker opens the archive
+		 * on its own, except the calling thread which reuses zip.
+		 */
+		auto worker = [&](zip_t* archive) {
+			std::unique_ptr<char[]> buffer(new char[EXTRACT_BUFFER_SIZE]);
+			for (;;) {
+				size_t position = next.fetch_add(1, std::memory_order_relaxed);
+				if (position >= order.size()) {
+					return;
 				}
-				// Create parent directories as needed.
-				if (filePath.has_parent_path() && !Filesystem::SafeExists(filePath.parent_path())) {
-					Logger::Info("[Zip::ExtractAllToFolder] Creating sub-directory: %s\n", filePath.parent_path().string().c_str());
-					try {
-						if (!std::filesystem::create_directories(filePath.parent_path())) {
-							Logger::Error("[Zip::ExtractAllToFolder] No exception, but unable to create directory.");
-							return false;
-						}
-					} catch (const std::filesystem::filesystem_error& e) {
-						Logger::Error("[Zip::ExtractAllToFolder] Filesystem error attempting to create directory: %s", e.what());
-					}
+
+				size_t index = order[position];
+				ExtractedEntry& entry = results[index];
+				if (liveDir && crcs[index] >= 0 &&
+					IsUnchanged(livePath / entry.name, entry.size, (uint32_t)crcs[index], buffer.get())) {
+					entry.unchanged = true;
+				} else {
+					entry.result = ExtractEntry(archive, index, paths[index], entry.size, buffer.get());
 				}
-				Logger::Info("[Zip::ExtractAllToFolder] Extracting file %s\n", filePath.string().c_str());
 
-				ScopedFile output(fopen(filePath.string().c_str(), "wb"));
-				if (!output) {
-					Logger::Error("[Zip::ExtractAllToFolder] fopen failed (%d)\n", (int)errno);
-					return false;
+				if (entry.unchanged) {
+					Logger::Info("[Zip::ExtractAllToFolder] Skipped unchanged file %s\n",
+						(livePath / entry.name).string().c_str());
+				} else if (entry.result == EXTRACT_FILE_OK) {
+					Logger::Info("[Zip::ExtractAllToFolder] Extracted file %s\n", paths[index].string().c_str());
+				} else {
+					Logger::Error("[Zip::ExtractAllToFolder] Failed to extract file %s (%d): %s\n",
+						entry.name.c_str(), entry.result, DescribeResult(entry.result));
 				}
 
-				const ExtractFileResult extractFileResult = ExtractFile(zip, i, file, output);
-				if (extractFileResult != EXTRACT_FILE_OK) {
-					Logger::Error("[Zip::ExtractAllToFolder] Failed to extract file (%d)\n", extractFileResult);
-					switch (extractFileResult) {
-					case Zip::EXTRACT_FILE_ERR_ZIP_FREAD:
-						Logger::Error("[Zip::ExtractAllToFolder] Error while reading file content\n");
-						break;
-
-					case Zip::EXTRACT_FILE_ERR_FOPEN:
-						Logger::Error("[Zip::ExtractAllToFolder] Unable to open file on disk to write content\n");
-						break;
-
-					case Zip::EXTRACT_FILE_ERR_FWRITE:
-						Logger::Error("[Zip::ExtractAllToFolder] Unable to write extracted file\n");
-						break;
-
-					default:
-						Logger::Error("[Zip::ExtractAllToFolder] Unexpected error %d\n", extractFileResult);
-						break;
-					}
-					extractError = true;
+				if (monitor) {
+					std::unique_lock<std::mutex> lck(progressMutex);
+					++entriesDone;
+					bytesDone += entry.size;
+
+					ExtractNotification notification;
+					notification.type = EXTRACT_ENTRY_DONE;
+					notification.index = index;
+					notification.result = entry.result;
+					notification.entriesDone = entriesDone;
+					notification.entriesTotal = results.size();
+					notification.bytesDone = bytesDone;
+					notification.bytesTotal = bytesTotal;
+					monitor->Push(notification);
 				}
 			}
+		};
+
+		std::vector<std::thread> pool;
+		for (unsigned int i = 1; i < threads; ++i) {
+			pool.emplace_back([&]() {
+				int openError = 0;
+				ScopedZip archive(zip_open(filename, ZIP_RDONLY, &openError));
+				if (!archive) {
+					/* Leave the entries to the threads that have the archive
+					 * open, the calling thread always does.
+					 */
+					Logger::Error("[Zip::ExtractAllToFolder] Failed to reopen zip file (%d)\n", openError);
+					return;
+				}
+
+				worker(archive);
+			});
+		}
+
+		worker(zip);
+
+		for (std::thread& thread : pool) {
+			thread.join();
+		}
+
+		auto failed = std::find_if(results.begin(), results.end(), [](ExtractedEntry const& entry) {
+			return entry.result != EXTRACT_FILE_OK;
+		});
+		bool ok = failed == results.end();
+
+		if (monitor) {
+			ExtractNotification notification;
+			notification.type = EXTRACT_DONE;
+			notification.index = 0;
+			/* Result of the first entry that failed, if any. */
+			notification.result = ok ? EXTRACT_FILE_OK : failed->result;
+			notification.entriesDone = results.size();
+			notification.entriesTotal = results.size();
+			notification.bytesDone = bytesTotal;
+			notification.bytesTotal = bytesTotal;
+			monitor->Push(notification);
+		}
+
+		if (entries) {
+			*entries = std::move(results);
 		}
 
-		return !extractError;
+		return ok;
 	}
 }
@@ -14,8 +14,10 @@
 #include "launcher/windows/setup_wizard.h"
 #include "shared/filesystem.h"
 #include "shared/github_executor.h"
+#include "shared/curl/http_cache.h"
 #include "shared/logger.h"
 #include "shared/loggable_gui.h"
+#include "shared/sha256.h"
 #include "launcher/windows/repentogon_installer.h"
 #include "launcher/modupdater.h"
 #include "launcher/version.h"
@@ -119,6 +121,7 @@ bool Launcher::App::OnInit() {
 	Logger::Init("launcher.log", "w");
 	Logger::Info("Launcher started, version %s\n", LAUNCHER_VERSION);
 	Logger::Info("Current Directory: %s\n", std::filesystem::current_path().u8string().c_str());
+	Logger::Info("SHA-256 backend: %s\n", Sha256::GetBackendName());
 
 	// Log the command line
 	std::ostringstream cli;
@@ -135,6 +138,14 @@ bool Launcher::App::OnInit() {
 		CheckLauncherUniqueness();
 	}
 
+	if (sCLI->CurlMaxTransfers()) {
+		sGithubExecutor->SetMaxTransfers(sCLI->CurlMaxTransfers());
+	}
+
+	if (sCLI->HttpCacheTTL()) {
+		curl::HttpCache::SetMaxStale(*sCLI->HttpCacheTTL());
+	}
+
 	sGithubExecutor->Start();
 	__installation = new Installation(&__nopLogGUI, &__configuration);
 	_mainFrame = CreateMainWindow();
@@ -30,6 +30,10 @@ int CLIParser::Parse(int argc, wxChar** argv) {
         wxCMD_LINE_VAL_NUMBER);
     parser.AddLongOption(Options::curlConnectTimeout, "Timeout (in milliseconds) when curl opens a connection",
         wxCMD_LINE_VAL_NUMBER);
+    parser.AddLongOption(Options::curlMaxTransfers, "Maximum number of curl transfers running at the same time",
+        wxCMD_LINE_VAL_NUMBER);
+    parser.AddLongOption(Options::httpCacheTTL, "Age (in seconds) up to which cached release information is used "
+        "when it cannot be downloaded (0 to never use it)", wxCMD_LINE_VAL_NUMBER);
     parser.AddLongOption(Options::configurationPath, "Path to the configuration file");
     parser.AddLongSwitch(Options::trapIsaacLaunch, "Trap the launcher when starting Isaac, allowing for a debugger to attach");
     parser.AddLongOption(Options::isaacWaitTime, "Max wait time (in milliseconds) after creating the Repentogon remote thread",
@@ -115,6 +119,20 @@ int CLIParser::Parse(int argc, wxChar** argv) {
         }
     }
 
+    long curlMaxTransfers = 0;
+    if (parser.Found(Options::curlMaxTransfers, &curlMaxTransfers)) {
+        if (curlMaxTransfers > 0) {
+            _curlMaxTransfers = curlMaxTransfers;
+        }
+    }
+
+    long httpCacheTTL = 0;
+    if (parser.Found(Options::httpCacheTTL, &httpCacheTTL)) {
+        if (httpCacheTTL >= 0) {
+            _httpCacheTTL = httpCacheTTL;
+        }
+    }
+
     long isaacWaitTime = 0;
     if (parser.Found(Options::isaacWaitTime, &isaacWaitTime)) {
         if (isaacWaitTime < 0) {
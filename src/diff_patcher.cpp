@@ -1,24 +1,40 @@
-﻿#include <cstring>
+﻿#include <climits>
+#include <cstdint>
+#include <cstring>
 #include <cstdlib>
 
+#include <algorithm>
+#include <atomic>
 #include <fstream>
 #include <iostream>
+#include <mutex>
+#include <set>
 #include <string>
 #include <stdexcept>
+#include <thread>
+#include <vector>
 
 #include "rapidjson/document.h"
 #include "rapidjson/istreamwrapper.h"
 
 #include <bzlib.h>
+#include <zlib.h>
 #include <bspatch.h>
 #include <bspatchlib.h>
 #include <compat.h>
 
+#if defined(_M_IX86) || defined(_M_X64) || defined(__i386__) || defined(__x86_64__)
+#define DIFF_PATCHER_SSE2 1
+#include <emmintrin.h>
+#endif
+
 #include "launcher/diff_patcher.h"
 #include "shared/filesystem.h"
 #include "shared/logger.h"
+#include "shared/mapped_file.h"
 #include "shared/pe32.h"
 #include "shared/scoped_file.h"
+#include "shared/sha256.h"
 
 namespace fs = std::filesystem;
 using namespace rapidjson;
@@ -204,10 +220,392 @@ void bspatch_stream(const char* oldfile, const char* patchfile, const char* newf
     }
 }
 
+/* Same as offtin, but always 64 bits wide (off_t is a 32 bits long on
+ * Windows).
+ */
+static int64_t offtin64(const unsigned char* buf) {
+    int64_t y = buf[7] & 0x7F;
+    for (int i = 6; i >= 0; i--) y = y * 256 + buf[i];
+    if (buf[7] & 0x80) y = -y;
+    return y;
+}
+
+/* bzip2 decoder reading from a buffer in memory and decompressing straight
+ * into the caller's buffer, without going through a FILE*.
+ */
+class BZ2MemoryStream {
+public:
+    BZ2MemoryStream(const unsigned char* data, size_t size) {
+        memset(&_stream, 0, sizeof(_stream));
+        if (BZ2_bzDecompressInit(&_stream, 0, 0) != BZ_OK) {
+            throw std::exception("bz2 init fail");
+        }
+
+        _stream.next_in = (char*)data;
+        _stream.avail_in = (unsigned int)size;
+    }
+
+    ~BZ2MemoryStream() {
+        BZ2_bzDecompressEnd(&_stream);
+    }
+
+    BZ2MemoryStream(BZ2MemoryStream const&) = delete;
+    BZ2MemoryStream& operator=(BZ2MemoryStream const&) = delete;
+
+    /* Decompress exactly size bytes into dst, throw if the stream is
+     * corrupted or ends early.
+     */
+    void Read(unsigned char* dst, uint64_t size, const char* error) {
+        while (size) {
+            unsigned int chunk = size > UINT_MAX ? UINT_MAX : (unsigned int)size;
+            _stream.next_out = (char*)dst;
+            _stream.avail_out = chunk;
+
+            int ret = BZ2_bzDecompress(&_stream);
+            unsigned int produced = chunk - _stream.avail_out;
+            if ((ret != BZ_OK && ret != BZ_STREAM_END) || produced == 0) {
+                throw std::exception(error);
+            }
+
+            dst += produced;
+            size -= produced;
+        }
+    }
+
+private:
+    bz_stream _stream;
+};
+
+/* dst[i] += src[i] for i in [0, size). */
+static void AddBytes(unsigned char* dst, const unsigned char* src, size_t size) {
+    size_t i = 0;
+#ifdef DIFF_PATCHER_SSE2
+    for (; i + 64 <= size; i += 64) {
+        for (size_t j = 0; j < 64; j += 16) {
+            __m128i a = _mm_loadu_si128((const __m128i*)(dst + i + j));
+            __m128i b = _mm_loadu_si128((const __m128i*)(src + i + j));
+            _mm_storeu_si128((__m128i*)(dst + i + j), _mm_add_epi8(a, b));
+        }
+    }
+
+    for (; i + 16 <= size; i += 16) {
+        __m128i a = _mm_loadu_si128((const __m128i*)(dst + i));
+        __m128i b = _mm_loadu_si128((const __m128i*)(src + i));
+        _mm_storeu_si128((__m128i*)(dst + i), _mm_add_epi8(a, b));
+    }
+#endif
+
+    for (; i < size; ++i) {
+        dst[i] += src[i];
+    }
+}
+
+/* Add the count bytes of the old file starting at oldpos to dst. Bytes
+ * outside of [0, oldsize) count as 0.
+ */
+static void AddOldBytes(unsigned char* dst, const unsigned char* old, int64_t oldsize,
+    int64_t oldpos, int64_t count) {
+    int64_t begin = oldpos < 0 ? 0 : oldpos;
+    int64_t end = oldpos + count > oldsize ? oldsize : oldpos + count;
+    if (begin < end) {
+        AddBytes(dst + (begin - oldpos), old + begin, (size_t)(end - begin));
+    }
+}
+
+/* RGPATCH1, block-compressed alternative to BSDIFF40 with the same
+ * control / diff / extra semantics.
+ *
+ * Header, all integers little-endian:
+ *   0    8           "RGPATCH1"
+ *   8    8           size of the new file
+ *   16   4           number of blocks
+ *   20   4           reserved, 0
+ *   24   48 * blocks block index (see ReadRGPatchBlock)
+ *
+ * Each block covers a contiguous range of the new file and is stored as an
+ * independent zlib stream. Once decompressed, a block holds its control
+ * entries (three offtin encoded values each, as in BSDIFF40) followed by the
+ * bytes of its range of the new file: the diff bytes of the first entry,
+ * its extra bytes, the diff bytes of the second entry, and so on. As the
+ * index records where each block starts in both files, the blocks can be
+ * decompressed in any order, and in parallel.
+ */
+static constexpr char RGPATCH_MAGIC[] = "RGPATCH1";
+static constexpr size_t RGPATCH_HEADER_SIZE = 24;
+static constexpr size_t RGPATCH_BLOCK_ENTRY_SIZE = 48;
+
+struct RGPatchBlock {
+    /* Position and size of the compressed block in the patch. */
+    uint64_t offset;
+    uint64_t compressedSize;
+    /* Position of the block in the new and old files. */
+    uint64_t newOffset;
+    int64_t oldOffset;
+    uint64_t newSize;
+    uint32_t ctrlCount;
+};
+
+static uint64_t ReadLE64(const unsigned char* p) {
+    uint64_t v = 0;
+    for (int i = 7; i >= 0; i--) v = (v << 8) | p[i];
+    return v;
+}
+
+static uint32_t ReadLE32(const unsigned char* p) {
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static RGPatchBlock ReadRGPatchBlock(const unsigned char* entry) {
+    RGPatchBlock block;
+    block.offset = ReadLE64(entry);
+    block.compressedSize = ReadLE64(entry + 8);
+    block.newOffset = ReadLE64(entry + 16);
+    block.oldOffset = (int64_t)ReadLE64(entry + 24);
+    block.newSize = ReadLE64(entry + 32);
+    block.ctrlCount = ReadLE32(entry + 40);
+    return block;
+}
+
+/* zlib decoder reading from a buffer in memory. */
+class ZlibMemoryStream {
+public:
+    ZlibMemoryStream(const unsigned char* data, size_t size) {
+        memset(&_stream, 0, sizeof(_stream));
+        if (size > UINT_MAX || inflateInit(&_stream) != Z_OK) {
+            throw std::exception("zlib init fail");
+        }
+
+        _stream.next_in = (Bytef*)data;
+        _stream.avail_in = (uInt)size;
+    }
+
+    ~ZlibMemoryStream() {
+        inflateEnd(&_stream);
+    }
+
+    ZlibMemoryStream(ZlibMemoryStream const&) = delete;
+    ZlibMemoryStream& operator=(ZlibMemoryStream const&) = delete;
+
+    /* Decompress exactly size bytes into dst, throw if the stream is
+     * corrupted or ends early.
+     */
+    void Read(unsigned char* dst, uint64_t size) {
+        while (size) {
+            uInt chunk = size > UINT_MAX ? UINT_MAX : (uInt)size;
+            _stream.next_out = dst;
+            _stream.avail_out = chunk;
+
+            int ret = inflate(&_stream, Z_NO_FLUSH);
+            uInt produced = chunk - _stream.avail_out;
+            if ((ret != Z_OK && ret != Z_STREAM_END) || produced == 0) {
+                throw std::exception("corrupt patch or zlib error");
+            }
+
+            dst += produced;
+            size -= produced;
+        }
+    }
+
+private:
+    z_stream _stream;
+};
+
+static void ApplyRGPatchBlock(RGPatchBlock const& block, const unsigned char* patch,
+    const unsigned char* old, int64_t oldsize, unsigned char* out) {
+    ZlibMemoryStream stream(patch + block.offset, block.compressedSize);
+    std::vector<unsigned char> ctrlBuffer((size_t)block.ctrlCount * 24);
+    stream.Read(ctrlBuffer.data(), ctrlBuffer.size());
+    stream.Read(out + block.newOffset, block.newSize);
+
+    int64_t oldpos = block.oldOffset;
+    int64_t newpos = block.newOffset;
+    int64_t end = block.newOffset + block.newSize;
+    for (uint32_t i = 0; i < block.ctrlCount; ++i) {
+        const unsigned char* cbuf = ctrlBuffer.data() + 24 * (size_t)i;
+        int64_t ctrl[3] = { offtin64(cbuf), offtin64(cbuf + 8), offtin64(cbuf + 16) };
+        if (ctrl[0] < 0 || ctrl[1] < 0 || ctrl[0] > end - newpos || ctrl[1] > end - newpos - ctrl[0]) {
+            throw std::exception("corrupt patch (invalid control entry)");
+        }
+
+        AddOldBytes(out + newpos, old, oldsize, oldpos, ctrl[0]);
+        newpos += ctrl[0] + ctrl[1];
+        oldpos += ctrl[0] + ctrl[2];
+    }
+
+    if (newpos != end) {
+        throw std::exception("corrupt patch (block size mismatch)");
+    }
+}
+
+/* Apply an RGPATCH1 patch, decompressing its blocks on up to threads threads
+ * (one per core if 0). Return false if the new file could not be mapped,
+ * throw on invalid patches.
+ */
+static bool rgpatch_mapped(MappedFile const& fold, MappedFile const& fpatch, const char* newfile,
+    unsigned int threads) {
+    const unsigned char* patch = fpatch.Data();
+    uint64_t patchsize = fpatch.Size();
+    uint64_t newsize = ReadLE64(patch + 8);
+    uint32_t count = ReadLE32(patch + 16);
+    if ((patchsize - RGPATCH_HEADER_SIZE) / RGPATCH_BLOCK_ENTRY_SIZE < count) {
+        throw std::exception("corrupted or fucked up patch!");
+    }
+
+    std::vector<RGPatchBlock> blocks;
+    uint64_t expected = 0;
+    for (uint32_t i = 0; i < count; ++i) {
+        RGPatchBlock block = ReadRGPatchBlock(patch + RGPATCH_HEADER_SIZE + RGPATCH_BLOCK_ENTRY_SIZE * (size_t)i);
+        if (block.newOffset != expected || block.newSize > newsize - expected ||
+            block.offset > patchsize || block.compressedSize > patchsize - block.offset) {
+            throw std::exception("corrupted or fucked up patch! (block index)");
+        }
+
+        expected += block.newSize;
+        blocks.push_back(block);
+    }
+
+    if (expected != newsize) {
+        throw std::exception("corrupted or fucked up patch! (block index)");
+    }
+
+    MappedFile fnew;
+    if (!fnew.Create(newfile, newsize)) {
+        return false;
+    }
+
+    unsigned int workers = threads ? threads : std::max(1u, std::thread::hardware_concurrency());
+    workers = (unsigned int)std::min<size_t>(workers, blocks.size());
+
+    std::atomic<size_t> next = 0;
+    std::mutex errorMutex;
+    std::exception_ptr error;
+    auto worker = [&]() {
+        for (size_t i = next++; i < blocks.size(); i = next++) {
+            try {
+                ApplyRGPatchBlock(blocks[i], patch, fold.Data(), fold.Size(), fnew.Data());
+            } catch (...) {
+                std::unique_lock<std::mutex> lck(errorMutex);
+                if (!error) {
+                    error = std::current_exception();
+                }
+
+                next = blocks.size();
+            }
+        }
+    };
+
+    std::vector<std::thread> helpers;
+    for (unsigned int i = 1; i < workers; ++i) {
+        helpers.emplace_back(worker);
+    }
+
+    worker();
+
+    for (std::thread& thread : helpers) {
+        thread.join();
+    }
+
+    if (error) {
+        std::rethrow_exception(error);
+    }
+
+    return true;
+}
+
+/* Memory-mapped equivalent of bspatch_stream.
+ *
+ * The old file and the patch are mapped in memory, and the new file is
+ * mapped at its final size. The diff and extra streams are decompressed
+ * directly into the output, and the old bytes are then added on top of the
+ * diff bytes in place. Bytes of the old file outside of [0, oldsize) count
+ * as 0, as in the reference bspatch.
+ *
+ * RGPATCH1 patches are detected by their magic number and applied by
+ * rgpatch_mapped instead, on up to threads threads (one per core if 0).
+ *
+ * Return false if the files could not be mapped (for example when the
+ * address space is too fragmented), in which case the caller should fall
+ * back to bspatch_stream. Throw on invalid patches.
+ */
+bool bspatch_mapped(const char* oldfile, const char* patchfile, const char* newfile, unsigned int threads) {
+    MappedFile fold, fpatch, fnew;
+    if (!fold.Open(oldfile) || !fpatch.Open(patchfile)) {
+        return false;
+    }
+
+    const unsigned char* patch = fpatch.Data();
+    uint64_t patchsize = fpatch.Size();
+    if (patchsize >= RGPATCH_HEADER_SIZE && !memcmp(patch, RGPATCH_MAGIC, 8)) {
+        return rgpatch_mapped(fold, fpatch, newfile, threads);
+    }
+
+    if (patchsize < HEADER_SIZE) {
+        throw std::exception("invalid patch format! (empty?)");
+    }
+
+    if (memcmp(patch, "BSDIFF40", 8)) {
+        throw std::exception("invalid patch format!");
+    }
+
+    int64_t bzctrllen = offtin64(patch + 8);
+    int64_t bzdifflen = offtin64(patch + 16);
+    int64_t newsize = offtin64(patch + 24);
+    if (bzctrllen < 0 || bzdifflen < 0 || newsize < 0 ||
+        (uint64_t)bzctrllen > patchsize - HEADER_SIZE ||
+        (uint64_t)bzdifflen > patchsize - HEADER_SIZE - bzctrllen) {
+        throw std::exception("corrupted or fucked up patch!");
+    }
+
+    if (!fnew.Create(newfile, newsize)) {
+        return false;
+    }
+
+    const unsigned char* ctrlStart = patch + HEADER_SIZE;
+    const unsigned char* diffStart = ctrlStart + bzctrllen;
+    const unsigned char* extraStart = diffStart + bzdifflen;
+    BZ2MemoryStream ctrlStream(ctrlStart, bzctrllen);
+    BZ2MemoryStream diffStream(diffStart, bzdifflen);
+    BZ2MemoryStream extraStream(extraStart, patchsize - HEADER_SIZE - bzctrllen - bzdifflen);
+
+    const unsigned char* old = fold.Data();
+    int64_t oldsize = fold.Size();
+    unsigned char* out = fnew.Data();
+    int64_t oldpos = 0, newpos = 0;
+
+    while (newpos < newsize) {
+        unsigned char cbuf[24];
+        int64_t ctrl[3];
+        ctrlStream.Read(cbuf, sizeof(cbuf), "bz2 decompression error! (Code:2)");
+        for (int i = 0; i < 3; i++) {
+            ctrl[i] = offtin64(cbuf + 8 * i);
+        }
+
+        if (ctrl[0] < 0 || ctrl[1] < 0 || ctrl[0] > newsize - newpos) {
+            throw std::exception("corrupt patch or bzdecomperr (code:69)");
+        }
+
+        diffStream.Read(out + newpos, ctrl[0], "corrupt patch or bzdecomperr (code:6969)");
+        AddOldBytes(out + newpos, old, oldsize, oldpos, ctrl[0]);
+
+        oldpos += ctrl[0];
+        newpos += ctrl[0];
+
+        if (ctrl[1] > newsize - newpos) {
+            throw std::exception("corrupt patch or bzdecomperr (code:69)");
+        }
+
+        extraStream.Read(out + newpos, ctrl[1], "corrupt patch or bzdecomperr (code:696969)");
+        newpos += ctrl[1];
+        oldpos += ctrl[2];
+    }
+
+    return true;
+}
+
 namespace diff_patcher {
     bool PatchIsaacMain(const char* file) {
         try {
-            PE32 pe32(file);
+            PE32 pe32(file, PE32::READ_WRITE);
             auto [textSectionHeader, textStart] = pe32.GetSection(".text");
 
             if (!textSectionHeader) {
@@ -215,13 +613,26 @@ namespace diff_patcher {
                 return false;
             }
 
-            PE32Byte mainFn = pe32.Lookup(ISAAC_MAIN_SIGNATURE, textSectionHeader);
-            if (!mainFn) {
+            SignatureScanner scanner;
+            scanner.Add(ISAAC_MAIN_SIGNATURE);
+            scanner.Compile();
+
+            std::vector<PE32Byte> matches = pe32.Scan(scanner, textSectionHeader)[0];
+            if (matches.empty()) {
                 Logger::Error("diff_patcher::PatchIsaacMain: main() not found in executable %s\n", file);
                 return false;
             }
 
-            if (!pe32.Patch(mainFn, std::string(&ISAAC_POISON_BYTE).c_str())) {
+            /* Wildcards make the signature looser: never patch at random. */
+            if (matches.size() > 1) {
+                Logger::Error("diff_patcher::PatchIsaacMain: main() signature is ambiguous in executable %s (%zu matches)\n",
+                    file, matches.size());
+                return false;
+            }
+
+            PE32Byte mainFn = matches.front();
+
+            if (!pe32.Patch(mainFn, &ISAAC_POISON_BYTE, 1)) {
                 Logger::Error("diff_patcher::PatchIsaacMain: error while patching main in %s\n", file);
                 return false;
             }
@@ -238,6 +649,38 @@ namespace diff_patcher {
         }
     }
 
+    struct PatchJob {
+        std::string name;
+        fs::path patch;
+        fs::path original;
+        fs::path temporary;
+        /* Expected hashes of the original and patched file, empty if the
+         * manifest does not provide them.
+         */
+        std::string pre;
+        std::string post;
+        /* Hash of the original file, computed before the patches are
+         * applied. Empty if the manifest gives no hash to compare it to, or
+         * if the file could not be hashed.
+         */
+        std::string hash;
+        /* Whether an interrupted run already recorded this entry as done. */
+        bool journaled = false;
+        /* Size of the original file, used to schedule the largest first. */
+        uintmax_t cost = 0;
+        /* Share of the thread budget that rgpatch_mapped may use. */
+        unsigned int threads = 1;
+        bool ok = false;
+        /* The original file already is the expected output. */
+        bool skipped = false;
+        /* The original file is missing, but the temporary left by an
+         * interrupted run is the expected output: it only has to be moved
+         * into place.
+         */
+        bool recovered = false;
+        int code = PATCH_ERROR_APPLY;
+    };
+
     static void PushError(std::vector<PatchError>* errors, std::string name,
         PatchOperation op, std::error_code errc) {
         if (errors) {
@@ -249,9 +692,303 @@ namespace diff_patcher {
         }
     }
 
+    static void PushError(std::vector<PatchError>* errors, std::string name,
+        PatchOperation op, int code) {
+        std::error_code err;
+        err.assign(code, std::generic_category());
+        PushError(errors, std::move(name), op, err);
+    }
+
+    static const char* OperationToJournal(PatchOperation op) {
+        switch (op) {
+        case OP_CREATE:
+            return "create";
+
+        case OP_DELETE:
+            return "delete";
+
+        default:
+            return "patch";
+        }
+    }
+
+    /* Return true if the file exists and its hash is expected. */
+    static bool Verify(fs::path const& path, std::string const& expected) {
+        std::string hash;
+        std::string pathStr = path.string();
+        if (Sha256::HashFile(pathStr.c_str(), hash) != HASH_OK) {
+            return false;
+        }
+
+        return Sha256::Equals(hash.c_str(), expected.c_str());
+    }
+
+    /* Return true if hash was computed and is expected. */
+    static bool Matches(std::string const& hash, std::string const& expected) {
+        return !hash.empty() && Sha256::Equals(hash.c_str(), expected.c_str());
+    }
+
+    /* Hash the original file of every job whose manifest entry has hashes,
+     * as a single batch spread over up to workers threads.
+     */
+    static void HashOriginals(std::vector<PatchJob>& jobs, unsigned int workers) {
+        std::vector<fs::path> paths;
+        std::vector<PatchJob*> hashed;
+        for (PatchJob& job : jobs) {
+            if (!job.pre.empty() || !job.post.empty()) {
+                paths.push_back(job.original);
+                hashed.push_back(&job);
+            }
+        }
+
+        if (paths.empty()) {
+            return;
+        }
+
+        std::vector<Sha256::FileHash> results = Sha256::HashFiles(paths, nullptr, nullptr, workers);
+        for (size_t i = 0; i < results.size(); ++i) {
+            if (results[i].result == HASH_OK) {
+                hashed[i]->hash = std::move(results[i].hash);
+            } else {
+                Logger::Warn("PatchFolder: unable to hash %s (%d)\n", paths[i].string().c_str(),
+                    results[i].result);
+            }
+        }
+    }
+
+    /* Read the journal left by an interrupted run, as a set of "op name"
+     * lines.
+     */
+    static std::set<std::string> LoadJournal(fs::path const& root) {
+        std::set<std::string> entries;
+        std::ifstream journal(root / PATCH_JOURNAL);
+        std::string line;
+        if (!std::getline(journal, line) || line != PATCH_JOURNAL_HEADER) {
+            return entries;
+        }
+
+        while (std::getline(journal, line)) {
+            if (!line.empty() && line.back() == '\r') {
+                line.pop_back();
+            }
+
+            entries.insert(line);
+        }
+
+        return entries;
+    }
+
+    /* Append-only journal of the entries of the manifest that are done. Each
+     * line is flushed as soon as it is written, so that a crash loses at
+     * most the entry being processed.
+     *
+     * A journal LoadJournal would ignore, because its header is missing or
+     * damaged, is started over: appending to it would never be read back.
+     */
+    class Journal {
+    public:
+        Journal(fs::path const& root) {
+            fs::path path = root / PATCH_JOURNAL;
+            std::string pathStr = path.string();
+
+            bool valid = false;
+            bool terminated = true;
+            {
+                std::ifstream existing(path, std::ios::binary);
+                std::string line;
+                if (std::getline(existing, line) && !line.empty() && line.back() == '\r') {
+                    line.pop_back();
+                }
+
+                valid = line == PATCH_JOURNAL_HEADER;
+                if (valid) {
+                    existing.clear();
+                    existing.seekg(-1, std::ios::end);
+                    terminated = existing.get() == '\n';
+                }
+            }
+
+            _f = fopen(pathStr.c_str(), valid ? "a" : "w");
+            if (!_f) {
+                Logger::Warn("PatchFolder: unable to open journal %s\n", pathStr.c_str());
+                return;
+            }
+
+            if (!valid) {
+                fprintf(_f, "%s\n", PATCH_JOURNAL_HEADER);
+            } else if (!terminated) {
+                /* Keep the first entry apart from a line cut by a crash. */
+                fputc('\n', _f);
+            }
+
+            fflush(_f);
+        }
+
+        void Record(PatchOperation op, std::string const& name) {
+            if (_f) {
+                fprintf(_f, "%s %s\n", OperationToJournal(op), name.c_str());
+                fflush(_f);
+            }
+        }
+
+    private:
+        ScopedFile _f;
+    };
+
+    static bool IsJournaled(std::set<std::string> const& journal, PatchOperation op,
+        std::string const& name) {
+        return journal.find(std::string(OperationToJournal(op)) + " " + name) != journal.end();
+    }
+
+    std::set<fs::path> GetFinishedEntries(fs::path const& rootFolderToPatch) {
+        std::set<fs::path> result;
+        for (std::string const& line : LoadJournal(rootFolderToPatch)) {
+            size_t space = line.find(' ');
+            if (space == std::string::npos) {
+                continue;
+            }
+
+            result.insert(fs::path(line.substr(space + 1)));
+        }
+
+        return result;
+    }
+
+    /* Apply the patch of a single file into its .patched temporary, checking
+     * the hashes of the input and output if the manifest provides them.
+     */
+    static void ApplyPatch(PatchJob& job) {
+        std::string originalStr = job.original.string();
+        std::string patchStr = job.patch.string();
+        std::string tempStr = job.temporary.string();
+
+        if (!job.post.empty() && !Filesystem::SafeExists(job.original) && Verify(job.temporary, job.post)) {
+            Logger::Info("PatchFolder: `%s` was patched by a previous run but not moved into place\n",
+                originalStr.c_str());
+            job.ok = job.recovered = true;
+            return;
+        }
+
+        if (!job.post.empty() && Matches(job.hash, job.post)) {
+            Logger::Info("PatchFolder: `%s` is already patched, skipping\n", originalStr.c_str());
+            job.ok = job.skipped = true;
+            return;
+        }
+
+        if (job.post.empty() && job.journaled) {
+            Logger::Info("PatchFolder: `%s` was patched by a previous run, skipping\n", originalStr.c_str());
+            job.ok = job.skipped = true;
+            return;
+        }
+
+        if (!job.pre.empty() && !Matches(job.hash, job.pre)) {
+            Logger::Error("PatchFolder: `%s` does not match the hash expected by the patch\n",
+                originalStr.c_str());
+            job.code = PATCH_ERROR_PRE_HASH;
+            return;
+        }
+
+        Logger::Info("PatchFolder: Patching `%s` using patch file `%s`\n", originalStr.c_str(), patchStr.c_str());
+
+        try {
+            if (!bspatch_mapped(originalStr.c_str(), patchStr.c_str(), tempStr.c_str(), job.threads)) {
+                Logger::Warn("PatchFolder: unable to map %s, falling back to streamed patching\n",
+                    job.name.c_str());
+                bspatch_stream(originalStr.c_str(), patchStr.c_str(), tempStr.c_str());
+            }
+            /* //No longer needed, keeping it just in case
+            if (const char* substring = strstr(tempStr.c_str(), "isaac-ng.exe")) {
+                if (!strcmp(substring, "isaac-ng.exe.patched")) {
+                    std::vector<char> buffer(tempStr.begin(), tempStr.end());
+                    buffer.push_back('\0');
+                    PatchIsaacMain(buffer.data());
+                }
+            }
+            */
+        } catch (std::exception& e) {
+            Logger::Error("PatchFolder: unable to apply patch for %s (%s)\n", job.name.c_str(),
+                e.what());
+            job.code = PATCH_ERROR_APPLY;
+            return;
+        }
+
+        if (!job.post.empty() && !Verify(job.temporary, job.post)) {
+            Logger::Error("PatchFolder: patched `%s` does not match the expected hash\n",
+                originalStr.c_str());
+            job.code = PATCH_ERROR_POST_HASH;
+            return;
+        }
+
+        job.ok = true;
+    }
+
+    /* Apply every job on up to workers threads (one per core if 0). The
+     * largest files are started first so that the total time is bounded by
+     * the largest file rather than by whichever file happens to be last.
+     *
+     * workers is a budget for the whole operation: the threads left over
+     * once there is one per file are split among the files for the block
+     * level parallelism of RGPATCH1, so that the jobs running at any time
+     * never use more than workers threads between them.
+     */
+    static void RunPatchJobs(std::vector<PatchJob>& jobs, unsigned int workers) {
+        std::vector<PatchJob*> order;
+        for (PatchJob& job : jobs) {
+            order.push_back(&job);
+        }
+
+        std::stable_sort(order.begin(), order.end(), [](PatchJob const* lhs, PatchJob const* rhs) {
+            return lhs->cost > rhs->cost;
+        });
+
+        if (workers == 0) {
+            workers = std::max(1u, std::thread::hardware_concurrency());
+        }
+
+        unsigned int budget = workers;
+        workers = (unsigned int)std::min<size_t>(workers, order.size());
+        if (workers == 0) {
+            return;
+        }
+
+        /* Only the first budget % workers jobs get an extra thread, so any
+         * workers jobs add up to at most budget threads.
+         */
+        for (size_t i = 0; i < order.size(); ++i) {
+            order[i]->threads = budget / workers + (i < budget % workers ? 1 : 0);
+        }
+
+        std::atomic<size_t> next = 0;
+        auto worker = [&]() {
+            for (size_t i = next++; i < order.size(); i = next++) {
+                ApplyPatch(*order[i]);
+            }
+        };
+
+        std::vector<std::thread> threads;
+        for (unsigned int i = 1; i < workers; ++i) {
+            threads.emplace_back(worker);
+        }
+
+        worker();
+
+        for (std::thread& thread : threads) {
+            thread.join();
+        }
+    }
+
+    /* Read an optional string member of an object entry of the manifest. */
+    static std::string GetOptionalString(Value const& v, const char* member) {
+        if (v.IsObject() && v.HasMember(member) && v[member].IsString()) {
+            return v[member].GetString();
+        }
+
+        return std::string();
+    }
+
     PatchFolderResult PatchFolder(const fs::path& rootFolderToPatch,
         const fs::path& rootPatchesFolder,
-        std::vector<PatchError>* errors) {
+        std::vector<PatchError>* errors, unsigned int workers) {
         fs::path manifest = rootPatchesFolder / "manifest.json";
 
         std::ifstream mf(manifest);
@@ -271,23 +1008,44 @@ namespace diff_patcher {
 
         bool ok = true;
         std::ofstream(rootFolderToPatch / "patchme.daddy"); //file to check if patching finished or not
+        std::set<std::string> finished = LoadJournal(rootFolderToPatch);
+        if (!finished.empty()) {
+            Logger::Info("PatchFolder: resuming interrupted patch (%zu entries done)\n", finished.size());
+        }
+
+        Journal journal(rootFolderToPatch);
+
         if (doc.HasMember("delete")) {
             std::error_code err;
             for (auto const& v : doc["delete"].GetArray()) {
                 std::string name = v.GetString();
+                if (IsJournaled(finished, OP_DELETE, name)) {
+                    continue;
+                }
+
                 Logger::Info("PatchFolder: Deleting file: %s\n", name.c_str());
                 fs::remove(rootFolderToPatch / name, err);
                 if (err) {
                     Logger::Error("PatchFolder: unable to delete %s\n", name.c_str());
                     PushError(errors, name, OP_DELETE, err);
                     ok = false;
+                } else {
+                    journal.Record(OP_DELETE, name);
                 }
             }
         }
 
         if (doc.HasMember("create")) {
             for (auto const& m : doc["create"].GetObject()) {
-                fs::path dst = rootFolderToPatch / m.name.GetString();
+                std::string dstName = m.name.GetString();
+                fs::path dst = rootFolderToPatch / dstName;
+                std::string name = m.value.IsString() ? m.value.GetString() : GetOptionalString(m.value, "source");
+                std::string post = GetOptionalString(m.value, "post");
+
+                if (IsJournaled(finished, OP_CREATE, dstName) && (post.empty() || Verify(dst, post))) {
+                    continue;
+                }
+
                 std::error_code err;
                 fs::path hierarchy = dst.parent_path();
                 fs::create_directories(hierarchy, err);
@@ -299,67 +1057,105 @@ namespace diff_patcher {
                     continue;
                 }
 
-                std::string name = m.value.GetString();
                 Logger::Info("PatchFolder: Creating file: %s\n", name.c_str());
                 fs::copy_file(rootPatchesFolder / name, dst, fs::copy_options::overwrite_existing, err);
                 if (err) {
                     Logger::Error("PatchFolder: unable to create file %s\n", name.c_str());
                     PushError(errors, name, OP_CREATE, err);
                     ok = false;
+                } else if (!post.empty() && !Verify(dst, post)) {
+                    Logger::Error("PatchFolder: created file %s does not match the expected hash\n", name.c_str());
+                    PushError(errors, name, OP_CREATE, PATCH_ERROR_POST_HASH);
+                    ok = false;
+                } else {
+                    journal.Record(OP_CREATE, dstName);
                 }
             }
         }
 
         if (doc.HasMember("patch")) {
+            std::vector<PatchJob> jobs;
             for (auto& v : doc["patch"].GetArray()) {
-                fs::path patch = rootPatchesFolder / "patches" / (std::string(v.GetString()) + ".patch");
-                std::string name = v.GetString();
-                fs::path original = rootFolderToPatch / name;
-                fs::path temporary = original;
-                std::string originalStr = original.string();
-                std::string patchStr = patch.string();
-                std::string tempStr = temporary.string();
-                temporary += ".patched";
-
-                Logger::Info("PatchFolder: Patching `%s` using patch file `%s`\n", originalStr.c_str(), patch.string().c_str());
-
-                try {
-                    std::string s = temporary.string();
-                    bspatch_stream(originalStr.c_str(), patchStr.c_str(),
-                        s.c_str());
-                    /* //No longer needed, keeping it just in case
-                    if (const char* substring = strstr(s.c_str(), "isaac-ng.exe")) {
-                        if (!strcmp(substring, "isaac-ng.exe.patched")) {
-                            std::string path = temporary.string();
-                            std::vector<char> buffer(path.begin(), path.end());
-                            buffer.push_back('\0');
-                            PatchIsaacMain(buffer.data());
-                        }
-                    }
-                    */
-                } catch (std::exception& e) {
-                    Logger::Error("PatchFolder: unable to apply patch for %s (%s)\n", name.c_str(),
-                        e.what());
-                    std::error_code err;
-                    err.assign(-1, std::generic_category());
-                    PushError(errors, name, OP_PATCH, err);
+                PatchJob job;
+                job.name = v.IsString() ? v.GetString() : GetOptionalString(v, "file");
+                job.pre = GetOptionalString(v, "pre");
+                job.post = GetOptionalString(v, "post");
+                job.journaled = IsJournaled(finished, OP_PATCH, job.name);
+                job.patch = rootPatchesFolder / "patches" / (job.name + ".patch");
+                job.original = rootFolderToPatch / job.name;
+                job.temporary = job.original;
+                job.temporary += ".patched";
+
+                std::error_code err;
+                job.cost = fs::file_size(job.original, err);
+                if (err) {
+                    job.cost = 0;
+                }
+
+                jobs.push_back(std::move(job));
+            }
+
+            HashOriginals(jobs, workers);
+            RunPatchJobs(jobs, workers);
+
+            bool applied = true;
+            for (PatchJob const& job : jobs) {
+                if (!job.ok) {
+                    PushError(errors, job.name, OP_PATCH, job.code);
+                    applied = false;
                     ok = false;
                 }
+            }
+
+            /* Only move the patched files into place once every patch has
+             * been applied, so that a patch that fails to apply leaves all
+             * the original files untouched. A failed move cannot be undone
+             * however: the other files are still moved into place, and the
+             * journal lets the next run finish the job. A recovered file is
+             * moved into place in any case, as its original is gone.
+             *
+             * The patched file replaces the original in a single rename, so
+             * that an interruption leaves either of them in place.
+             */
+            for (PatchJob const& job : jobs) {
+                std::error_code err;
+                if (!applied && !job.recovered) {
+                    fs::remove(job.temporary, err);
+                    continue;
+                }
 
-                if (ok) {
-                    if (Filesystem::SafeExists(temporary)) {
-                        if (Filesystem::SafeExists(original)) {
-                            fs::remove(original);
-                        }
-                        fs::rename(temporary, original);
+                if (job.skipped) {
+                    if (!job.journaled) {
+                        journal.Record(OP_PATCH, job.name);
                     }
-                } else if (Filesystem::SafeExists(temporary)) {
-                    fs::remove(temporary);
+
+                    continue;
+                }
+
+                if (!Filesystem::SafeExists(job.temporary)) {
+                    continue;
+                }
+
+                fs::rename(job.temporary, job.original, err);
+                if (err) {
+                    Logger::Error("PatchFolder: unable to move patched %s into place\n", job.name.c_str());
+                    PushError(errors, job.name, OP_PATCH, err);
+                    ok = false;
+                } else {
+                    journal.Record(OP_PATCH, job.name);
                 }
             }
         }
-        fs::remove(rootFolderToPatch / "patchme.daddy"); //file to check if patching finished or not
+
+        /* On failure, the marker and the journal stay behind: the folder is
+         * reported as broken and the next run resumes from the journal.
+         */
+        if (ok) {
+            std::error_code err;
+            fs::remove(rootFolderToPatch / PATCH_JOURNAL, err);
+            fs::remove(rootFolderToPatch / "patchme.daddy", err); //file to check if patching finished or not
+        }
 
         return ok ? PATCH_OK : PATCH_FAIL;
     }
-}
\ No newline at end of file
+}
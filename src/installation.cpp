@@ -20,6 +20,7 @@
 #include "shared/filesystem.h"
 #include "shared/scoped_file.h"
 #include "shared/sha256.h"
+#include "shared/staging.h"
 
 namespace fs = std::filesystem;
 
@@ -91,6 +92,15 @@ namespace Launcher {
 		if (locatedIsaacPath) {
 			_launcherConfiguration->SetIsaacExecutablePath(
 				_isaacInstallation.GetMainInstallation().GetExePath());
+
+			/* Undo an update of Repentogon interrupted by a crash before
+			 * looking at the installation.
+			 */
+			fs::path repentogonPath;
+			if (standalone_rgon::GenerateRepentogonPath(_isaacInstallation.GetMainInstallation().GetFolderPath(),
+				repentogonPath, true)) {
+				Staging::Recover(repentogonPath);
+			}
 		}
 		bool repentogonOk = locatedIsaacPath ? CheckRepentogonInstallation() : false;
 
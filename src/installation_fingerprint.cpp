@@ -0,0 +1,208 @@
+#include <WinSock2.h>
+#include <Windows.h>
+
+#include <cinttypes>
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "launcher/installation_fingerprint.h"
+#include "shared/logger.h"
+
+namespace FingerprintCache {
+	static constexpr const char* CACHE_HEADER = "REPENTOGON-FINGERPRINTS";
+
+	/* Entries are written one per line, as tab separated fields: path, size,
+	 * last write time, volume, file index, hash ("-" if unknown), version.
+	 */
+	static constexpr size_t ENTRY_FIELDS = 7;
+
+	class Cache {
+	public:
+		static Cache& Instance() {
+			static Cache cache;
+			return cache;
+		}
+
+		bool Lookup(const char* path, ExecutableFingerprint& fingerprint) {
+			std::unique_lock<std::mutex> lck(_mutex);
+			Load();
+
+			Filesystem::FileIdentity const& identity = fingerprint.identity;
+			auto it = _entries.find(identity.path);
+			const char* reason = nullptr;
+			if (it == _entries.end()) {
+				reason = "unknown executable";
+			} else {
+				Filesystem::FileIdentity const& cached = it->second.identity;
+				if (cached.volume != identity.volume || cached.fileIndex != identity.fileIndex) {
+					reason = "executable replaced";
+				} else if (cached.size != identity.size) {
+					reason = "size changed";
+				} else if (cached.lastWrite != identity.lastWrite) {
+					reason = "last write time changed";
+				}
+			}
+
+			if (reason) {
+				++_misses;
+				Logger::Info("FingerprintCache::Lookup: miss for %s (%s) (%u hit(s), %u miss(es))\n",
+					path, reason, _hits, _misses);
+				if (it != _entries.end()) {
+					_entries.erase(it);
+					Save();
+				}
+
+				return false;
+			}
+
+			++_hits;
+			fingerprint.version = it->second.version;
+			fingerprint.hash = it->second.hash;
+			Logger::Info("FingerprintCache::Lookup: hit for %s (version '%s', hash %s) (%u hit(s), %u miss(es))\n",
+				path, fingerprint.version.c_str(), fingerprint.hash.empty() ? "unknown" : "known",
+				_hits, _misses);
+			return true;
+		}
+
+		void Store(ExecutableFingerprint const& fingerprint) {
+			std::unique_lock<std::mutex> lck(_mutex);
+			Load();
+
+			_entries[fingerprint.identity.path] = fingerprint;
+			Save();
+		}
+
+	private:
+		void Load() {
+			if (_loaded) {
+				return;
+			}
+
+			_loaded = true;
+			FILE* f = fopen(CACHE_FILE, "r");
+			if (!f) {
+				return;
+			}
+
+			char header[64];
+			unsigned int format = 0;
+			if (!fgets(header, sizeof(header), f) || strncmp(header, CACHE_HEADER, strlen(CACHE_HEADER)) ||
+				sscanf(header + strlen(CACHE_HEADER), "%u", &format) != 1 || format != CACHE_FORMAT) {
+				Logger::Info("FingerprintCache::Load: discarding %s, different format\n", CACHE_FILE);
+				fclose(f);
+				return;
+			}
+
+			char line[4096];
+			while (fgets(line, sizeof(line), f)) {
+				std::vector<std::string> fields;
+				const char* start = line;
+				while (true) {
+					const char* end = start + strcspn(start, "\t\r\n");
+					fields.emplace_back(start, end);
+					if (*end != '\t') {
+						break;
+					}
+
+					start = end + 1;
+				}
+
+				ExecutableFingerprint fingerprint;
+				Filesystem::FileIdentity& identity = fingerprint.identity;
+				if (fields.size() != ENTRY_FIELDS || fields[0].empty() || fields[6].empty() ||
+					sscanf(fields[1].c_str(), "%" SCNu64, &identity.size) != 1 ||
+					sscanf(fields[2].c_str(), "%" SCNu64, &identity.lastWrite) != 1 ||
+					sscanf(fields[3].c_str(), "%" SCNu32, &identity.volume) != 1 ||
+					sscanf(fields[4].c_str(), "%" SCNu64, &identity.fileIndex) != 1 ||
+					(fields[5] != "-" && fields[5].size() != 64)) {
+					continue;
+				}
+
+				identity.path = fields[0];
+				if (fields[5] != "-") {
+					fingerprint.hash = fields[5];
+				}
+
+				fingerprint.version = fields[6];
+				_entries[identity.path] = std::move(fingerprint);
+			}
+
+			fclose(f);
+		}
+
+		void Save() {
+			std::string content = CACHE_HEADER;
+			content += " " + std::to_string(CACHE_FORMAT) + "\n";
+			for (auto const& [path, fingerprint] : _entries) {
+				Filesystem::FileIdentity const& identity = fingerprint.identity;
+				char fields[128];
+				snprintf(fields, sizeof(fields), "\t%" PRIu64 "\t%" PRIu64 "\t%" PRIu32 "\t%" PRIu64 "\t",
+					identity.size, identity.lastWrite, identity.volume, identity.fileIndex);
+				content += path;
+				content += fields;
+				content += fingerprint.hash.empty() ? "-" : fingerprint.hash;
+				content += "\t";
+				content += fingerprint.version;
+				content += "\n";
+			}
+
+			CreateDirectoryA("launcher-data", NULL);
+			if (!Filesystem::AtomicWriteFile(CACHE_FILE, content.data(), content.size())) {
+				Logger::Warn("FingerprintCache::Save: unable to write %s\n", CACHE_FILE);
+			}
+		}
+
+		std::mutex _mutex;
+		std::unordered_map<std::string, ExecutableFingerprint> _entries;
+		bool _loaded = false;
+		unsigned int _hits = 0;
+		unsigned int _misses = 0;
+	};
+
+	static bool ReadIdentity(const char* path, Filesystem::FileIdentity& identity) {
+		HANDLE file = CreateFileA(path, FILE_READ_ATTRIBUTES,
+			FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, NULL, OPEN_EXISTING,
+			FILE_ATTRIBUTE_NORMAL, NULL);
+		if (file == INVALID_HANDLE_VALUE) {
+			return false;
+		}
+
+		bool ok = Filesystem::GetFileIdentity(file, identity);
+		CloseHandle(file);
+		return ok;
+	}
+
+	bool Lookup(const char* path, ExecutableFingerprint& fingerprint) {
+		fingerprint = ExecutableFingerprint();
+		if (!ReadIdentity(path, fingerprint.identity)) {
+			Logger::Info("FingerprintCache::Lookup: miss for %s (unable to identify the file)\n", path);
+			fingerprint.identity = Filesystem::FileIdentity();
+			return false;
+		}
+
+		return Cache::Instance().Lookup(path, fingerprint);
+	}
+
+	void Store(const char* path, ExecutableFingerprint const& fingerprint) {
+		if (fingerprint.identity.path.empty() || fingerprint.version.empty() ||
+			fingerprint.version.find_first_of("\t\r\n") != std::string::npos) {
+			return;
+		}
+
+		Filesystem::FileIdentity current;
+		if (!ReadIdentity(path, current) || !(current == fingerprint.identity)) {
+			Logger::Info("FingerprintCache::Store: %s changed while it was inspected, not remembering it\n", path);
+			return;
+		}
+
+		if (!Filesystem::IsOlderThan(current, CACHE_MIN_AGE)) {
+			return;
+		}
+
+		Cache::Instance().Store(fingerprint);
+	}
+}
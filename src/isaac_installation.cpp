@@ -18,8 +18,10 @@
 
 #include <curl/curl.h>
 
+#include "launcher/installation_fingerprint.h"
 #include "launcher/isaac_installation.h"
 #include "launcher/repentogon_installation.h"
+#include "shared/curl/handle_pool.h"
 #include "shared/filesystem.h"
 #include "shared/logger.h"
 #include "shared/pe32.h"
@@ -262,20 +264,31 @@ bool InstallationData::Validate(std::string const& sourcePath, bool repentogon)
 		Logger::Info("Installation::Validate: validating %s\n", path.c_str());
 	}
 
-	if (!ValidateExecutable(path)) {
-		_gui->LogError("%s is not a valid Isaac executable\n", path.c_str());
-		Logger::Error("Installation::Validate: invalid file given\n");
-		return false;
-	}
+	/* Only valid executables whose version was found are remembered: a hit
+	 * skips both the validation and the parsing of the executable.
+	 */
+	if (FingerprintCache::Lookup(path.c_str(), _fingerprint)) {
+		_isValid = true;
+		_version = _fingerprint.version;
+	} else {
+		if (!ValidateExecutable(path)) {
+			_gui->LogError("%s is not a valid Isaac executable\n", path.c_str());
+			Logger::Error("Installation::Validate: invalid file given\n");
+			return false;
+		}
 
-	std::optional<std::variant<const Version*, std::string>> version = ComputeVersion(path);
-	if (!version) {
-		_gui->LogError("Unable to compute version of executable %s, rejecting it as invalid\n", path.c_str());
-		Logger::Error("Installation::Validate: unable to get version of executable\n");
-		return false;
+		std::optional<std::variant<const Version*, std::string>> version = ComputeVersion(path);
+		if (!version) {
+			_gui->LogError("Unable to compute version of executable %s, rejecting it as invalid\n", path.c_str());
+			Logger::Error("Installation::Validate: unable to get version of executable\n");
+			return false;
+		}
+
+		_version = std::move(*version);
+		_fingerprint.version = GetVersion();
+		FingerprintCache::Store(path.c_str(), _fingerprint);
 	}
 
-	_version = std::move(*version);
 	Logger::Info("InstallationData::Validate: validated executable %s (version '%s') (repentogon = %d)\n",
 		path.c_str(), GetVersion(), repentogon);
 	_exePath = path;
@@ -422,7 +435,7 @@ OnlinePatchCheckResult CheckIfAvailableOnlineNGet(const std::string& currexehash
 		"https://gitlab.com/repentogon/versiontracker/-/raw/main/Patches/_" +
 		currexehash + "_-_" + targetversion + "_.zip?inline=false";
 
-	CURL* curl = curl_easy_init();
+	CURL* curl = curl::AcquireHandle();
 	if (!curl)
 	{
 		Logger::Error("Failed to initialize curl!!!\n");
@@ -433,7 +446,7 @@ OnlinePatchCheckResult CheckIfAvailableOnlineNGet(const std::string& currexehash
 	if (!fp)
 	{
 		Logger::Error("Failed to fopen %s (%d)\n", __patchZip, errno);
-		curl_easy_cleanup(curl);
+		curl::ReleaseHandle(curl);
 		return ONLINE_PATCH_ERROR;
 	}
 
@@ -517,8 +530,8 @@ OnlinePatchCheckResult CheckIfAvailableOnlineNGet(const std::string& currexehash
 		checkresult = ONLINE_PATCH_SUCCESS;
 	}
 
+	curl::ReleaseHandle(curl);
 	curl_slist_free_all(headers);
-	curl_easy_cleanup(curl);
 
 	try {
 		std::filesystem::remove(__patchZip);
@@ -534,8 +547,15 @@ bool InstallationData::PatchIsAvailable(const bool skipOnlineCheck) {
 	if (_patchAvailability != ISAAC_PATCH_NOT_CHECKED) {
 		return _patchAvailability == ISAAC_PATCH_AVAILABLE; //so it doesnt do the whole check and we can call this a shitton of times without worrying, the vanilla exe shouldnt change while the launcher is open anyway, since the launcher doesnt update it and...if it does, just fucking restart the launcher, dude
 	}
-	std::string vanillaexehash;
-	HashResult result = Sha256::Sha256F(this->GetExePath().c_str(), vanillaexehash);
+	std::string vanillaexehash = _fingerprint.hash;
+	HashResult result = HASH_OK;
+	if (vanillaexehash.empty()) {
+		result = Sha256::Sha256F(this->GetExePath().c_str(), vanillaexehash);
+		if (result == HASH_OK) {
+			_fingerprint.hash = vanillaexehash;
+			FingerprintCache::Store(this->GetExePath().c_str(), _fingerprint);
+		}
+	}
 
 	if (result == HASH_OK) {
 		fs::path fullPath = fs::current_path() / __patchFolder / "exehash.txt";
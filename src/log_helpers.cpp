@@ -139,11 +139,18 @@ namespace Launcher {
 		{
 			int i = 0;
 			LogError(text, "Could not install Repentogon: error while extracting archive\n");
-			for (auto const& [filename, success] : state.unzipedFiles) {
+			for (auto const& [filename, fileState] : state.unzipedFiles) {
 				if (filename.empty()) {
 					LogError(text, "Could not extract file %d from the archive\n", i);
 				} else {
-					LogError(text, "Extracted %s: %s\n", filename.c_str(), success ? "yes" : "no");
+					const char* description = "failed";
+					if (fileState == REPENTOGON_EXTRACTED_FILE_CHANGED) {
+						description = "changed";
+					} else if (fileState == REPENTOGON_EXTRACTED_FILE_UNCHANGED) {
+						description = "unchanged";
+					}
+
+					LogError(text, "Extracted %s: %s\n", filename.c_str(), description);
 				}
 
 				++i;
@@ -175,6 +182,10 @@ namespace Launcher {
 			LogError(text, "Could not install Repentogon: unable to downpatch copied Isaac files to compatible version\n");
 			break;
 
+		case REPENTOGON_INSTALLATION_RESULT_INVALID:
+			LogError(text, "Could not install Repentogon: the installed files are invalid, the previous ones were restored\n");
+			break;
+
 		case REPENTOGON_INSTALLATION_RESULT_OK:
 			break;
 
@@ -9,6 +9,8 @@
 #include "steam_api.h"
 #include "curl/curl.h"
 #include "shared/curl_request.h"
+#include "shared/curl/handle_pool.h"
+#include "shared/scoped_curl.h"
 #include "shared/filesystem.h"
 #include "shared/logger.h"
 #include "rapidxml/rapidxml.hpp"
@@ -380,7 +382,7 @@ std::string GetThumbnailURL(const std::wstring& itemId) {
     std::string url = "https://steamcommunity.com/sharedfiles/filedetails/?id=" + wxString(itemId).ToStdString();
     std::string html;
 
-    CURL* curl = curl_easy_init();
+    CURL* curl = curl::AcquireHandle();
     if (curl) {
         curl_easy_setopt(curl, CURLOPT_URL, url.c_str());
         curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, WriteCallback);
@@ -390,7 +392,7 @@ std::string GetThumbnailURL(const std::wstring& itemId) {
         curl::SetupProxyForCurl(curl);
 
         curl_easy_perform(curl);
-        curl_easy_cleanup(curl);
+        curl::ReleaseHandle(curl);
     }
 
     std::regex imgRegex(
@@ -421,12 +423,12 @@ std::string GetThumbnailURL(const std::wstring& itemId) {
 bool DownloadThumbFromID(const std::wstring& itemId, const std::wstring& filePath) {
 
     if (itemId.length() <= 0) { return false; }
-    CURL* curl = curl_easy_init();
+    CURL* curl = curl::AcquireHandle();
     if (!curl) return false;
+    ScopedCURL scopedCurl(curl);
 
     FILE* fp = _wfopen(filePath.c_str(), L"wb");
     if (!fp) {
-        curl_easy_cleanup(curl);
         return false;
     }
 
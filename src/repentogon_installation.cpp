@@ -1,12 +1,13 @@
+#include "launcher/diff_patcher.h"
 #include "launcher/repentogon_installation.h"
 #include "launcher/standalone_rgon_folder.h"
-#include "shared/scoped_module.h"
 #include "shared/filesystem.h"
 #include "shared/logger.h"
-#include "shared/module.h"
+#include "shared/pe32.h"
 
 #include <iostream>
 #include <fstream>
+#include <stdexcept>
 
 /* Array of all the names of files that must be found for the installation
  * to be considered a valid Repentogon installation.
@@ -37,6 +38,7 @@ void RepentogonInstallation::ClearInstallation() {
 bool RepentogonInstallation::CheckHalfAssedPatch(std::string const& installationPath) {
 	std::string basepath = installationPath;
 	std::string patchme = basepath + "patchme.daddy";
+	std::string journal = basepath + diff_patcher::PATCH_JOURNAL;
 
 	//legacy files that may be fucked up
 	std::string afterbirthpa = basepath + "resources\\packed\\afterbirthp.a.patched";
@@ -45,7 +47,7 @@ bool RepentogonInstallation::CheckHalfAssedPatch(std::string const& installation
 	std::string mainlua = basepath + "resources\\scripts\\main.lua.patched";
 	//end of legacy files that may be fucked up
 
-	return Filesystem::Exists(patchme.c_str()) || Filesystem::Exists(afterbirthpa.c_str()) || Filesystem::Exists(enumslua.c_str()) || Filesystem::Exists(jsonlua.c_str()) || Filesystem::Exists(mainlua.c_str());
+	return Filesystem::Exists(patchme.c_str()) || Filesystem::Exists(journal.c_str()) || Filesystem::Exists(afterbirthpa.c_str()) || Filesystem::Exists(enumslua.c_str()) || Filesystem::Exists(jsonlua.c_str()) || Filesystem::Exists(mainlua.c_str());
 }
 
 bool RepentogonInstallation::CheckExeFuckMethod(std::string const& installationPath) {
@@ -139,29 +141,29 @@ bool RepentogonInstallation::Validate(std::string const& installationFolder) {
 			installationFolder.c_str());
 	}
 
-	ScopedModule loader = LoadModule(Libraries::loader, (repentogonFolder + Libraries::loader).c_str(), LOADABLE_DLL_ZHL_LOADER);
+	std::unique_ptr<PE32> loader = OpenLibrary(Libraries::loader, (repentogonFolder + Libraries::loader).c_str(), LOADABLE_DLL_ZHL_LOADER);
 	if (!loader && !loaderMissing) {
 		_gui->LogError("No valid Repentogon installation found: ZHL loader missing\n");
 		return false;
 	}
 
-	ScopedModule zhl = LoadModule(Libraries::zhl, (repentogonFolder + Libraries::zhl).c_str(), LOADABLE_DLL_LIBZHL);
+	std::unique_ptr<PE32> zhl = OpenLibrary(Libraries::zhl, (repentogonFolder + Libraries::zhl).c_str(), LOADABLE_DLL_LIBZHL);
 	if (!zhl) {
 		_gui->LogError("No valid Repentogon installation found: ZHL DLL missing\n");
 		return false;
 	}
 
-	ScopedModule repentogon = LoadModule(Libraries::repentogon, (repentogonFolder + Libraries::repentogon).c_str(), LOADABLE_DLL_REPENTOGON);
+	std::unique_ptr<PE32> repentogon = OpenLibrary(Libraries::repentogon, (repentogonFolder + Libraries::repentogon).c_str(), LOADABLE_DLL_REPENTOGON);
 	if (!repentogon) {
 		_gui->LogError("No valid Repentogon installation found: Repentogon DLL missing\n");
 		return false;
 	}
 
-	FARPROC zhlVersion = RetrieveSymbol(zhl, Libraries::zhl, Symbols::zhlVersion);
-	FARPROC repentogonVersion = RetrieveSymbol(repentogon, Libraries::repentogon, Symbols::repentogonVersion);
-	FARPROC loaderVersion = NULL;
+	PE32Byte zhlVersion = RetrieveSymbol(*zhl, Libraries::zhl, Symbols::zhlVersion);
+	PE32Byte repentogonVersion = RetrieveSymbol(*repentogon, Libraries::repentogon, Symbols::repentogonVersion);
+	PE32Byte loaderVersion;
 	if (!loaderMissing) {
-		loaderVersion = RetrieveSymbol(loader, Libraries::loader, Symbols::loaderVersion);
+		loaderVersion = RetrieveSymbol(*loader, Libraries::loader, Symbols::loaderVersion);
 	}
 
 	if (!zhlVersion || !repentogonVersion || (!dsoundFound && !loaderVersion && !loaderMissing)) {
@@ -170,18 +172,18 @@ bool RepentogonInstallation::Validate(std::string const& installationFolder) {
 	}
 
 	if (!loaderMissing && !dsoundFound) {
-		if (!ValidateVersionSymbol(loader, Libraries::loader, Symbols::loaderVersion, loaderVersion, _zhlLoaderVersion)) {
+		if (!ValidateVersionSymbol(*loader, Libraries::loader, Symbols::loaderVersion, loaderVersion, _zhlLoaderVersion)) {
 			_gui->LogError("[DANGER] No valid Repentogon installation found: the ZHL loader DLL is malformed\n");
 			return false;
 		}
 	}
 
-	if (!ValidateVersionSymbol(zhl, Libraries::zhl, Symbols::zhlVersion, zhlVersion, _zhlVersion)) {
+	if (!ValidateVersionSymbol(*zhl, Libraries::zhl, Symbols::zhlVersion, zhlVersion, _zhlVersion)) {
 		_gui->LogError("[DANGER] No valid Repentogon installation found: the ZHL DLL is malformed\n");
 		return false;
 	}
 
-	if (!ValidateVersionSymbol(repentogon, Libraries::repentogon, Symbols::repentogonVersion, repentogonVersion, _repentogonVersion)) {
+	if (!ValidateVersionSymbol(*repentogon, Libraries::repentogon, Symbols::repentogonVersion, repentogonVersion, _repentogonVersion)) {
 		_gui->LogError("[DANGER] No valid Repentogon installation found: the Repentogon DLL is malformed\n");
 		return false;
 	}
@@ -211,36 +213,42 @@ bool RepentogonInstallation::Validate(std::string const& installationFolder) {
 	return true;
 }
 
-ScopedModule RepentogonInstallation::LoadModule(const char* shortName, const char* path, LoadableDlls dll) {
-	HMODULE lib = LoadLib(path, dll);
-	ScopedModule module(lib);
-	if (!module) {
-		Logger::Error("Installation::LoadModule: Failed to load %s (%d)\n", shortName, GetLastError());
-	} else {
-		Logger::Info("Installation::LoadModule: Loaded %s\n", shortName);
+std::unique_ptr<PE32> RepentogonInstallation::OpenLibrary(const char* shortName, const char* path, LoadableDlls dll) {
+	/* The DLLs are only parsed, never loaded: loading them, even with
+	 * DONT_RESOLVE_DLL_REFERENCES, maps them as images and runs the checks
+	 * of the loader for nothing, as the versions are plain data.
+	 */
+	std::unique_ptr<PE32> library;
+	try {
+		library = std::make_unique<PE32>(path);
+	} catch (std::runtime_error& e) {
+		Logger::Error("Installation::OpenLibrary: Failed to open %s (%s)\n", shortName, e.what());
+		_dllStates[dll] = LOAD_DLL_STATE_FAIL;
+		return nullptr;
 	}
 
-	return module;
+	Logger::Info("Installation::OpenLibrary: Opened %s\n", shortName);
+	_dllStates[dll] = LOAD_DLL_STATE_OK;
+	return library;
 }
 
-FARPROC RepentogonInstallation::RetrieveSymbol(HMODULE module, const char* libname, const char* symbol) {
-	FARPROC result = GetProcAddress(module, symbol);
+PE32Byte RepentogonInstallation::RetrieveSymbol(PE32 const& library, const char* libname, const char* symbol) {
+	PE32Byte result = library.GetExport(symbol);
 	if (!result) {
 		Logger::Warn("Installation::RetrieveSymbol: %s does not export %s\n", libname, symbol);
 	} else {
-		Logger::Info("Installation::RetrieveSymbol: found %s at %p\n", symbol, result);
+		Logger::Info("Installation::RetrieveSymbol: found %s\n", symbol);
 	}
 
 	return result;
 }
 
-bool RepentogonInstallation::ValidateVersionSymbol(HMODULE module, const char* libname, const char* symbolName,
-	FARPROC symbol, std::string& target) {
+bool RepentogonInstallation::ValidateVersionSymbol(PE32 const& library, const char* libname, const char* symbolName,
+	PE32Byte symbol, std::string& target) {
 
 	if (symbol) {
-		Module::ValidateStringSymbolResult validateResult;
 		std::string localTarget;
-		if (!Module::ValidateStringSymbol(module, symbol, localTarget, &validateResult)) {
+		if (!library.ReadStringPointer(symbol, localTarget)) {
 			char buffer[4096];
 			Logger::Error("Installation::ValidateVersionSymbol: malformed %s, %s extends past the module's boundaries\n", libname, symbolName);
 			snprintf(buffer, 4096, "Your build of %s is malformed\n"
@@ -262,23 +270,6 @@ bool RepentogonInstallation::ValidateVersionSymbol(HMODULE module, const char* l
 	return true;
 }
 
-HMODULE RepentogonInstallation::LoadLib(const char* name, LoadableDlls dll) {
-	/* Ideally, we should load using LOAD_LIBRARY_AS_IMAGE_RESOURCE, however
-	 * this causes GetProcAddress to not work. DONT_RESOLVE_DLL_REFERENCED,
-	 * though deprecated, it the safest I can come up with, barring a full
-	 * load of the DLL (that will fail because Lua5.4.dll is not in the
-	 * PATH), or scanning the DLL myself (come on GetProcAddress, just work).
-	 */
-	HMODULE lib = LoadLibraryExA(name, NULL, DONT_RESOLVE_DLL_REFERENCES);
-	if (!lib) {
-		_dllStates[dll] = LOAD_DLL_STATE_FAIL;
-		return NULL;
-	}
-
-	_dllStates[dll] = LOAD_DLL_STATE_OK;
-	return lib;
-}
-
 bool RepentogonInstallation::IsIsaacVersionCompatible(const char* version) {
 	return !strcmp(version, "v1.9.7.12.J273");
 }
@@ -1,8 +1,12 @@
 #include <cstdarg>
+#include <filesystem>
 #include <future>
 #include <regex>
+#include <set>
+#include <thread>
 
 #include "launcher/cli.h"
+#include "launcher/diff_patcher.h"
 #include "launcher/repentogon_installer.h"
 #include "launcher/standalone_rgon_folder.h"
 #include "launcher/steam_workshop.h"
@@ -11,6 +15,7 @@
 #include "shared/filesystem.h"
 #include "shared/logger.h"
 #include "shared/sha256.h"
+#include "shared/staging.h"
 #include "shared/zip.h"
 #include "shared/gitlab_versionchecker.h"
 #include "shared/version_utils.h"
@@ -29,6 +34,10 @@ namespace Launcher {
 	static const std::string DownloadedRepentogonZipPath = DownloadedFileBasePath + RepentogonZipName;
 	static const std::string DownloadedHashPath = DownloadedFileBasePath + HashName;
 	static const std::string DownloadedReqLauncherVersionPath = DownloadedFileBasePath + ReqLauncherVersionName;
+	/* Number of times an interrupted download of the archive is resumed
+	 * before falling back to Steam.
+	 */
+	static constexpr int ZipResumeAttempts = 2;
 
 	RepentogonInstallationState::RepentogonInstallationState() {
 
@@ -79,6 +88,8 @@ namespace Launcher {
 		std::string s = path.string();
 		outputDir = s.c_str();
 
+		fs::path stagingDir = Staging::GetStagingFolder(path);
+
 		_installationState.Clear();
 		_installationState.phase = REPENTOGON_INSTALLATION_PHASE_CHECK_ASSETS;
 		if (!outputDir) {
@@ -96,7 +107,7 @@ namespace Launcher {
 		}
 
 		_installationState.phase = REPENTOGON_INSTALLATION_PHASE_DOWNLOAD;
-		if (!DownloadRepentogon()) {
+		if (!DownloadRepentogon(stagingDir)) {
 			Logger::Error("RepentogonInstaller::InstallRepentogonThread: download failed\n");
 			_installationState.result = REPENTOGON_INSTALLATION_RESULT_DOWNLOAD_ERROR;
 			return false;
@@ -118,6 +129,7 @@ namespace Launcher {
 				NULL
 			);
 			_installationState.result = REPENTOGON_INSTALLATION_RESULT_LAUNCHER_UPDATE_REQUIRED;
+			DiscardStreamedRepentogon();
 			return false;
 		}
 
@@ -126,6 +138,7 @@ namespace Launcher {
 		if (!CreateRepentogonFolder(outputDir)) {
 			_installationState.result = REPENTOGON_INSTALLATION_RESULT_NO_REPENTOGON;
 			Logger::Error("RepentogonInstaller::InstallRepentogonThread: unable to create Repentogon folder\n");
+			DiscardStreamedRepentogon();
 			return false;
 		}
 
@@ -144,9 +157,14 @@ namespace Launcher {
 			if (isaacData.IsCompatibleWithRepentogon()) {
 				PushNotification(false, "Copying Isaac files, please wait...");
 
+				/* Files patched, created or deleted by an interrupted
+				 * installation are left as they are, PatchFolder will pick up
+				 * where it stopped.
+				 */
+				std::set<std::filesystem::path> patched = diff_patcher::GetFinishedEntries(outputDir);
 				if (!standalone_rgon::CopyFiles(_installation->GetIsaacInstallation()
 					.GetMainInstallation().GetFolderPath(),
-					outputDir)) {
+					outputDir, patched.empty() ? nullptr : &patched)) {
 					Logger::Error("RepentogonInstaller::InstallRepentogonThread: unable to copy Isaac files\n");
 					_installationState.result = REPENTOGON_INSTALLATION_RESULT_NO_ISAAC_COPY;
 					return false;
@@ -172,6 +190,22 @@ namespace Launcher {
 
 					}
 				}
+
+				/* Everything the installation needs is in place: if it still
+				 * does not validate, the new Repentogon files are at fault.
+				 */
+				if (!_installation->CheckRepentogonInstallation()) {
+					Logger::Error("RepentogonInstaller::InstallRepentogonThread: installation is invalid, "
+						"restoring the previous Repentogon files\n");
+					if (!Staging::Rollback(path)) {
+						Logger::Error("RepentogonInstaller::InstallRepentogonThread: unable to restore the "
+							"previous Repentogon files\n");
+					}
+
+					_installation->CheckRepentogonInstallation();
+					_installationState.result = REPENTOGON_INSTALLATION_RESULT_INVALID;
+					return false;
+				}
 			}
 			else {
 				Logger::Warn("RepentogonInstaller::InstallRepentogonThread: Skipped copy/patch routine since the vanilla installation is not compatible\n");
@@ -434,24 +468,79 @@ namespace Launcher {
 		return hasHash && hasZip;
 	}
 
-	bool RepentogonInstaller::DownloadRepentogon() {
+	bool RepentogonInstaller::DownloadRepentogon(fs::path const& stagingDir) {
 		// curl::DownloadMonitor monitor;
 		curl::RequestParameters request;
 		request.maxSpeed = sCLI->CurlLimit();
 		request.timeout = sCLI->CurlTimeout();
 		request.serverTimeout = sCLI->CurlConnectTimeout();
 		request.url = _installationState.hashUrl;
+		request.retry.attempts = Github::REQUEST_ATTEMPTS;
 
 		Github::GenerateGithubHeaders(request);
 
+		/* Start every download at once, so that the small files are fetched
+		 * while the archive downloads. The archive has a lower priority so
+		 * that it does not delay them.
+		 */
 		Logger::Info("RepentogonInstaller::DownloadRepentogon: Downloading hash from `%s`...\n", request.url.c_str());
 		std::shared_ptr<curl::AsynchronousDownloadFileDescriptor> hashDownloadDescriptor =
 			curl::AsyncDownloadFile(request, DownloadedHashPath);
+
+		std::shared_ptr<curl::AsynchronousDownloadFileDescriptor> ReqLauncherverDownloadDescriptor;
+		if (_installationState.launcherversionlock) {
+			request.url = _installationState.launcherversionreqUrl;
+
+			Github::GenerateGithubHeaders(request);
+
+			Logger::Info("RepentogonInstaller::DownloadRepentogon: Downloading required launcher version from `%s`...\n", request.url.c_str());
+			ReqLauncherverDownloadDescriptor = curl::AsyncDownloadFile(request, DownloadedReqLauncherVersionPath);
+		}
+
+		request.url = _installationState.zipUrl;
+		request.priority = curl::REQUEST_PRIORITY_LOW;
+		request.resume = true;
+
+		/* Hash and unpack the archive while it is received, so that once the
+		 * download is over, only the comparison with hash.txt and moving the
+		 * staged files remain. The archive is still written to the disk, in
+		 * case it cannot be streamed. Streaming needs the archive in order,
+		 * so the first attempt is a single stream (see
+		 * RequestParameters::segments).
+		 */
+		std::shared_ptr<Sha256::Context> zipHasher = std::make_shared<Sha256::Context>();
+		zipHasher->Init();
+		_streamedZipHash.clear();
+		_streamExtractor = std::make_shared<ZipStreamExtractor>(stagingDir);
+		request.onData = [zipHasher, extractor = _streamExtractor](bool, void* data, size_t size, size_t n) {
+			zipHasher->Update(data, size * n);
+			extractor->Feed(data, size * n);
+			return true;
+		};
+
+		Logger::Info("RepentogonInstaller::DownloadRepentogon: Downloading REPENTOGON zip from `%s`...\n", request.url.c_str());
+		std::shared_ptr<curl::AsynchronousDownloadFileDescriptor> zipDownloadDesc =
+			curl::AsyncDownloadFile(request, DownloadedRepentogonZipPath);
+
+		/* Stop the downloads that are still running when giving up early. */
+		auto cancelDownloads = [&]() {
+			hashDownloadDescriptor->base.cancel.store(true, std::memory_order_release);
+			if (ReqLauncherverDownloadDescriptor) {
+				ReqLauncherverDownloadDescriptor->base.cancel.store(true, std::memory_order_release);
+			}
+
+			zipDownloadDesc->base.cancel.store(true, std::memory_order_release);
+			/* The transfer may still be feeding the extractor, the staging
+			 * folder is cleaned up by Staging::Recover on the next start.
+			 */
+			_streamExtractor.reset();
+		};
+
 		std::optional<curl::DownloadFileDescriptor> hashResult = GithubToRepInstall<curl::DownloadFileDescriptor>(
 			&hashDownloadDescriptor->base.monitor, hashDownloadDescriptor->result);
 
 		if (!hashResult) {
-			hashDownloadDescriptor->base.cancel.store(true, std::memory_order_release);
+			cancelDownloads();
 			Logger::Info("RepentogonUpdater::DownloadRepentogon: cancel requested\n");
 			return false;
 		}
@@ -465,6 +554,7 @@ namespace Launcher {
 			}
 			else {
 				Logger::Error("RepentogonUpdater::DownloadRepentogon: error while downloading hash from steam\n");
+				cancelDownloads();
 				return false;
 			}
 		}
@@ -474,22 +564,16 @@ namespace Launcher {
 
 		if (!_installationState.hashFile) {
 			Logger::Error("RepentogonUpdater::DownloadRepentogon: Unable to open %s for reading\n", HashName);
+			cancelDownloads();
 			return false;
 		}
 
-		if (_installationState.launcherversionlock) {
-			request.url = _installationState.launcherversionreqUrl;
-
-			Github::GenerateGithubHeaders(request);
-
-			Logger::Info("RepentogonInstaller::DownloadRepentogon: Downloading required launcher version from `%s`...\n", request.url.c_str());
-			std::shared_ptr<curl::AsynchronousDownloadFileDescriptor> ReqLauncherverDownloadDescriptor =
-				curl::AsyncDownloadFile(request, DownloadedReqLauncherVersionPath);
+		if (ReqLauncherverDownloadDescriptor) {
 			std::optional<curl::DownloadFileDescriptor> reqlauncherResult = GithubToRepInstall<curl::DownloadFileDescriptor>(
 				&ReqLauncherverDownloadDescriptor->base.monitor, ReqLauncherverDownloadDescriptor->result);
 
 			if (!reqlauncherResult) {
-				ReqLauncherverDownloadDescriptor->base.cancel.store(true, std::memory_order_release);
+				cancelDownloads();
 				Logger::Info("RepentogonUpdater::DownloadRepentogon: cancel requested\n");
 				return false;
 			}
@@ -505,6 +589,7 @@ namespace Launcher {
 				}
 				else {
 					Logger::Error("RepentogonUpdater::DownloadRepentogon: error while downloading launcher version.txt from steam\n");
+					cancelDownloads();
 					return false;
 				}
 			}
@@ -514,23 +599,54 @@ namespace Launcher {
 			
 			if (!_installationState.ReqVersionFile) {
 				Logger::Error("RepentogonUpdater::DownloadRepentogon: Unable to open %s for reading\n", ReqLauncherVersionName);
+				cancelDownloads();
 				return false;
 			}
 		}
-		request.url = _installationState.zipUrl;
 
-		Logger::Info("RepentogonInstaller::DownloadRepentogon: Downloading REPENTOGON zip from `%s`...\n", request.url.c_str());
-		std::shared_ptr<curl::AsynchronousDownloadFileDescriptor> zipDownloadDesc =
-			curl::AsyncDownloadFile(request, DownloadedRepentogonZipPath);
 		std::optional<curl::DownloadFileDescriptor> zipResult = GithubToRepInstall<curl::DownloadFileDescriptor>(
 			&zipDownloadDesc->base.monitor, zipDownloadDesc->result);
 
+		/* The streamed hash and extraction only cover the part of the archive
+		 * received by the first attempt.
+		 */
+		bool resumed = false;
+		for (int attempt = 1; zipResult && zipResult->result == curl::DOWNLOAD_FILE_DOWNLOAD_ERROR &&
+			attempt <= ZipResumeAttempts; ++attempt) {
+			Logger::Warn("RepentogonUpdater::DownloadRepentogon: download of zip interrupted, "
+				"resuming it (attempt %d/%d)\n", attempt, ZipResumeAttempts);
+			/* The rest is hashed and extracted afterwards, it can be split. */
+			request.onData = nullptr;
+			request.segments = GithubExecutor::DEFAULT_MAX_TRANSFERS - 1;
+			zipDownloadDesc = curl::AsyncDownloadFile(request, DownloadedRepentogonZipPath);
+			zipResult = GithubToRepInstall<curl::DownloadFileDescriptor>(
+				&zipDownloadDesc->base.monitor, zipDownloadDesc->result);
+			resumed = true;
+		}
+
 		if (!zipResult) {
-			zipDownloadDesc->base.cancel.store(true, std::memory_order_release);
+			cancelDownloads();
 			Logger::Info("RepentogonUpdater::DownloadRepentogon: cancel requested\n");
 			return false;
 		}
 
+		if (zipResult->result == curl::DOWNLOAD_FILE_OK && (resumed || zipResult->resumedFrom)) {
+			Logger::Info("RepentogonUpdater::DownloadRepentogon: %s was resumed, it will be hashed "
+				"and extracted afterwards\n", RepentogonZipName);
+			DiscardStreamedRepentogon();
+			_streamedZipHash.clear();
+		} else if (zipResult->result == curl::DOWNLOAD_FILE_OK) {
+			zipHasher->Final(_streamedZipHash);
+			if (!_streamExtractor->Finish()) {
+				Logger::Warn("RepentogonUpdater::DownloadRepentogon: unable to extract %s "
+					"while downloading it, it will be extracted afterwards\n", RepentogonZipName);
+				DiscardStreamedRepentogon();
+			}
+		} else {
+			DiscardStreamedRepentogon();
+			_streamedZipHash.clear();
+		}
+
 		if (zipResult->result != curl::DOWNLOAD_FILE_OK) {
 			std::string filePath;
 			std::string relpath = RepentogonZipName;
@@ -590,12 +706,14 @@ namespace Launcher {
 			return false;
 		}
 
-		std::string zipHash;
-		HashResult hashResult = Sha256::Sha256F(DownloadedRepentogonZipPath.c_str(), zipHash);
+		std::string zipHash = _streamedZipHash;
+		if (zipHash.empty()) {
+			HashResult hashResult = Sha256::Sha256F(DownloadedRepentogonZipPath.c_str(), zipHash);
 
-		if (hashResult != HASH_OK) {
-			Logger::Fatal("RepentogonUpdater::CheckRepentogonIntegrity: unable "
-				"to compute hash of %s: %s\n", RepentogonZipName, HashResultToString(hashResult));
+			if (hashResult != HASH_OK) {
+				Logger::Fatal("RepentogonUpdater::CheckRepentogonIntegrity: unable "
+					"to compute hash of %s: %s\n", RepentogonZipName, HashResultToString(hashResult));
+			}
 		}
 
 		_installationState.hash = hash;
@@ -603,6 +721,7 @@ namespace Launcher {
 
 		if (!Sha256::Equals(hash, zipHash.c_str())) {
 			Logger::Error("RepentogonUpdater::CheckRepentogonIntegrity: hash mismatch: expected \"%s\", got \"%s\"\n", zipHash.c_str(), hash);
+			DiscardStreamedRepentogon();
 			return false;
 		}
 
@@ -637,102 +756,115 @@ namespace Launcher {
 			return false;
 		}
 
-		std::vector<std::tuple<std::string, bool>>& filesState = _installationState.unzipedFiles;
-		int zipError;
-		zip_t* zip = zip_open(DownloadedRepentogonZipPath.c_str(), ZIP_RDONLY | ZIP_CHECKCONS, &zipError);
-		if (!zip) {
-			Logger::Error("RepentogonUpdater::ExtractRepentogon: error %d while opening %s\n", zipError, RepentogonZipName);
-			return false;
+		if (_streamExtractor) {
+			return CommitStreamedRepentogon(outputDir);
 		}
 
-		bool ok = true;
-		int nFiles = zip_get_num_entries(zip, 0);
-		std::string outputDirBase(outputDir);
-		outputDirBase += "/";
-		for (int i = 0; i < nFiles; ++i) {
-			zip_file_t* file = zip_fopen_index(zip, i, 0);
-			if (!file) {
-				Logger::Error("RepentogonUpdater::ExtractRepentogon: error opening file %d in archive\n", i);
-				ok = false;
-				zip_fclose(file);
-				filesState.push_back(std::make_tuple("", false));
-				continue;
-			}
+		std::vector<std::tuple<std::string, RepentogonExtractedFileState>>& filesState = _installationState.unzipedFiles;
+		std::vector<Zip::ExtractedEntry> entries;
+		Zip::ExtractMonitor monitor;
+		/* A failed update must not leave a mix of old and new files behind. */
+		std::future<bool> extraction = std::async(std::launch::async, [&]() {
+			return Zip::ExtractAllToFolder(DownloadedRepentogonZipPath.c_str(), outputDir, &entries, &monitor,
+				0, Zip::EXTRACT_STAGED);
+		});
 
-			const char* name = zip_get_name(zip, i, 0);
-			if (!name) {
-				zip_error_t* error = zip_get_error(zip);
-				Logger::Error("RepentogonUpdater::ExtractRepentogon: error getting name of file %d in archive (%s)\n",
-					i, zip_error_strerror(error));
-				ok = false;
-				zip_fclose(file);
-				filesState.push_back(std::make_tuple("", false));
+		/* Relay the progress of the extraction threads until they are done.
+		 * Nothing is pushed if the archive cannot be opened.
+		 */
+		while (extraction.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+			std::optional<Zip::ExtractNotification> notification = monitor.Get(nullptr);
+			if (!notification) {
+				std::this_thread::sleep_for(std::chrono::milliseconds(10));
 				continue;
 			}
 
-			std::string fullName = (outputDirBase + name);
-			if (!Filesystem::CreateFileHierarchy(fullName.c_str(), "/")) {
-				Logger::Error("RepentogonUpdater::ExtractRepentogon: cannot create intermediate folders for file %s\n", name);
-				ok = false;
-				zip_fclose(file);
-				filesState.push_back(std::make_tuple(name, false));
-				continue;
+			if (notification->type == Zip::EXTRACT_DONE) {
+				break;
 			}
 
-			std::string outputPath(outputDirBase);
-			outputPath += "/";
-			outputPath += name;
-			FILE* output = fopen(outputPath.c_str(), "wb");
-			if (!output) {
-				DWORD attributes = GetFileAttributesA(outputPath.c_str());
-				bool fileOk = false;
-				if (attributes != INVALID_FILE_ATTRIBUTES && attributes & FILE_ATTRIBUTE_DIRECTORY) {
-					fileOk = true;
-				} else {
-					Logger::Error("RepentogonUpdater::ExtractRepentogon: cannot create file %s\n", name);
-					ok = false;
-				}
+			PushNotification(false, "Extracting REPENTOGON (%zu/%zu files)",
+				notification->entriesDone, notification->entriesTotal);
+		}
 
-				zip_fclose(file);
-				filesState.push_back(std::make_tuple(name, fileOk));
-				continue;
+		bool ok = extraction.get();
+		if (entries.empty() && !ok) {
+			Logger::Error("RepentogonUpdater::ExtractRepentogon: error while opening %s\n", RepentogonZipName);
+			return false;
+		}
+
+		size_t changed = 0, unchanged = 0;
+		for (Zip::ExtractedEntry const& entry : entries) {
+			RepentogonExtractedFileState state;
+			if (entry.result != Zip::EXTRACT_FILE_OK) {
+				Logger::Error("RepentogonUpdater::ExtractRepentogon: error while extracting %s (%d)\n",
+					entry.name.c_str(), entry.result);
+				state = REPENTOGON_EXTRACTED_FILE_FAILED;
+			} else if (entry.unchanged) {
+				state = REPENTOGON_EXTRACTED_FILE_UNCHANGED;
+				++unchanged;
+			} else {
+				state = REPENTOGON_EXTRACTED_FILE_CHANGED;
+				++changed;
 			}
 
-			char buffer[4096];
-			int count = zip_fread(file, buffer, 4096);
-			bool fileOk = true;
-			while (count != 0) {
-				if (count == -1) {
-					Logger::Error("RepentogonUpdater::ExtractRepentogon: error while reading %s\n", name);
-					ok = false;
-					fileOk = false;
-					break;
-				}
+			filesState.push_back(std::make_tuple(entry.name, state));
+		}
 
-				if (fwrite(buffer, count, 1, output) != 1) {
-					Logger::Error("RepentogonUpdater::ExtractRepentogon: error while writing %s\n", name);
-					ok = false;
-					fileOk = false;
-					break;
-				}
+		Logger::Info("RepentogonUpdater::ExtractRepentogon: %zu files written, %zu files unchanged\n",
+			changed, unchanged);
+		return ok;
+	}
+
+	bool RepentogonInstaller::CommitStreamedRepentogon(const char* outputDir) {
+		PushNotification(false, "Installing REPENTOGON...");
+
+		/* Updates usually only change a few files: take the others out of
+		 * the staging folder so that they are not swapped at all.
+		 */
+		std::vector<ZipStreamExtractor::Entry> const& entries = _streamExtractor->GetEntries();
+		std::vector<bool> unchanged = _streamExtractor->RemoveUnchanged(outputDir);
 
-				count = zip_fread(file, buffer, 4096);
+		/* The stream extractor stages the archive where Staging expects it. */
+		bool ok = Staging::Commit(outputDir);
+		size_t changed = 0, kept = 0;
+		for (size_t i = 0; i < entries.size(); ++i) {
+			if (entries[i].directory) {
+				continue;
 			}
 
-			if (fileOk) {
-				Logger::Info("RepentogonUpdater::ExtractRepentogon: successfully extracted %s to %s\n", name, outputPath.c_str());
-				PushNotification(false, "Extracting %s", name);
+			RepentogonExtractedFileState state;
+			if (unchanged[i]) {
+				state = REPENTOGON_EXTRACTED_FILE_UNCHANGED;
+				++kept;
+			} else if (ok) {
+				state = REPENTOGON_EXTRACTED_FILE_CHANGED;
+				++changed;
+			} else {
+				state = REPENTOGON_EXTRACTED_FILE_FAILED;
 			}
 
-			filesState.push_back(std::make_tuple(name, fileOk));
-			fclose(output);
-			zip_fclose(file);
+			_installationState.unzipedFiles.push_back(std::make_tuple(entries[i].name, state));
 		}
 
-		zip_close(zip);
+		Logger::Info("RepentogonUpdater::CommitStreamedRepentogon: %zu files written, %zu files unchanged\n",
+			changed, kept);
+		if (!ok) {
+			Logger::Error("RepentogonUpdater::CommitStreamedRepentogon: unable to install the content of %s\n",
+				RepentogonZipName);
+		}
+
+		DiscardStreamedRepentogon();
 		return ok;
 	}
 
+	void RepentogonInstaller::DiscardStreamedRepentogon() {
+		if (_streamExtractor) {
+			_streamExtractor->Discard();
+			_streamExtractor.reset();
+		}
+	}
+
 	Github::VersionCheckResult RepentogonInstaller::CheckRepentogonUpdatesThread_Updater(rapidjson::Document& doc,
 		bool allowPreReleases) {
 		RepentogonInstallation const& repentogon = _installation->GetRepentogonInstallation();
@@ -780,6 +912,8 @@ namespace Launcher {
 		request.maxSpeed = sCLI->CurlLimit();
 		request.timeout = sCLI->CurlTimeout();
 		request.serverTimeout = sCLI->CurlConnectTimeout();
+		request.cache = true;
+		request.retry.attempts = Github::REQUEST_ATTEMPTS;
 
 		Github::GenerateGithubHeaders(request);
 
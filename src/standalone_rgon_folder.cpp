@@ -1305,8 +1305,30 @@ namespace standalone_rgon {
         return diff_patcher::PatchFolder(repentogonFolder, patchPath, nullptr) == diff_patcher::PATCH_OK;
     }
 
+    /* Whether destPath already is an unmodified copy of sourcePath. */
+    static bool IsSameFile(const fs::path& sourcePath, const fs::path& destPath) {
+        std::error_code err;
+        uintmax_t sourceSize = fs::file_size(sourcePath, err);
+        if (err) {
+            return false;
+        }
+
+        uintmax_t destSize = fs::file_size(destPath, err);
+        if (err || destSize != sourceSize) {
+            return false;
+        }
+
+        fs::file_time_type sourceTime = fs::last_write_time(sourcePath, err);
+        if (err) {
+            return false;
+        }
+
+        fs::file_time_type destTime = fs::last_write_time(destPath, err);
+        return !err && sourceTime == destTime;
+    }
+
     bool CopyFiles(const std::string& srcFolder,
-        const std::string& dstFolder) {
+        const std::string& dstFolder, const std::set<fs::path>* keep) {
         fs::path src(srcFolder);
         fs::path dst(dstFolder);
 
@@ -1343,6 +1365,18 @@ namespace standalone_rgon {
                         continue;
                     }
 
+                    if (keep) {
+                        if (keep->find(fs::path(relative)) != keep->end()) {
+                            Logger::Info("standalone_rgon::CopyFiles: not copying %s, already "
+                                "processed by the interrupted patch\n", destPath.string().c_str());
+                            continue;
+                        }
+
+                        if (IsSameFile(sourcePath, destPath)) {
+                            continue;
+                        }
+                    }
+
                     fs::create_directories(destPath.parent_path());
                     fs::copy_file(sourcePath, destPath, fs::copy_options::overwrite_existing);
                     Logger::Info("standalone_rgon::CopyFiles: copied %s\n", destPath.string().c_str());
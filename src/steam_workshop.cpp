@@ -10,6 +10,7 @@
 #include "launcher/steam_workshop.h"
 #include "shared/filesystem.h"
 #include "shared/logger.h"
+#include "shared/curl/handle_pool.h"
 #include <curl/curl.h>
 
 namespace SteamWorkshop {
@@ -114,7 +115,7 @@ bool CanReachSteamWorkshop()
 		return false;
 	}
 
-	CURL* curl = curl_easy_init();
+	CURL* curl = curl::AcquireHandle();
 	if (!curl)
 		return false;
 
@@ -130,7 +131,7 @@ bool CanReachSteamWorkshop()
 	if (res == CURLE_OK)
 		curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &response_code);
 
-	curl_easy_cleanup(curl);
+	curl::ReleaseHandle(curl);
 	return (res == CURLE_OK && response_code >= 200 && response_code < 400);
 }
 
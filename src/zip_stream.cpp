@@ -0,0 +1,489 @@
+#include <cstring>
+
+#include <algorithm>
+
+#include "launcher/zip_stream.h"
+#include "shared/crc32.h"
+#include "shared/logger.h"
+#include "shared/zip.h"
+
+namespace fs = std::filesystem;
+
+namespace Launcher {
+	static constexpr uint32_t LOCAL_HEADER_SIGNATURE = 0x04034b50;
+	static constexpr uint32_t CENTRAL_HEADER_SIGNATURE = 0x02014b50;
+	static constexpr uint32_t END_OF_CENTRAL_SIGNATURE = 0x06054b50;
+	static constexpr uint32_t DESCRIPTOR_SIGNATURE = 0x08074b50;
+
+	static constexpr size_t LOCAL_HEADER_SIZE = 30;
+
+	static constexpr uint16_t FLAG_ENCRYPTED = 1 << 0;
+	static constexpr uint16_t FLAG_DESCRIPTOR = 1 << 3;
+
+	static constexpr uint16_t METHOD_STORED = 0;
+	static constexpr uint16_t METHOD_DEFLATED = 8;
+
+	static constexpr uint16_t ZIP64_EXTRA_ID = 0x0001;
+
+	static constexpr size_t INFLATE_BUFFER_SIZE = 1 << 20;
+
+	/* Data received but not processed yet. Past this, the disk cannot keep
+	 * up with the download and the queue would only keep growing.
+	 */
+	static constexpr size_t MAX_QUEUED_BYTES = 64 << 20;
+
+	/* Total size of the extracted files. Releases are a small fraction of
+	 * this, anything larger is not an archive worth streaming.
+	 */
+	static constexpr uint64_t MAX_STAGED_BYTES = 2ULL << 30;
+
+	static uint16_t Read16(const unsigned char* p) {
+		return (uint16_t)(p[0] | (p[1] << 8));
+	}
+
+	static uint32_t Read32(const unsigned char* p) {
+		return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+	}
+
+	static uint64_t Read64(const unsigned char* p) {
+		return (uint64_t)Read32(p) | ((uint64_t)Read32(p + 4) << 32);
+	}
+
+	/* Reject names that would escape the staging folder. */
+	static bool IsSafeName(std::string const& name) {
+		fs::path path(name);
+		if (name.empty() || path.is_absolute() || path.has_root_name() || path.has_root_directory()) {
+			return false;
+		}
+
+		for (fs::path const& component : path) {
+			if (component == "..") {
+				return false;
+			}
+		}
+
+		return true;
+	}
+
+	ZipStreamExtractor::ZipStreamExtractor(fs::path folder) : _folder(std::move(folder)) {
+		memset(&_zstream, 0, sizeof(_zstream));
+
+		std::error_code ec;
+		fs::remove_all(_folder, ec);
+		fs::create_directories(_folder, ec);
+		if (ec) {
+			Logger::Error("ZipStreamExtractor: unable to create staging folder %s: %s\n",
+				_folder.string().c_str(), ec.message().c_str());
+			_state = STATE_ERROR;
+			_ignoring = true;
+		}
+
+		_thread = std::thread(&ZipStreamExtractor::Run, this);
+	}
+
+	ZipStreamExtractor::~ZipStreamExtractor() {
+		{
+			std::unique_lock<std::mutex> lck(_mutex);
+			_finished = true;
+		}
+
+		_cv.notify_one();
+		if (_thread.joinable()) {
+			_thread.join();
+		}
+
+		if (_inflating) {
+			inflateEnd(&_zstream);
+		}
+	}
+
+	void ZipStreamExtractor::Feed(const void* data, size_t size) {
+		if (!size || _ignoring) {
+			return;
+		}
+
+		const unsigned char* bytes = (const unsigned char*)data;
+		{
+			std::unique_lock<std::mutex> lck(_mutex);
+			if (_queued + size > MAX_QUEUED_BYTES) {
+				_queue.clear();
+				_queued = 0;
+				_overflow = true;
+				_ignoring = true;
+			} else {
+				_queue.emplace_back(bytes, bytes + size);
+				_queued += size;
+			}
+		}
+
+		_cv.notify_one();
+	}
+
+	bool ZipStreamExtractor::Finish() {
+		{
+			std::unique_lock<std::mutex> lck(_mutex);
+			_finished = true;
+		}
+
+		_cv.notify_one();
+		if (_thread.joinable()) {
+			_thread.join();
+		}
+
+		if (_state != STATE_DONE && _state != STATE_ERROR) {
+			Fail("archive ended before its central directory");
+		}
+
+		return _state == STATE_DONE;
+	}
+
+	std::vector<bool> ZipStreamExtractor::RemoveUnchanged(fs::path const& liveFolder) {
+		std::vector<bool> unchanged(_entries.size(), false);
+		for (size_t i = 0; i < _entries.size(); ++i) {
+			Entry const& entry = _entries[i];
+			if (!entry.directory && Zip::FileMatches(liveFolder / entry.name, entry.size, entry.crc)) {
+				std::error_code ec;
+				unchanged[i] = fs::remove(_folder / entry.name, ec);
+			}
+		}
+
+		return unchanged;
+	}
+
+	void ZipStreamExtractor::Discard() {
+		_output.close();
+		std::error_code ec;
+		fs::remove_all(_folder, ec);
+	}
+
+	void ZipStreamExtractor::Run() {
+		for (;;) {
+			std::deque<std::vector<unsigned char>> chunks;
+			bool overflow = false;
+			{
+				std::unique_lock<std::mutex> lck(_mutex);
+				_cv.wait(lck, [this]() { return _finished || _overflow || !_queue.empty(); });
+				std::swap(overflow, _overflow);
+				if (_queue.empty() && !overflow) {
+					return;
+				}
+
+				chunks.swap(_queue);
+				_queued = 0;
+			}
+
+			if (overflow && _state != STATE_DONE && _state != STATE_ERROR) {
+				Fail("too much data waiting to be extracted");
+			}
+
+			if (_state == STATE_DONE || _state == STATE_ERROR) {
+				continue;
+			}
+
+			/* Drop what has been parsed before appending. */
+			_pending.erase(_pending.begin(), _pending.begin() + _offset);
+			_offset = 0;
+			for (std::vector<unsigned char> const& chunk : chunks) {
+				_pending.insert(_pending.end(), chunk.begin(), chunk.end());
+			}
+
+			Process();
+		}
+	}
+
+	void ZipStreamExtractor::Process() {
+		bool progress = true;
+		while (progress) {
+			switch (_state) {
+			case STATE_HEADER:
+				progress = ParseHeader();
+				break;
+
+			case STATE_DATA:
+				progress = ParseData();
+				break;
+
+			case STATE_DESCRIPTOR:
+				progress = ParseDescriptor();
+				break;
+
+			default:
+				return;
+			}
+		}
+	}
+
+	bool ZipStreamExtractor::ParseHeader() {
+		size_t available = _pending.size() - _offset;
+		if (available < 4) {
+			return false;
+		}
+
+		const unsigned char* p = _pending.data() + _offset;
+		uint32_t signature = Read32(p);
+		if (signature == CENTRAL_HEADER_SIGNATURE || signature == END_OF_CENTRAL_SIGNATURE) {
+			_state = STATE_DONE;
+			_ignoring = true;
+			return false;
+		}
+
+		if (signature != LOCAL_HEADER_SIGNATURE) {
+			Fail("unexpected signature");
+			return false;
+		}
+
+		if (available < LOCAL_HEADER_SIZE) {
+			return false;
+		}
+
+		uint16_t nameLength = Read16(p + 26);
+		uint16_t extraLength = Read16(p + 28);
+		if (available < LOCAL_HEADER_SIZE + nameLength + extraLength) {
+			return false;
+		}
+
+		_flags = Read16(p + 6);
+		_method = Read16(p + 8);
+		_expectedCrc = Read32(p + 14);
+		_compressedSize = Read32(p + 18);
+		_expectedSize = Read32(p + 22);
+		_zip64 = false;
+
+		std::string name((const char*)p + LOCAL_HEADER_SIZE, nameLength);
+		std::replace(name.begin(), name.end(), '\\', '/');
+
+		const unsigned char* extra = p + LOCAL_HEADER_SIZE + nameLength;
+		const unsigned char* extraEnd = extra + extraLength;
+		while (extraEnd - extra >= 4) {
+			uint16_t id = Read16(extra);
+			uint16_t size = Read16(extra + 2);
+			const unsigned char* data = extra + 4;
+			if (extraEnd - data < size) {
+				break;
+			}
+
+			/* Only the sizes that do not fit in the header are present. */
+			if (id == ZIP64_EXTRA_ID) {
+				_zip64 = true;
+				const unsigned char* field = data;
+				if (_expectedSize == 0xFFFFFFFF && data + size - field >= 8) {
+					_expectedSize = Read64(field);
+					field += 8;
+				}
+
+				if (_compressedSize == 0xFFFFFFFF && data + size - field >= 8) {
+					_compressedSize = Read64(field);
+				}
+			}
+
+			extra = data + size;
+		}
+
+		_offset += LOCAL_HEADER_SIZE + nameLength + extraLength;
+
+		if (_flags & FLAG_ENCRYPTED) {
+			Fail("encrypted entry");
+			return false;
+		}
+
+		if (_method != METHOD_STORED && _method != METHOD_DEFLATED) {
+			Fail("unsupported compression method");
+			return false;
+		}
+
+		if (!IsSafeName(name)) {
+			Fail("invalid entry name");
+			return false;
+		}
+
+		/* Folders are empty, their end is known even with a descriptor. */
+		if (_method == METHOD_STORED && (_flags & FLAG_DESCRIPTOR) && name.back() != '/') {
+			Fail("stored entry with a data descriptor");
+			return false;
+		}
+
+		Entry entry;
+		entry.name = name;
+		entry.directory = name.back() == '/';
+		_entries.push_back(std::move(entry));
+		if (!OpenEntry()) {
+			return false;
+		}
+
+		_state = STATE_DATA;
+		return true;
+	}
+
+	bool ZipStreamExtractor::OpenEntry() {
+		Entry const& entry = _entries.back();
+		fs::path path = _folder / entry.name;
+		std::error_code ec;
+		if (entry.directory) {
+			/* Folders have no content, but some tools still give them a
+			 * deflate stream or a descriptor: go through the usual steps
+			 * without writing anything.
+			 */
+			fs::create_directories(path, ec);
+			if (ec) {
+				Fail("unable to create folder");
+				return false;
+			}
+		} else {
+			fs::create_directories(path.parent_path(), ec);
+			_output.open(path, std::ios::binary | std::ios::trunc);
+			if (ec || !_output) {
+				Fail("unable to create file");
+				return false;
+			}
+		}
+
+		_crc = 0;
+		_written = 0;
+		_remaining = _compressedSize;
+
+		if (_method == METHOD_DEFLATED) {
+			if (_inflating) {
+				inflateReset(&_zstream);
+			} else {
+				memset(&_zstream, 0, sizeof(_zstream));
+				/* Raw deflate data, without zlib header. */
+				if (inflateInit2(&_zstream, -MAX_WBITS) != Z_OK) {
+					Fail("inflateInit2 failed");
+					return false;
+				}
+
+				_inflating = true;
+			}
+
+			if (_inflateBuffer.empty()) {
+				_inflateBuffer.resize(INFLATE_BUFFER_SIZE);
+			}
+		}
+
+		return true;
+	}
+
+	bool ZipStreamExtractor::Write(const unsigned char* data, size_t size) {
+		_staged += size;
+		if (_staged > MAX_STAGED_BYTES) {
+			Fail("archive too large");
+			return false;
+		}
+
+		if (!_entries.back().directory) {
+			_output.write((const char*)data, size);
+			if (!_output) {
+				Fail("unable to write file");
+				return false;
+			}
+		}
+
+		_crc = Crc32::Update(_crc, data, size);
+		_written += size;
+		return true;
+	}
+
+	bool ZipStreamExtractor::ParseData() {
+		if (_method == METHOD_STORED && (!_remaining || (_flags & FLAG_DESCRIPTOR))) {
+			return EndData();
+		}
+
+		size_t available = _pending.size() - _offset;
+		if (!available) {
+			return false;
+		}
+
+		const unsigned char* p = _pending.data() + _offset;
+		if (_method == METHOD_STORED) {
+			size_t count = (size_t)std::min<uint64_t>(_remaining, available);
+			if (!Write(p, count)) {
+				return false;
+			}
+
+			_offset += count;
+			_remaining -= count;
+			return !_remaining && EndData();
+		}
+
+		_zstream.next_in = (Bytef*)p;
+		_zstream.avail_in = (uInt)std::min<size_t>(available, UINT32_MAX);
+		int ret = Z_OK;
+		do {
+			_zstream.next_out = _inflateBuffer.data();
+			_zstream.avail_out = (uInt)_inflateBuffer.size();
+			ret = inflate(&_zstream, Z_NO_FLUSH);
+			if (ret != Z_OK && ret != Z_STREAM_END && ret != Z_BUF_ERROR) {
+				Fail("corrupted deflate stream");
+				return false;
+			}
+
+			size_t produced = _inflateBuffer.size() - _zstream.avail_out;
+			if (produced && !Write(_inflateBuffer.data(), produced)) {
+				return false;
+			}
+		} while (ret == Z_OK && (_zstream.avail_in || !_zstream.avail_out));
+
+		_offset += (size_t)(_zstream.next_in - p);
+		return ret == Z_STREAM_END && EndData();
+	}
+
+	bool ZipStreamExtractor::EndData() {
+		if (_flags & FLAG_DESCRIPTOR) {
+			_state = STATE_DESCRIPTOR;
+			return true;
+		}
+
+		return CloseEntry(_expectedCrc, _expectedSize);
+	}
+
+	bool ZipStreamExtractor::ParseDescriptor() {
+		size_t sizeWidth = _zip64 ? 8 : 4;
+		size_t length = 4 + 2 * sizeWidth;
+		size_t available = _pending.size() - _offset;
+		if (available < 4) {
+			return false;
+		}
+
+		const unsigned char* p = _pending.data() + _offset;
+		size_t signatureLength = Read32(p) == DESCRIPTOR_SIGNATURE ? 4 : 0;
+		if (available < signatureLength + length) {
+			return false;
+		}
+
+		p += signatureLength;
+		uint32_t crc = Read32(p);
+		uint64_t size = _zip64 ? Read64(p + 4 + sizeWidth) : Read32(p + 4 + sizeWidth);
+		_offset += signatureLength + length;
+		return CloseEntry(crc, size);
+	}
+
+	bool ZipStreamExtractor::CloseEntry(uint32_t crc, uint64_t size) {
+		if (!_entries.back().directory) {
+			_output.close();
+			if (!_output) {
+				Fail("unable to close file");
+				return false;
+			}
+		}
+
+		if (_crc != crc || _written != size) {
+			Fail("CRC or size mismatch");
+			return false;
+		}
+
+		Entry& entry = _entries.back();
+		entry.crc = crc;
+		entry.size = size;
+		_state = STATE_HEADER;
+		return true;
+	}
+
+	void ZipStreamExtractor::Fail(const char* reason) {
+		std::string name = _entries.empty() ? "" : _entries.back().name;
+		Logger::Warn("ZipStreamExtractor: giving up on streamed extraction (%s, entry \"%s\")\n",
+			reason, name.c_str());
+		_output.close();
+		_state = STATE_ERROR;
+		_ignoring = true;
+	}
+}
@@ -0,0 +1,132 @@
+/* Times the search of a signature in a synthetic 30 MB .text section, with
+ * the memcmp loop PE32::Lookup used to run, ByteSearch and
+ * SignatureScanner.
+ *
+ * The section is made of random bytes with a function prologue
+ * (55 8B EC) every 97 bytes, so that the first byte of the signature
+ * is found often, and the signature itself near the end.
+ *
+ * Usage: byte_search_benchmark [runs]
+ */
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#include "shared/byte_search.h"
+#include "shared/signature_scanner.h"
+
+using namespace std::chrono;
+
+static constexpr size_t SECTION_SIZE = 30 << 20;
+static constexpr size_t PROLOGUE_INTERVAL = 97;
+
+/* ISAAC_MAIN_SIGNATURE, with its wildcards filled in. */
+static const unsigned char Needle[] = {
+	0x55, 0x8B, 0xEC, 0x6A, 0xFE, 0x68, 0x10, 0x20, 0x30, 0x00, 0x68, 0x40, 0x50, 0x60, 0x00,
+	0x64, 0xA1, 0x00, 0x00, 0x00, 0x00, 0x50, 0x81, 0xEC, 0x3C, 0x05, 0x00, 0x00
+};
+
+static const char* NeedleSignature = "55 8B EC 6A FE 68 ?? ?? ?? ?? 68 ?? ?? ?? ?? "
+	"64 A1 00 00 00 00 50 81 EC 3C 05 00 00";
+
+/* A second signature, absent from the section. */
+static const char* OtherSignature = "55 8B EC 83 E4 F8 ?? ?? 6A FF 68";
+
+static std::vector<unsigned char> BuildSection(size_t needleOffset) {
+	std::vector<unsigned char> section(SECTION_SIZE);
+	uint32_t state = 0x12345678;
+	for (unsigned char& byte : section) {
+		state = state * 1664525 + 1013904223;
+		byte = (unsigned char)(state >> 24);
+	}
+
+	for (size_t i = 0; i + 3 <= SECTION_SIZE; i += PROLOGUE_INTERVAL) {
+		memcpy(section.data() + i, Needle, 3);
+	}
+
+	memcpy(section.data() + needleOffset, Needle, sizeof(Needle));
+	return section;
+}
+
+/* PE32::Lookup before ByteSearch. */
+static size_t FindMemcmp(const unsigned char* haystack, size_t size, const unsigned char* needle, size_t needleSize) {
+	for (size_t i = 0; i + needleSize <= size; ++i) {
+		if (!memcmp(haystack + i, needle, needleSize)) {
+			return i;
+		}
+	}
+
+	return ByteSearch::NOT_FOUND;
+}
+
+template<typename Fn>
+static double Time(int runs, Fn&& fn) {
+	double best = 0;
+	for (int i = 0; i < runs; ++i) {
+		steady_clock::time_point start = steady_clock::now();
+		fn();
+		double elapsed = duration<double, std::milli>(steady_clock::now() - start).count();
+		if (i == 0 || elapsed < best) {
+			best = elapsed;
+		}
+	}
+
+	return best;
+}
+
+int main(int argc, char** argv) {
+	int runs = argc > 1 ? atoi(argv[1]) : 5;
+	if (runs <= 0) {
+		runs = 5;
+	}
+
+	size_t expected = SECTION_SIZE - 4096 + 13;
+	std::vector<unsigned char> section = BuildSection(expected);
+
+	SignatureScanner scanner;
+	scanner.Add(NeedleSignature);
+	scanner.Compile();
+
+	/* Two signatures go through the Aho-Corasick automaton. */
+	SignatureScanner multiScanner;
+	multiScanner.Add(NeedleSignature);
+	multiScanner.Add(OtherSignature);
+	multiScanner.Compile();
+
+	size_t memcmpResult = 0, findResult = 0, findAllCount = 0, scanCount = 0, multiScanCount = 0;
+	double memcmpTime = Time(runs, [&]() {
+		memcmpResult = FindMemcmp(section.data(), section.size(), Needle, sizeof(Needle));
+	});
+	double findTime = Time(runs, [&]() {
+		findResult = ByteSearch::Find(section.data(), section.size(), Needle, sizeof(Needle));
+	});
+	double findAllTime = Time(runs, [&]() {
+		findAllCount = ByteSearch::FindAll(section.data(), section.size(), Needle, sizeof(Needle)).size();
+	});
+	double scanTime = Time(runs, [&]() {
+		scanCount = scanner.Scan(section.data(), section.size())[0].size();
+	});
+	double multiScanTime = Time(runs, [&]() {
+		multiScanCount = multiScanner.Scan(section.data(), section.size())[0].size();
+	});
+
+	printf("%zu bytes, prologue every %zu bytes, best of %d run(s), ByteSearch backend: %s\n",
+		section.size(), PROLOGUE_INTERVAL, runs, ByteSearch::GetBackendName());
+	printf("  memcmp loop          %8.2f ms\n", memcmpTime);
+	printf("  ByteSearch::Find     %8.2f ms\n", findTime);
+	printf("  ByteSearch::FindAll  %8.2f ms\n", findAllTime);
+	printf("  SignatureScanner, 1  %8.2f ms\n", scanTime);
+	printf("  SignatureScanner, 2  %8.2f ms\n", multiScanTime);
+
+	if (memcmpResult != expected || findResult != expected || findAllCount != 1 || scanCount != 1 ||
+		multiScanCount != 1) {
+		fprintf(stderr, "Signature not found where expected\n");
+		return 1;
+	}
+
+	return 0;
+}
@@ -0,0 +1,94 @@
+/* Times small HTTPS requests to https_server.py, with a new easy handle for
+ * every request as before curl::AcquireHandle, and with the handles of the
+ * pool, which share the DNS cache, the TLS sessions and the connections.
+ *
+ * The certificate of the stand-in is self-signed, so it is not verified.
+ *
+ * Usage: connection_benchmark base_url [requests]
+ * e.g. ../network/run_with_server.py https_server.py 18773 50 --
+ *          connection_benchmark https://127.0.0.1:18773
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include <curl/curl.h>
+
+#include "shared/curl/handle_pool.h"
+
+using namespace std::chrono;
+
+static size_t Discard(char*, size_t size, size_t n, void*) {
+	return size * n;
+}
+
+/* Perform a GET of url with curl. Return false on error, add the number of
+ * connections it opened to connections.
+ */
+static bool Get(CURL* curl, std::string const& url, long& connections) {
+	curl_easy_setopt(curl, CURLOPT_URL, url.c_str());
+	curl_easy_setopt(curl, CURLOPT_SSL_VERIFYPEER, 0L);
+	curl_easy_setopt(curl, CURLOPT_SSL_VERIFYHOST, 0L);
+	curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, Discard);
+
+	long code = 0, opened = 0;
+	bool ok = curl_easy_perform(curl) == CURLE_OK;
+	curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &code);
+	curl_easy_getinfo(curl, CURLINFO_NUM_CONNECTS, &opened);
+	connections += opened;
+	return ok && code == 200;
+}
+
+static bool Run(const char* label, std::string const& url, int requests, bool pooled) {
+	std::vector<double> latencies;
+	long connections = 0;
+	bool ok = true;
+	for (int i = 0; i < requests; ++i) {
+		steady_clock::time_point start = steady_clock::now();
+		CURL* curl = pooled ? curl::AcquireHandle() : curl_easy_init();
+		ok &= curl && Get(curl, url, connections);
+		if (pooled) {
+			curl::ReleaseHandle(curl);
+		} else if (curl) {
+			curl_easy_cleanup(curl);
+		}
+
+		latencies.push_back(duration<double, std::milli>(steady_clock::now() - start).count());
+	}
+
+	std::sort(latencies.begin(), latencies.end());
+	double total = 0;
+	for (double latency : latencies) {
+		total += latency;
+	}
+
+	printf("  %-30s mean %8.2f ms  median %8.2f ms  max %8.2f ms  %3ld connection(s) %s\n", label,
+		total / requests, latencies[requests / 2], latencies.back(), connections, ok ? "" : "FAILED");
+	return ok;
+}
+
+int main(int argc, char** argv) {
+	if (argc < 2) {
+		fprintf(stderr, "Usage: %s base_url [requests]\n", argv[0]);
+		return 2;
+	}
+
+	std::string base = argv[1];
+	int requests = argc > 2 ? atoi(argv[2]) : 20;
+	if (requests <= 0) {
+		requests = 20;
+	}
+
+	curl_global_init(CURL_GLOBAL_DEFAULT);
+	printf("%d sequential request(s) per case\n", requests);
+
+	bool ok = true;
+	ok &= Run("new handle per request", base + "/", requests, false);
+	ok &= Run("pooled handles", base + "/", requests, true);
+
+	return ok ? 0 : 1;
+}
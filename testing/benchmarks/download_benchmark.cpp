@@ -0,0 +1,95 @@
+/* Times file downloads from throttled_server.py, which limits the rate of
+ * every connection, as a single stream and split in segments (see
+ * RequestParameters::segments).
+ *
+ * Usage: download_benchmark base_url
+ * e.g. ../network/run_with_server.py throttled_server.py 18772 16 2048 --
+ *          download_benchmark http://127.0.0.1:18772
+ */
+
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+#include <memory>
+#include <optional>
+#include <string>
+
+#include "shared/curl_request.h"
+#include "shared/github_executor.h"
+#include "shared/logger.h"
+
+using namespace std::chrono;
+
+static const char* Filename = "download_benchmark.bin";
+
+static bool CheckFile() {
+	std::ifstream stream(Filename, std::ios::binary);
+	std::string content((std::istreambuf_iterator<char>(stream)), std::istreambuf_iterator<char>());
+	if (content.empty()) {
+		return false;
+	}
+
+	for (size_t i = 0; i < content.size(); ++i) {
+		if (content[i] != (char)((i * 7) % 251)) {
+			return false;
+		}
+	}
+
+	return true;
+}
+
+static bool Run(const char* label, std::string const& url, unsigned int segments,
+	curl::RequestPriority priority = curl::REQUEST_PRIORITY_LOW, bool onData = false) {
+	curl::RequestParameters parameters;
+	parameters.url = url;
+	parameters.segments = segments;
+	parameters.priority = priority;
+	if (onData) {
+		parameters.onData = [](bool, void*, size_t, size_t) { return true; };
+	}
+
+	remove(Filename);
+	steady_clock::time_point start = steady_clock::now();
+	std::shared_ptr<curl::AsynchronousDownloadFileDescriptor> desc = curl::AsyncDownloadFile(parameters, Filename);
+	curl::DownloadFileDescriptor result = desc->result.get();
+	double elapsed = duration<double>(steady_clock::now() - start).count();
+
+	size_t received = 0;
+	bool timeout;
+	while (std::optional<curl::DownloadNotification> notification = desc->base.monitor.Get(&timeout)) {
+		if (notification->type == curl::DOWNLOAD_DATA_RECEIVED) {
+			received += std::get<size_t>(notification->data);
+		}
+	}
+
+	bool ok = result.result == curl::DOWNLOAD_FILE_OK && CheckFile();
+	printf("  %-32s %7.2f s %8.2f MiB/s %s\n", label, elapsed, received / 1048576.0 / elapsed,
+		ok ? "" : "FAILED");
+	return ok;
+}
+
+int main(int argc, char** argv) {
+	if (argc < 2) {
+		fprintf(stderr, "Usage: %s base_url\n", argv[0]);
+		return 2;
+	}
+
+	std::string base = argv[1];
+	Logger::Init("download_benchmark.log", false);
+	sGithubExecutor->Start();
+
+	bool ok = true;
+	ok &= Run("single stream", base + "/file", 1);
+	ok &= Run("2 segments", base + "/file", 2);
+	ok &= Run("3 segments (low priority)", base + "/file", 3);
+	ok &= Run("4 segments (normal priority)", base + "/file", 4, curl::REQUEST_PRIORITY_NORMAL);
+	ok &= Run("3 segments, onData (one stream)", base + "/file", 3, curl::REQUEST_PRIORITY_LOW, true);
+	ok &= Run("3 segments, no byte ranges", base + "/noranges", 3);
+
+	sGithubExecutor->Stop();
+	Logger::End();
+	remove(Filename);
+
+	return ok ? 0 : 1;
+}
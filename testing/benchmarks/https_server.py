@@ -0,0 +1,69 @@
+# HTTPS server standing in for github.com, for connection_benchmark.cpp.
+#
+# Usage: https_server.py port delay_ms [cert key]
+#
+# delay_ms is waited on every new connection before the TLS handshake, as
+# the round trips of the TCP and TLS handshakes to a distant server would.
+# Without cert and key, a self-signed certificate is created with openssl.
+# Every path answers with a small JSON body, keeping the connection open.
+import http.server
+import os
+import socketserver
+import ssl
+import subprocess
+import sys
+import tempfile
+import time
+
+DELAY = int(sys.argv[2]) / 1000
+
+class Handler(http.server.BaseHTTPRequestHandler):
+    protocol_version = "HTTP/1.1"
+    disable_nagle_algorithm = True
+
+    def log_message(self, *args):
+        pass
+
+    def setup(self):
+        time.sleep(DELAY)
+        try:
+            self.request.do_handshake()
+        except OSError:
+            pass
+        super().setup()
+
+    def do_GET(self):
+        body = b'{"tag_name": "v1.0.0"}'
+        self.send_response(200)
+        self.send_header("Content-Type", "application/json")
+        self.send_header("Content-Length", str(len(body)))
+        self.end_headers()
+        self.wfile.write(body)
+
+    def handle(self):
+        try:
+            super().handle()
+        except OSError:
+            pass
+
+class Server(socketserver.ThreadingMixIn, http.server.HTTPServer):
+    daemon_threads = True
+    allow_reuse_address = True
+
+def main():
+    if len(sys.argv) >= 5:
+        cert, key = sys.argv[3], sys.argv[4]
+    else:
+        directory = tempfile.mkdtemp()
+        cert, key = os.path.join(directory, "cert.pem"), os.path.join(directory, "key.pem")
+        subprocess.check_call(["openssl", "req", "-x509", "-newkey", "rsa:2048", "-nodes", "-days", "1",
+            "-subj", "/CN=127.0.0.1", "-keyout", key, "-out", cert],
+            stdout=subprocess.DEVNULL, stderr=subprocess.DEVNULL)
+
+    context = ssl.SSLContext(ssl.PROTOCOL_TLS_SERVER)
+    context.load_cert_chain(cert, key)
+    server = Server(("127.0.0.1", int(sys.argv[1])), Handler)
+    server.socket = context.wrap_socket(server.socket, server_side=True, do_handshake_on_connect=False)
+    server.serve_forever()
+
+main()
@@ -0,0 +1,123 @@
+/* Times diff_patcher::PatchFolder applying the same update as a BSDIFF40
+ * patch and as an RGPATCH1 patch, each on a fresh copy of the source
+ * folder, with one worker and with one worker per core.
+ *
+ * The patches are generated by patchgen, see patch_benchmark.py which
+ * prepares everything and runs this program.
+ *
+ * Usage: patch_benchmark source bsdiff_output rgpatch_output [runs]
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+#include "launcher/diff_patcher.h"
+#include "shared/logger.h"
+#include "shared/sha256.h"
+
+namespace fs = std::filesystem;
+using namespace std::chrono;
+
+static const char* Copy = "patch_benchmark.work";
+
+static uintmax_t FolderSize(fs::path const& folder) {
+	uintmax_t size = 0;
+	for (fs::directory_entry const& entry : fs::recursive_directory_iterator(folder)) {
+		if (entry.is_regular_file()) {
+			size += entry.file_size();
+		}
+	}
+
+	return size;
+}
+
+/* Hashes of the files of the patched copy, to check that both formats give
+ * the same result.
+ */
+static std::vector<std::string> HashCopy() {
+	std::vector<fs::path> files;
+	for (fs::directory_entry const& entry : fs::recursive_directory_iterator(Copy)) {
+		if (entry.is_regular_file()) {
+			files.push_back(entry.path());
+		}
+	}
+
+	std::sort(files.begin(), files.end());
+	std::vector<std::string> hashes;
+	for (Sha256::FileHash& hash : Sha256::HashFiles(files)) {
+		hashes.push_back(std::move(hash.hash));
+	}
+
+	return hashes;
+}
+
+static bool Run(const char* label, fs::path const& source, fs::path const& patches, unsigned int workers,
+	int runs, std::vector<std::string>& hashes) {
+	double best = 0;
+	bool ok = true;
+	for (int i = 0; i < runs && ok; ++i) {
+		std::error_code ec;
+		fs::remove_all(Copy, ec);
+		fs::copy(source, Copy, fs::copy_options::recursive, ec);
+		if (ec) {
+			fprintf(stderr, "Unable to copy %s: %s\n", source.string().c_str(), ec.message().c_str());
+			return false;
+		}
+
+		std::vector<diff_patcher::PatchError> errors;
+		steady_clock::time_point start = steady_clock::now();
+		ok = diff_patcher::PatchFolder(Copy, patches, &errors, workers) == diff_patcher::PATCH_OK;
+		double elapsed = duration<double, std::milli>(steady_clock::now() - start).count();
+		if (i == 0 || elapsed < best) {
+			best = elapsed;
+		}
+	}
+
+	if (ok) {
+		std::vector<std::string> result = HashCopy();
+		if (hashes.empty()) {
+			hashes = std::move(result);
+		} else {
+			ok = result == hashes;
+		}
+	}
+
+	printf("  %-28s %9.2f ms  %s\n", label, best, ok ? "" : "FAILED");
+	return ok;
+}
+
+int main(int argc, char** argv) {
+	if (argc < 4) {
+		fprintf(stderr, "Usage: %s source bsdiff_output rgpatch_output [runs]\n", argv[0]);
+		return 2;
+	}
+
+	fs::path source = argv[1], bsdiff = argv[2], rgpatch = argv[3];
+	int runs = argc > 4 ? atoi(argv[4]) : 3;
+	if (runs <= 0) {
+		runs = 3;
+	}
+
+	Logger::Init("patch_benchmark.log", false);
+	printf("Source %.1f MiB, BSDIFF40 patches %.1f KiB, RGPATCH1 patches %.1f KiB, best of %d run(s)\n",
+		FolderSize(source) / 1048576.0, FolderSize(bsdiff / "patches") / 1024.0,
+		FolderSize(rgpatch / "patches") / 1024.0, runs);
+
+	std::vector<std::string> hashes;
+	bool ok = true;
+	ok &= Run("BSDIFF40, 1 worker", source, bsdiff, 1, runs, hashes);
+	ok &= Run("BSDIFF40, 1 worker per core", source, bsdiff, 0, runs, hashes);
+	ok &= Run("RGPATCH1, 1 worker", source, rgpatch, 1, runs, hashes);
+	ok &= Run("RGPATCH1, 1 worker per core", source, rgpatch, 0, runs, hashes);
+
+	std::error_code ec;
+	fs::remove_all(Copy, ec);
+	Logger::End();
+
+	return ok ? 0 : 1;
+}
@@ -0,0 +1,42 @@
+# Generates a source and a target folder with ../patching/make_folders.py,
+# makes a BSDIFF40 and an RGPATCH1 patch of them with patchgen, then runs
+# patch_benchmark on both.
+#
+# Usage: patch_benchmark.py patchgen patch_benchmark [large_mib] [runs]
+#
+# Works in patch_benchmark.data, in the current folder.
+import os
+import subprocess
+import sys
+
+sys.path.insert(0, os.path.join(os.path.dirname(os.path.abspath(__file__)), "..", "patching"))
+import make_folders
+
+def main():
+    if len(sys.argv) < 3:
+        sys.stderr.write("Usage: patch_benchmark.py patchgen patch_benchmark [large_mib] [runs]\n")
+        return 2
+
+    patchgen, benchmark = sys.argv[1], sys.argv[2]
+    large_mib = int(sys.argv[3]) if len(sys.argv) > 3 else 32
+    runs = sys.argv[4] if len(sys.argv) > 4 else "3"
+
+    folder = "patch_benchmark.data"
+    make_folders.make(folder, large_mib)
+    source = os.path.join(folder, "source")
+    target = os.path.join(folder, "target")
+
+    outputs = []
+    for format in ("bsdiff", "rgpatch"):
+        output = os.path.join(folder, format)
+        outputs.append(output)
+        status = subprocess.call([patchgen, "-y", "-f", format, "-s", source, "-t", target, "-o", output],
+                                 stdout=subprocess.DEVNULL)
+        if status:
+            sys.stderr.write("patchgen -f %s failed (%d)\n" % (format, status))
+            return 1
+
+    return subprocess.call([benchmark, source] + outputs + [runs])
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,122 @@
+/* Times SHA-256 over one large buffer and over many small ones, with
+ * Sha256::Context (the native kernel selected at startup), HashBuffers
+ * (the multi-buffer kernel) and Sha256BCrypt (the Windows CNG provider).
+ *
+ * The small buffers stand for the files of a mod or of the game, which
+ * HashFiles gives to HashBuffers eight at a time.
+ *
+ * Usage: sha256_benchmark [runs]
+ */
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include "shared/sha256.h"
+
+using namespace std::chrono;
+
+static constexpr size_t LARGE_SIZE = 64 << 20;
+static constexpr size_t SMALL_COUNT = 4096;
+
+static std::vector<unsigned char> Random(size_t size, uint32_t seed) {
+	std::vector<unsigned char> buffer(size);
+	for (unsigned char& byte : buffer) {
+		seed = seed * 1664525 + 1013904223;
+		byte = (unsigned char)(seed >> 24);
+	}
+
+	return buffer;
+}
+
+template<typename Fn>
+static double Time(int runs, Fn&& fn) {
+	double best = 0;
+	for (int i = 0; i < runs; ++i) {
+		steady_clock::time_point start = steady_clock::now();
+		fn();
+		double elapsed = duration<double, std::milli>(steady_clock::now() - start).count();
+		if (i == 0 || elapsed < best) {
+			best = elapsed;
+		}
+	}
+
+	return best;
+}
+
+static void Print(const char* label, double ms, size_t bytes) {
+	printf("  %-24s %8.2f ms %8.1f MiB/s\n", label, ms, bytes / 1048576.0 / (ms / 1000));
+}
+
+static bool Large(int runs) {
+	std::vector<unsigned char> buffer = Random(LARGE_SIZE, 1);
+	std::string native, bcrypt;
+
+	printf("1 buffer of %zu MiB\n", LARGE_SIZE >> 20);
+	Print("Context", Time(runs, [&]() {
+		Sha256::Context context;
+		context.Update(buffer.data(), buffer.size());
+		context.Final(native);
+	}), buffer.size());
+	Print("Sha256BCrypt", Time(runs, [&]() {
+		Sha256::Sha256BCrypt(buffer.data(), buffer.size(), bcrypt);
+	}), buffer.size());
+
+	return native == bcrypt;
+}
+
+static bool Small(int runs, size_t size) {
+	std::vector<std::vector<unsigned char>> buffers;
+	std::vector<const void*> pointers;
+	std::vector<size_t> sizes;
+	for (size_t i = 0; i < SMALL_COUNT; ++i) {
+		buffers.push_back(Random(size, (uint32_t)i));
+		pointers.push_back(buffers.back().data());
+		sizes.push_back(size);
+	}
+
+	std::vector<std::string> native(SMALL_COUNT), multi(SMALL_COUNT), bcrypt(SMALL_COUNT);
+	size_t total = SMALL_COUNT * size;
+
+	printf("%zu buffers of %zu KiB\n", SMALL_COUNT, size >> 10);
+	Print("Context", Time(runs, [&]() {
+		for (size_t i = 0; i < SMALL_COUNT; ++i) {
+			Sha256::Context context;
+			context.Update(pointers[i], sizes[i]);
+			context.Final(native[i]);
+		}
+	}), total);
+	Print("HashBuffers", Time(runs, [&]() {
+		Sha256::HashBuffers(pointers.data(), sizes.data(), SMALL_COUNT, multi.data());
+	}), total);
+	Print("Sha256BCrypt", Time(runs, [&]() {
+		for (size_t i = 0; i < SMALL_COUNT; ++i) {
+			Sha256::Sha256BCrypt(pointers[i], sizes[i], bcrypt[i]);
+		}
+	}), total);
+
+	return native == multi && native == bcrypt;
+}
+
+int main(int argc, char** argv) {
+	int runs = argc > 1 ? atoi(argv[1]) : 5;
+	if (runs <= 0) {
+		runs = 5;
+	}
+
+	printf("Backend: %s, best of %d run(s)\n", Sha256::GetBackendName(), runs);
+
+	bool ok = Large(runs);
+	ok &= Small(runs, 1 << 10);
+	ok &= Small(runs, 16 << 10);
+
+	if (!ok) {
+		fprintf(stderr, "The implementations disagree\n");
+		return 1;
+	}
+
+	return 0;
+}
@@ -0,0 +1,62 @@
+# HTTP server sending a file at a limited rate per connection, like a CDN
+# on which a single stream is far below the capacity of the link, for
+# download_benchmark.cpp.
+#
+# Usage: throttled_server.py port size_mib rate_kib
+#
+#   /file       the file, accepting byte ranges, at most rate_kib KiB/s
+#               per connection
+#   /noranges   the same file, ignoring byte ranges
+#
+# Byte i of the file is (i * 7) % 251.
+import http.server
+import socketserver
+import sys
+import time
+
+SIZE = int(float(sys.argv[2]) * 1048576)
+RATE = int(sys.argv[3]) * 1024
+DATA = bytes((i * 7) % 251 for i in range(SIZE))
+TICK = 0.05
+
+class Handler(http.server.BaseHTTPRequestHandler):
+    protocol_version = "HTTP/1.1"
+
+    def log_message(self, *args):
+        pass
+
+    def do_GET(self):
+        if self.path not in ("/file", "/noranges"):
+            self.send_response(404)
+            self.send_header("Content-Length", "0")
+            self.end_headers()
+            return
+
+        start, end = 0, SIZE - 1
+        byte_range = self.headers.get("Range")
+        if self.path == "/file" and byte_range and self.headers.get("If-Range") in (None, '"v1"'):
+            first, last = byte_range.split("=")[1].split("-")
+            start = int(first)
+            end = int(last) if last else end
+            self.send_response(206)
+            self.send_header("Content-Range", "bytes %d-%d/%d" % (start, end, SIZE))
+        else:
+            self.send_response(200)
+        self.send_header("ETag", '"v1"')
+        self.send_header("Content-Length", str(end - start + 1))
+        self.end_headers()
+
+        body = memoryview(DATA)[start:end + 1]
+        chunk = max(1, int(RATE * TICK))
+        try:
+            for i in range(0, len(body), chunk):
+                self.wfile.write(body[i:i + chunk])
+                time.sleep(TICK)
+        except (BrokenPipeError, ConnectionResetError):
+            pass
+
+class Server(socketserver.ThreadingMixIn, http.server.HTTPServer):
+    daemon_threads = True
+    allow_reuse_address = True
+
+Server(("127.0.0.1", int(sys.argv[1])), Handler).serve_forever()
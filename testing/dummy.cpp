@@ -1,6 +1,11 @@
 #include <cstdio>
 #include <ctime>
 
+/* Forwarded to libzhl: the content of the export is in another module, the
+ * launcher must not read the forwarder string as a version.
+ */
+#pragma comment(linker, "/export:__ZHL_VERSION=libzhl.__ZHL_VERSION")
+
 extern "C" {
 	__declspec(dllexport) int ModInit() {
 		FILE* f = fopen("dummy.log", "w");
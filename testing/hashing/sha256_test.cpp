@@ -0,0 +1,305 @@
+/* Checks the SHA-256 kernels and the functions built on them against the
+ * FIPS 180-2 test vectors, the Windows CNG provider and each other.
+ *
+ * Kernels the CPU does not support are skipped.
+ *
+ * Usage: sha256_test
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "shared/cpu_features.h"
+#include "shared/sha256.h"
+#include "shared/private/sha256/kernels.h"
+
+using namespace Sha256::detail;
+
+static int _failures = 0;
+
+static void Check(bool condition, const char* test, const char* what) {
+	if (!condition) {
+		fprintf(stderr, "FAIL %s: %s\n", test, what);
+		++_failures;
+	}
+}
+
+struct Vector {
+	std::string message;
+	const char* digest;
+};
+
+static std::vector<Vector> Vectors() {
+	return {
+		{ "", "e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855" },
+		{ "abc", "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad" },
+		{ "abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq",
+			"248d6a61d20638b8e5c026930c3e6039a33ce45964ff2167f6ecedd419db06c1" },
+		{ "abcdefghbcdefghicdefghijdefghijkefghijklfghijklmghijklmnhijklmno"
+			"ijklmnopjklmnopqklmnopqrlmnopqrsmnopqrstnopqrstu",
+			"cf5b16a778af8380036ce59e7b0492370b249b11e8f07a51afac45037afee9d1" },
+		{ std::string(1000000, 'a'), "cdc76e5c9914fb9281a1c7e284d73e67f1809a48a497200e046d39ccc7112cd0" }
+	};
+}
+
+static std::vector<unsigned char> Random(size_t size, uint32_t seed) {
+	std::vector<unsigned char> buffer(size);
+	for (unsigned char& byte : buffer) {
+		seed = seed * 1664525 + 1013904223;
+		byte = (unsigned char)(seed >> 24);
+	}
+
+	return buffer;
+}
+
+/* Append the padding of FIPS 180-2 5.1.1 to message. */
+static std::vector<unsigned char> Pad(const void* data, size_t size) {
+	std::vector<unsigned char> padded((const unsigned char*)data, (const unsigned char*)data + size);
+	padded.push_back(0x80);
+	while (padded.size() % BLOCK_SIZE != BLOCK_SIZE - 8) {
+		padded.push_back(0);
+	}
+
+	uint64_t bits = (uint64_t)size * 8;
+	for (int i = 7; i >= 0; --i) {
+		padded.push_back((unsigned char)(bits >> (8 * i)));
+	}
+
+	return padded;
+}
+
+static void InitialState(uint32_t state[8]) {
+	static const uint32_t initial[8] = {
+		0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+	};
+
+	memcpy(state, initial, sizeof(initial));
+}
+
+static std::string ToHex(const uint32_t state[8]) {
+	std::string result;
+	char word[9];
+	for (int i = 0; i < 8; ++i) {
+		snprintf(word, sizeof(word), "%08x", state[i]);
+		result += word;
+	}
+
+	return result;
+}
+
+static std::string Digest(CompressFn compress, const void* data, size_t size) {
+	std::vector<unsigned char> padded = Pad(data, size);
+	uint32_t state[8];
+	InitialState(state);
+	compress(state, padded.data(), padded.size() / BLOCK_SIZE);
+	return ToHex(state);
+}
+
+static void TestKernel(const char* name, CompressFn compress) {
+	for (Vector const& vector : Vectors()) {
+		Check(Digest(compress, vector.message.data(), vector.message.size()) == vector.digest,
+			name, "wrong digest of a test vector");
+	}
+}
+
+static void TestKernel8x(const char* name, Compress8xFn compress) {
+	/* Every lane on the same test vector. */
+	for (Vector const& vector : Vectors()) {
+		std::vector<unsigned char> padded = Pad(vector.message.data(), vector.message.size());
+		const unsigned char* data[LANES];
+		uint32_t states[LANES][8];
+		for (size_t lane = 0; lane < LANES; ++lane) {
+			data[lane] = padded.data();
+			InitialState(states[lane]);
+		}
+
+		compress(states, data, padded.size() / BLOCK_SIZE);
+		for (size_t lane = 0; lane < LANES; ++lane) {
+			Check(ToHex(states[lane]) == vector.digest, name, "wrong digest of a test vector");
+		}
+	}
+
+	/* A different message in every lane, to catch lanes mixed up. */
+	std::vector<std::vector<unsigned char>> messages;
+	const unsigned char* data[LANES];
+	uint32_t states[LANES][8];
+	for (size_t lane = 0; lane < LANES; ++lane) {
+		messages.push_back(Pad(Random(1000, (uint32_t)lane).data(), 1000));
+		data[lane] = messages.back().data();
+		InitialState(states[lane]);
+	}
+
+	compress(states, data, messages[0].size() / BLOCK_SIZE);
+	for (size_t lane = 0; lane < LANES; ++lane) {
+		Check(ToHex(states[lane]) == Digest(CompressScalar, Random(1000, (uint32_t)lane).data(), 1000),
+			name, "lanes do not match the scalar kernel");
+	}
+}
+
+/* Context, whatever the way the message is split between calls to Update. */
+static void TestContext() {
+	static const size_t chunks[] = { 1, 3, 63, 64, 65, 1000, 1 << 20 };
+	for (Vector const& vector : Vectors()) {
+		for (size_t chunk : chunks) {
+			if (vector.message.size() > 100000 && chunk < 63) {
+				continue;
+			}
+
+			Sha256::Context context;
+			for (size_t offset = 0; offset < vector.message.size(); offset += chunk) {
+				context.Update(vector.message.data() + offset, std::min(chunk, vector.message.size() - offset));
+			}
+
+			std::string digest;
+			Check(context.Final(digest) == HASH_OK && digest == vector.digest, "Context", "wrong digest");
+
+			/* Final resets the context. */
+			context.Update("abc", 3);
+			context.Final(digest);
+			Check(digest == Vectors()[1].digest, "Context", "not reset by Final");
+		}
+
+		std::string digest;
+		Sha256::Sha256(vector.message.data(), vector.message.size(), digest);
+		Check(digest == vector.digest, "Sha256", "wrong digest");
+		Check(Sha256::Sha256BCrypt(vector.message.data(), vector.message.size(), digest) == HASH_OK &&
+			digest == vector.digest, "Sha256BCrypt", "wrong digest");
+	}
+}
+
+/* HashBuffers against Sha256BCrypt, with groups of buffers of unequal sizes and
+ * a last group that does not fill every lane.
+ */
+static void TestHashBuffers() {
+	std::vector<std::vector<unsigned char>> buffers;
+	std::vector<const void*> pointers;
+	std::vector<size_t> sizes;
+	for (size_t i = 0; i < 19; ++i) {
+		buffers.push_back(Random(i * 517 + (i % 3) * 64, (uint32_t)i));
+	}
+
+	for (std::vector<unsigned char> const& buffer : buffers) {
+		pointers.push_back(buffer.data());
+		sizes.push_back(buffer.size());
+	}
+
+	std::vector<std::string> results(buffers.size());
+	Check(Sha256::HashBuffers(pointers.data(), sizes.data(), buffers.size(), results.data()) == HASH_OK,
+		"HashBuffers", "failed");
+
+	for (size_t i = 0; i < buffers.size(); ++i) {
+		std::string expected;
+		Sha256::Sha256BCrypt(buffers[i].data(), buffers[i].size(), expected);
+		Check(results[i] == expected, "HashBuffers", "wrong digest");
+	}
+}
+
+static bool WriteFile(std::filesystem::path const& path, std::vector<unsigned char> const& content) {
+	FILE* file = fopen(path.string().c_str(), "wb");
+	if (!file) {
+		return false;
+	}
+
+	bool ok = fwrite(content.data(), 1, content.size(), file) == content.size();
+	return fclose(file) == 0 && ok;
+}
+
+/* HashFile in both modes and HashFiles, over files on both sides of
+ * BATCH_FILE_SIZE and a missing file.
+ */
+static void TestFiles() {
+	std::filesystem::path folder = "sha256_test";
+	std::filesystem::remove_all(folder);
+	std::filesystem::create_directories(folder);
+
+	const size_t fileSizes[] = { 0, 1, 64, 3000, 70000, Sha256::BATCH_FILE_SIZE,
+		Sha256::BATCH_FILE_SIZE + 1, 100, 5, 4096, 3 * Sha256::FILE_BLOCK_SIZE + 17 };
+	std::vector<std::filesystem::path> files;
+	std::vector<std::string> expected;
+	for (size_t i = 0; i < sizeof(fileSizes) / sizeof(*fileSizes); ++i) {
+		std::vector<unsigned char> content = Random(fileSizes[i], (uint32_t)(100 + i));
+		files.push_back(folder / ("file" + std::to_string(i)));
+		Check(WriteFile(files.back(), content), "files", "cannot write the test file");
+
+		expected.emplace_back();
+		Sha256::Sha256BCrypt(content.data(), content.size(), expected.back());
+
+		std::string digest;
+		Check(Sha256::HashFile(files.back().string().c_str(), digest, Sha256::HASH_FILE_READ) == HASH_OK &&
+			digest == expected.back(), "HashFile", "wrong digest when reading");
+		Check(Sha256::HashFile(files.back().string().c_str(), digest, Sha256::HASH_FILE_MAPPED) == HASH_OK &&
+			digest == expected.back(), "HashFile", "wrong digest when mapping");
+	}
+
+	files.push_back(folder / "missing");
+
+	for (unsigned int threads : { 1u, 3u }) {
+		Sha256::HashFilesMonitor monitor;
+		std::vector<Sha256::FileHash> results = Sha256::HashFiles(files, &monitor, nullptr, threads);
+
+		Check(results.size() == files.size(), "HashFiles", "wrong number of results");
+		for (size_t i = 0; i < expected.size(); ++i) {
+			Check(results[i].result == HASH_OK && results[i].hash == expected[i], "HashFiles", "wrong digest");
+		}
+
+		Check(results.back().result == HASH_INVALID_FILE, "HashFiles", "missing file not reported");
+
+		size_t done = 0;
+		bool finished = false, timeout;
+		while (std::optional<Sha256::HashFilesNotification> notification = monitor.Get(&timeout)) {
+			if (notification->type == Sha256::HASH_FILES_FILE_DONE) {
+				++done;
+			} else {
+				finished = true;
+			}
+		}
+
+		Check(done == files.size() && finished, "HashFiles", "wrong notifications");
+	}
+
+	std::atomic<bool> cancel = true;
+	std::vector<Sha256::FileHash> results = Sha256::HashFiles(files, nullptr, &cancel, 2);
+	for (Sha256::FileHash const& result : results) {
+		Check(result.result == HASH_CANCELLED, "HashFiles", "not cancelled");
+	}
+
+	std::filesystem::remove_all(folder);
+}
+
+int main() {
+	CPU::Features const& features = CPU::GetFeatures();
+	printf("Backend: %s\n", Sha256::GetBackendName());
+
+	TestKernel("scalar kernel", CompressScalar);
+	if (features.sha && features.ssse3 && features.sse41) {
+		TestKernel("SHA-NI kernel", CompressSHANI);
+	} else {
+		printf("SHA-NI not supported, skipped\n");
+	}
+
+	TestKernel8x("scalar 8x kernel", Compress8xScalar);
+	if (features.avx2) {
+		TestKernel8x("AVX2 8x kernel", Compress8xAVX2);
+	} else {
+		printf("AVX2 not supported, skipped\n");
+	}
+
+	TestContext();
+	TestHashBuffers();
+	TestFiles();
+
+	if (_failures) {
+		fprintf(stderr, "%d check(s) failed\n", _failures);
+		return 1;
+	}
+
+	printf("All checks passed\n");
+	return 0;
+}
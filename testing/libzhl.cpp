@@ -2,7 +2,7 @@
 #include <ctime>
 
 extern "C" {
-	__declspec(dllexport) const char* __ZHL_VERSION = "1.0.0";
+	__declspec(dllexport) const char* __ZHL_VERSION = ZHL_VERSION;
 
 	__declspec(dllexport) int InitZHL() {
 		FILE* f = fopen("zhl.log", "w");
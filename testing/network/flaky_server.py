@@ -0,0 +1,107 @@
+# HTTP server failing in scripted ways, for retry_test.cpp.
+#
+# Usage: flaky_server.py port
+#
+# The first path component selects the behaviour, the following ones its
+# arguments. The server counts the requests made to every path: GET
+# /count/<path> returns how many requests /<path> received.
+#
+#   /fail/<n>/<tag>     503 for the first n requests, then 200 "ok-<tag>"
+#   /ra/<s>/<tag>       429 with Retry-After: s once, then 200 "ok"
+#   /rl/<s>/<tag>       403 with X-RateLimit-Reset in s seconds once, then 200 "ok"
+#   /rlfar              403 with X-RateLimit-Reset in an hour
+#   /forbidden          403 without any rate limit header
+#   /404                404
+#   /drop/<n>/<tag>     cuts the body short for the first n requests, then 200 "ok"
+#   /file/<n>/<tag>     1 MiB file accepting byte ranges, cut after 300000
+#                       bytes for the first n requests
+import collections
+import http.server
+import socketserver
+import sys
+import threading
+import time
+
+FILE = bytes((i * 7) % 251 for i in range(1 << 20))
+FILE_CUT = 300000
+
+counts = collections.Counter()
+lock = threading.Lock()
+
+class Handler(http.server.BaseHTTPRequestHandler):
+    protocol_version = "HTTP/1.1"
+
+    def log_message(self, *args):
+        pass
+
+    def send(self, code, body=b"", headers=()):
+        self.send_response(code)
+        for name, value in headers:
+            self.send_header(name, value)
+        self.send_header("Content-Length", str(len(body)))
+        self.end_headers()
+        self.wfile.write(body)
+
+    def do_GET(self):
+        path = self.path.strip("/").split("/")
+        with lock:
+            counts[self.path] += 1
+            n = counts[self.path]
+        kind = path[0]
+        if kind == "count":
+            return self.send(200, str(counts["/" + "/".join(path[1:])]).encode())
+        if kind == "fail":
+            if n <= int(path[1]):
+                return self.send(503, b"busy")
+            return self.send(200, ("ok-" + path[2]).encode())
+        if kind == "ra":
+            if n == 1:
+                return self.send(429, b"slow down", [("Retry-After", path[1])])
+            return self.send(200, b"ok")
+        if kind == "rl":
+            if n == 1:
+                reset = str(int(time.time()) + int(path[1]))
+                return self.send(403, b"limit", [("X-RateLimit-Remaining", "0"), ("X-RateLimit-Reset", reset)])
+            return self.send(200, b"ok")
+        if kind == "rlfar":
+            reset = str(int(time.time()) + 3600)
+            return self.send(403, b"limit", [("X-RateLimit-Remaining", "0"), ("X-RateLimit-Reset", reset)])
+        if kind == "forbidden":
+            return self.send(403, b"no")
+        if kind == "404":
+            return self.send(404, b"nope")
+        if kind == "drop":
+            if n <= int(path[1]):
+                self.send_response(200)
+                self.send_header("Content-Length", "100")
+                self.end_headers()
+                self.wfile.write(b"x" * 10)
+                self.wfile.flush()
+                self.close_connection = True
+                return
+            return self.send(200, b"ok")
+        if kind == "file":
+            byte_range = self.headers.get("Range")
+            start = int(byte_range.split("=")[1].split("-")[0]) if byte_range else 0
+            body = FILE[start:]
+            self.send_response(206 if byte_range else 200)
+            self.send_header("ETag", '"v1"')
+            self.send_header("Accept-Ranges", "bytes")
+            if byte_range:
+                self.send_header("Content-Range", "bytes %d-%d/%d" % (start, len(FILE) - 1, len(FILE)))
+            self.send_header("Content-Length", str(len(body)))
+            self.end_headers()
+            if n <= int(path[1]):
+                self.wfile.write(body[:FILE_CUT])
+                self.wfile.flush()
+                self.close_connection = True
+                return
+            self.wfile.write(body)
+            return
+        self.send(400, b"unknown request")
+
+class Server(socketserver.ThreadingMixIn, http.server.HTTPServer):
+    daemon_threads = True
+    allow_reuse_address = True
+
+Server(("127.0.0.1", int(sys.argv[1])), Handler).serve_forever()
@@ -0,0 +1,224 @@
+/* Checks the retry policy of curl::RequestParameters against
+ * flaky_server.py, through both the blocking functions and the
+ * GithubExecutor.
+ *
+ * Usage: retry_test base_url
+ * e.g. run_with_server.py flaky_server.py 18771 -- retry_test http://127.0.0.1:18771
+ */
+
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+#include <memory>
+#include <optional>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "shared/curl_request.h"
+#include "shared/github_executor.h"
+#include "shared/logger.h"
+
+using namespace std::chrono;
+
+static std::string _base;
+static int _failures = 0;
+
+static void Check(bool condition, const char* test, const char* what) {
+	if (!condition) {
+		fprintf(stderr, "FAIL %s: %s\n", test, what);
+		++_failures;
+	}
+}
+
+static curl::RequestParameters Request(std::string const& path, unsigned int attempts = 4) {
+	curl::RequestParameters parameters;
+	parameters.url = _base + "/" + path;
+	parameters.retry.attempts = attempts;
+	parameters.retry.baseDelay = milliseconds(100);
+	parameters.retry.maxDelay = milliseconds(400);
+	return parameters;
+}
+
+/* Number of requests the server received for path. */
+static int Count(std::string const& path) {
+	curl::RequestParameters parameters;
+	parameters.url = _base + "/count/" + path;
+	curl::DownloadStringDescriptor result = curl::DownloadString(parameters, "count");
+	return result.result == curl::DOWNLOAD_STRING_OK ? std::stoi(result.string) : -1;
+}
+
+struct AsyncResult {
+	curl::DownloadStringDescriptor result;
+	int retries;
+	long long elapsed;
+};
+
+static AsyncResult RunAsync(curl::RequestParameters const& parameters, long long cancelAfter = -1) {
+	steady_clock::time_point start = steady_clock::now();
+	std::shared_ptr<curl::AsynchronousDownloadStringDescriptor> desc = curl::AsyncDownloadString(parameters, "retry");
+	if (cancelAfter >= 0) {
+		std::this_thread::sleep_for(milliseconds(cancelAfter));
+		desc->base.cancel = true;
+	}
+
+	AsyncResult result;
+	result.result = desc->result.get();
+	result.elapsed = duration_cast<milliseconds>(steady_clock::now() - start).count();
+	result.retries = 0;
+
+	bool timeout;
+	while (std::optional<curl::DownloadNotification> notification = desc->base.monitor.Get(&timeout)) {
+		if (notification->type == curl::DOWNLOAD_RETRY) {
+			++result.retries;
+		}
+	}
+
+	return result;
+}
+
+static void TestBlocking() {
+	curl::DownloadStringDescriptor result = curl::DownloadString(Request("fail/2/b1"), "retry");
+	Check(result.string == "ok-b1", "blocking 503 twice", "wrong body");
+	Check(Count("fail/2/b1") == 3, "blocking 503 twice", "expected 3 requests");
+
+	result = curl::DownloadString(Request("fail/9/b2"), "retry");
+	Check(result.string == "busy", "blocking 503 always", "wrong body");
+	Check(Count("fail/9/b2") == 4, "blocking 503 always", "expected 4 requests");
+
+	result = curl::DownloadString(Request("fail/1/b3", 1), "retry");
+	Check(result.string == "busy", "blocking without policy", "wrong body");
+	Check(Count("fail/1/b3") == 1, "blocking without policy", "expected 1 request");
+
+	result = curl::DownloadString(Request("404"), "retry");
+	Check(result.string == "nope", "blocking 404", "wrong body");
+	Check(Count("404") == 1, "blocking 404", "expected 1 request");
+
+	result = curl::DownloadString(Request("forbidden"), "retry");
+	Check(result.string == "no", "blocking 403", "wrong body");
+	Check(Count("forbidden") == 1, "blocking 403", "expected 1 request");
+}
+
+static void TestAsync() {
+	AsyncResult result = RunAsync(Request("fail/2/a1"));
+	Check(result.result.string == "ok-a1", "async 503 twice", "wrong body");
+	Check(result.retries == 2, "async 503 twice", "expected 2 retry notifications");
+	Check(Count("fail/2/a1") == 3, "async 503 twice", "expected 3 requests");
+
+	result = RunAsync(Request("ra/1/a2"));
+	Check(result.result.string == "ok", "Retry-After", "wrong body");
+	Check(result.retries == 1, "Retry-After", "expected 1 retry notification");
+	Check(result.elapsed >= 1000, "Retry-After", "retried before the delay asked by the server");
+	Check(Count("ra/1/a2") == 2, "Retry-After", "expected 2 requests");
+
+	result = RunAsync(Request("rl/2/a3"));
+	Check(result.result.string == "ok", "X-RateLimit-Reset", "wrong body");
+	Check(result.retries == 1, "X-RateLimit-Reset", "expected 1 retry notification");
+	Check(result.elapsed >= 1000, "X-RateLimit-Reset", "retried before the reset");
+	Check(Count("rl/2/a3") == 2, "X-RateLimit-Reset", "expected 2 requests");
+
+	result = RunAsync(Request("rlfar"));
+	Check(result.result.string == "limit", "distant X-RateLimit-Reset", "wrong body");
+	Check(result.retries == 0, "distant X-RateLimit-Reset", "expected no retry");
+	Check(Count("rlfar") == 1, "distant X-RateLimit-Reset", "expected 1 request");
+
+	result = RunAsync(Request("drop/2/a4"));
+	Check(result.result.string == "ok", "truncated body", "wrong body");
+	Check(result.retries == 2, "truncated body", "expected 2 retry notifications");
+	Check(Count("drop/2/a4") == 3, "truncated body", "expected 3 requests");
+
+	result = RunAsync(Request("fail/9/a5"), 50);
+	Check(result.result.code == CURLE_ABORTED_BY_CALLBACK, "cancel while waiting", "not aborted");
+	Check(result.elapsed < 1000, "cancel while waiting", "cancel not seen while waiting");
+
+	curl::RequestParameters parameters = Request("fail/1/a6");
+	parameters.onData = [](bool, void*, size_t, size_t) { return true; };
+	result = RunAsync(parameters);
+	Check(result.result.string == "busy", "onData", "wrong body");
+	Check(Count("fail/1/a6") == 1, "onData", "retried after onData was given data");
+
+	parameters = Request("refused");
+	parameters.url = "http://127.0.0.1:1/refused";
+	result = RunAsync(parameters);
+	Check(result.result.code == CURLE_COULDNT_CONNECT, "connection refused", "wrong error");
+	Check(result.retries == 3, "connection refused", "expected 3 retry notifications");
+}
+
+/* Requests waiting before their next attempt do not hold a transfer slot. */
+static void TestWaitingRequests() {
+	std::vector<std::shared_ptr<curl::AsynchronousDownloadStringDescriptor>> failing;
+	for (int i = 0; i < 6; ++i) {
+		failing.push_back(curl::AsyncDownloadString(Request("fail/2/m" + std::to_string(i)), "retry"));
+	}
+
+	std::shared_ptr<curl::AsynchronousDownloadStringDescriptor> quick = curl::AsyncDownloadString(Request("fail/0/q"), "retry");
+	Check(quick->result.get().string == "ok-q", "waiting requests", "quick request failed");
+	for (std::shared_ptr<curl::AsynchronousDownloadStringDescriptor>& desc : failing) {
+		Check(desc->result.get().result == curl::DOWNLOAD_STRING_OK, "waiting requests", "retried request failed");
+	}
+}
+
+static std::string ReadFile(const char* filename) {
+	std::ifstream stream(filename, std::ios::binary);
+	return std::string(std::istreambuf_iterator<char>(stream), std::istreambuf_iterator<char>());
+}
+
+/* A retried download starts over, unless it may resume. */
+static void TestFiles() {
+	std::string expected(1 << 20, '\0');
+	for (size_t i = 0; i < expected.size(); ++i) {
+		expected[i] = (char)((i * 7) % 251);
+	}
+
+	const char* filename = "retry_test.bin";
+	for (int mode = 0; mode < 3; ++mode) {
+		const char* test = mode == 0 ? "file" : mode == 1 ? "resumed file" : "blocking resumed file";
+		std::string path = "file/2/f" + std::to_string(mode);
+		curl::RequestParameters parameters = Request(path);
+		parameters.resume = mode != 0;
+		remove(filename);
+
+		curl::DownloadFileDescriptor result;
+		if (mode == 2) {
+			result = curl::DownloadFile(parameters, filename);
+		} else {
+			result = curl::AsyncDownloadFile(parameters, filename)->result.get();
+		}
+
+		Check(result.result == curl::DOWNLOAD_FILE_OK, test, "download failed");
+		Check(result.resumedFrom == (mode == 0 ? 0 : 600000), test, "wrong resume offset");
+		Check(Count(path) == 3, test, "expected 3 requests");
+		Check(ReadFile(filename) == expected, test, "wrong content");
+		Check(ReadFile((std::string(filename) + ".resume").c_str()).empty(), test, "resume state left behind");
+	}
+
+	remove(filename);
+}
+
+int main(int argc, char** argv) {
+	if (argc < 2) {
+		fprintf(stderr, "Usage: %s base_url\n", argv[0]);
+		return 2;
+	}
+
+	_base = argv[1];
+	Logger::Init("retry_test.log", false);
+	sGithubExecutor->Start();
+
+	TestBlocking();
+	TestAsync();
+	TestWaitingRequests();
+	TestFiles();
+
+	sGithubExecutor->Stop();
+	Logger::End();
+
+	if (_failures) {
+		fprintf(stderr, "%d check(s) failed\n", _failures);
+		return 1;
+	}
+
+	printf("All checks passed\n");
+	return 0;
+}
@@ -0,0 +1,34 @@
+# Runs a command while one of the local test servers is listening.
+#
+# Usage: run_with_server.py server.py port [server arguments...] -- command [arguments...]
+#
+# Exits with the status of the command.
+import socket
+import subprocess
+import sys
+import time
+
+def main():
+    separator = sys.argv.index("--")
+    server = sys.argv[1:separator]
+    command = sys.argv[separator + 1:]
+    port = int(server[1])
+
+    process = subprocess.Popen([sys.executable] + server)
+    try:
+        deadline = time.monotonic() + 10
+        while True:
+            try:
+                socket.create_connection(("127.0.0.1", port), timeout=1).close()
+                break
+            except OSError:
+                if process.poll() is not None or time.monotonic() > deadline:
+                    sys.stderr.write("run_with_server: %s did not start\n" % server[0])
+                    return 1
+                time.sleep(0.1)
+        return subprocess.call(command)
+    finally:
+        process.terminate()
+        process.wait()
+
+sys.exit(main())
@@ -0,0 +1,141 @@
+# HTTP server handing out zip archives built to exercise the parser of
+# ZipStreamExtractor, for zip_stream_test.cpp.
+#
+# Usage: zip_server.py port
+#
+# Every archive holds the FILES below. The content of a file only depends
+# on its seed, zip_stream_test.cpp generates the same bytes to check what
+# was extracted.
+#
+#   /plain.zip                 stored and deflated entries, sizes in the
+#                              local headers
+#   /descriptor.zip            deflated entries followed by data
+#                              descriptors, with and without signature
+#   /zip64.zip                 zip64 extras, with and without data
+#                              descriptors (8-byte sizes)
+#   /stored-descriptor.zip     a stored entry followed by a data descriptor
+#   /truncated-data.zip        descriptor.zip cut in the middle of an entry
+#   /truncated-directory.zip   descriptor.zip cut before its central directory
+import http.server
+import io
+import socketserver
+import struct
+import sys
+import zipfile
+import zlib
+
+# (name, size, seed), seed None for a folder.
+FILES = [
+    ("readme.txt", 1000, 1),
+    ("libzhl.dll", 300000, 2),
+    ("resources/", 0, None),
+    ("resources/scripts/main.lua", 70000, 3),
+    ("resources/empty.txt", 0, 4),
+]
+
+STORED = 0
+DEFLATED = 8
+
+def content(size, seed):
+    """Same generator as Random in zip_stream_test.cpp."""
+    data = bytearray(size)
+    for i in range(size):
+        seed = (seed * 1664525 + 1013904223) & 0xFFFFFFFF
+        data[i] = seed >> 24
+    return bytes(data)
+
+def deflate(data):
+    compressor = zlib.compressobj(9, zlib.DEFLATED, -15)
+    return compressor.compress(data) + compressor.flush()
+
+def build(entries):
+    """Write an archive. entries holds (name, data, method, descriptor,
+    zip64) tuples, descriptor being None, "signed" or "unsigned".
+
+    Also return the offset of the central directory."""
+    out = io.BytesIO()
+    central = []
+    for name, data, method, descriptor, zip64 in entries:
+        name = name.encode()
+        crc = zlib.crc32(data)
+        body = deflate(data) if method == DEFLATED else data
+        flags = 0x08 if descriptor else 0
+        header_crc, header_size, header_body = (0, 0, 0) if descriptor else (crc, len(data), len(body))
+        extra = b""
+        if zip64:
+            extra = struct.pack("<HHQQ", 0x0001, 16, header_size, header_body)
+            header_size = header_body = 0xFFFFFFFF
+        offset = out.tell()
+        out.write(struct.pack("<IHHHHHIIIHH", 0x04034b50, 45 if zip64 else 20, flags, method, 0, 0x21,
+                              header_crc, header_body, header_size, len(name), len(extra)))
+        out.write(name + extra + body)
+        if descriptor:
+            if descriptor == "signed":
+                out.write(struct.pack("<I", 0x08074b50))
+            out.write(struct.pack("<IQQ" if zip64 else "<III", crc, len(body), len(data)))
+        central.append(struct.pack("<IHHHHHHIIIHHHHHII", 0x02014b50, 20, 45 if zip64 else 20, flags, method, 0,
+                                   0x21, crc, len(body), len(data), len(name), 0, 0, 0, 0, 0, offset) + name)
+
+    directory = out.tell()
+    for header in central:
+        out.write(header)
+    size = out.tell() - directory
+    out.write(struct.pack("<IHHHHIIH", 0x06054b50, 0, 0, len(central), len(central), size, directory, 0))
+    return out.getvalue(), directory
+
+def archive(method, descriptor, zip64):
+    """The FILES, with the given layout. method, descriptor and zip64 are
+    called with the index of the entry."""
+    entries = []
+    for i, (name, size, seed) in enumerate(FILES):
+        if seed is None:
+            entries.append((name, b"", STORED, None, False))
+        else:
+            entries.append((name, content(size, seed), method(i), descriptor(i), zip64(i)))
+    return build(entries)
+
+def make_archives():
+    archives = {}
+    archives["plain"], _ = archive(lambda i: STORED if i % 2 else DEFLATED, lambda i: None, lambda i: False)
+    descriptor, directory = archive(lambda i: DEFLATED, lambda i: "signed" if i % 2 else "unsigned",
+                                    lambda i: False)
+    archives["descriptor"] = descriptor
+    archives["zip64"], _ = archive(lambda i: STORED if i == 0 else DEFLATED,
+                                   lambda i: "signed" if i % 2 else None, lambda i: True)
+    archives["stored-descriptor"], _ = archive(lambda i: STORED if i == 3 else DEFLATED,
+                                               lambda i: "signed" if i == 3 else None, lambda i: False)
+    archives["truncated-data"] = descriptor[:directory // 2]
+    archives["truncated-directory"] = descriptor[:directory]
+
+    # The complete archives must be valid for any other zip reader.
+    for name in ("plain", "descriptor", "zip64", "stored-descriptor"):
+        with zipfile.ZipFile(io.BytesIO(archives[name])) as check:
+            if check.testzip() is not None:
+                raise RuntimeError("%s.zip is invalid" % name)
+    return archives
+
+ARCHIVES = make_archives()
+
+class Handler(http.server.BaseHTTPRequestHandler):
+    protocol_version = "HTTP/1.1"
+
+    def log_message(self, *args):
+        pass
+
+    def do_GET(self):
+        name = self.path.strip("/")
+        body = ARCHIVES.get(name[:-4]) if name.endswith(".zip") else None
+        if body is None:
+            self.send_response(404)
+            body = b"nope"
+        else:
+            self.send_response(200)
+        self.send_header("Content-Length", str(len(body)))
+        self.end_headers()
+        self.wfile.write(body)
+
+class Server(socketserver.ThreadingMixIn, http.server.HTTPServer):
+    daemon_threads = True
+    allow_reuse_address = True
+
+Server(("127.0.0.1", int(sys.argv[1])), Handler).serve_forever()
@@ -0,0 +1,219 @@
+/* Checks ZipStreamExtractor on the archives of zip_server.py, streamed the
+ * way RepentogonInstaller streams a release: through the onData hook of
+ * curl::AsyncDownloadFile. Each archive is then fed again one byte at a
+ * time, so that every header, descriptor and deflate block is split at
+ * every possible place.
+ *
+ * Also checks RemoveUnchanged followed by Staging::Commit, as done by
+ * CommitStreamedRepentogon.
+ *
+ * Usage: zip_stream_test base_url
+ * e.g. run_with_server.py zip_server.py 18772 -- zip_stream_test http://127.0.0.1:18772
+ */
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "launcher/zip_stream.h"
+#include "shared/curl_request.h"
+#include "shared/github_executor.h"
+#include "shared/logger.h"
+#include "shared/staging.h"
+
+namespace fs = std::filesystem;
+
+static std::string _base;
+static int _failures = 0;
+
+static const char* Downloaded = "zip_stream_test.zip";
+static const char* Staged = "zip_stream_test.staging";
+
+static void Check(bool condition, std::string const& test, const char* what) {
+	if (!condition) {
+		fprintf(stderr, "FAIL %s: %s\n", test.c_str(), what);
+		++_failures;
+	}
+}
+
+/* The content of every archive, see FILES in zip_server.py. */
+struct File {
+	const char* name;
+	size_t size;
+	uint32_t seed;
+};
+
+static const File Files[] = {
+	{ "readme.txt", 1000, 1 },
+	{ "libzhl.dll", 300000, 2 },
+	{ "resources/", 0, 0 },
+	{ "resources/scripts/main.lua", 70000, 3 },
+	{ "resources/empty.txt", 0, 4 },
+};
+
+static constexpr size_t FILE_COUNT = sizeof(Files) / sizeof(*Files);
+
+static std::string Random(size_t size, uint32_t seed) {
+	std::string buffer(size, '\0');
+	for (char& byte : buffer) {
+		seed = seed * 1664525 + 1013904223;
+		byte = (char)(seed >> 24);
+	}
+
+	return buffer;
+}
+
+static std::string ReadFile(fs::path const& path) {
+	std::ifstream stream(path, std::ios::binary);
+	return std::string(std::istreambuf_iterator<char>(stream), std::istreambuf_iterator<char>());
+}
+
+static bool WriteFile(fs::path const& path, std::string const& content) {
+	std::ofstream stream(path, std::ios::binary | std::ios::trunc);
+	stream.write(content.data(), content.size());
+	return (bool)stream;
+}
+
+/* Download archive, feeding the extractor while it is received. Return what
+ * was received.
+ */
+static std::string Stream(std::string const& archive, Launcher::ZipStreamExtractor& extractor) {
+	curl::RequestParameters parameters;
+	parameters.url = _base + "/" + archive;
+	parameters.onData = [&extractor](bool, void* data, size_t size, size_t n) {
+		extractor.Feed(data, size * n);
+		return true;
+	};
+
+	remove(Downloaded);
+	curl::DownloadFileDescriptor result = curl::AsyncDownloadFile(parameters, Downloaded)->result.get();
+	Check(result.result == curl::DOWNLOAD_FILE_OK, archive, "download failed");
+
+	std::string content = ReadFile(Downloaded);
+	remove(Downloaded);
+	return content;
+}
+
+/* Every file of the archive is in folder, with the right content. */
+static void CheckFolder(fs::path const& folder, std::string const& test) {
+	for (File const& file : Files) {
+		fs::path path = folder / file.name;
+		if (file.seed) {
+			Check(ReadFile(path) == Random(file.size, file.seed), test, "wrong content");
+		} else {
+			Check(fs::is_directory(path), test, "folder not created");
+		}
+	}
+}
+
+static void CheckEntries(Launcher::ZipStreamExtractor const& extractor, std::string const& test) {
+	std::vector<Launcher::ZipStreamExtractor::Entry> const& entries = extractor.GetEntries();
+	Check(entries.size() == FILE_COUNT, test, "wrong number of entries");
+	for (size_t i = 0; i < entries.size() && i < FILE_COUNT; ++i) {
+		Check(entries[i].name == Files[i].name, test, "wrong entry name");
+		Check(entries[i].size == Files[i].size, test, "wrong entry size");
+		Check(entries[i].directory == !Files[i].seed, test, "folder not told apart");
+	}
+
+	CheckFolder(extractor.GetFolder(), test);
+}
+
+/* Extract archive as it is received, then one byte at a time. If valid is
+ * false, the extractor must give up.
+ */
+static void TestArchive(const char* archive, bool valid) {
+	std::string content;
+	for (int mode = 0; mode < 2; ++mode) {
+		std::string test = std::string(archive) + (mode == 0 ? ", streamed" : ", byte by byte");
+		Launcher::ZipStreamExtractor extractor(Staged);
+		if (mode == 0) {
+			content = Stream(archive, extractor);
+		} else {
+			for (char const& byte : content) {
+				extractor.Feed(&byte, 1);
+			}
+		}
+
+		bool extracted = extractor.Finish();
+		Check(extracted == valid, test, valid ? "not extracted" : "not given up");
+		if (extracted && valid) {
+			CheckEntries(extractor, test);
+		}
+
+		extractor.Discard();
+		Check(!fs::exists(Staged), test, "staging folder left behind");
+	}
+}
+
+/* Files the installation already holds are left out of the commit. */
+static void TestUnchanged() {
+	fs::path live = "zip_stream_test.live";
+	fs::remove_all(live);
+	fs::remove_all(Staging::GetBackupFolder(live));
+	fs::create_directories(live);
+
+	/* Same as in the archive, different, and foreign to the archive. */
+	Check(WriteFile(live / "readme.txt", Random(1000, 1)), "unchanged", "cannot write the test file");
+	Check(WriteFile(live / "libzhl.dll", Random(300000, 5)), "unchanged", "cannot write the test file");
+	Check(WriteFile(live / "foreign.txt", "mine"), "unchanged", "cannot write the test file");
+
+	/* An extracted file would be newer. */
+	fs::file_time_type old = fs::file_time_type::clock::now() - std::chrono::hours(24);
+	fs::last_write_time(live / "readme.txt", old);
+
+	Launcher::ZipStreamExtractor extractor(Staging::GetStagingFolder(live));
+	Stream("plain.zip", extractor);
+	Check(extractor.Finish(), "unchanged", "not extracted");
+
+	std::vector<bool> unchanged = extractor.RemoveUnchanged(live);
+	Check(unchanged == std::vector<bool>({ true, false, false, false, false }), "unchanged",
+		"wrong files left out");
+	Check(!fs::exists(extractor.GetFolder() / "readme.txt"), "unchanged", "unchanged file still staged");
+	Check(fs::exists(extractor.GetFolder() / "libzhl.dll"), "unchanged", "changed file not staged");
+
+	Check(Staging::Commit(live), "unchanged", "commit failed");
+	CheckFolder(live, "unchanged");
+	Check(fs::last_write_time(live / "readme.txt") == old, "unchanged", "unchanged file replaced");
+	Check(ReadFile(live / "foreign.txt") == "mine", "unchanged", "foreign file lost");
+	Check(!fs::exists(extractor.GetFolder()), "unchanged", "staging folder left behind");
+
+	extractor.Discard();
+	fs::remove_all(live);
+	fs::remove_all(Staging::GetBackupFolder(live));
+}
+
+int main(int argc, char** argv) {
+	if (argc < 2) {
+		fprintf(stderr, "Usage: %s base_url\n", argv[0]);
+		return 2;
+	}
+
+	_base = argv[1];
+	Logger::Init("zip_stream_test.log", false);
+	sGithubExecutor->Start();
+
+	TestArchive("plain.zip", true);
+	TestArchive("descriptor.zip", true);
+	TestArchive("zip64.zip", true);
+	TestArchive("stored-descriptor.zip", false);
+	TestArchive("truncated-data.zip", false);
+	TestArchive("truncated-directory.zip", false);
+	TestUnchanged();
+
+	sGithubExecutor->Stop();
+	Logger::End();
+
+	if (_failures) {
+		fprintf(stderr, "%d check(s) failed\n", _failures);
+		return 1;
+	}
+
+	printf("All checks passed\n");
+	return 0;
+}
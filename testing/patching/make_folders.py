@@ -0,0 +1,74 @@
+# Generates a source and a target folder for patchgen, as an update of the
+# game would: files changed, created, deleted or left alone, in nested
+# folders, and a large executable-like file changed in several places so
+# that its RGPATCH1 patch spans several blocks.
+#
+# Usage: make_folders.py folder [large_mib]
+#
+# Creates folder/source and folder/target, replacing any previous content.
+# The content only depends on large_mib (default 5).
+import os
+import random
+import shutil
+import sys
+
+def write(path, data):
+    os.makedirs(os.path.dirname(path), exist_ok=True)
+    with open(path, "wb") as f:
+        f.write(data)
+
+def update(rng, data):
+    """Return data with bytes patched, inserted and removed here and there,
+    as a rebuild of an executable would."""
+    data = bytearray(data)
+    for offset in range(4096, len(data), 200 * 1024):
+        data[offset:offset + 64] = rng.randbytes(64)
+    for offset in sorted(rng.sample(range(len(data)), 4), reverse=True):
+        if rng.random() < 0.5:
+            data[offset:offset] = rng.randbytes(1000)
+        else:
+            del data[offset:offset + 1000]
+    return bytes(data) + rng.randbytes(300 * 1024)
+
+def make(folder, large_mib=5):
+    rng = random.Random(large_mib)
+    source = os.path.join(folder, "source")
+    target = os.path.join(folder, "target")
+    shutil.rmtree(source, ignore_errors=True)
+    shutil.rmtree(target, ignore_errors=True)
+
+    large = rng.randbytes(large_mib << 20)
+    script = b"".join(b"local value%d = %d\n" % (i, i * 7) for i in range(2000))
+    readme = b"The Binding of Isaac\n" * 50
+
+    files = {
+        # Left alone.
+        "readme.txt": (readme, readme),
+        # Changed.
+        "isaac-ng.exe": (large, update(rng, large)),
+        "resources/scripts/main.lua": (script, script.replace(b"value1000 ", b"value1000b ")),
+        "resources/empty.txt": (b"", b"no longer empty\n"),
+        "resources/emptied.txt": (b"soon empty\n", b""),
+        # Deleted.
+        "resources/gfx/old.png": (rng.randbytes(20000), None),
+        "resources/old/only.txt": (b"gone\n", None),
+        # Created.
+        "resources/gfx/new.png": (None, rng.randbytes(30000)),
+        "resources/new/nested/only.txt": (None, b"new\n"),
+    }
+
+    for name, (before, after) in files.items():
+        if before is not None:
+            write(os.path.join(source, name), before)
+        if after is not None:
+            write(os.path.join(target, name), after)
+
+def main():
+    if len(sys.argv) < 2:
+        sys.stderr.write("Usage: make_folders.py folder [large_mib]\n")
+        return 2
+    make(sys.argv[1], int(sys.argv[2]) if len(sys.argv) > 2 else 5)
+    return 0
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,58 @@
+# Round-trips generated folders (see make_folders.py) through
+# patchgen --verify in both patch formats: patchgen applies the patch it
+# generated to a copy of the source folder with PatchFolder, and fails if
+# the result differs from the target folder.
+#
+# Usage: patchgen_test.py patchgen
+#
+# Works in patchgen_test.data, in the current folder.
+import os
+import struct
+import subprocess
+import sys
+
+import make_folders
+
+# Size of the large file of make_folders.py, in MiB: RGPATCH1 blocks cover
+# 1 MiB of the new file each (patchgen::RGPATCH_BLOCK_SIZE).
+LARGE_MIB = 5
+
+def check_patch(path, magic, min_blocks, failures):
+    with open(path, "rb") as f:
+        header = f.read(24)
+    if header[:8] != magic:
+        failures.append("%s is not a %s patch" % (path, magic.decode()))
+    elif magic == b"RGPATCH1" and struct.unpack_from("<I", header, 16)[0] < min_blocks:
+        failures.append("%s has fewer than %d blocks" % (path, min_blocks))
+
+def main():
+    if len(sys.argv) < 2:
+        sys.stderr.write("Usage: patchgen_test.py patchgen\n")
+        return 2
+
+    folder = "patchgen_test.data"
+    make_folders.make(folder, LARGE_MIB)
+    source = os.path.join(folder, "source")
+    target = os.path.join(folder, "target")
+
+    failures = []
+    for format, magic in (("bsdiff", b"BSDIFF40"), ("rgpatch", b"RGPATCH1")):
+        output = os.path.join(folder, format)
+        status = subprocess.call([sys.argv[1], "-y", "--verify", "-f", format,
+                                  "-s", source, "-t", target, "-o", output])
+        if status:
+            failures.append("patchgen --verify -f %s failed (%d)" % (format, status))
+            continue
+        check_patch(os.path.join(output, "patches", "isaac-ng.exe.patch"), magic, LARGE_MIB, failures)
+        check_patch(os.path.join(output, "patches", "resources", "scripts", "main.lua.patch"), magic, 1, failures)
+
+    for failure in failures:
+        sys.stderr.write("FAIL %s\n" % failure)
+    if failures:
+        return 1
+
+    print("All checks passed")
+    return 0
+
+if __name__ == "__main__":
+    sys.exit(main())
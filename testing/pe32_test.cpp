@@ -0,0 +1,124 @@
+/* Checks the lookup of the version exports of the fake ZHL and Repentogon
+ * DLLs built next to this test, the way RepentogonInstallation reads them
+ * (OpenLibrary, RetrieveSymbol, ValidateVersionSymbol): through the export
+ * directory of the file, without loading it.
+ *
+ * dummy.dll forwards __ZHL_VERSION to libzhl, which must not be resolved.
+ *
+ * Usage: pe32_test libzhl.dll zhl_version zhlRepentogon.dll repentogon_version zhlDummy.dll
+ */
+
+#include <cstdio>
+#include <memory>
+#include <stdexcept>
+#include <string>
+
+#include "shared/pe32.h"
+
+static int _failures = 0;
+
+static void Check(bool condition, const char* test, const char* what) {
+	if (!condition) {
+		fprintf(stderr, "FAIL %s: %s\n", test, what);
+		++_failures;
+	}
+}
+
+static std::unique_ptr<PE32> Open(const char* path) {
+	try {
+		return std::make_unique<PE32>(path);
+	} catch (std::runtime_error& e) {
+		fprintf(stderr, "Unable to open %s (%s)\n", path, e.what());
+		return nullptr;
+	}
+}
+
+/* Resolve the version string exported under symbol, as ValidateVersionSymbol
+ * does. Return false if the export or the string cannot be found.
+ */
+static bool ReadVersion(PE32 const& library, const char* symbol, std::string& version) {
+	PE32Byte pointer = library.GetExport(symbol);
+	return pointer && library.ReadStringPointer(pointer, version);
+}
+
+static void TestVersion(const char* path, const char* test, const char* symbol, const char* function,
+	const char* expected) {
+	std::unique_ptr<PE32> library = Open(path);
+	Check(library != nullptr, test, "not opened");
+	if (!library) {
+		return;
+	}
+
+	std::string version;
+	Check(ReadVersion(*library, symbol, version), test, "version not found");
+	Check(version == expected, test, "wrong version");
+	Check(library->GetExport(function), test, "function export not found");
+
+	/* Names around the exported ones, on both sides of the binary search. */
+	Check(!library->GetExport(""), test, "empty name found");
+	Check(!library->GetExport("A"), test, "name before every export found");
+	Check(!library->GetExport("zzz"), test, "name after every export found");
+	Check(!library->GetExport((std::string(symbol) + "_").c_str()), test, "longer name found");
+	Check(!library->GetExport(std::string(symbol).substr(0, 4).c_str()), test, "prefix found");
+
+	Check(!library->ReadStringPointer(PE32Byte(), version), test, "NULL pointer read");
+}
+
+static void TestForwarder(const char* path) {
+	std::unique_ptr<PE32> library = Open(path);
+	Check(library != nullptr, "dummy", "not opened");
+	if (!library) {
+		return;
+	}
+
+	Check(library->GetExport("ModInit"), "dummy", "function export not found");
+	Check(!library->GetExport("__ZHL_VERSION"), "dummy", "forwarded export resolved");
+	Check(!library->GetExport("__REPENTOGON_VERSION"), "dummy", "missing export found");
+}
+
+/* OpenLibrary reports files that are not PE32 images through an exception. */
+static void TestInvalidFile() {
+	/* A DOS header pointing to a PE header without its signature. */
+	std::string content(0x80, '\0');
+	content[0] = 'M';
+	content[1] = 'Z';
+	content[PE32::PE_SIGNATURE_OFFSET] = 0x40;
+
+	const char* path = "pe32_test.dll";
+	FILE* file = fopen(path, "wb");
+	if (file) {
+		fwrite(content.data(), 1, content.size(), file);
+		fclose(file);
+	}
+
+	bool thrown = false;
+	try {
+		PE32 library(path);
+	} catch (std::runtime_error&) {
+		thrown = true;
+	}
+
+	Check(thrown, "invalid file", "accepted");
+	remove(path);
+}
+
+int main(int argc, char** argv) {
+	if (argc < 6) {
+		fprintf(stderr, "Usage: %s libzhl.dll zhl_version zhlRepentogon.dll repentogon_version zhlDummy.dll\n",
+			argv[0]);
+		return 2;
+	}
+
+	TestVersion(argv[1], "libzhl", "__ZHL_VERSION", "InitZHL", argv[2]);
+	TestVersion(argv[3], "repentogon", "__REPENTOGON_VERSION", "ModInit", argv[4]);
+	TestForwarder(argv[5]);
+	TestInvalidFile();
+
+	if (_failures) {
+		fprintf(stderr, "%d check(s) failed\n", _failures);
+		return 1;
+	}
+
+	printf("All checks passed\n");
+	return 0;
+}
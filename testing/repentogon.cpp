@@ -2,7 +2,7 @@
 #include <ctime>
 
 extern "C" {
-	__declspec(dllexport) const char* __REPENTOGON_VERSION = "1.0.0";
+	__declspec(dllexport) const char* __REPENTOGON_VERSION = REPENTOGON_VERSION;
 
 	__declspec(dllexport) int ModInit() {
 		FILE* f = fopen("repentogon.log", "w");